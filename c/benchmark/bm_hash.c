@@ -7,6 +7,7 @@
 extern "C" {
 #endif
 #include "hash.h"
+#include "term_hash.h"
 #include "benchmark.h"
 #ifdef __cplusplus
 }
@@ -33,6 +34,45 @@ static void ferret_hash()
     }
 }
 
+/* the DocWriter already knows the length of each token so we don't include
+ * strlen in the timings */
+static int *word_lengths()
+{
+    const char **word;
+    int *lens, i = 0;
+    for (word = WORD_LIST; *word; word++) i++;
+    lens = ALLOC_N(int, i);
+    for (i = 0, word = WORD_LIST; *word; word++, i++) {
+        lens[i] = (int)strlen(*word);
+    }
+    return lens;
+}
+
+static void ferret_term_hash()
+{
+    int i, j;
+    int *lens = word_lengths();
+    for (i = 0; i < N; i++) {
+        TermHash *th = th_new();
+        TermHashSlot *slot;
+        const char **word;
+        char buf[100];
+        long res;
+        for (word = WORD_LIST, j = 0; *word; word++, j++) {
+            if (th_set_ext(th, *word, lens[j], th_hash(*word, lens[j]),
+                           &slot)) {
+                slot->value = (void *)1;
+            }
+        }
+        for (word = WORD_LIST, j = 0; *word; word++, j++) {
+            strcpy(buf, *word);
+            res = (long)th_get(th, buf, lens[j]);
+        }
+        th_destroy(th);
+    }
+    free(lens);
+}
+
 #ifdef __cplusplus
 
 #include <iostream>
@@ -124,6 +164,7 @@ static void google_sparse_hash()
 BENCH(hash_implementations)
 {
     BM_ADD(ferret_hash);
+    BM_ADD(ferret_term_hash);
 #ifdef __cplusplus
     BM_ADD(stdcpp_hash);
 # ifdef HAVE_SPARSE_HASH
@@ -217,8 +258,32 @@ static void string_hash()
     }
 }
 
+/* mimics the DocWriter which copies each token into a buffer before looking
+ * it up and then points new entries at a persistent copy of the term */
+static void term_hash()
+{
+    int i, j;
+    int *lens = word_lengths();
+    for (i = 0; i < N; i++) {
+        TermHash *th = th_new();
+        TermHashSlot *slot;
+        const char **word;
+        char buf[100];
+        for (word = WORD_LIST, j = 0; *word; word++, j++) {
+            strcpy(buf, *word);
+            if (th_set_ext(th, buf, lens[j], th_hash(buf, lens[j]), &slot)) {
+                slot->term = *word;
+                slot->value = (void *)1;
+            }
+        }
+        th_destroy(th);
+    }
+    free(lens);
+}
+
 BENCH(specialized_string_hash)
 {
     BM_ADD(standard_hash);
     BM_ADD(string_hash);
+    BM_ADD(term_hash);
 }
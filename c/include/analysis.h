@@ -7,8 +7,10 @@ extern "C" {
 
 #include "global.h"
 #include "hash.h"
+#include "hashset.h"
 #include "symbol.h"
 #include "multimapper.h"
+#include "threading.h"
 #include <wchar.h>
 
 /****************************************************************************
@@ -17,6 +19,15 @@ extern "C" {
  *
  ****************************************************************************/
 
+/*
+ * A token's text is normally copied into +text+. When the consumer of a
+ * FrtTokenStream sets its +zero_copy+ flag, tokenizers may instead leave
+ * +ref+ pointing at the token in the text being tokenized and leave +text+
+ * unset. The +len+ bytes at +ref+ are not '\0' terminated. Filters which
+ * rewrite the token write the result to +text+ and clear +ref+, so a copy is
+ * only made when the text actually changes. Use FRT_TK_PTR to read +len+
+ * bytes of either, or frt_tk_text to get a '\0' terminated string.
+ */
 typedef struct FrtToken
 {
     char text[FRT_MAX_WORD_SIZE];
@@ -24,8 +35,11 @@ typedef struct FrtToken
     off_t start;
     off_t end;
     int pos_inc;
+    char *ref;
 } FrtToken;
 
+#define FRT_TK_PTR(tk) ((tk)->ref ? (tk)->ref : (tk)->text)
+
 extern FrtToken *frt_tk_new();
 extern void frt_tk_destroy(void *p);
 extern FrtToken *frt_tk_set(FrtToken *tk, char *text, int tlen, off_t start, off_t end,
@@ -34,6 +48,7 @@ extern FrtToken *frt_tk_set_no_len(FrtToken *tk, char *text, off_t start, off_t
                             int pos_inc);
 extern int frt_tk_eq(FrtToken *tk1, FrtToken *tk2);
 extern int frt_tk_cmp(FrtToken *tk1, FrtToken *tk2);
+extern char *frt_tk_text(FrtToken *tk);
 
 /****************************************************************************
  *
@@ -52,6 +67,8 @@ struct FrtTokenStream
     FrtTokenStream  *(*clone_i)(FrtTokenStream *ts);
     void            (*destroy_i)(FrtTokenStream *ts);
     int             ref_cnt;
+    bool            zero_copy;      /* tokens may reference text, cleared by
+                                       reset */
 };
 
 #define frt_ts_new(type) frt_ts_new_i(sizeof(type))
@@ -81,6 +98,7 @@ typedef struct FrtStandardTokenizer
 {
     FrtCachedTokenStream     super;
     FrtStandardTokenizerType type;
+    char                    *text_end;  /* the '\0' terminating text */
 } FrtStandardTokenizer;
 
 typedef struct FrtLegacyStandardTokenizer
@@ -106,6 +124,7 @@ typedef struct FrtStopFilter
 {
     FrtTokenFilter super;
     FrtHash  *words;
+    int       max_len;  /* length of the longest word */
 } FrtStopFilter;
 
 typedef struct FrtMappingFilter
@@ -124,12 +143,31 @@ typedef struct FrtHyphenFilter
     FrtToken *tk;
 } FrtHyphenFilter;
 
+/* Each StemFilter keeps a direct mapped cache of the stems of recent words
+ * so that common words aren't stemmed over and over. Words of
+ * FRT_STEM_CACHE_WORD_SIZE bytes or more are always stemmed. */
+#define FRT_STEM_CACHE_SIZE 1024
+#define FRT_STEM_CACHE_WORD_SIZE 24
+
+typedef struct FrtStemCacheEntry
+{
+    unsigned long hash;
+    int           word_len;     /* 0 if the entry is empty */
+    int           stem_len;
+    char          word[FRT_STEM_CACHE_WORD_SIZE];
+    char          stem[FRT_STEM_CACHE_WORD_SIZE];
+} FrtStemCacheEntry;
+
 typedef struct FrtStemFilter
 {
     FrtTokenFilter        super;
     struct sb_stemmer  *stemmer;
     char               *algorithm;
     char               *charenc;
+    FrtStemCacheEntry  *cache;      /* allocated on first use */
+    int                 cache_size;
+    frt_u64             cache_hits;
+    frt_u64             cache_misses;
 } FrtStemFilter;
 
 #define frt_ts_next(mts) mts->next(mts)
@@ -155,6 +193,14 @@ extern FrtTokenStream *frt_mb_legacy_standard_tokenizer_new();
 extern FrtTokenStream *frt_hyphen_filter_new(FrtTokenStream *ts);
 extern FrtTokenStream *frt_lowercase_filter_new(FrtTokenStream *ts);
 extern FrtTokenStream *frt_mb_lowercase_filter_new(FrtTokenStream *ts);
+/* Lowercases UTF-8 tokens whatever the locale. See frt_utf8_downcase. */
+extern FrtTokenStream *frt_utf8_lowercase_filter_new(FrtTokenStream *ts);
+
+/* Lowercase +len+ bytes of UTF-8 +src+ into +dst+ which has room for +capa+
+ * bytes including the terminating '\0'. Invalid bytes are copied as they
+ * are and the output is cut short, at a character boundary, if it won't
+ * fit. Returns the length of +dst+. */
+extern int frt_utf8_downcase(char *dst, const char *src, int len, int capa);
 
 extern const char *FRT_ENGLISH_STOP_WORDS[];
 extern const char *FRT_FULL_ENGLISH_STOP_WORDS[];
@@ -178,6 +224,10 @@ extern FrtTokenStream *frt_stop_filter_new_with_words_len(FrtTokenStream *ts,
 extern FrtTokenStream *frt_stop_filter_new_with_words(FrtTokenStream *ts,
                                                const char **words);
 extern FrtTokenStream *frt_stop_filter_new(FrtTokenStream *ts);
+/* Set the number of entries in the StemFilter +ts+'s cache, rounded up to a
+ * power of 2. A size of 0 turns the cache off. Clones of +ts+ get their own
+ * empty cache of the same size. */
+extern void frt_stem_filter_set_cache_size(FrtTokenStream *ts, int size);
 extern FrtTokenStream *frt_stem_filter_new(FrtTokenStream *ts, const char *algorithm,
                                     const char *charenc);
 
@@ -197,6 +247,15 @@ typedef struct FrtAnalyzer
     FrtTokenStream *(*get_ts)(struct FrtAnalyzer *a, FrtSymbol field, char *text);
     void (*destroy_i)(struct FrtAnalyzer *a);
     int ref_cnt;
+    /* The standard get_ts hands each thread its own clone of current_ts and
+     * resets it for every field rather than cloning current_ts each time.
+     * ts_bucket holds every thread's clone so that they can be freed with
+     * the analyzer. A thread's clone is freed when it exits. ts_bucket is
+     * NULL for analyzers not made by frt_analyzer_new, or if no thread key
+     * was left for this one. */
+    frt_thread_key_t thread_ts;
+    frt_mutex_t ts_mutex;
+    FrtHashSet *ts_bucket;
 } FrtAnalyzer;
 
 extern void frt_a_deref(FrtAnalyzer *a);
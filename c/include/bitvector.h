@@ -9,15 +9,19 @@ extern "C" {
 
 #define FRT_BV_INIT_CAPA 256
 
+/* the number of 64-bit words needed to hold +n+ bits */
+#define FRT_BV_TO_WORD(n) ((((n) - 1) >> 6) + 1)
+#define FRT_BV_ALL_ONES (~(frt_u64)0)
+
 typedef struct FrtBitVector
 {
-    /** The bits are held in an array of 32-bit integers */
-    frt_u32 *bits;
+    /** The bits are held in an array of 64-bit integers */
+    frt_u64 *bits;
 
     /** size is equal to 1 + the highest order bit set */
     int size;
 
-    /** capa is the number of words (U32) allocated for the bits */
+    /** capa is the number of words (U64) allocated for the bits */
     int capa;
 
     /** count is the running count of bits set. This is kept up to
@@ -61,6 +65,27 @@ FrtBitVector *frt_bv_new_capa(int capa);
  */
 extern void frt_bv_destroy(FrtBitVector *bv);
 
+/**
+ * Word kernels used by the boolean operations below. Each of these works on
+ * +n+ 64-bit words and uses AVX2 or SSE2 when the compiler targets them.
+ * +dest+ may be the same array as +a+ or +b+.
+ */
+extern void frt_bv_and_words(frt_u64 *dest, const frt_u64 *a,
+                             const frt_u64 *b, int n);
+extern void frt_bv_or_words(frt_u64 *dest, const frt_u64 *a,
+                            const frt_u64 *b, int n);
+extern void frt_bv_xor_words(frt_u64 *dest, const frt_u64 *a,
+                             const frt_u64 *b, int n);
+/* dest = a & ~b */
+extern void frt_bv_andnot_words(frt_u64 *dest, const frt_u64 *a,
+                                const frt_u64 *b, int n);
+extern void frt_bv_not_words(frt_u64 *dest, const frt_u64 *a, int n);
+
+/**
+ * Count the set bits in the first +n+ words of +bits+.
+ */
+extern int frt_bv_count_words(const frt_u64 *bits, int n);
+
 /**
  * Set the bit at position +index+ with +value+. If +index+ is outside
  * of the range of the FrtBitVector, that is >= FrtBitVector.size,
@@ -81,9 +106,9 @@ extern void frt_bv_destroy(FrtBitVector *bv);
 static FRT_ATTR_ALWAYS_INLINE
 void frt_bv_set_value(FrtBitVector *bv, int bit, bool value)
 {
-    frt_u32 *word_p;
-    int word = bit >> 5;
-    frt_u32 bitmask = 1 << (bit & 31);
+    frt_u64 *word_p;
+    int word = bit >> 6;
+    frt_u64 bitmask = (frt_u64)1 << (bit & 63);
 
     /* Check to see if we need to grow the BitVector */
     if (unlikely(bit >= bv->size)) {
@@ -93,9 +118,9 @@ void frt_bv_set_value(FrtBitVector *bv, int bit, bool value)
             while (capa <= word) {
                 capa <<= 1;
             }
-            FRT_REALLOC_N(bv->bits, frt_u32, capa);
+            FRT_REALLOC_N(bv->bits, frt_u64, capa);
             memset(bv->bits + bv->capa, (bv->extends_as_ones ? 0xFF : 0),
-                   sizeof(frt_u32) * (capa - bv->capa));
+                   sizeof(frt_u64) * (capa - bv->capa));
             bv->capa = capa;
         }
     }
@@ -162,7 +187,7 @@ void frt_bv_set_fast(FrtBitVector *bv, int bit)
 {
     bv->count++;
     bv->size = bit + 1;
-    bv->bits[bit >> 5] |= (1 << (bit & 31));
+    bv->bits[bit >> 6] |= ((frt_u64)1 << (bit & 63));
 }
 
 /**
@@ -181,7 +206,7 @@ int frt_bv_get(FrtBitVector *bv, int bit)
     if (unlikely(bit >= bv->size)) {
         return bv->extends_as_ones;
     }
-    return (bv->bits[bit >> 5] >> (bit & 31)) & 0x01;
+    return (int)((bv->bits[bit >> 6] >> (bit & 63)) & 0x01);
 }
 
 /**
@@ -220,31 +245,26 @@ extern void frt_bv_clear(FrtBitVector *bv);
 static FRT_ATTR_ALWAYS_INLINE
 int frt_bv_recount(FrtBitVector *bv)
 {
-    unsigned int extra = ((bv->size & 31) >> 3) + 1;
-    unsigned int len   = bv->size >> 5;
-    unsigned int idx, count = 0;
+    int len, count, extra;
+    frt_u64 mask;
 
+    if (bv->size <= 0) {
+        return bv->count = 0;
+    }
+    len = bv->size >> 6;
+    extra = bv->size & 63;
+    /* only count the bits below size in the last partial word */
+    mask = extra ? (((frt_u64)1 << extra) - 1) : 0;
+
+    count = frt_bv_count_words(bv->bits, len);
     if (bv->extends_as_ones) {
-        for (idx = 0; idx < len; ++idx) {
-            count += frt_count_zeros(bv->bits[idx]);
-        }
-        switch (extra) {
-            case 4: count += frt_count_zeros(bv->bits[idx] | 0x00ffffff);
-            case 3: count += frt_count_zeros(bv->bits[idx] | 0xff00ffff);
-            case 2: count += frt_count_zeros(bv->bits[idx] | 0xffff00ff);
-            case 1: count += frt_count_zeros(bv->bits[idx] | 0xffffff00);
+        count = (len << 6) - count;
+        if (mask) {
+            count += frt_count_ones64(~bv->bits[len] & mask);
         }
     }
-    else {
-        for (idx = 0; idx < len; ++idx) {
-            count += frt_count_ones(bv->bits[idx]);
-        }
-        switch (extra) {
-            case 4: count += frt_count_ones(bv->bits[idx] & 0xff000000);
-            case 3: count += frt_count_ones(bv->bits[idx] & 0x00ff0000);
-            case 2: count += frt_count_ones(bv->bits[idx] & 0x0000ff00);
-            case 1: count += frt_count_ones(bv->bits[idx] & 0x000000ff);
-        }
+    else if (mask) {
+        count += frt_count_ones64(bv->bits[len] & mask);
     }
     return bv->count = count;
 }
@@ -270,28 +290,25 @@ extern void frt_bv_scan_reset(FrtBitVector *bv);
 static FRT_ATTR_ALWAYS_INLINE
 int frt_bv_scan_next_from(FrtBitVector *bv, const int bit)
 {
-    frt_u32 pos  = bit >> 5;
-    frt_u32 word = bv->bits[pos];
+    int pos, word_size;
+    frt_u64 word;
 
     if (bit >= bv->size)
         return -1;
 
     /* Keep only the bits above this position */
-    word &= ~0 << (bit & 31);
-    if (word) {
-        goto done;
-    }
-    else {
-        frt_u32 word_size = FRT_TO_WORD(bv->size);
-        for (pos++; pos < word_size; ++pos)
-        {
-            if ( (word = bv->bits[pos]) )
-                goto done;
+    pos  = bit >> 6;
+    word = bv->bits[pos] & (FRT_BV_ALL_ONES << (bit & 63));
+    if (!word) {
+        word_size = FRT_BV_TO_WORD(bv->size);
+        for (pos++; pos < word_size; ++pos) {
+            if ((word = bv->bits[pos]))
+                break;
         }
+        if (pos >= word_size)
+            return -1;
     }
-        return -1;
- done:
-    return bv->curr_bit = (pos << 5) + frt_count_trailing_zeros(word);
+    return bv->curr_bit = (pos << 6) + frt_count_trailing_zeros64(word);
 }
 
 /**
@@ -320,28 +337,25 @@ int frt_bv_scan_next(FrtBitVector *bv)
 static FRT_ATTR_ALWAYS_INLINE
 int frt_bv_scan_next_unset_from(FrtBitVector *bv, const int bit)
 {
-    frt_u32 pos  = bit >> 5;
-    frt_u32 word = bv->bits[pos];
+    int pos, word_size;
+    frt_u64 word;
 
     if (bit >= bv->size)
         return -1;
 
     /* Set all of the bits below this position */
-    word |= (1 << (bit & 31)) - 1;
-    if (~word) {
-        goto done;
-    }
-    else {
-        frt_u32 word_size = FRT_TO_WORD(bv->size);
-        for (pos++; pos < word_size; ++pos)
-        {
-            if ( ~(word = bv->bits[pos]) )
-                goto done;
+    pos  = bit >> 6;
+    word = bv->bits[pos] | (((frt_u64)1 << (bit & 63)) - 1);
+    if (!~word) {
+        word_size = FRT_BV_TO_WORD(bv->size);
+        for (pos++; pos < word_size; ++pos) {
+            if (~(word = bv->bits[pos]))
+                break;
         }
+        if (pos >= word_size)
+            return -1;
     }
-    return -1;
- done:
-    return bv->curr_bit = (pos << 5) + frt_count_trailing_ones(word);
+    return bv->curr_bit = (pos << 6) + frt_count_trailing_ones64(word);
 }
 
 /**
@@ -379,13 +393,13 @@ extern unsigned long frt_bv_hash(FrtBitVector *bv);
 static FRT_ATTR_ALWAYS_INLINE
 void frt_bv_capa(FrtBitVector *bv, int capa, int size)
 {
-    int word_size = FRT_TO_WORD(size);
+    int word_size = FRT_BV_TO_WORD(size);
     if (bv->capa < capa)
     {
-        FRT_REALLOC_N(bv->bits, frt_u32, capa);
+        FRT_REALLOC_N(bv->bits, frt_u64, capa);
         bv->capa = capa;
         memset(bv->bits + word_size, (bv->extends_as_ones ? 0xFF : 0),
-               sizeof(frt_u32) * (capa - word_size));
+               sizeof(frt_u64) * (capa - word_size));
     }
     bv->size = size;
 }
@@ -403,29 +417,29 @@ void frt_bv_capa(FrtBitVector *bv, int capa, int size)
 } while(0)
 
 #define frt_bv_xor_ext(dest, src, extends_as_ones, i, max) do { \
-    frt_u32 n = (extends_as_ones ? 0xffffffff : 0);             \
-    for (; i < max; ++i)                                        \
-        dest[i] = src[i] ^ n;                                   \
+    if (extends_as_ones)                                        \
+         frt_bv_not_words(&dest[i], &src[i], max - i);          \
+    else memcpy(&dest[i], &src[i], sizeof(*dest)*(max - i));    \
 } while(0)
 
-#define FRT_BV_OP(bv, a, b, op, ext_cb) do {                          \
+#define FRT_BV_OP(bv, a, b, op, words_fn, ext_cb) do {                \
     int i;                                                            \
-    int a_wsz = FRT_TO_WORD(a->size);                                 \
-    int b_wsz = FRT_TO_WORD(b->size);                                 \
+    int a_wsz = FRT_BV_TO_WORD(a->size);                              \
+    int b_wsz = FRT_BV_TO_WORD(b->size);                              \
     int max_size = frt_max2(a->size, b->size);                        \
     int min_size = frt_min2(a->size, b->size);                        \
-    int max_word_size = FRT_TO_WORD(max_size);                        \
-    int min_word_size = FRT_TO_WORD(min_size);                        \
+    int max_word_size = FRT_BV_TO_WORD(max_size);                     \
+    int min_word_size = FRT_BV_TO_WORD(min_size);                     \
     int capa = frt_max2(frt_round2(max_word_size), 4);                \
                                                                       \
     bv->extends_as_ones = (a->extends_as_ones op b->extends_as_ones); \
     frt_bv_capa(bv, capa, max_size);                                  \
                                                                       \
-    for (i = 0; i < min_word_size; ++i)                               \
-        bv->bits[i] = a->bits[i] op b->bits[i];                       \
+    words_fn(bv->bits, a->bits, b->bits, min_word_size);              \
+    i = min_word_size;                                                \
                                                                       \
     if (a_wsz != b_wsz) {                                             \
-        frt_u32 *bits = a->bits;                                      \
+        frt_u64 *bits = a->bits;                                      \
         bool extends_as_ones = b->extends_as_ones;                    \
         if (a_wsz < b_wsz) {                                          \
             bits = b->bits;                                           \
@@ -440,7 +454,7 @@ static FRT_ATTR_ALWAYS_INLINE
 FrtBitVector *frt_bv_and_i(FrtBitVector *bv,
                            FrtBitVector *a, FrtBitVector *b)
 {
-    FRT_BV_OP(bv, a, b, &, frt_bv_and_ext);
+    FRT_BV_OP(bv, a, b, &, frt_bv_and_words, frt_bv_and_ext);
     return bv;
 }
 
@@ -448,7 +462,7 @@ static FRT_ATTR_ALWAYS_INLINE
 FrtBitVector *frt_bv_or_i(FrtBitVector *bv,
                           FrtBitVector *a, FrtBitVector *b)
 {
-    FRT_BV_OP(bv, a, b, |, frt_bv_or_ext);
+    FRT_BV_OP(bv, a, b, |, frt_bv_or_words, frt_bv_or_ext);
     return bv;
 }
 
@@ -456,25 +470,53 @@ static FRT_ATTR_ALWAYS_INLINE
 FrtBitVector *frt_bv_xor_i(FrtBitVector *bv,
                            FrtBitVector *a, FrtBitVector *b)
 {
-    FRT_BV_OP(bv, a, b, ^, frt_bv_xor_ext);
+    FRT_BV_OP(bv, a, b, ^, frt_bv_xor_words, frt_bv_xor_ext);
+    return bv;
+}
+
+static FRT_ATTR_ALWAYS_INLINE
+FrtBitVector *frt_bv_andnot_i(FrtBitVector *bv,
+                              FrtBitVector *a, FrtBitVector *b)
+{
+    int a_wsz = FRT_BV_TO_WORD(a->size);
+    int b_wsz = FRT_BV_TO_WORD(b->size);
+    int max_size = frt_max2(a->size, b->size);
+    int max_word_size = FRT_BV_TO_WORD(max_size);
+    int min_word_size = frt_min2(a_wsz, b_wsz);
+    int capa = frt_max2(frt_round2(max_word_size), 4);
+    bool a_ext = a->extends_as_ones, b_ext = b->extends_as_ones;
+    int i = min_word_size;
+
+    bv->extends_as_ones = a_ext && !b_ext;
+    frt_bv_capa(bv, capa, max_size);
+
+    frt_bv_andnot_words(bv->bits, a->bits, b->bits, min_word_size);
+
+    if (a_wsz > b_wsz) {
+        frt_bv_and_ext(bv->bits, a->bits, !b_ext, i, max_word_size);
+    }
+    else if (b_wsz > a_wsz) {
+        if (a_ext)
+             frt_bv_not_words(&bv->bits[i], &b->bits[i], max_word_size - i);
+        else memset(&bv->bits[i], 0x00, sizeof(frt_u64)*(max_word_size - i));
+    }
+    frt_bv_recount(bv);
     return bv;
 }
 
 static FRT_ATTR_ALWAYS_INLINE
 FrtBitVector *frt_bv_not_i(FrtBitVector *bv, FrtBitVector *bv1)
 {
-    int i;
-    int word_size = FRT_TO_WORD(bv1->size);
+    int word_size = FRT_BV_TO_WORD(bv1->size);
     int capa = frt_max2(frt_round2(word_size), 4);
 
     bv->extends_as_ones = !bv1->extends_as_ones;
     frt_bv_capa(bv, capa, bv1->size);
 
-    for (i = 0; i < word_size; i++)
-        bv->bits[i] = ~(bv1->bits[i]);
+    frt_bv_not_words(bv->bits, bv1->bits, word_size);
 
     memset(bv->bits + word_size, (bv->extends_as_ones ? 0xFF : 0),
-           sizeof(frt_u32) * (bv->capa - word_size));
+           sizeof(frt_u64) * (bv->capa - word_size));
 
     frt_bv_recount(bv);
     return bv;
@@ -523,6 +565,20 @@ FrtBitVector *frt_bv_xor(FrtBitVector *bv1, FrtBitVector *bv2)
     return frt_bv_xor_i(frt_bv_new(), bv1, bv2);
 }
 
+/**
+ * Clears the bits of +bv1+ that are set in +bv2+ and returns the resultant
+ * FrtBitVector. This is useful for removing deleted documents from a filter.
+ *
+ * @param bv1 FrtBitVector to remove bits from
+ * @param bv2 FrtBitVector of bits to remove
+ * @return A FrtBitVector with all bits set that are set in bv1 but not bv2
+ */
+static FRT_ATTR_ALWAYS_INLINE
+FrtBitVector *frt_bv_andnot(FrtBitVector *bv1, FrtBitVector *bv2)
+{
+    return frt_bv_andnot_i(frt_bv_new(), bv1, bv2);
+}
+
 /**
  * Returns FrtBitVector with all of +bv+'s bits flipped
  *
@@ -575,6 +631,19 @@ FrtBitVector *frt_bv_xor_x(FrtBitVector *bv1, FrtBitVector *bv2)
     return frt_bv_xor_i(bv1, bv1, bv2);
 }
 
+/**
+ * Clears the bits of +bv1+ that are set in +bv2+, in place of +bv1+
+ *
+ * @param bv1 FrtBitVector to remove bits from
+ * @param bv2 FrtBitVector of bits to remove
+ * @return bv1
+ */
+static FRT_ATTR_ALWAYS_INLINE
+FrtBitVector *frt_bv_andnot_x(FrtBitVector *bv1, FrtBitVector *bv2)
+{
+    return frt_bv_andnot_i(bv1, bv1, bv2);
+}
+
 /**
  * Flips all bits in the FrtBitVector +bv+
  *
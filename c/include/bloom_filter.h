@@ -0,0 +1,46 @@
+#ifndef FRT_BLOOM_FILTER_H
+#define FRT_BLOOM_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "store.h"
+
+/****************************************************************************
+ *
+ * FrtBloomFilter
+ *
+ * A Bloom filter over a set of terms. frt_bf_may_contain never returns false
+ * for a term which was added to the filter but it may return true for a term
+ * which wasn't. With FRT_BF_BITS_PER_TERM bits per term false positives
+ * happen for less than 1% of lookups.
+ *
+ * Terms are hashed once with frt_bf_hash and the hash is reused for each of
+ * the +num_hashes+ probes so the same hash can be checked against the
+ * filters of many segments, as a MultiReader's doc_freq does.
+ *
+ ****************************************************************************/
+
+#define FRT_BF_BITS_PER_TERM 10
+
+typedef struct FrtBloomFilter
+{
+    int      num_hashes;
+    int      word_cnt;
+    frt_u64 *words;
+} FrtBloomFilter;
+
+extern frt_u64 frt_bf_hash(const char *term, int term_len);
+extern FrtBloomFilter *frt_bf_new(int term_cnt);
+extern void frt_bf_add(FrtBloomFilter *bf, frt_u64 hash);
+extern bool frt_bf_may_contain(FrtBloomFilter *bf, frt_u64 hash);
+extern void frt_bf_write(FrtBloomFilter *bf, FrtOutStream *os);
+extern FrtBloomFilter *frt_bf_read(FrtInStream *is);
+extern void frt_bf_destroy(FrtBloomFilter *bf);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef FRT_DOC_SET_H
+#define FRT_DOC_SET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "bitvector.h"
+
+/****************************************************************************
+ *
+ * FrtDocSet
+ *
+ * A compressed set of document numbers in the style of a roaring bitmap.
+ * Document numbers are split into a 16-bit key (the high bits) and a 16-bit
+ * low part. All document numbers sharing a key are stored together in a
+ * container which is one of;
+ *
+ *   FRT_DS_ARRAY  - a sorted array of the low parts. Used for sparse
+ *                   containers of up to FRT_DS_ARRAY_MAX documents.
+ *   FRT_DS_BITMAP - a 65536 bit bitmap. Used for dense containers.
+ *   FRT_DS_RUN    - a sorted array of runs of consecutive documents.
+ *
+ * frt_ds_optimize picks the smallest of the three for each container so a
+ * set with a handful of documents, or one with nearly every document, only
+ * takes a few bytes per 65536 documents.
+ *
+ ****************************************************************************/
+
+#define FRT_DS_ARRAY_MAX 4096
+#define FRT_DS_BITMAP_WORDS 1024
+
+#define FRT_DS_ARRAY  0
+#define FRT_DS_BITMAP 1
+#define FRT_DS_RUN    2
+
+/* a run covers the low values start..(start + len) */
+typedef struct FrtDocSetRun
+{
+    frt_u16 start;
+    frt_u16 len;
+} FrtDocSetRun;
+
+typedef struct FrtDocSetContainer
+{
+    int key;            /* doc_num >> 16 for every doc in the container */
+    int type;           /* FRT_DS_ARRAY, FRT_DS_BITMAP or FRT_DS_RUN */
+    int card;           /* number of docs in the container */
+    int size;           /* number of values or runs used */
+    int capa;           /* number of values, words or runs allocated */
+    union {
+        frt_u16 *values;
+        frt_u64 *words;
+        FrtDocSetRun *runs;
+    } data;
+} FrtDocSetContainer;
+
+typedef struct FrtDocSet
+{
+    /** count is the number of docs in the set */
+    int count;
+
+    /** size is the number of containers in use and capa the number of
+     * containers allocated. Containers are kept sorted by key */
+    int size;
+    int capa;
+    FrtDocSetContainer *cons;
+} FrtDocSet;
+
+/**
+ * Create a new empty FrtDocSet.
+ *
+ * @return an empty FrtDocSet
+ */
+extern FRT_ATTR_MALLOC
+FrtDocSet *frt_ds_new(void);
+
+/**
+ * Destroy a FrtDocSet, freeing all memory allocated to it.
+ *
+ * @param ds FrtDocSet to destroy
+ */
+extern void frt_ds_destroy(FrtDocSet *ds);
+
+/**
+ * Add +doc_num+ to the set. Adding docs in increasing order is fastest but
+ * they may be added in any order.
+ *
+ * @param ds FrtDocSet to add to
+ * @param doc_num the document number to add. Must be >= 0
+ */
+extern void frt_ds_add(FrtDocSet *ds, int doc_num);
+
+/**
+ * Check whether +doc_num+ is in the set.
+ *
+ * @param ds FrtDocSet to check
+ * @param doc_num the document number to look for
+ * @return true if +doc_num+ is in the set
+ */
+extern bool frt_ds_get(FrtDocSet *ds, int doc_num);
+
+/**
+ * Convert each container to whichever of the array, bitmap or run
+ * representations takes up the least memory and release any unused space.
+ * Call this once the set has been built.
+ *
+ * @param ds FrtDocSet to optimize
+ */
+extern void frt_ds_optimize(FrtDocSet *ds);
+
+/**
+ * Create an optimized FrtDocSet holding the bits set in +bv+ below
+ * +max_doc+. If +bv->extends_as_ones+ is set every doc from +bv->size+ up to
+ * +max_doc+ is in the set too, just as frt_bv_get would report.
+ *
+ * @param bv FrtBitVector to copy
+ * @param max_doc one more than the largest doc that can be in the set
+ * @return a new FrtDocSet
+ */
+extern FrtDocSet *frt_ds_from_bv(FrtBitVector *bv, int max_doc);
+
+/**
+ * Create a FrtBitVector with the bits for each doc in the set set.
+ *
+ * @param ds FrtDocSet to copy
+ * @return a new FrtBitVector
+ */
+extern FrtBitVector *frt_ds_to_bv(FrtDocSet *ds);
+
+/**
+ * Return the number of bytes of memory used by the FrtDocSet.
+ *
+ * @param ds FrtDocSet to measure
+ * @return the memory used by +ds+ in bytes
+ */
+extern size_t frt_ds_memsize(FrtDocSet *ds);
+
+/****************************************************************************
+ *
+ * FrtDocSetIterator
+ *
+ * Iterates through the docs in a FrtDocSet in increasing order. The iterator
+ * lives on the stack so any number of them can read the same (cached)
+ * FrtDocSet at once.
+ *
+ ****************************************************************************/
+
+typedef struct FrtDocSetIterator
+{
+    FrtDocSet *ds;
+    int ci;             /* index of the current container */
+    int pos;            /* position within the current container */
+    int doc;            /* the current doc or -1 */
+} FrtDocSetIterator;
+
+/**
+ * Initialize +dsi+ to iterate through +ds+. The first call to frt_dsi_next
+ * will return the first doc in the set.
+ *
+ * @param dsi the iterator to initialize
+ * @param ds the FrtDocSet to iterate through
+ */
+extern void frt_dsi_init(FrtDocSetIterator *dsi, FrtDocSet *ds);
+
+/**
+ * Move to the next doc in the set.
+ *
+ * @param dsi the iterator
+ * @return the next doc or -1 if there are no more docs
+ */
+extern int frt_dsi_next(FrtDocSetIterator *dsi);
+
+/**
+ * Move to the first doc in the set that is greater than or equal to
+ * +doc_num+. If the iterator is already at or past +doc_num+ it stays where
+ * it is so +frt_dsi_skip_to(dsi, doc_num) == doc_num+ can be used to check
+ * membership for an increasing sequence of docs.
+ *
+ * @param dsi the iterator
+ * @param doc_num the doc to skip to
+ * @return the current doc or -1 if there are no more docs
+ */
+extern int frt_dsi_skip_to(FrtDocSetIterator *dsi, int doc_num);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
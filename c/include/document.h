@@ -9,6 +9,41 @@ extern "C" {
 #include "symbol.h"
 #include "hash.h"
 
+/****************************************************************************
+ *
+ * FrtTokenList
+ *
+ * The tokens of an analyzed field, ready to be inverted. Offsets are from the
+ * start of the field's first value, as if the values were joined with a
+ * single character between them.
+ *
+ ****************************************************************************/
+
+typedef struct FrtDocToken
+{
+    int text;       /* offset of the token's text in the list's buf */
+    int len;
+    int pos_inc;
+    off_t start;
+    off_t end;
+} FrtDocToken;
+
+#define FRT_TKL_INIT_CAPA 16
+typedef struct FrtTokenList
+{
+    int size;
+    int capa;
+    FrtDocToken *tokens;
+    int buf_size;
+    int buf_capa;
+    char *buf;      /* the tokens' text, each '\0' terminated */
+} FrtTokenList;
+
+extern FrtTokenList *frt_tkl_new();
+extern void frt_tkl_add(FrtTokenList *tkl, const char *text, int len,
+                        int pos_inc, off_t start, off_t end);
+extern void frt_tkl_destroy(FrtTokenList *tkl);
+
 /****************************************************************************
  *
  * FrtDocField
@@ -26,11 +61,17 @@ typedef struct FrtDocField
     float boost;
     bool destroy_data : 1;
     bool is_compressed : 1;
+    /* if set, these tokens are indexed rather than analyzing data */
+    FrtTokenList *tokens;
 } FrtDocField;
 
 extern FrtDocField *frt_df_new(FrtSymbol name);
 extern FrtDocField *frt_df_add_data(FrtDocField *df, char *data);
 extern FrtDocField *frt_df_add_data_len(FrtDocField *df, char *data, int len);
+/* Add a token to be indexed in place of analyzing the field's data. +start+
+ * and +end+ are offsets from the start of the field as in FrtTokenList. */
+extern FrtDocField *frt_df_add_token(FrtDocField *df, const char *text, int len,
+                                     int pos_inc, off_t start, off_t end);
 extern void frt_df_destroy(FrtDocField *df);
 extern char *frt_df_to_s(FrtDocField *df);
 
@@ -259,6 +259,45 @@ int frt_count_zeros(frt_u32 word)
     return frt_count_ones(~word);
 }
 
+/**
+ * Return the count of trailing [LSB] 0 bits in the 64-bit +word+.
+ */
+static FRT_ATTR_ALWAYS_INLINE FRT_ATTR_CONST
+int frt_count_trailing_zeros64(frt_u64 word)
+{
+#ifdef __GNUC__
+    if (word)
+        return __builtin_ctzll(word);
+    return 64;
+#else
+    if ((frt_u32)word)
+        return frt_count_trailing_zeros((frt_u32)word);
+    return 32 + frt_count_trailing_zeros((frt_u32)(word >> 32));
+#endif
+}
+
+static FRT_ATTR_ALWAYS_INLINE FRT_ATTR_CONST
+int frt_count_trailing_ones64(frt_u64 word)
+{
+    return frt_count_trailing_zeros64(~word);
+}
+
+static FRT_ATTR_ALWAYS_INLINE FRT_ATTR_CONST
+int frt_count_ones64(frt_u64 word)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    return frt_count_ones((frt_u32)word) + frt_count_ones((frt_u32)(word >> 32));
+#endif
+}
+
+static FRT_ATTR_ALWAYS_INLINE FRT_ATTR_CONST
+int frt_count_zeros64(frt_u64 word)
+{
+    return frt_count_ones64(~word);
+}
+
 /**
  * Round up to the next power of 2
  */
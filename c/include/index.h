@@ -10,9 +10,11 @@ extern "C" {
 #include "analysis.h"
 #include "hash.h"
 #include "hashset.h"
+#include "term_hash.h"
 #include "store.h"
 #include "mempool.h"
 #include "similarity.h"
+#include "bloom_filter.h"
 #include "bitvector.h"
 #include "priorityqueue.h"
 
@@ -28,6 +30,26 @@ extern bool frt_file_name_filter_is_index_file(const char *file_name, bool inclu
  *
  ****************************************************************************/
 
+/* An IndexWriter can keep the documents in each segment sorted by up to
+ * FRT_INDEX_SORT_MAX_FIELDS fields. The values are read from the stored
+ * fields so the sort fields must be stored. Only the first value of a field
+ * is used and documents without a value go after all the others. */
+#define FRT_INDEX_SORT_MAX_FIELDS 4
+
+typedef enum
+{
+    FRT_INDEX_SORT_STRING,
+    FRT_INDEX_SORT_INTEGER,
+    FRT_INDEX_SORT_FLOAT
+} FrtIndexSortType;
+
+typedef struct FrtIndexSortField
+{
+    FrtSymbol field;
+    FrtIndexSortType type;
+    bool reverse;
+} FrtIndexSortField;
+
 typedef struct FrtConfig
 {
     int chunk_size;
@@ -36,9 +58,12 @@ typedef struct FrtConfig
     int skip_interval;
     int merge_factor;
     int max_buffered_docs;
+    int max_buffered_delete_terms;
     int max_merge_docs;
     int max_field_length;
     bool use_compound_file;
+    int index_sort_cnt;     /* 0 unless the segments are to be sorted */
+    FrtIndexSortField index_sort[FRT_INDEX_SORT_MAX_FIELDS];
 } FrtConfig;
 
 extern const FrtConfig frt_default_config;
@@ -103,6 +128,10 @@ typedef enum
 #define FRT_FI_STORE_TERM_VECTOR_BM 0x020
 #define FRT_FI_STORE_POSITIONS_BM   0x040
 #define FRT_FI_STORE_OFFSETS_BM     0x080
+/* write a Bloom filter of the field's terms with each segment so that term
+ * lookups can skip segments which don't contain the term. Useful for id
+ * fields. Set it directly on the FieldInfo's bits. */
+#define FRT_FI_BLOOM_FILTER_BM      0x100
 
 typedef struct FrtFieldInfo
 {
@@ -128,6 +157,7 @@ extern void frt_fi_deref(FrtFieldInfo *fi);
 #define fi_store_term_vector(fi) (((fi)->bits & FRT_FI_STORE_TERM_VECTOR_BM) != 0)
 #define fi_store_positions(fi)   (((fi)->bits & FRT_FI_STORE_POSITIONS_BM) != 0)
 #define fi_store_offsets(fi)     (((fi)->bits & FRT_FI_STORE_OFFSETS_BM) != 0)
+#define fi_has_bloom_filter(fi)  (((fi)->bits & FRT_FI_BLOOM_FILTER_BM) != 0)
 #define fi_has_norms(fi)\
     (((fi)->bits & (FRT_FI_OMIT_NORMS_BM|FRT_FI_IS_INDEXED_BM)) == FRT_FI_IS_INDEXED_BM)
 
@@ -183,6 +213,7 @@ typedef struct FrtSegmentInfo
     int *norm_gens;
     int norm_gens_size;
     bool use_compound_file;
+    char *sorted_by;        /* the index sort of the documents or NULL */
 } FrtSegmentInfo;
 
 extern FrtSegmentInfo *frt_si_new(char *name, int doc_cnt, FrtStore *store);
@@ -294,6 +325,9 @@ typedef struct FrtSegmentTermIndex
     int        *index_term_lens;
     FrtTermInfo   *index_term_infos;
     off_t      *index_ptrs;
+    off_t       restart_ptr;
+    frt_u32    *restart_offsets;
+    FrtBloomFilter *bloom; /* NULL unless the field has a bloom filter */
 } FrtSegmentTermIndex;
 
 /* * FrtSegmentFieldIndex * */
@@ -305,8 +339,10 @@ typedef struct FrtSegmentFieldIndex
     frt_mutex_t     mutex;
     int         skip_interval;
     int         index_interval;
+    int         restart_interval; /* 0 if the segment has no .trp file */
     off_t       index_ptr;
     FrtTermEnum   *index_te;
+    FrtInStream   *restart_in;
     FrtHash  *field_dict;
 } FrtSegmentFieldIndex;
 
@@ -322,6 +358,7 @@ struct FrtSegmentTermEnum
     int         size;
     int         pos;
     int         skip_interval;
+    int         restart_interval;
     FrtSegmentFieldIndex *sfi;
 };
 
@@ -341,12 +378,46 @@ extern FrtTermEnum *frt_mte_new(FrtMultiReader *mr, int field_num, const char *t
 
 #define FRT_TE_BUCKET_INIT_CAPA 1
 
+/* The TermInfos of recently looked up terms are cached in each
+ * TermInfosReader. The cache is split into FRT_TI_CACHE_STRIPES stripes, each
+ * with its own lock and least recently used list, so that threads looking up
+ * different terms rarely wait on each other. */
+#define FRT_TI_CACHE_STRIPES 16
+#define FRT_TI_CACHE_SIZE 1024
+
+typedef struct FrtTermInfoCacheEntry
+{
+    struct FrtTermInfoCacheEntry *prev;
+    struct FrtTermInfoCacheEntry *next;
+    int          field_num;
+    char        *term;
+    FrtTermInfo  ti;
+} FrtTermInfoCacheEntry;
+
+typedef struct FrtTermInfoCacheStripe
+{
+    frt_mutex_t  mutex;
+    FrtHash     *entries;
+    FrtTermInfoCacheEntry *head; /* most recently used */
+    FrtTermInfoCacheEntry *tail; /* next to be evicted */
+    frt_u64      hits;
+    frt_u64      misses;
+} FrtTermInfoCacheStripe;
+
+typedef struct FrtTermInfoCacheStats
+{
+    frt_u64      hits;
+    frt_u64      misses;
+    int          size;
+} FrtTermInfoCacheStats;
+
 typedef struct FrtTermInfosReader
 {
     frt_thread_key_t thread_te;
     void       **te_bucket;
     FrtTermEnum     *orig_te;
     int          field_num;
+    FrtTermInfoCacheStripe cache[FRT_TI_CACHE_STRIPES];
 } FrtTermInfosReader;
 
 extern FrtTermInfosReader *frt_tir_open(FrtStore *store,
@@ -355,6 +426,8 @@ extern FrtTermInfosReader *frt_tir_open(FrtStore *store,
 extern FrtTermInfosReader *frt_tir_set_field(FrtTermInfosReader *tir, int field_num);
 extern FrtTermInfo *frt_tir_get_ti(FrtTermInfosReader *tir, const char *term);
 extern char *frt_tir_get_term(FrtTermInfosReader *tir, int pos);
+extern void frt_tir_cache_stats(FrtTermInfosReader *tir,
+                                FrtTermInfoCacheStats *stats);
 extern void frt_tir_close(FrtTermInfosReader *tir);
 
 /****************************************************************************
@@ -365,6 +438,11 @@ extern void frt_tir_close(FrtTermInfosReader *tir);
 
 #define FRT_INDEX_INTERVAL 128
 #define FRT_SKIP_INTERVAL 16
+/* Every FRT_RESTART_INTERVAL terms in the .tis file a term is written in full
+ * with absolute pointers. The offsets of these restart points within each
+ * index block are kept in the .trp file so a lookup can binary search them
+ * rather than scan the whole block. */
+#define FRT_RESTART_INTERVAL 16
 
 typedef struct FrtTermWriter
 {
@@ -379,14 +457,26 @@ typedef struct FrtTermInfosWriter
     int field_count;
     int index_interval;
     int skip_interval;
+    int restart_interval;
     off_t last_index_ptr;
     FrtOutStream *tfx_out;
+    FrtOutStream *trp_out;
     FrtTermWriter *tix_writer;
     FrtTermWriter *tis_writer;
+    FrtFieldInfos *fis;
+    FrtOutStream *blm_out;
+    int bloom_count;
+    int bloom_field_num;    /* -1 unless the current field has a filter */
+    frt_u64 *bloom_hashes;
+    int bloom_hashes_size;
+    int bloom_hashes_capa;
 } FrtTermInfosWriter;
 
+/* +fis+ is used to find the fields that need a bloom filter. It can be NULL
+ * in which case no bloom filters are written. */
 extern FrtTermInfosWriter *frt_tiw_open(FrtStore *store,
                                  const char *segment,
+                                 FrtFieldInfos *fis,
                                  int index_interval,
                                  int skip_interval);
 extern void frt_tiw_start_field(FrtTermInfosWriter *tiw, int field_num);
@@ -570,6 +660,31 @@ extern int frt_tv_get_term_index(FrtTermVector *tv, const char *term);
 extern int frt_tv_scan_to_term_index(FrtTermVector *tv, const char *term);
 extern FrtTVTerm *frt_tv_get_tv_term(FrtTermVector *tv, const char *term);
 
+/****************************************************************************
+ *
+ * FrtFieldsBlock
+ *
+ * The values of compressed fields aren't stored in the .fdt file with the
+ * rest of the document. Instead the compressed values of consecutive
+ * documents are gathered into blocks of about FRT_FIELDS_BLOCK_SIZE bytes
+ * which are compressed together and written to the .fdz file. A
+ * FrtFieldsBlock holds one of these blocks decompressed.
+ *
+ ****************************************************************************/
+
+#define FRT_FIELDS_BLOCK_SIZE 16384
+
+typedef struct FrtFieldsBlock
+{
+    int   first_doc;
+    int   doc_cnt;
+    int  *offsets;      /* doc_cnt + 1 offsets of each document's data */
+    char *data;
+    int   ref_cnt;
+} FrtFieldsBlock;
+
+extern void frt_fb_deref(FrtFieldsBlock *fb);
+
 /****************************************************************************
  *
  * FrtLazyDoc
@@ -596,6 +711,21 @@ typedef struct FrtLazyDocField
 } FrtLazyDocField;
 
 extern char *frt_lazy_df_get_data(FrtLazyDocField *self, int i);
+
+/**
+ * Get the data for element +i+ of +self+ without copying it if possible. The
+ * data is +self->data[i].length+ bytes long and, unlike the string returned
+ * by frt_lazy_df_get_data, is NOT null terminated. Uncompressed data read
+ * from a store opened with frt_open_mmap_store points directly into the
+ * mapped file and compressed data points into the decompressed block. In
+ * other cases the data is loaded as with frt_lazy_df_get_data. Either way it
+ * is valid until the LazyDoc is closed.
+ *
+ * @param self the LazyDocField to get the data from
+ * @param i the index of the data element
+ * @return the data or NULL if +i+ is out of range
+ */
+extern const char *frt_lazy_df_get_view(FrtLazyDocField *self, int i);
 extern void frt_lazy_df_get_bytes(FrtLazyDocField *self, char *buf,
                               int start, int len);
 
@@ -606,6 +736,9 @@ struct FrtLazyDoc
     int size;
     FrtLazyDocField **fields;
     FrtInStream *fields_in;
+    /* the block holding the compressed fields. The start of compressed data
+     * is an offset into the block's data rather than into fields_in. */
+    FrtFieldsBlock *fields_block;
 };
 
 extern void frt_lazy_doc_close(FrtLazyDoc *self);
@@ -617,6 +750,15 @@ extern FrtLazyDocField *frt_lazy_doc_get(FrtLazyDoc *self, FrtSymbol field);
  *
  ****************************************************************************/
 
+typedef struct FrtFieldsBlockInfo
+{
+    int   first_doc;
+    int   doc_cnt;
+    int   raw_len;
+    int   zip_len;
+    off_t ptr;
+} FrtFieldsBlockInfo;
+
 typedef struct FrtFieldsReader
 {
     int           size;
@@ -624,6 +766,10 @@ typedef struct FrtFieldsReader
     FrtStore      *store;
     FrtInStream   *fdx_in;
     FrtInStream   *fdt_in;
+    FrtInStream   *fdz_in; /* NULL for segments which zip values one by one */
+    int            block_cnt;
+    FrtFieldsBlockInfo *blocks;
+    FrtFieldsBlock *block; /* the last block read */
 } FrtFieldsReader;
 
 extern FrtFieldsReader *frt_fr_open(FrtStore *store,
@@ -631,6 +777,8 @@ extern FrtFieldsReader *frt_fr_open(FrtStore *store,
 extern FrtFieldsReader *frt_fr_clone(FrtFieldsReader *orig);
 extern void frt_fr_close(FrtFieldsReader *fr);
 extern FrtDocument *frt_fr_get_doc(FrtFieldsReader *fr, int doc_num);
+extern FrtDocument *frt_fr_get_doc_fields(FrtFieldsReader *fr, int doc_num,
+                                          FrtBitVector *fields);
 extern FrtLazyDoc *frt_fr_get_lazy_doc(FrtFieldsReader *fr, int doc_num);
 extern FrtHash *frt_fr_get_tv(FrtFieldsReader *fr, int doc_num);
 extern FrtTermVector *frt_fr_get_field_tv(FrtFieldsReader *fr, int doc_num,
@@ -650,6 +798,19 @@ typedef struct FrtFieldsWriter
     FrtOutStream  *buffer;
     FrtTVField    *tv_fields;
     off_t       start_ptr;
+    int         doc_num;
+    /* compressed fields of the current block */
+    FrtOutStream  *fdz_out;
+    FrtOutStream  *block_index;
+    int         block_cnt;
+    int         block_first_doc; /* -1 until a document has zipped data */
+    char       *block_data;
+    int         block_data_size;
+    int         block_data_capa;
+    int         block_doc_start;
+    int        *block_doc_lens;
+    int         block_doc_cnt;
+    int         block_doc_capa;
 } FrtFieldsWriter;
 
 extern FrtFieldsWriter *frt_fw_open(FrtStore *store,
@@ -704,6 +865,9 @@ struct FrtIndexReader
     int                 (*max_doc)(FrtIndexReader *ir);
     FrtDocument           *(*get_doc)(FrtIndexReader *ir, int doc_num);
     FrtLazyDoc            *(*get_lazy_doc)(FrtIndexReader *ir, int doc_num);
+    void                (*get_docs_i)(FrtIndexReader *ir, const int *doc_nums,
+                                      int cnt, FrtSymbol *fields,
+                                      int field_cnt, FrtDocument **docs);
     frt_uchar              *(*get_norms)(FrtIndexReader *ir, int field_num);
     frt_uchar              *(*get_norms_into)(FrtIndexReader *ir, int field_num,
                                           frt_uchar *buf);
@@ -759,6 +923,9 @@ extern frt_uchar *frt_ir_get_norms_i(FrtIndexReader *ir, int field_num);
 extern frt_uchar *frt_ir_get_norms(FrtIndexReader *ir, FrtSymbol field);
 extern frt_uchar *frt_ir_get_norms_into(FrtIndexReader *ir, FrtSymbol field, frt_uchar *buf);
 extern void frt_ir_destroy(FrtIndexReader *self);
+extern FrtDocument **frt_ir_get_docs(FrtIndexReader *ir, const int *doc_nums,
+                                     int cnt, FrtSymbol *fields,
+                                     int field_cnt);
 extern FrtDocument *frt_ir_get_doc_with_term(FrtIndexReader *ir, FrtSymbol field,
                                       const char *term);
 extern FrtTermEnum *frt_ir_terms(FrtIndexReader *ir, FrtSymbol field);
@@ -813,7 +980,7 @@ typedef struct FrtBoost
 
 typedef struct FrtFieldInverter
 {
-    FrtHash *plists;
+    FrtTermHash *plists;
     frt_uchar *norms;
     FrtFieldInfo *fi;
     int length;
@@ -840,7 +1007,7 @@ typedef struct FrtDocWriter
     FrtFieldsWriter *fw;
     FrtMemoryPool *mp;
     FrtAnalyzer *analyzer;
-    FrtHash *curr_plists;
+    FrtTermHash *curr_plists;
     FrtHash *fields;
     FrtSimilarity *similarity;
     FrtOffset *offsets;
@@ -858,11 +1025,55 @@ extern void frt_dw_close(FrtDocWriter *dw);
 extern void frt_dw_add_doc(FrtDocWriter *dw, FrtDocument *doc);
 extern void frt_dw_new_segment(FrtDocWriter *dw, FrtSegmentInfo *si);
 /* For testing. need to remove somehow. FIXME */
-extern FrtHash *frt_dw_invert_field(FrtDocWriter *dw,
-                                  FrtFieldInverter *fld_inv,
-                                  FrtDocField *df);
+extern FrtTermHash *frt_dw_invert_field(FrtDocWriter *dw,
+                                       FrtFieldInverter *fld_inv,
+                                       FrtDocField *df);
 extern FrtFieldInverter *frt_dw_get_fld_inv(FrtDocWriter *dw, FrtFieldInfo *fi);
-extern void frt_dw_reset_postings(FrtHash *postings);
+extern void frt_dw_reset_postings(FrtTermHash *postings);
+
+/****************************************************************************
+ *
+ * FrtMergePolicy
+ *
+ ****************************************************************************/
+
+/* A FrtMergePolicy decides which segments the IndexWriter merges after each
+ * flush. find_merge sets +min_seg+ and +max_seg+ to a run of segments
+ * [min_seg, max_seg) to merge and returns true, or returns false when the
+ * index needs no merging. The IndexWriter keeps merging until it does. */
+typedef struct FrtMergePolicy FrtMergePolicy;
+struct FrtMergePolicy
+{
+    bool (*find_merge)(FrtMergePolicy *mp, FrtIndexWriter *iw,
+                       int *min_seg, int *max_seg);
+    void (*destroy)(FrtMergePolicy *mp);
+};
+
+/* The classic policy which merges whenever +merge_factor+ segments of
+ * roughly the same document count build up. It ignores deletions. This is
+ * the default. */
+extern FrtMergePolicy *frt_log_merge_policy_new(void);
+
+/* Budgets the index by segment byte size. Each tier of similar sized
+ * segments may hold +segs_per_tier+ segments and a merge picks the run of
+ * segments that is most evenly sized and reclaims the most deletions.
+ * Segments whose live documents are over half of +max_merged_segment_bytes+
+ * are left alone unless more than +deletes_pct_allowed+ percent of their
+ * documents are deleted, in which case they are rewritten on their own. */
+typedef struct FrtTieredMergePolicy
+{
+    FrtMergePolicy super;
+    frt_i64 max_merged_segment_bytes;
+    /* segments smaller than this are treated as this size */
+    frt_i64 floor_segment_bytes;
+    int segs_per_tier;
+    int max_merge_at_once;
+    double deletes_pct_allowed;
+} FrtTieredMergePolicy;
+
+#define FRT_TIERED_MP(mp) ((FrtTieredMergePolicy *)(mp))
+
+extern FrtMergePolicy *frt_tiered_merge_policy_new(void);
 
 /****************************************************************************
  *
@@ -870,10 +1081,14 @@ extern void frt_dw_reset_postings(FrtHash *postings);
  *
  ****************************************************************************/
 
+/* A buffered delete. Matching docs are deleted from every segment except
+ * the one being flushed, where only docs numbered below +doc_limit+ (the
+ * docs added before the delete) are deleted. */
 typedef struct FrtDelTerm
 {
     int field_num;
     char *term;
+    int doc_limit;
 } FrtDelTerm;
 
 struct FrtIndexWriter
@@ -888,6 +1103,11 @@ struct FrtIndexWriter
     FrtSimilarity *similarity;
     FrtLock *write_lock;
     FrtDeleter *deleter;
+    FrtMergePolicy *merge_policy;
+    /* delete terms waiting to be applied when the segment is flushed */
+    FrtDelTerm *del_terms;
+    int del_terms_size;
+    int del_terms_capa;
 };
 
 extern void frt_index_create(FrtStore *store, FrtFieldInfos *fis);
@@ -898,14 +1118,75 @@ extern void frt_iw_delete_term(FrtIndexWriter *iw, FrtSymbol field,
                            const char *term);
 extern void frt_iw_delete_terms(FrtIndexWriter *iw, FrtSymbol field,
                             char **terms, const int term_cnt);
+/**
+ * Replace the documents with +term+ in +field+ by +doc+. The delete is
+ * buffered along with the other delete terms and will only remove documents
+ * that were added before +doc+, so +doc+ itself is safe even if it contains
+ * +term+.
+ */
+extern void frt_iw_update_doc(FrtIndexWriter *iw, FrtSymbol field,
+                              const char *term, FrtDocument *doc);
 extern void frt_iw_close(FrtIndexWriter *iw);
 extern void frt_iw_add_doc(FrtIndexWriter *iw, FrtDocument *doc);
 extern int frt_iw_doc_count(FrtIndexWriter *iw);
 extern void frt_iw_commit(FrtIndexWriter *iw);
 extern void frt_iw_optimize(FrtIndexWriter *iw);
+/* Replace the IndexWriter's FrtMergePolicy. The IndexWriter destroys +mp+
+ * when it is closed. */
+extern void frt_iw_set_merge_policy(FrtIndexWriter *iw, FrtMergePolicy *mp);
 extern void frt_iw_add_readers(FrtIndexWriter *iw, FrtIndexReader **readers,
                            const int r_cnt);
 
+/****************************************************************************
+ *
+ * Pre-analyzed Documents
+ *
+ * Fields which have tokens set (see FrtDocField) are indexed from those
+ * tokens rather than analyzed again, so documents can be analyzed once and
+ * added to several indexes.
+ *
+ ****************************************************************************/
+
+/* Analyze +df+ with +a+ and set its tokens, replacing any it already had. */
+extern void frt_df_analyze(FrtDocField *df, FrtAnalyzer *a);
+/* Write +doc+, including any tokens, in a compact binary format. Documents
+ * can be written one after another to build a stream for frt_iw_load_docs. */
+extern void frt_doc_write(FrtDocument *doc, FrtOutStream *os);
+/* Read a document written by frt_doc_write. The document owns its data. */
+extern FrtDocument *frt_doc_read(FrtInStream *is);
+/* Add every document in +is+ to +iw+. Returns the number of documents. */
+extern int frt_iw_load_docs(FrtIndexWriter *iw, FrtInStream *is);
+
+/****************************************************************************
+ *
+ * FrtIndexPipeline
+ *
+ ****************************************************************************/
+
+#ifndef UNTHREADED
+/**
+ * Adds documents to an FrtIndexWriter, analyzing them on worker threads
+ * first. Analyzed documents are added to the index by a single thread in the
+ * order they were queued, so the index is the same as if each had been added
+ * with frt_iw_add_doc. The IndexWriter's analyzer is used from all the worker
+ * threads at once, which is safe for analyzers made by frt_analyzer_new.
+ */
+typedef struct FrtIndexPipeline FrtIndexPipeline;
+
+/* Start +thread_cnt+ analysis threads. At most +queue_size+ documents are
+ * held in the pipeline at once. */
+extern FrtIndexPipeline *frt_ip_new(FrtIndexWriter *iw, int thread_cnt,
+                                    int queue_size);
+/* Queue +doc+ to be added, waiting while the pipeline is full. The pipeline
+ * destroys +doc+ once it has been added. Field data the document doesn't own
+ * must stay valid until frt_ip_close returns. */
+extern void frt_ip_add_doc(FrtIndexPipeline *ip, FrtDocument *doc);
+/* Wait for the queued documents to be added and stop the threads. The
+ * IndexWriter isn't committed. Raises the first error hit by the pipeline,
+ * after which later documents were dropped. */
+extern void frt_ip_close(FrtIndexPipeline *ip);
+#endif
+
 /****************************************************************************
  *
  * FrtCompoundWriter
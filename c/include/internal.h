@@ -17,12 +17,15 @@
 #define BC_MUST                            FRT_BC_MUST
 #define BC_MUST_NOT                        FRT_BC_MUST_NOT
 #define BC_SHOULD                          FRT_BC_SHOULD
+#define BF_BITS_PER_TERM                   FRT_BF_BITS_PER_TERM
 #define BODY                               FRT_BODY
 #define BOOLEAN_CLAUSES_START_CAPA         FRT_BOOLEAN_CLAUSES_START_CAPA
 #define BOOLEAN_QUERY                      FRT_BOOLEAN_QUERY
 #define BUFFER_SIZE                        FRT_BUFFER_SIZE
+#define BV_ALL_ONES                        FRT_BV_ALL_ONES
 #define BV_INIT_CAPA                       FRT_BV_INIT_CAPA
 #define BV_OP                              FRT_BV_OP
+#define BV_TO_WORD                         FRT_BV_TO_WORD
 #define BYTE_FIELD_INDEX_CLASS             FRT_BYTE_FIELD_INDEX_CLASS
 #define COMMIT_LOCK_NAME                   FRT_COMMIT_LOCK_NAME
 #define CONSTANT_QUERY                     FRT_CONSTANT_QUERY
@@ -35,6 +38,11 @@
 #define DEREF                              FRT_DEREF
 #define DF_INIT_CAPA                       FRT_DF_INIT_CAPA
 #define DOC_INIT_CAPA                      FRT_DOC_INIT_CAPA
+#define DS_ARRAY                           FRT_DS_ARRAY
+#define DS_ARRAY_MAX                       FRT_DS_ARRAY_MAX
+#define DS_BITMAP                          FRT_DS_BITMAP
+#define DS_BITMAP_WORDS                    FRT_DS_BITMAP_WORDS
+#define DS_RUN                             FRT_DS_RUN
 #define EMPTY_STRING                       FRT_EMPTY_STRING
 #define ENDTRY                             FRT_ENDTRY
 #define ENGLISH_STOP_WORDS                 FRT_ENGLISH_STOP_WORDS
@@ -46,6 +54,8 @@
 #define EXTENDED_ENGLISH_STOP_WORDS        FRT_EXTENDED_ENGLISH_STOP_WORDS
 #define EXTERNC                            FRT_EXTERNC
 #define FERRET_ERROR                       FRT_FERRET_ERROR
+#define FI_BLOOM_FILTER_BM                 FRT_FI_BLOOM_FILTER_BM
+#define FIELDS_BLOCK_SIZE                  FRT_FIELDS_BLOCK_SIZE
 #define FILE_NOT_FOUND_ERROR               FRT_FILE_NOT_FOUND_ERROR
 #define FILTERED_QUERY                     FRT_FILTERED_QUERY
 #define FINALLY                            FRT_FINALLY
@@ -86,6 +96,10 @@
 #define INDEX_ERROR                        FRT_INDEX_ERROR
 #define INDEX_INTERVAL                     FRT_INDEX_INTERVAL
 #define INDEX_NO                           FRT_INDEX_NO
+#define INDEX_SORT_FLOAT                   FRT_INDEX_SORT_FLOAT
+#define INDEX_SORT_INTEGER                 FRT_INDEX_SORT_INTEGER
+#define INDEX_SORT_MAX_FIELDS              FRT_INDEX_SORT_MAX_FIELDS
+#define INDEX_SORT_STRING                  FRT_INDEX_SORT_STRING
 #define INDEX_UNTOKENIZED                  FRT_INDEX_UNTOKENIZED
 #define INDEX_UNTOKENIZED_OMIT_NORMS       FRT_INDEX_UNTOKENIZED_OMIT_NORMS
 #define INDEX_YES                          FRT_INDEX_YES
@@ -97,6 +111,7 @@
 #define LOCK_ERROR                         FRT_LOCK_ERROR
 #define LOCK_EXT                           FRT_LOCK_EXT
 #define LOCK_PREFIX                        FRT_LOCK_PREFIX
+#define LZ_COMPRESS_BOUND                  FRT_LZ_COMPRESS_BOUND
 #define MATCH_ALL_QUERY                    FRT_MATCH_ALL_QUERY
 #define MATCH_VECTOR_INIT_CAPA             FRT_MATCH_VECTOR_INIT_CAPA
 #define MAX                                FRT_MAX
@@ -112,6 +127,7 @@
 #define MP_ALLOC_N                         FRT_MP_ALLOC_N
 #define MP_BUF_SIZE                        FRT_MP_BUF_SIZE
 #define MP_INIT_CAPA                       FRT_MP_INIT_CAPA
+#define MULMAP_IS_FIRST                    FRT_MULMAP_IS_FIRST
 #define MULTI_TERM_QUERY                   FRT_MULTI_TERM_QUERY
 #define MULTI_TERM_QUERY_MAX_TERMS         FRT_MULTI_TERM_QUERY_MAX_TERMS
 #define MUTEX_INITIALIZER                  FRT_MUTEX_INITIALIZER
@@ -136,6 +152,7 @@
 #define REALLOC_N                          FRT_REALLOC_N
 #define RECAPA                             FRT_RECAPA
 #define REF                                FRT_REF
+#define RESTART_INTERVAL                   FRT_RESTART_INTERVAL
 #define RETURN_EARLY                       FRT_RETURN_EARLY
 #define S                                  FRT_S
 #define SCANNER                            FRT_SCANNER
@@ -165,6 +182,8 @@
 #define SPAN_PREFIX_QUERY_MAX_TERMS        FRT_SPAN_PREFIX_QUERY_MAX_TERMS
 #define SPAN_TERM_QUERY                    FRT_SPAN_TERM_QUERY
 #define STATE_ERROR                        FRT_STATE_ERROR
+#define STEM_CACHE_SIZE                    FRT_STEM_CACHE_SIZE
+#define STEM_CACHE_WORD_SIZE               FRT_STEM_CACHE_WORD_SIZE
 #define STORE_COMPRESS                     FRT_STORE_COMPRESS
 #define STORE_NO                           FRT_STORE_NO
 #define STORE_YES                          FRT_STORE_YES
@@ -179,7 +198,15 @@
 #define TERM_VECTOR_WITH_POSITIONS_OFFSETS FRT_TERM_VECTOR_WITH_POSITIONS_OFFSETS
 #define TERM_VECTOR_YES                    FRT_TERM_VECTOR_YES
 #define TE_BUCKET_INIT_CAPA                FRT_TE_BUCKET_INIT_CAPA
+#define TH_EMPTY                           FRT_TH_EMPTY
+#define TH_GROUP_WIDTH                     FRT_TH_GROUP_WIDTH
+#define TH_MIN_CAPA                        FRT_TH_MIN_CAPA
 #define THREAD_ONCE_INIT                   FRT_THREAD_ONCE_INIT
+#define TI_CACHE_SIZE                      FRT_TI_CACHE_SIZE
+#define TI_CACHE_STRIPES                   FRT_TI_CACHE_STRIPES
+#define TIERED_MP                          FRT_TIERED_MP
+#define TK_PTR                             FRT_TK_PTR
+#define TKL_INIT_CAPA                      FRT_TKL_INIT_CAPA
 #define TO_WORD                            FRT_TO_WORD
 #define TRY                                FRT_TRY
 #define TV_FIELD_INIT_CAPA                 FRT_TV_FIELD_INIT_CAPA
@@ -205,6 +232,7 @@
 #define Analyzer                FrtAnalyzer
 #define BCType                  FrtBCType
 #define BitVector               FrtBitVector
+#define BloomFilter             FrtBloomFilter
 #define BooleanClause           FrtBooleanClause
 #define BooleanQuery            FrtBooleanQuery
 #define Boost                   FrtBoost
@@ -222,6 +250,11 @@
 #define Deleter                 FrtDeleter
 #define DeterministicState      FrtDeterministicState
 #define DocField                FrtDocField
+#define DocSet                  FrtDocSet
+#define DocSetContainer         FrtDocSetContainer
+#define DocSetIterator          FrtDocSetIterator
+#define DocSetRun               FrtDocSetRun
+#define DocToken                FrtDocToken
 #define DocWriter               FrtDocWriter
 #define Document                FrtDocument
 #define Explanation             FrtExplanation
@@ -231,6 +264,8 @@
 #define FieldInfo               FrtFieldInfo
 #define FieldInfos              FrtFieldInfos
 #define FieldInverter           FrtFieldInverter
+#define FieldsBlock             FrtFieldsBlock
+#define FieldsBlockInfo         FrtFieldsBlockInfo
 #define FieldStack              FrtFieldStack
 #define FieldsReader            FrtFieldsReader
 #define FieldsWriter            FrtFieldsWriter
@@ -244,6 +279,9 @@
 #define HashSetEntry            FrtHashSetEntry
 #define Hit                     FrtHit
 #define HyphenFilter            FrtHyphenFilter
+#define IndexPipeline           FrtIndexPipeline
+#define IndexSortField          FrtIndexSortField
+#define IndexSortType           FrtIndexSortType
 #define InStream                FrtInStream
 #define InStreamMethods         FrtInStreamMethods
 #define Index                   FrtIndex
@@ -256,6 +294,7 @@
 #define LazyDocFieldData        FrtLazyDocFieldData
 #define LegacyStandardTokenizer FrtLegacyStandardTokenizer
 #define Lock                    FrtLock
+#define MergePolicy             FrtMergePolicy
 #define MTQMaxTerms             FrtMTQMaxTerms
 #define MTQSubQuery             FrtMTQSubQuery
 #define Mapping                 FrtMapping
@@ -283,6 +322,8 @@
 #define PriorityQueue           FrtPriorityQueue
 #define PriorityQueueInsertEnum FrtPriorityQueueInsertEnum
 #define QParser                 FrtQParser
+#define QParserCache            FrtQParserCache
+#define QParserCacheEntry       FrtQParserCacheEntry
 #define Query                   FrtQuery
 #define QueryParser             FrtQueryParser
 #define QueryType               FrtQueryType
@@ -311,12 +352,20 @@
 #define StandardTokenizer       FrtStandardTokenizer
 #define StandardTokenizerType   FrtStandardTokenizerType
 #define State                   FrtState
+#define StemCacheEntry          FrtStemCacheEntry
 #define StemFilter              FrtStemFilter
 #define StopFilter              FrtStopFilter
 #define Store                   FrtStore
 #define StoreValue              FrtStoreValue
 #define StringIndex             FrtStringIndex
 #define Symbol                  FrtSymbol
+#define TermHash                FrtTermHash
+#define TermHashSlot            FrtTermHashSlot
+#define TermInfoCacheEntry      FrtTermInfoCacheEntry
+#define TermInfoCacheStats      FrtTermInfoCacheStats
+#define TermInfoCacheStripe     FrtTermInfoCacheStripe
+#define TieredMergePolicy       FrtTieredMergePolicy
+#define TokenList               FrtTokenList
 #define TVField                 FrtTVField
 #define TVTerm                  FrtTVTerm
 #define Term                    FrtTerm
@@ -383,6 +432,13 @@
 #define bc_deref                                       frt_bc_deref
 #define bc_new                                         frt_bc_new
 #define bc_set_occur                                   frt_bc_set_occur
+#define bf_add                                         frt_bf_add
+#define bf_destroy                                     frt_bf_destroy
+#define bf_hash                                        frt_bf_hash
+#define bf_may_contain                                 frt_bf_may_contain
+#define bf_new                                         frt_bf_new
+#define bf_read                                        frt_bf_read
+#define bf_write                                       frt_bf_write
 #define bq_add_clause                                  frt_bq_add_clause
 #define bq_add_clause_nr                               frt_bq_add_clause_nr
 #define bq_add_query                                   frt_bq_add_query
@@ -392,9 +448,15 @@
 #define bv_and                                         frt_bv_and
 #define bv_and_ext                                     frt_bv_and_ext
 #define bv_and_i                                       frt_bv_and_i
+#define bv_and_words                                   frt_bv_and_words
 #define bv_and_x                                       frt_bv_and_x
+#define bv_andnot                                      frt_bv_andnot
+#define bv_andnot_i                                    frt_bv_andnot_i
+#define bv_andnot_words                                frt_bv_andnot_words
+#define bv_andnot_x                                    frt_bv_andnot_x
 #define bv_capa                                        frt_bv_capa
 #define bv_clear                                       frt_bv_clear
+#define bv_count_words                                 frt_bv_count_words
 #define bv_destroy                                     frt_bv_destroy
 #define bv_eq                                          frt_bv_eq
 #define bv_get                                         frt_bv_get
@@ -403,10 +465,12 @@
 #define bv_new_capa                                    frt_bv_new_capa
 #define bv_not                                         frt_bv_not
 #define bv_not_i                                       frt_bv_not_i
+#define bv_not_words                                   frt_bv_not_words
 #define bv_not_x                                       frt_bv_not_x
 #define bv_or                                          frt_bv_or
 #define bv_or_ext                                      frt_bv_or_ext
 #define bv_or_i                                        frt_bv_or_i
+#define bv_or_words                                    frt_bv_or_words
 #define bv_or_x                                        frt_bv_or_x
 #define bv_recount                                     frt_bv_recount
 #define bv_scan_next                                   frt_bv_scan_next
@@ -421,6 +485,7 @@
 #define bv_xor                                         frt_bv_xor
 #define bv_xor_ext                                     frt_bv_xor_ext
 #define bv_xor_i                                       frt_bv_xor_i
+#define bv_xor_words                                   frt_bv_xor_words
 #define bv_xor_x                                       frt_bv_xor_x
 #define byte2float                                     frt_byte2float
 #define cache_destroy                                  frt_cache_destroy
@@ -428,12 +493,22 @@
 #define close_lock                                     frt_close_lock
 #define co_create                                      frt_co_create
 #define co_hash_create                                 frt_co_hash_create
+#define cond_broadcast                                 frt_cond_broadcast
+#define cond_destroy                                   frt_cond_destroy
+#define cond_init                                      frt_cond_init
+#define cond_signal                                    frt_cond_signal
+#define cond_t                                         frt_cond_t
+#define cond_wait                                      frt_cond_wait
 #define count_leading_ones                             frt_count_leading_ones
 #define count_leading_zeros                            frt_count_leading_zeros
 #define count_ones                                     frt_count_ones
+#define count_ones64                                   frt_count_ones64
 #define count_trailing_ones                            frt_count_trailing_ones
+#define count_trailing_ones64                          frt_count_trailing_ones64
 #define count_trailing_zeros                           frt_count_trailing_zeros
+#define count_trailing_zeros64                         frt_count_trailing_zeros64
 #define count_zeros                                    frt_count_zeros
+#define count_zeros64                                  frt_count_zeros64
 #define csq_new                                        frt_csq_new
 #define csq_new_nr                                     frt_csq_new_nr
 #define cw_add_file                                    frt_cw_add_file
@@ -449,6 +524,8 @@
 #define deleter_new                                    frt_deleter_new
 #define df_add_data                                    frt_df_add_data
 #define df_add_data_len                                frt_df_add_data_len
+#define df_add_token                                   frt_df_add_token
+#define df_analyze                                     frt_df_analyze
 #define df_destroy                                     frt_df_destroy
 #define df_new                                         frt_df_new
 #define df_to_s                                        frt_df_to_s
@@ -457,7 +534,20 @@
 #define doc_destroy                                    frt_doc_destroy
 #define doc_get_field                                  frt_doc_get_field
 #define doc_new                                        frt_doc_new
+#define doc_read                                       frt_doc_read
 #define doc_to_s                                       frt_doc_to_s
+#define doc_write                                      frt_doc_write
+#define ds_add                                         frt_ds_add
+#define ds_destroy                                     frt_ds_destroy
+#define ds_from_bv                                     frt_ds_from_bv
+#define ds_get                                         frt_ds_get
+#define ds_memsize                                     frt_ds_memsize
+#define ds_new                                         frt_ds_new
+#define ds_optimize                                    frt_ds_optimize
+#define ds_to_bv                                       frt_ds_to_bv
+#define dsi_init                                       frt_dsi_init
+#define dsi_next                                       frt_dsi_next
+#define dsi_skip_to                                    frt_dsi_skip_to
 #define dummy_free                                     frt_dummy_free
 #define dw_add_doc                                     frt_dw_add_doc
 #define dw_close                                       frt_dw_close
@@ -482,6 +572,7 @@
 #define expl_to_html                                   frt_expl_to_html
 #define expl_to_s                                      frt_expl_to_s
 #define expl_to_s_depth                                frt_expl_to_s_depth
+#define fb_deref                                       frt_fb_deref
 #define fd_destroy                                     frt_fd_destroy
 #define fdshq_lt                                       frt_fdshq_lt
 #define fi_deref                                       frt_fi_deref
@@ -495,6 +586,7 @@
 #define filt_destroy_i                                 frt_filt_destroy_i
 #define filt_eq                                        frt_filt_eq
 #define filt_get_bv                                    frt_filt_get_bv
+#define filt_get_ds                                    frt_filt_get_ds
 #define filt_hash                                      frt_filt_hash
 #define filter_clone_size                              frt_filter_clone_size
 #define filter_ft                                      frt_filter_ft
@@ -515,6 +607,7 @@
 #define fr_clone                                       frt_fr_clone
 #define fr_close                                       frt_fr_close
 #define fr_get_doc                                     frt_fr_get_doc
+#define fr_get_doc_fields                              frt_fr_get_doc_fields
 #define fr_get_field_tv                                frt_fr_get_field_tv
 #define fr_get_lazy_doc                                frt_fr_get_lazy_doc
 #define fr_get_tv                                      frt_fr_get_tv
@@ -618,6 +711,9 @@
 #define int2float                                      frt_int2float
 #define intern                                         frt_intern
 #define intern_and_free                                frt_intern_and_free
+#define ip_add_doc                                     frt_ip_add_doc
+#define ip_close                                       frt_ip_close
+#define ip_new                                         frt_ip_new
 #define ir_add_cache                                   frt_ir_add_cache
 #define ir_close                                       frt_ir_close
 #define ir_commit                                      frt_ir_commit
@@ -626,6 +722,7 @@
 #define ir_destroy                                     frt_ir_destroy
 #define ir_doc_freq                                    frt_ir_doc_freq
 #define ir_get_doc_with_term                           frt_ir_get_doc_with_term
+#define ir_get_docs                                    frt_ir_get_docs
 #define ir_get_field_num                               frt_ir_get_field_num
 #define ir_get_norms                                   frt_ir_get_norms
 #define ir_get_norms_i                                 frt_ir_get_norms_i
@@ -643,6 +740,7 @@
 #define is2os_copy_vints                               frt_is2os_copy_vints
 #define is_clone                                       frt_is_clone
 #define is_close                                       frt_is_close
+#define is_map                                         frt_is_map
 #define is_new                                         frt_is_new
 #define is_pos                                         frt_is_pos
 #define is_read_byte                                   frt_is_read_byte
@@ -667,10 +765,14 @@
 #define iw_delete_term                                 frt_iw_delete_term
 #define iw_delete_terms                                frt_iw_delete_terms
 #define iw_doc_count                                   frt_iw_doc_count
+#define iw_load_docs                                   frt_iw_load_docs
 #define iw_open                                        frt_iw_open
 #define iw_optimize                                    frt_iw_optimize
+#define iw_set_merge_policy                            frt_iw_set_merge_policy
+#define iw_update_doc                                  frt_iw_update_doc
 #define lazy_df_get_bytes                              frt_lazy_df_get_bytes
 #define lazy_df_get_data                               frt_lazy_df_get_data
+#define lazy_df_get_view                               frt_lazy_df_get_view
 #define lazy_doc_close                                 frt_lazy_doc_close
 #define lazy_doc_get                                   frt_lazy_doc_get
 #define legacy_standard_analyzer_new                   frt_legacy_standard_analyzer_new
@@ -680,8 +782,11 @@
 #define letter_analyzer_new                            frt_letter_analyzer_new
 #define letter_tokenizer_new                           frt_letter_tokenizer_new
 #define lmalloc                                        frt_lmalloc
+#define log_merge_policy_new                           frt_log_merge_policy_new
 #define lowercase_filter_new                           frt_lowercase_filter_new
 #define lt_ft                                          frt_lt_ft
+#define lz_compress                                    frt_lz_compress
+#define lz_decompress                                  frt_lz_decompress
 #define mapping_filter_add                             frt_mapping_filter_add
 #define mapping_filter_new                             frt_mapping_filter_new
 #define maq_new                                        frt_maq_new
@@ -730,6 +835,7 @@
 #define mulmap_map                                     frt_mulmap_map
 #define mulmap_map_len                                 frt_mulmap_map_len
 #define mulmap_new                                     frt_mulmap_new
+#define mulmap_scan                                    frt_mulmap_scan
 #define multi_tq_add_term                              frt_multi_tq_add_term
 #define multi_tq_add_term_boost                        frt_multi_tq_add_term_boost
 #define multi_tq_new                                   frt_multi_tq_new
@@ -747,6 +853,7 @@
 #define open_cw                                        frt_open_cw
 #define open_fs_store                                  frt_open_fs_store
 #define open_lock                                      frt_open_lock
+#define open_mmap_store                                frt_open_mmap_store
 #define open_ram_store                                 frt_open_ram_store
 #define open_ram_store_and_copy                        frt_open_ram_store_and_copy
 #define os_close                                       frt_os_close
@@ -807,11 +914,13 @@
 #define qfilt_new_nr                                   frt_qfilt_new_nr
 #define qp_add_field                                   frt_qp_add_field
 #define qp_clean_str                                   frt_qp_clean_str
+#define qp_clear_cache                                 frt_qp_clear_cache
 #define qp_default_fuzzy_min_sim                       frt_qp_default_fuzzy_min_sim
 #define qp_default_fuzzy_pre_len                       frt_qp_default_fuzzy_pre_len
 #define qp_destroy                                     frt_qp_destroy
 #define qp_new                                         frt_qp_new
 #define qp_parse                                       frt_qp_parse
+#define qp_set_cache_size                              frt_qp_set_cache_size
 #define ram_destroy_buffer                             frt_ram_destroy_buffer
 #define ram_new_buffer                                 frt_ram_new_buffer
 #define ramo_length                                    frt_ramo_length
@@ -828,6 +937,7 @@
 #define scorer_destroy_i                               frt_scorer_destroy_i
 #define scorer_doc_cmp                                 frt_scorer_doc_cmp
 #define scorer_doc_less_than                           frt_scorer_doc_less_than
+#define scorer_leapfrog                                frt_scorer_leapfrog
 #define scorer_less_than                               frt_scorer_less_than
 #define scorer_new                                     frt_scorer_new
 #define searcher_close                                 frt_searcher_close
@@ -835,10 +945,13 @@
 #define searcher_explain                               frt_searcher_explain
 #define searcher_explain_w                             frt_searcher_explain_w
 #define searcher_get_doc                               frt_searcher_get_doc
+#define searcher_get_docs                              frt_searcher_get_docs
 #define searcher_get_lazy_doc                          frt_searcher_get_lazy_doc
 #define searcher_get_match_vector                      frt_searcher_get_match_vector
 #define searcher_get_similarity                        frt_searcher_get_similarity
 #define searcher_highlight                             frt_searcher_highlight
+#define searcher_highlight_docs                        frt_searcher_highlight_docs
+#define searcher_highlight_td                          frt_searcher_highlight_td
 #define searcher_max_doc                               frt_searcher_max_doc
 #define searcher_rewrite                               frt_searcher_rewrite
 #define searcher_search                                frt_searcher_search
@@ -921,6 +1034,7 @@
 #define ste_close                                      frt_ste_close
 #define ste_new                                        frt_ste_new
 #define stem_filter_new                                frt_stem_filter_new
+#define stem_filter_set_cache_size                     frt_stem_filter_set_cache_size
 #define stop_filter_new                                frt_stop_filter_new
 #define stop_filter_new_with_words                     frt_stop_filter_new_with_words
 #define stop_filter_new_with_words_len                 frt_stop_filter_new_with_words_len
@@ -946,15 +1060,27 @@
 #define term_hash                                      frt_term_hash
 #define term_new                                       frt_term_new
 #define tf_new_i                                       frt_tf_new_i
+#define th_clear                                       frt_th_clear
+#define th_destroy                                     frt_th_destroy
+#define th_get                                         frt_th_get
+#define th_hash                                        frt_th_hash
+#define th_new                                         frt_th_new
+#define th_set_ext                                     frt_th_set_ext
+#define th_slot_is_full                                frt_th_slot_is_full
+#define thread_create                                  frt_thread_create
 #define thread_exit                                    frt_thread_exit
 #define thread_getspecific                             frt_thread_getspecific
+#define thread_join                                    frt_thread_join
 #define thread_key_create                              frt_thread_key_create
 #define thread_key_delete                              frt_thread_key_delete
 #define thread_key_t                                   frt_thread_key_t
 #define thread_once                                    frt_thread_once
 #define thread_once_t                                  frt_thread_once_t
 #define thread_setspecific                             frt_thread_setspecific
+#define thread_t                                       frt_thread_t
 #define ti_set                                         frt_ti_set
+#define tiered_merge_policy_new                        frt_tiered_merge_policy_new
+#define tir_cache_stats                                frt_tir_cache_stats
 #define tir_close                                      frt_tir_close
 #define tir_get_term                                   frt_tir_get_term
 #define tir_get_ti                                     frt_tir_get_ti
@@ -970,6 +1096,10 @@
 #define tk_new                                         frt_tk_new
 #define tk_set                                         frt_tk_set
 #define tk_set_no_len                                  frt_tk_set_no_len
+#define tk_text                                        frt_tk_text
+#define tkl_add                                        frt_tkl_add
+#define tkl_destroy                                    frt_tkl_destroy
+#define tkl_new                                        frt_tkl_new
 #define tq_new                                         frt_tq_new
 #define trfilt_new                                     frt_trfilt_new
 #define trq_new                                        frt_trq_new
@@ -991,6 +1121,8 @@
 #define u64                                            frt_u64
 #define u64malloc                                      frt_u64malloc
 #define uchar                                          frt_uchar
+#define utf8_downcase                                  frt_utf8_downcase
+#define utf8_lowercase_filter_new                      frt_utf8_lowercase_filter_new
 #define utf8_standard_analyzer_new                     frt_utf8_standard_analyzer_new
 #define utf8_standard_analyzer_new_with_words          frt_utf8_standard_analyzer_new_with_words
 #define utf8_standard_analyzer_new_with_words_len      frt_utf8_standard_analyzer_new_with_words_len
@@ -43,14 +43,29 @@ typedef struct FrtMultiMapper
     int nsize;
     int *next_states;
     int ref_cnt;
+    /* bitmap of the bytes patterns start with. No match can start with any
+     * other byte */
+    unsigned char first_bytes[32];
+    /* every pattern starts with a byte above 0x7f */
+    bool ascii_unmapped;
+    /* no replacement is longer than its pattern */
+    bool never_grows;
 } FrtMultiMapper;
 
+#define FRT_MULMAP_IS_FIRST(self, c)\
+    ((self)->first_bytes[(unsigned char)(c) >> 3]\
+     & (1 << ((unsigned char)(c) & 7)))
+
 extern FrtMultiMapper *frt_mulmap_new();
 extern void frt_mulmap_add_mapping(FrtMultiMapper *self, const char *p, const char *r);
 extern void frt_mulmap_compile(FrtMultiMapper *self);
 extern char *frt_mulmap_map(FrtMultiMapper *self, char *to, char *from, int capa);
 extern char *frt_mulmap_dynamic_map(FrtMultiMapper *self, char *from);
+/* +to+ may be the same as +from+ if the mapper never_grows */
 extern int frt_mulmap_map_len(FrtMultiMapper *self, char *to, char *from, int capa);
+/* Returns the offset of the first byte in the +len+ bytes of +text+ which
+ * could start a match, or +len+ if nothing in +text+ would be mapped. */
+extern int frt_mulmap_scan(FrtMultiMapper *self, const char *text, int len);
 extern void frt_mulmap_destroy(FrtMultiMapper *self);
 
 #ifdef __cplusplus
@@ -11,6 +11,7 @@ typedef struct FrtScorer FrtScorer;
 
 #include "index.h"
 #include "bitvector.h"
+#include "doc_set.h"
 #include "similarity.h"
 #include "field_index.h"
 
@@ -101,6 +102,10 @@ extern char *frt_td_to_s(FrtTopDocs *td);
  *
  * FrtFilter
  *
+ * A Filter's get_bv_i method builds a FrtBitVector of the docs it allows.
+ * The result is cached for each FrtIndexReader as a compressed FrtDocSet so
+ * that many cached filters can be kept for a large index.
+ *
  ***************************************************************************/
 
 typedef struct FrtFilter
@@ -118,6 +123,7 @@ typedef struct FrtFilter
 #define filt_new(type) frt_filt_create(sizeof(type), frt_intern(#type))
 extern FrtFilter *frt_filt_create(size_t size, FrtSymbol name);
 extern FrtBitVector *frt_filt_get_bv(FrtFilter *filt, FrtIndexReader *ir);
+extern FrtDocSet *frt_filt_get_ds(FrtFilter *filt, FrtIndexReader *ir);
 extern void frt_filt_destroy_i(FrtFilter *filt);
 extern void frt_filt_deref(FrtFilter *filt);
 extern unsigned long frt_filt_hash(FrtFilter *filt);
@@ -640,6 +646,21 @@ extern bool frt_scorer_less_than(void *p1, void *p2);
 extern bool frt_scorer_doc_less_than(const FrtScorer *s1, const FrtScorer *s2);
 extern int frt_scorer_doc_cmp(const void *p1, const void *p2);
 
+/**
+ * Move +self+ and +dsi+ to the first doc >= +doc_num+ which both of them
+ * match. The two are leapfrogged, each skipping to the other's current doc,
+ * so whichever is sparser drives the search. +self+ is only moved with
+ * skip_to and must be behind +doc_num+. Pass +dsi->doc + 1+ as +doc_num+ to
+ * get the next match.
+ *
+ * @param self the FrtScorer to filter
+ * @param dsi iterator for the docs allowed by the filter
+ * @param doc_num the doc to start looking from
+ * @return true if a matching doc was found. It is left in +self->doc+
+ */
+extern bool frt_scorer_leapfrog(FrtScorer *self, FrtDocSetIterator *dsi,
+                                int doc_num);
+
 /***************************************************************************
  * FrtComparable
  ***************************************************************************/
@@ -775,6 +796,9 @@ struct FrtSearcher
                              const char *term);
     FrtDocument    *(*get_doc)(FrtSearcher *self, int doc_num);
     FrtLazyDoc     *(*get_lazy_doc)(FrtSearcher *self, int doc_num);
+    /* see frt_ir_get_docs */
+    FrtDocument   **(*get_docs)(FrtSearcher *self, const int *doc_nums,
+                                int cnt, FrtSymbol *fields, int field_cnt);
     int          (*max_doc)(FrtSearcher *self);
     FrtWeight      *(*create_weight)(FrtSearcher *self, FrtQuery *query);
     FrtTopDocs     *(*search)(FrtSearcher *self, FrtQuery *query, int first_doc,
@@ -824,6 +848,7 @@ struct FrtSearcher
 #define frt_searcher_doc_freq(s, t)         s->doc_freq(s, t)
 #define frt_searcher_get_doc(s, dn)         s->get_doc(s, dn)
 #define frt_searcher_get_lazy_doc(s, dn)    s->get_lazy_doc(s, dn)
+#define frt_searcher_get_docs(s, dns, c, fs, fc) s->get_docs(s, dns, c, fs, fc)
 #define frt_searcher_max_doc(s)             s->max_doc(s)
 #define frt_searcher_rewrite(s, q)          s->rewrite(s, q)
 #define frt_searcher_explain(s, q, dn)      s->explain(s, q, dn)
@@ -854,6 +879,37 @@ extern char **frt_searcher_highlight(FrtSearcher *self,
                                  const char *post_tag,
                                  const char *ellipsis);
 
+/**
+ * Highlight +field+ in each of the +doc_cnt+ documents in +doc_nums+. The
+ * query is rewritten only once and the documents are loaded in doc-id order.
+ * Returns an array of +doc_cnt+ excerpt arrays (as returned by
+ * frt_searcher_highlight) in the same order as +doc_nums+. Each excerpt array
+ * may be NULL and should be destroyed with frt_ary_destroy(excerpts, &free)
+ * before the outer array is free'd.
+ */
+extern char ***frt_searcher_highlight_docs(FrtSearcher *self,
+                                           FrtQuery *query,
+                                           const int *doc_nums,
+                                           const int doc_cnt,
+                                           FrtSymbol field,
+                                           const int excerpt_len,
+                                           const int num_excerpts,
+                                           const char *pre_tag,
+                                           const char *post_tag,
+                                           const char *ellipsis);
+/**
+ * Same as frt_searcher_highlight_docs but highlights the hits in +td+.
+ */
+extern char ***frt_searcher_highlight_td(FrtSearcher *self,
+                                         FrtQuery *query,
+                                         FrtTopDocs *td,
+                                         FrtSymbol field,
+                                         const int excerpt_len,
+                                         const int num_excerpts,
+                                         const char *pre_tag,
+                                         const char *post_tag,
+                                         const char *ellipsis);
+
 /***************************************************************************
  *
  * FrtIndexSearcher
@@ -903,36 +959,69 @@ typedef struct FrtFieldStack {
     bool destroy : 1;
 } FrtFieldStack;
 
+/* Each thread parsing with a QParser keeps its own cache of the queries it
+ * has parsed, so a cached Query is only ever shared within one thread, along
+ * with the token streams its parses use. */
+typedef struct FrtQParserCacheEntry
+{
+    struct FrtQParserCacheEntry *prev;
+    struct FrtQParserCacheEntry *next;
+    char *key;
+    FrtQuery *query;
+} FrtQParserCacheEntry;
+
+typedef struct FrtQParserCache
+{
+    FrtHash *entries;
+    FrtQParserCacheEntry *head; /* most recently used */
+    FrtQParserCacheEntry *tail; /* next to be evicted */
+    int gen;                    /* cleared when it differs from cache_gen */
+    char *key_buf;
+    int key_capa;
+    frt_u64 hits;
+    frt_u64 misses;
+    FrtHash *ts_cache;          /* field => TokenStream */
+    FrtTokenStream *non_tokenizer;
+    struct FrtQueryParser *qp;  /* the parser whose cache_bucket holds it */
+} FrtQParserCache;
+
+/* A QParser can be shared by any number of threads once it has been set up.
+ * frt_qp_parse never changes it, instead working on a copy of the parser on
+ * its own stack. The fields from qstr on are only used in that copy. */
 typedef struct FrtQueryParser
 {
-    frt_mutex_t mutex;
     int def_slop;
     int max_clauses;
     int phq_pos_inc;
-    char *qstr;
-    char *qstrp;
-    char buf[FRT_QP_CONC_WORDS][FRT_MAX_WORD_SIZE];
-    char *dynbuf;
-    int  buf_index;
     FrtHash *field_cache;
     FrtHashSet *def_fields;
     FrtHashSet *all_fields;
     FrtHashSet *tokenized_fields;
-    FrtHashSet *fields;
-    FrtFieldStack *fields_top;
     FrtAnalyzer *analyzer;
-    FrtHash *ts_cache;
-    FrtQuery *result;
-    FrtTokenStream *non_tokenizer;
+    int cache_size;             /* per thread, 0 to disable the cache */
+    int cache_gen;
+    frt_thread_key_t thread_cache;
+    FrtHashSet *cache_bucket;   /* every thread's cache, to free them */
     bool or_default : 1;
     bool wild_lower : 1;
     bool clean_str : 1;
     bool handle_parse_errors : 1;
     bool allow_any_fields : 1;
-    bool destruct : 1;
-    bool recovering : 1;
     bool use_keywords : 1;
     bool use_typed_range_query : 1;
+
+    char *qstr;
+    char *qstrp;
+    char buf[FRT_QP_CONC_WORDS][FRT_MAX_WORD_SIZE];
+    char *dynbuf;
+    int  buf_index;
+    FrtHashSet *fields;
+    FrtFieldStack *fields_top;
+    FrtHash *ts_cache;          /* the thread's, see FrtQParserCache */
+    FrtQuery *result;
+    FrtTokenStream *non_tokenizer;
+    bool destruct : 1;
+    bool recovering : 1;
 } FrtQueryParser;
 typedef FrtQueryParser FrtQParser; /* QParser is an alias for QueryParser */
 
@@ -941,6 +1030,14 @@ extern void frt_qp_add_field(FrtQParser *self, FrtSymbol field,
                              bool is_default, bool is_tokenized);
 extern void frt_qp_destroy(FrtQParser *self);
 extern FrtQuery *frt_qp_parse(FrtQParser *self, char *qstr);
+/* Cache up to +size+ parsed queries in each thread, evicting the least
+ * recently used. Parsing a query string again with the same default fields
+ * and options returns the cached Query, so queries returned by frt_qp_parse
+ * must not be modified while the cache is enabled. */
+extern void frt_qp_set_cache_size(FrtQParser *self, int size);
+/* Drop the cached queries. Call this after changing all_fields, def_fields
+ * or tokenized_fields other than through frt_qp_add_field. */
+extern void frt_qp_clear_cache(FrtQParser *self);
 extern char *frt_qp_clean_str(char *str);
 
 extern float frt_qp_default_fuzzy_min_sim;
@@ -112,6 +112,20 @@ struct FrtInStreamMethods
      * @raise FRT_IO_ERROR if the close fails
      */
     void (*close_i)(struct FrtInStream *is);
+
+    /**
+     * Return a pointer to +len+ bytes at position +pos+ of the input stream
+     * +is+ without copying them. The bytes stay valid until the stream and
+     * all its clones are closed. Streams which aren't memory mapped set this
+     * to NULL.
+     *
+     * @param is self
+     * @param pos the position of the bytes in the stream
+     * @param len the number of bytes needed
+     * @return a pointer to the bytes or NULL if they can't be mapped
+     * @raise FRT_EOF_ERROR if the bytes run past the end of the stream
+     */
+    const frt_uchar *(*map_i)(struct FrtInStream *is, off_t pos, int len);
 };
 
 struct FrtInStream
@@ -121,11 +135,13 @@ struct FrtInStream
     {
         int fd;
         FrtRAMFile *rf;
+        frt_uchar *map;         /* only used by MMapIn */
     } file;
     union
     {
         off_t pointer;          /* only used by RAMIn */
         char *path;             /* only used by FSIn */
+        off_t length;           /* only used by MMapIn */
         FrtCompoundInStream *cis;
     } d;
     int *ref_cnt_ptr;
@@ -331,6 +347,20 @@ struct FrtStore
  */
 extern FrtStore *frt_open_fs_store(const char *pathname);
 
+/**
+ * Create a newly allocated file-system FrtStore at the pathname designated
+ * which memory maps the files it opens for reading. Apart from that it works
+ * the same as a store opened with frt_open_fs_store and the two can be used
+ * on the same directory. Reading from a mapped file doesn't need a system
+ * call and data can be read in place using frt_is_map.
+ *
+ * On systems without mmap this is the same as frt_open_fs_store.
+ *
+ * @param pathname the pathname of the directory to be used by the index
+ * @return a newly allocated memory mapped file-system FrtStore.
+ */
+extern FrtStore *frt_open_mmap_store(const char *pathname);
+
 /**
  * Create a newly allocated in-memory or RAM FrtStore.
  *
@@ -645,6 +675,21 @@ extern FRT_INLINE frt_uchar frt_is_read_byte(FrtInStream *is);
  */
 extern frt_uchar *frt_is_read_bytes(FrtInStream *is, frt_uchar *buf, int len);
 
+/**
+ * Get a pointer to +len+ bytes at position +pos+ in FrtInStream +is+ without
+ * copying them. This only works for streams opened from a store created with
+ * frt_open_mmap_store (or compound files within such a store). The bytes
+ * stay valid until +is+ and all of its clones are closed. The current
+ * position of +is+ isn't changed.
+ *
+ * @param is     the FrtInStream to read from
+ * @param pos    the position of the bytes in the stream
+ * @param len    the number of bytes needed
+ * @return       a pointer to the bytes or NULL if +is+ isn't memory mapped
+ * @raise FRT_EOF_ERROR if the bytes run past the end of the file
+ */
+extern const frt_uchar *frt_is_map(FrtInStream *is, off_t pos, int len);
+
 /**
  * Read a 32-bit unsigned integer from the FrtInStream.
  *
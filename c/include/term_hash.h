@@ -0,0 +1,122 @@
+#ifndef FRT_TERM_HASH_H
+#define FRT_TERM_HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "global.h"
+
+/****************************************************************************
+ *
+ * FrtTermHash
+ *
+ * A flat open-addressing hash table keyed by (term, length) pairs. It is
+ * used by the DocWriter to map each term to its PostingList. Each slot has a
+ * control byte holding the low 7 bits of the term's hash (or FRT_TH_EMPTY) so
+ * that a whole group of FRT_TH_GROUP_WIDTH slots can be checked at once, with
+ * SSE2 where it is available. The full hash is cached in the slot so keys are
+ * only compared on a probable match and never need to be rehashed when the
+ * table grows.
+ *
+ * There is no delete operation. Entries are only ever removed all at once
+ * with frt_th_clear.
+ *
+ ****************************************************************************/
+
+#define FRT_TH_MIN_CAPA 16
+#define FRT_TH_GROUP_WIDTH 16
+#define FRT_TH_EMPTY 0x80
+
+typedef struct FrtTermHashSlot
+{
+    frt_u32 hash;
+    int len;
+    const char *term;
+    void *value;
+} FrtTermHashSlot;
+
+typedef struct FrtTermHash
+{
+    int size;           /* number of terms in the table */
+    int mask;           /* capacity of the table - 1 */
+    int growth_left;    /* number of terms we can add before resizing */
+
+    /* one control byte per slot followed by a copy of the first
+     * FRT_TH_GROUP_WIDTH control bytes so groups can be loaded at any slot
+     * without wrapping */
+    frt_uchar *ctrl;
+    FrtTermHashSlot *slots;
+} FrtTermHash;
+
+/**
+ * Hash a term for use with a FrtTermHash. The term does not need to be null
+ * terminated.
+ *
+ * @param term the term to hash
+ * @param len the length of the term in bytes
+ * @return the hash value for the term
+ */
+extern frt_u32 frt_th_hash(const char *term, int len);
+
+/**
+ * Create a new FrtTermHash.
+ *
+ * @return a newly allocated FrtTermHash
+ */
+extern FrtTermHash *frt_th_new(void);
+
+/**
+ * Destroy the FrtTermHash. The terms and values are not free'd.
+ *
+ * @param self the FrtTermHash to destroy
+ */
+extern void frt_th_destroy(FrtTermHash *self);
+
+/**
+ * Remove all terms from the FrtTermHash without releasing its memory.
+ *
+ * @param self the FrtTermHash to clear
+ */
+extern void frt_th_clear(FrtTermHash *self);
+
+/**
+ * Get the value stored for +term+.
+ *
+ * @param self the FrtTermHash to look in
+ * @param term the term to look for
+ * @param len the length of +term+
+ * @return the value stored for +term+ or NULL if it isn't in the table
+ */
+extern void *frt_th_get(FrtTermHash *self, const char *term, int len);
+
+/**
+ * Find the slot for +term+, adding a new one if +term+ isn't already in the
+ * table. The hash must be the value returned by frt_th_hash so it can be
+ * shared between tables.
+ *
+ * When a new slot is added its +term+ points to the +term+ passed in and its
+ * +value+ is NULL. If +term+ won't live as long as the FrtTermHash then
+ * the caller should point the slot's +term+ at a persistent copy.
+ *
+ * @param self the FrtTermHash to add the term to
+ * @param term the term to look for
+ * @param len the length of +term+
+ * @param hash the hash of +term+ as returned by frt_th_hash
+ * @param slot the slot for +term+ will be returned here
+ * @return true if a new slot was added for +term+
+ */
+extern bool frt_th_set_ext(FrtTermHash *self, const char *term, int len,
+                           frt_u32 hash, FrtTermHashSlot **slot);
+
+/**
+ * Check whether the slot at index +i+ holds a term. Use this to iterate
+ * through the (mask + 1) slots of the table.
+ */
+#define frt_th_slot_is_full(th, i) (((th)->ctrl[i] & FRT_TH_EMPTY) == 0)
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
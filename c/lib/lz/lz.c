@@ -0,0 +1,187 @@
+#include <string.h>
+#include "lz.h"
+
+#define LZ_MIN_MATCH      4
+#define LZ_MAX_OFFSET     65535
+#define LZ_HASH_LOG       12
+#define LZ_HASH_SIZE      (1 << LZ_HASH_LOG)
+/* keep the end of the input as literals so the match finder can always read
+ * 4 bytes ahead without checking the bounds */
+#define LZ_LAST_LITERALS  5
+#define LZ_MATCH_LIMIT    12
+/* skip ahead faster through input that isn't compressing */
+#define LZ_SKIP_TRIGGER   6
+
+typedef unsigned char lz_uchar;
+typedef unsigned int  lz_u32;
+
+static lz_u32 lz_read32(const lz_uchar *p)
+{
+    lz_u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int lz_hash(lz_u32 seq)
+{
+    return (int)((seq * 2654435761U) >> (32 - LZ_HASH_LOG));
+}
+
+static lz_uchar *lz_write_len(lz_uchar *op, int len)
+{
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (lz_uchar)len;
+    return op;
+}
+
+static lz_uchar *lz_write_literals(lz_uchar *op, const lz_uchar *lit,
+                                   int lit_len, int match_len)
+{
+    lz_uchar *token = op++;
+    *token = (lz_uchar)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = lz_write_len(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len >= 0) {
+        *token |= (lz_uchar)(match_len >= 15 ? 15 : match_len);
+    }
+    return op;
+}
+
+int frt_lz_compress(const char *src, int src_len, char *dst)
+{
+    const lz_uchar *const base = (const lz_uchar *)src;
+    const lz_uchar *const end = base + src_len;
+    const lz_uchar *ip = base, *anchor = base;
+    lz_uchar *op = (lz_uchar *)dst;
+    int table[LZ_HASH_SIZE];
+
+    if (src_len >= LZ_MATCH_LIMIT + 1) {
+        const lz_uchar *const match_limit = end - LZ_MATCH_LIMIT;
+        const lz_uchar *const copy_limit = end - LZ_LAST_LITERALS;
+        memset(table, 0xff, sizeof(table));
+
+        while (ip < match_limit) {
+            const lz_u32 seq = lz_read32(ip);
+            const int h = lz_hash(seq);
+            const int ref = table[h];
+            table[h] = (int)(ip - base);
+
+            if (ref >= 0 && (ip - base) - ref <= LZ_MAX_OFFSET
+                && lz_read32(base + ref) == seq) {
+                const lz_uchar *match = base + ref;
+                const int offset = (int)(ip - match);
+                int match_len = LZ_MIN_MATCH;
+
+                /* extend the match backwards over pending literals */
+                while (ip > anchor && match > base && ip[-1] == match[-1]) {
+                    ip--;
+                    match--;
+                }
+                while (ip + match_len < copy_limit
+                       && match[match_len] == ip[match_len]) {
+                    match_len++;
+                }
+
+                op = lz_write_literals(op, anchor, (int)(ip - anchor),
+                                       match_len - LZ_MIN_MATCH);
+                *op++ = (lz_uchar)(offset & 0xff);
+                *op++ = (lz_uchar)(offset >> 8);
+                if (match_len - LZ_MIN_MATCH >= 15) {
+                    op = lz_write_len(op, match_len - LZ_MIN_MATCH - 15);
+                }
+
+                ip += match_len;
+                anchor = ip;
+                if (ip < match_limit) {
+                    /* index a position inside the match for the next one */
+                    table[lz_hash(lz_read32(ip - 2))] = (int)(ip - 2 - base);
+                }
+            }
+            else {
+                ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+            }
+        }
+    }
+
+    op = lz_write_literals(op, anchor, (int)(end - anchor), -1);
+    return (int)(op - (lz_uchar *)dst);
+}
+
+/* read the extra length bytes following a length of 15 in a token */
+static int lz_read_len(const lz_uchar **ipp, const lz_uchar *end, int len)
+{
+    const lz_uchar *ip = *ipp;
+    lz_uchar b;
+    do {
+        if (ip >= end || len > (1 << 30)) {
+            return -1;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    *ipp = ip;
+    return len;
+}
+
+int frt_lz_decompress(const char *src, int src_len, char *dst, int dst_capa)
+{
+    const lz_uchar *ip = (const lz_uchar *)src;
+    const lz_uchar *const end = ip + src_len;
+    lz_uchar *op = (lz_uchar *)dst;
+    lz_uchar *const op_start = op;
+    lz_uchar *const op_end = op + dst_capa;
+
+    while (ip < end) {
+        const int token = *ip++;
+        int lit_len = token >> 4;
+        int match_len = token & 15;
+        int offset;
+        const lz_uchar *match;
+
+        if (lit_len == 15 && (lit_len = lz_read_len(&ip, end, 15)) < 0) {
+            return -1;
+        }
+        if (lit_len > end - ip || lit_len > op_end - op) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip >= end) {
+            break; /* the last sequence has no match */
+        }
+        if (end - ip < 2) {
+            return -1;
+        }
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (match_len == 15
+            && (match_len = lz_read_len(&ip, end, 15)) < 0) {
+            return -1;
+        }
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op - op_start
+            || match_len > op_end - op) {
+            return -1;
+        }
+
+        match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+        }
+        else {
+            /* overlapping match repeats the last +offset+ bytes */
+            while (match_len-- > 0) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return (int)(op - op_start);
+}
@@ -0,0 +1,44 @@
+#ifndef FRT_LZ_H
+#define FRT_LZ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/****************************************************************************
+ *
+ * A small LZ77 block codec used to compress stored fields.
+ *
+ * It trades compression ratio for speed. There is no entropy coding, just
+ * runs of literals and back-references of up to 64Kb, so decompression is
+ * little more than a sequence of memcpys. The encoding is the same sequence
+ * format as LZ4 blocks;
+ *
+ *   token:     high 4 bits literal count, low 4 bits match length - 4.
+ *              15 in either means more length bytes follow, each adding up
+ *              to 255 until a byte less than 255.
+ *   literals:  the literal bytes
+ *   offset:    2 byte little-endian distance back to the match
+ *
+ * The last sequence only holds literals.
+ *
+ ****************************************************************************/
+
+/* the largest compressed size of +len+ bytes of input */
+#define FRT_LZ_COMPRESS_BOUND(len) ((len) + ((len) / 255) + 16)
+
+/* Compress +src_len+ bytes of +src+ into +dst+ which must have space for at
+ * least FRT_LZ_COMPRESS_BOUND(src_len) bytes. Returns the compressed length. */
+extern int frt_lz_compress(const char *src, int src_len, char *dst);
+
+/* Decompress +src_len+ bytes of +src+ into +dst+ which has space for
+ * +dst_capa+ bytes. Returns the decompressed length or -1 if the data is
+ * corrupt or won't fit in +dst+. Never reads or writes out of bounds. */
+extern int frt_lz_decompress(const char *src, int src_len,
+                             char *dst, int dst_capa);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -1,3 +1,6 @@
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 #include "analysis.h"
 #include "hash.h"
 #include "libstemmer.h"
@@ -26,16 +29,10 @@ INLINE Token *tk_set(Token *tk,
     tk->start = start;
     tk->end = end;
     tk->pos_inc = pos_inc;
+    tk->ref = NULL;
     return tk;
 }
 
-static INLINE Token *tk_set_ts(Token *tk, char *start, char *end,
-                               char *text, int pos_inc)
-{
-    return tk_set(tk, start, (int)(end - start),
-                  (off_t)(start - text), (off_t)(end - text), pos_inc);
-}
-
 INLINE Token *tk_set_no_len(Token *tk,
                             char *text, off_t start, off_t end, int pos_inc)
 {
@@ -51,12 +48,23 @@ static INLINE Token *w_tk_set(Token *tk, wchar_t *text, off_t start,
     tk->start = start;
     tk->end = end;
     tk->pos_inc = pos_inc;
+    tk->ref = NULL;
     return tk;
 }
 
+char *tk_text(Token *tk)
+{
+    if (tk->ref) {
+        memcpy(tk->text, tk->ref, tk->len);
+        tk->text[tk->len] = '\0';
+        tk->ref = NULL;
+    }
+    return tk->text;
+}
+
 int tk_eq(Token *tk1, Token *tk2)
 {
-    return (strcmp((char *)tk1->text, (char *)tk2->text) == 0 &&
+    return (strcmp(tk_text(tk1), tk_text(tk2)) == 0 &&
             tk1->start == tk2->start && tk1->end == tk2->end &&
             tk1->pos_inc == tk2->pos_inc);
 }
@@ -78,7 +86,7 @@ int tk_cmp(Token *tk1, Token *tk2)
             cmp = -1;
         }
         else {
-            cmp = strcmp((char *)tk1->text, (char *)tk2->text);
+            cmp = strcmp(tk_text(tk1), tk_text(tk2));
         }
     }
     return cmp;
@@ -100,6 +108,12 @@ Token *tk_new()
  *
  ****************************************************************************/
 
+#ifndef UNTHREADED
+/* clones of a StopFilter or MappingFilter share its words or mapper, and the
+ * clones can be made and destroyed in different threads */
+static mutex_t shared_ref_mutex = MUTEX_INITIALIZER;
+#endif
+
 void ts_deref(TokenStream *ts)
 {
     if (--ts->ref_cnt <= 0) {
@@ -110,6 +124,7 @@ void ts_deref(TokenStream *ts)
 static TokenStream *ts_reset(TokenStream *ts, char *text)
 {
     ts->t = ts->text = text;
+    ts->zero_copy = false;
     return ts;
 }
 
@@ -150,6 +165,24 @@ static TokenStream *cts_new()
     return ts;
 }
 
+/* set the token to the text from +start+ to +end+, copying it only if the
+ * consumer hasn't asked for zero_copy tokens */
+static INLINE Token *cts_set_ts(TokenStream *ts, char *start, char *end,
+                                int pos_inc)
+{
+    Token *tk = &(CTS(ts)->token);
+    if (ts->zero_copy) {
+        tk->ref = start;
+        tk->len = min2((int)(end - start), MAX_WORD_SIZE - 1);
+        tk->start = (off_t)(start - ts->text);
+        tk->end = (off_t)(end - ts->text);
+        tk->pos_inc = pos_inc;
+        return tk;
+    }
+    return tk_set(tk, start, (int)(end - start), (off_t)(start - ts->text),
+                  (off_t)(end - ts->text), pos_inc);
+}
+
 /* * Multi-byte TokenStream * */
 
 #define MBTS(token_stream) ((MultiByteTokenStream *)(token_stream))
@@ -197,9 +230,40 @@ static TokenStream *mb_ts_new()
  *
  ****************************************************************************/
 
+/* A thread's own stream and the analyzer it belongs to */
+typedef struct ThreadTS
+{
+    Analyzer *a;
+    TokenStream *ts;
+} ThreadTS;
+
+static void thread_ts_destroy(ThreadTS *tts)
+{
+    /* streams still held by their callers outlive the analyzer */
+    ts_deref(tts->ts);
+    free(tts);
+}
+
+/* called when a thread exits so that its stream isn't kept until the
+ * analyzer is destroyed */
+static void thread_ts_exit(void *p)
+{
+    ThreadTS *tts = (ThreadTS *)p;
+    Analyzer *a = tts->a;
+    mutex_lock(&a->ts_mutex);
+    hs_del(a->ts_bucket, tts);
+    mutex_unlock(&a->ts_mutex);
+}
+
 void a_deref(Analyzer *a)
 {
     if (--a->ref_cnt <= 0) {
+        if (a->ts_bucket) {
+            thread_setspecific(a->thread_ts, NULL);
+            thread_key_delete(a->thread_ts);
+            hs_destroy(a->ts_bucket);
+            mutex_destroy(&a->ts_mutex);
+        }
         a->destroy_i(a);
     }
 }
@@ -217,8 +281,31 @@ static TokenStream *a_standard_get_ts(Analyzer *a,
                                       char *text)
 {
     TokenStream *ts;
+    ThreadTS *tts;
     (void)field;
-    ts = ts_clone(a->current_ts);
+    if (NULL == a->ts_bucket) {
+        /* no thread key could be made so every caller gets a clone */
+        ts = ts_clone(a->current_ts);
+        return ts->reset(ts, text);
+    }
+    tts = (ThreadTS *)thread_getspecific(a->thread_ts);
+    if (NULL == tts) {
+        tts = ALLOC(ThreadTS);
+        tts->a = a;
+        tts->ts = ts_clone(a->current_ts);
+        mutex_lock(&a->ts_mutex);
+        hs_add(a->ts_bucket, tts);
+        mutex_unlock(&a->ts_mutex);
+        thread_setspecific(a->thread_ts, tts);
+    }
+    ts = tts->ts;
+    if (ts->ref_cnt > 1) {
+        /* this thread's stream is still in use so it gets a fresh one */
+        ts = ts_clone(a->current_ts);
+    }
+    else {
+        REF(ts);
+    }
     return ts->reset(ts, text);
 }
 
@@ -233,6 +320,13 @@ Analyzer *analyzer_new(TokenStream *ts,
     a->destroy_i = (destroy_i ? destroy_i : &a_standard_destroy_i);
     a->get_ts = (get_ts ? get_ts : &a_standard_get_ts);
     a->ref_cnt = 1;
+    if (0 == thread_key_create(&a->thread_ts, &thread_ts_exit)) {
+        mutex_init(&a->ts_mutex, NULL);
+        a->ts_bucket = hs_new_ptr((free_ft)&thread_ts_destroy);
+    }
+    else {
+        a->ts_bucket = NULL;
+    }
     return a;
 }
 
@@ -301,7 +395,7 @@ static Token *wst_next(TokenStream *ts)
     }
 
     ts->t = t;
-    return tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+    return cts_set_ts(ts, start, t, 1);
 }
 
 TokenStream *whitespace_tokenizer_new()
@@ -339,7 +433,7 @@ static Token *mb_wst_next(TokenStream *ts)
         i = mb_next_char(&wchr, t, state);
     }
     ts->t = t;
-    return tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+    return cts_set_ts(ts, start, t, 1);
 }
 
 /*
@@ -438,7 +532,7 @@ static Token *lt_next(TokenStream *ts)
     }
 
     ts->t = t;
-    return tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+    return cts_set_ts(ts, start, t, 1);
 }
 
 TokenStream *letter_tokenizer_new()
@@ -477,7 +571,7 @@ static Token *mb_lt_next(TokenStream *ts)
         i = mb_next_char(&wchr, t, state);
     }
     ts->t = t;
-    return tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+    return cts_set_ts(ts, start, t, 1);
 }
 
 /*
@@ -558,7 +652,86 @@ Analyzer *mb_letter_analyzer_new(bool lowercase)
 
 /*
  * StandardTokenizer
+ *
+ * Most text is plain ASCII words separated by spaces so rather than run every
+ * byte through the scanner, std_next first skips whitespace and looks for a
+ * run of ASCII letters and digits 16 bytes at a time. If the run ends at a
+ * byte that can't continue any of the scanner's tokens (an email, URL,
+ * acronym, number, contraction or hyphenated word) it is exactly the token
+ * the scanner would return so it is emitted directly. Anything else is left
+ * to the scanner. The multibyte tokenizer always uses the scanner as what
+ * counts as a letter depends on the locale.
  */
+static INLINE bool std_is_space(uchar c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static INLINE bool std_is_alnum(uchar c)
+{
+    return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || (c >= '0' && c <= '9');
+}
+
+/* bytes which end a token and can't be part of a longer match */
+static INLINE bool std_is_term(uchar c, StandardTokenizerType type)
+{
+    switch (c) {
+        case '\0': case ',': case ';': case '(': case ')': case '"':
+        case '<': case '>': case '[': case ']': case '\\':
+            return true;
+        default:
+            /* non-ASCII bytes may be letters in UTF-8 */
+            return std_is_space(c) || (c >= 0x80 && type == STT_ASCII);
+    }
+}
+
+static const char *std_skip_space(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    while (p + 16 <= end) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)p);
+        /* signed compares leave bytes above 0x7f out of every range */
+        const __m128i space = _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+            _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                          _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1))));
+        const int mask = ~_mm_movemask_epi8(space) & 0xffff;
+        if (mask) {
+            return p + count_trailing_zeros(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && std_is_space(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *std_skip_alnum(const char *p, const char *end)
+{
+#ifdef __SSE2__
+    while (p + 16 <= end) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)p);
+        const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i alnum = _mm_or_si128(
+            _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                          _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1))),
+            _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                          _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+        const int mask = ~_mm_movemask_epi8(alnum) & 0xffff;
+        if (mask) {
+            return p + count_trailing_zeros(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && std_is_alnum(*p)) {
+        p++;
+    }
+    return p;
+}
+
 static Token *std_next(TokenStream *ts)
 {
     StandardTokenizer *std_tz = STDTS(ts);
@@ -567,6 +740,29 @@ static Token *std_next(TokenStream *ts)
     int len;
     Token *tk = &(CTS(ts)->token);
 
+    if (std_tz->type != STT_MB) {
+        start = std_skip_space(ts->t, std_tz->text_end);
+        if (start == std_tz->text_end) {
+            return NULL;
+        }
+        if (std_is_alnum(*start)) {
+            end = std_skip_alnum(start + 1, std_tz->text_end);
+            if (std_is_term(*end, std_tz->type)) {
+                len = min2((int)(end - start), (int)sizeof(tk->text) - 1);
+                if (ts->zero_copy) {
+                    tk->ref = (char *)start;
+                }
+                else {
+                    memcpy(tk->text, start, len);
+                    tk->text[len] = '\0';
+                    tk->ref = NULL;
+                }
+                goto found;
+            }
+        }
+        ts->t = (char *)start;
+    }
+
     switch (std_tz->type) {
         case STT_ASCII:
             frt_std_scan(ts->t, tk->text, sizeof(tk->text) - 1,
@@ -584,7 +780,9 @@ static Token *std_next(TokenStream *ts)
 
     if (len == 0)
         return NULL;
+    tk->ref = NULL;
 
+found:
     ts->t       = (char *)end;
     tk->len     = len;
     tk->start   = start - ts->text;
@@ -598,10 +796,18 @@ static TokenStream *std_ts_clone_i(TokenStream *orig_ts)
     return ts_clone_size(orig_ts, sizeof(StandardTokenizer));
 }
 
+static TokenStream *std_ts_reset(TokenStream *ts, char *text)
+{
+    ts_reset(ts, text);
+    STDTS(ts)->text_end = text ? text + strlen(text) : NULL;
+    return ts;
+}
+
 static TokenStream *std_ts_new()
 {
     TokenStream *ts = ts_new(StandardTokenizer);
 
+    ts->reset       = &std_ts_reset;
     ts->clone_i     = &std_ts_clone_i;
     ts->next        = &std_next;
 
@@ -904,7 +1110,7 @@ static Token *legacy_std_next(TokenStream *ts)
     if (!std_tz->is_tok_char(t)) {
         /* very common case, ie a plain word, so check and return */
         ts->t = t;
-        return tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+        return cts_set_ts(ts, start, t, 1);
     }
 
     if (*t == '\'') {       /* apostrophe case. */
@@ -914,16 +1120,16 @@ static Token *legacy_std_next(TokenStream *ts)
         /* strip possesive */
         if ((t[-1] == 's' || t[-1] == 'S') && t[-2] == '\'') {
             t -= 2;
-            tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+            cts_set_ts(ts, start, t, 1);
             CTS(ts)->token.end += 2;
         }
         else if (t[-1] == '\'') {
             t -= 1;
-            tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+            cts_set_ts(ts, start, t, 1);
             CTS(ts)->token.end += 1;
         }
         else {
-            tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+            cts_set_ts(ts, start, t, 1);
         }
 
         return &(CTS(ts)->token);
@@ -932,7 +1138,7 @@ static Token *legacy_std_next(TokenStream *ts)
     if (*t == '&') {        /* apostrophe case. */
         t += legacy_std_get_company_name(t);
         ts->t = t;
-        return tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+        return cts_set_ts(ts, start, t, 1);
     }
 
     if ((isdigit(*start) || isnumpunc(*start))       /* possibly a number */
@@ -940,7 +1146,7 @@ static Token *legacy_std_next(TokenStream *ts)
         num_end = start + len;
         if (!std_tz->is_tok_char(num_end)) { /* won't find a longer token */
             ts->t = num_end;
-            return tk_set_ts(&(CTS(ts)->token), start, num_end, ts->text, 1);
+            return cts_set_ts(ts, start, num_end, 1);
         }
         /* else there may be a longer token so check */
     }
@@ -1018,12 +1224,12 @@ static Token *legacy_std_next(TokenStream *ts)
                    (off_t)(t - ts->text), 1);
         }
         else { /* just return the url as is */
-            tk_set_ts(&(CTS(ts)->token), start, t, ts->text, 1);
+            cts_set_ts(ts, start, t, 1);
         }
     }
     else {                  /* return the number */
         ts->t = num_end;
-        tk_set_ts(&(CTS(ts)->token), start, num_end, ts->text, 1);
+        cts_set_ts(ts, start, num_end, 1);
     }
 
     return &(CTS(ts)->token);
@@ -1091,9 +1297,18 @@ static TokenStream *filter_clone_i(TokenStream *ts)
 static TokenStream *filter_reset(TokenStream *ts, char *text)
 {
     TkFilt(ts)->sub_ts->reset(TkFilt(ts)->sub_ts, text);
+    ts->zero_copy = false;
     return ts;
 }
 
+/* pass the consumer's zero_copy setting down to the tokenizer */
+static INLINE Token *tf_sub_next(TokenStream *ts)
+{
+    TokenStream *sub_ts = TkFilt(ts)->sub_ts;
+    sub_ts->zero_copy = ts->zero_copy;
+    return sub_ts->next(sub_ts);
+}
+
 static void filter_destroy_i(TokenStream *ts)
 {
     ts_deref(TkFilt(ts)->sub_ts);
@@ -1122,27 +1337,44 @@ TokenStream *tf_new_i(size_t size, TokenStream *sub_ts)
 
 static void sf_destroy_i(TokenStream *ts)
 {
+    mutex_lock(&shared_ref_mutex);
     h_destroy(StopFilt(ts)->words);
+    mutex_unlock(&shared_ref_mutex);
     filter_destroy_i(ts);
 }
 
 static TokenStream *sf_clone_i(TokenStream *orig_ts)
 {
-    TokenStream *new_ts = filter_clone_size(orig_ts, sizeof(MappingFilter));
+    TokenStream *new_ts = filter_clone_size(orig_ts, sizeof(StopFilter));
+    mutex_lock(&shared_ref_mutex);
     REF(StopFilt(new_ts)->words);
+    mutex_unlock(&shared_ref_mutex);
     return new_ts;
 }
 
+static bool sf_is_stop_word(StopFilter *sf, Token *tk)
+{
+    char buf[MAX_WORD_SIZE];
+    if (NULL == tk->ref) {
+        return h_get(sf->words, tk->text) != NULL;
+    }
+    /* look up short words without giving up the reference to the text */
+    if (tk->len > sf->max_len) {
+        return false;
+    }
+    memcpy(buf, tk->ref, tk->len);
+    buf[tk->len] = '\0';
+    return h_get(sf->words, buf) != NULL;
+}
+
 static Token *sf_next(TokenStream *ts)
 {
     int pos_inc = 0;
-    Hash *words = StopFilt(ts)->words;
-    TokenFilter *tf = TkFilt(ts);
-    Token *tk = tf->sub_ts->next(tf->sub_ts);
+    Token *tk = tf_sub_next(ts);
 
-    while ((tk != NULL) && (h_get(words, tk->text) != NULL)) {
+    while ((tk != NULL) && sf_is_stop_word(StopFilt(ts), tk)) {
         pos_inc += tk->pos_inc;
-        tk = tf->sub_ts->next(tf->sub_ts);
+        tk = tf_sub_next(ts);
     }
 
     if (tk != NULL) {
@@ -1163,6 +1395,7 @@ TokenStream *stop_filter_new_with_words_len(TokenStream *sub_ts,
     for (i = 0; i < len; i++) {
         word = estrdup(words[i]);
         h_set(word_table, word, word);
+        StopFilt(ts)->max_len = max2(StopFilt(ts)->max_len, (int)strlen(word));
     }
     StopFilt(ts)->words = word_table;
     ts->next            = &sf_next;
@@ -1181,6 +1414,7 @@ TokenStream *stop_filter_new_with_words(TokenStream *sub_ts,
     while (*words) {
         word = estrdup(*words);
         h_set(word_table, word, word);
+        StopFilt(ts)->max_len = max2(StopFilt(ts)->max_len, (int)strlen(word));
         words++;
     }
 
@@ -1204,14 +1438,18 @@ TokenStream *stop_filter_new(TokenStream *ts)
 
 static void mf_destroy_i(TokenStream *ts)
 {
+    mutex_lock(&shared_ref_mutex);
     mulmap_destroy(MFilt(ts)->mapper);
+    mutex_unlock(&shared_ref_mutex);
     filter_destroy_i(ts);
 }
 
 static TokenStream *mf_clone_i(TokenStream *orig_ts)
 {
     TokenStream *new_ts = filter_clone_size(orig_ts, sizeof(MappingFilter));
+    mutex_lock(&shared_ref_mutex);
     REF(MFilt(new_ts)->mapper);
+    mutex_unlock(&shared_ref_mutex);
     return new_ts;
 }
 
@@ -1219,11 +1457,25 @@ static Token *mf_next(TokenStream *ts)
 {
     char buf[MAX_WORD_SIZE + 1];
     MultiMapper *mapper = MFilt(ts)->mapper;
-    TokenFilter *tf = TkFilt(ts);
-    Token *tk = tf->sub_ts->next(tf->sub_ts);
+    Token *tk = tf_sub_next(ts);
     if (tk != NULL) {
-        tk->len = mulmap_map_len(mapper, buf, tk->text, MAX_WORD_SIZE);
-        memcpy(tk->text, buf, tk->len + 1);
+        /* most tokens have nothing to map and are passed through untouched.
+         * The bytes before the first possible match are left where they
+         * are */
+        const int start = mulmap_scan(mapper, TK_PTR(tk), tk->len);
+        if (start < tk->len) {
+            char *text = tk_text(tk) + start;
+            if (mapper->never_grows) {
+                tk->len = start + mulmap_map_len(mapper, text, text,
+                                                 MAX_WORD_SIZE - start);
+            }
+            else {
+                const int len = mulmap_map_len(mapper, buf, text,
+                                               MAX_WORD_SIZE - start);
+                memcpy(text, buf, len + 1);
+                tk->len = start + len;
+            }
+        }
     }
     return tk;
 }
@@ -1268,10 +1520,16 @@ static TokenStream *hf_clone_i(TokenStream *orig_ts)
     return new_ts;
 }
 
+static TokenStream *hf_reset(TokenStream *ts, char *text)
+{
+    /* drop the rest of any hyphenated word from the last text */
+    HyphenFilt(ts)->pos = HyphenFilt(ts)->len = 0;
+    return filter_reset(ts, text);
+}
+
 static Token *hf_next(TokenStream *ts)
 {
     HyphenFilter *hf = HyphenFilt(ts);
-    TokenFilter *tf = TkFilt(ts);
     Token *tk = hf->tk;
 
     if (hf->pos < hf->len) {
@@ -1287,25 +1545,26 @@ static Token *hf_next(TokenStream *ts)
     }
     else {
         char *p;
+        const char *word;
+        int i;
         bool seen_hyphen = false;
         bool seen_other_punc = false;
-        hf->tk = tk = tf->sub_ts->next(tf->sub_ts);
+        hf->tk = tk = tf_sub_next(ts);
         if (NULL == tk) return NULL;
-        p = tk->text + 1;
-        while (*p) {
-            if (*p == '-') {
+        word = TK_PTR(tk);
+        for (i = 1; i < tk->len; i++) {
+            if (word[i] == '-') {
                 seen_hyphen = true;
             }
-            else if (!isalpha(*p)) {
+            else if (!isalpha(word[i])) {
                 seen_other_punc = true;
                 break;
             }
-            p++;
         }
         if (seen_hyphen && !seen_other_punc) {
             char *q = hf->text;
             char *r = tk->text;
-            p = tk->text;
+            p = tk_text(tk);
             while (*p) {
                 if (*p == '-') {
                     *q = '\0';
@@ -1331,6 +1590,7 @@ TokenStream *hyphen_filter_new(TokenStream *sub_ts)
 {
     TokenStream *ts = tf_new(HyphenFilter, sub_ts);
     ts->next        = &hf_next;
+    ts->reset       = &hf_reset;
     ts->clone_i     = &hf_clone_i;
     return ts;
 }
@@ -1343,7 +1603,7 @@ TokenStream *hyphen_filter_new(TokenStream *sub_ts)
 static Token *mb_lcf_next(TokenStream *ts)
 {
     wchar_t wbuf[MAX_WORD_SIZE + 1], *wchr;
-    Token *tk = TkFilt(ts)->sub_ts->next(TkFilt(ts)->sub_ts);
+    Token *tk = tf_sub_next(ts);
     int x;
     wbuf[MAX_WORD_SIZE] = 0;
 
@@ -1351,7 +1611,7 @@ static Token *mb_lcf_next(TokenStream *ts)
         return tk;
     }
 
-    if ((x=mbstowcs(wbuf, tk->text, MAX_WORD_SIZE)) <= 0) return tk;
+    if ((x=mbstowcs(wbuf, tk_text(tk), MAX_WORD_SIZE)) <= 0) return tk;
     wchr = wbuf;
     while (*wchr != 0) {
         *wchr = towlower(*wchr);
@@ -1373,13 +1633,53 @@ TokenStream *mb_lowercase_filter_new(TokenStream *sub_ts)
     return ts;
 }
 
+static Token *utf8_lcf_next(TokenStream *ts)
+{
+    char buf[MAX_WORD_SIZE];
+    Token *tk = tf_sub_next(ts);
+    if (tk == NULL) {
+        return tk;
+    }
+    if (tk->ref) {
+        tk->len = utf8_downcase(tk->text, tk->ref, tk->len, MAX_WORD_SIZE);
+        tk->ref = NULL;
+        return tk;
+    }
+    tk->len = utf8_downcase(buf, tk->text, tk->len, MAX_WORD_SIZE);
+    memcpy(tk->text, buf, tk->len + 1);
+    return tk;
+}
+
+TokenStream *utf8_lowercase_filter_new(TokenStream *sub_ts)
+{
+    TokenStream *ts = tf_new(TokenFilter, sub_ts);
+    ts->next = &utf8_lcf_next;
+    return ts;
+}
+
 static Token *lcf_next(TokenStream *ts)
 {
     int i = 0;
-    Token *tk = TkFilt(ts)->sub_ts->next(TkFilt(ts)->sub_ts);
+    Token *tk = tf_sub_next(ts);
     if (tk == NULL) {
         return tk;
     }
+    if (tk->ref) {
+        /* only copy the token if there is something to lowercase */
+        while (i < tk->len && !isupper((uchar)tk->ref[i])) {
+            i++;
+        }
+        if (i == tk->len) {
+            return tk;
+        }
+        memcpy(tk->text, tk->ref, i);
+        for (; i < tk->len; i++) {
+            tk->text[i] = tolower((uchar)tk->ref[i]);
+        }
+        tk->text[i] = '\0';
+        tk->ref = NULL;
+        return tk;
+    }
     while (tk->text[i] != '\0') {
         tk->text[i] = tolower(tk->text[i]);
         i++;
@@ -1402,23 +1702,59 @@ TokenStream *lowercase_filter_new(TokenStream *sub_ts)
 
 static void stemf_destroy_i(TokenStream *ts)
 {
+    free(StemFilt(ts)->cache);
     sb_stemmer_delete(StemFilt(ts)->stemmer);
     free(StemFilt(ts)->algorithm);
     free(StemFilt(ts)->charenc);
     filter_destroy_i(ts);
 }
 
+/* the same as str_hash but the token may not be '\0' terminated */
+static unsigned long stemf_hash(const char *word, int len)
+{
+    const uchar *p = (const uchar *)word;
+    const uchar *end = p + len;
+    unsigned long h = 0;
+    for (; p < end; p++) {
+        h = 37 * h + *p;
+    }
+    return h;
+}
+
 static Token *stemf_next(TokenStream *ts)
 {
     int len;
     const sb_symbol *stemmed;
-    struct sb_stemmer *stemmer = StemFilt(ts)->stemmer;
-    TokenFilter *tf = TkFilt(ts);
-    Token *tk = tf->sub_ts->next(tf->sub_ts);
+    StemFilter *stemf = StemFilt(ts);
+    struct sb_stemmer *stemmer = stemf->stemmer;
+    StemCacheEntry *entry = NULL;
+    Token *tk = tf_sub_next(ts);
+    const char *word;
     if (tk == NULL) {
         return tk;
     }
-    stemmed = sb_stemmer_stem(stemmer, (sb_symbol *)tk->text, tk->len);
+    word = TK_PTR(tk);
+    if (stemf->cache_size > 0 && tk->len > 0
+        && tk->len < STEM_CACHE_WORD_SIZE) {
+        const unsigned long hash = stemf_hash(word, tk->len);
+        if (NULL == stemf->cache) {
+            stemf->cache = ALLOC_AND_ZERO_N(StemCacheEntry, stemf->cache_size);
+        }
+        entry = &stemf->cache[hash & (stemf->cache_size - 1)];
+        if (entry->hash == hash && entry->word_len == tk->len
+            && 0 == memcmp(entry->word, word, tk->len)) {
+            stemf->cache_hits++;
+            memcpy(tk->text, entry->stem, entry->stem_len + 1);
+            tk->len = entry->stem_len;
+            tk->ref = NULL;
+            return tk;
+        }
+        stemf->cache_misses++;
+        entry->hash = hash;
+        entry->word_len = tk->len;
+        memcpy(entry->word, word, tk->len);
+    }
+    stemmed = sb_stemmer_stem(stemmer, (const sb_symbol *)word, tk->len);
     len = sb_stemmer_length(stemmer);
     if (len >= MAX_WORD_SIZE) {
         len = MAX_WORD_SIZE - 1;
@@ -1427,9 +1763,31 @@ static Token *stemf_next(TokenStream *ts)
     memcpy(tk->text, stemmed, len);
     tk->text[len] = '\0';
     tk->len = len;
+    tk->ref = NULL;
+    if (entry) {
+        if (len < STEM_CACHE_WORD_SIZE) {
+            memcpy(entry->stem, tk->text, len + 1);
+            entry->stem_len = len;
+        }
+        else {
+            entry->word_len = 0;
+        }
+    }
     return tk;
 }
 
+void stem_filter_set_cache_size(TokenStream *ts, int size)
+{
+    StemFilter *stemf = StemFilt(ts);
+    int cache_size = size > 0 ? 1 : 0;
+    while (cache_size < size) {
+        cache_size <<= 1;
+    }
+    free(stemf->cache);
+    stemf->cache = NULL;
+    stemf->cache_size = cache_size;
+}
+
 static TokenStream *stemf_clone_i(TokenStream *orig_ts)
 {
     TokenStream *new_ts      = filter_clone_size(orig_ts, sizeof(StemFilter));
@@ -1441,6 +1799,8 @@ static TokenStream *stemf_clone_i(TokenStream *orig_ts)
         orig_stemf->algorithm ? estrdup(orig_stemf->algorithm) : NULL;
     stemf->charenc =
         orig_stemf->charenc ? estrdup(orig_stemf->charenc) : NULL;
+    stemf->cache = NULL;
+    stemf->cache_hits = stemf->cache_misses = 0;
     return new_ts;
 }
 
@@ -1477,6 +1837,7 @@ TokenStream *stem_filter_new(TokenStream *ts, const char *algorithm,
     }
 
     StemFilt(tf)->stemmer   = sb_stemmer_new(my_algorithm, my_charenc);
+    StemFilt(tf)->cache_size = STEM_CACHE_SIZE;
 
     tf->next = &stemf_next;
     tf->destroy_i = &stemf_destroy_i;
@@ -1543,7 +1904,7 @@ Analyzer *utf8_standard_analyzer_new_with_words_len(const char **words,
 {
     TokenStream *ts = utf8_standard_tokenizer_new();
     if (lowercase) {
-        ts = mb_lowercase_filter_new(ts);
+        ts = utf8_lowercase_filter_new(ts);
     }
     ts = hyphen_filter_new(stop_filter_new_with_words_len(ts, words, len));
     return analyzer_new(ts, NULL, NULL);
@@ -1554,7 +1915,7 @@ Analyzer *utf8_standard_analyzer_new_with_words(const char **words,
 {
     TokenStream *ts = utf8_standard_tokenizer_new();
     if (lowercase) {
-        ts = mb_lowercase_filter_new(ts);
+        ts = utf8_lowercase_filter_new(ts);
     }
     ts = hyphen_filter_new(stop_filter_new_with_words(ts, words));
     return analyzer_new(ts, NULL, NULL);
@@ -1700,7 +2061,7 @@ int main(int argc, char **argv)
     while (fgets(buf, 9999, stdin) != NULL) {
         ts = a_get_ts(a, "hello", buf);
         while ((tk = ts->next(ts)) != NULL) {
-            printf("<%s:%ld:%ld> ", tk->text, tk->start, tk->end);
+            printf("<%s:%ld:%ld> ", tk_text(tk), tk->start, tk->end);
         }
         printf("\n");
         ts_deref(ts);
@@ -1,15 +1,20 @@
 #include "bitvector.h"
 #include "internal.h"
 #include <string.h>
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
 
 BitVector *bv_new_capa(int capa)
 {
     BitVector *bv = ALLOC_AND_ZERO(BitVector);
 
     /* The capacity passed by the user is number of bits allowed, however we
-     * store capacity as the number of words (U32) allocated. */
-    bv->capa = max2(TO_WORD(capa), 4);
-    bv->bits = ALLOC_AND_ZERO_N(u32, bv->capa);
+     * store capacity as the number of words (U64) allocated. */
+    bv->capa = max2(BV_TO_WORD(capa), 4);
+    bv->bits = ALLOC_AND_ZERO_N(u64, bv->capa);
     bv->curr_bit = -1;
     bv->ref_cnt = 1;
     return bv;
@@ -30,7 +35,7 @@ void bv_destroy(BitVector *bv)
 
 void bv_clear(BitVector *bv)
 {
-    memset(bv->bits, 0, bv->capa * sizeof(u32));
+    memset(bv->bits, 0, bv->capa * sizeof(u64));
     bv->extends_as_ones = 0;
     bv->count = 0;
     bv->size = 0;
@@ -43,7 +48,7 @@ void bv_scan_reset(BitVector *bv)
 
 int bv_eq(BitVector *bv1, BitVector *bv2)
 {
-    u32 *bits, *bits2;
+    u64 *bits, *bits2;
     int min_size, word_size, ext_word_size = 0, i;
     if (bv1 == bv2) {
         return true;
@@ -56,7 +61,7 @@ int bv_eq(BitVector *bv1, BitVector *bv2)
     bits = bv1->bits;
     bits2 = bv2->bits;
     min_size = min2(bv1->size, bv2->size);
-    word_size = TO_WORD(min_size);
+    word_size = BV_TO_WORD(min_size);
 
     for (i = 0; i < word_size; i++) {
         if (bits[i] != bits2[i]) {
@@ -65,14 +70,14 @@ int bv_eq(BitVector *bv1, BitVector *bv2)
     }
     if (bv1->size > min_size) {
         bits = bv1->bits;
-        ext_word_size = TO_WORD(bv1->size);
+        ext_word_size = BV_TO_WORD(bv1->size);
     }
     else if (bv2->size > min_size) {
         bits = bv2->bits;
-        ext_word_size = TO_WORD(bv2->size);
+        ext_word_size = BV_TO_WORD(bv2->size);
     }
     if (ext_word_size) {
-        const u32 expected = (bv1->extends_as_ones ? 0xFFFFFFFF : 0);
+        const u64 expected = (bv1->extends_as_ones ? BV_ALL_ONES : 0);
         for (i = word_size; i < ext_word_size; i++) {
             if (bits[i] != expected) {
                 return false;
@@ -85,12 +90,123 @@ int bv_eq(BitVector *bv1, BitVector *bv2)
 unsigned long bv_hash(BitVector *bv)
 {
     unsigned long hash = 0;
-    const u32 empty_word = bv->extends_as_ones ? 0xFFFFFFFF : 0;
+    const u64 empty_word = bv->extends_as_ones ? BV_ALL_ONES : 0;
     int i;
-    for (i = TO_WORD(bv->size) - 1; i >= 0; i--) {
-        const u32 word = bv->bits[i];
+    for (i = BV_TO_WORD(bv->size) - 1; i >= 0; i--) {
+        const u64 word = bv->bits[i];
         if (word != empty_word)
-            hash = (hash << 1) ^ word;
+            hash = (hash << 1) ^ (unsigned long)(word ^ (word >> 32));
     }
     return (hash << 1) | bv->extends_as_ones;
 }
+
+/****************************************************************************
+ *
+ * Word kernels
+ *
+ * The main loops work on a whole vector register at a time and the remaining
+ * words are handled one at a time. We use unaligned loads and stores since
+ * the bits are allocated with plain malloc.
+ ****************************************************************************/
+
+#if defined(__AVX2__)
+# define BV_VEC_WORDS 4
+# define BV_VEC __m256i
+# define BV_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+# define BV_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+# define BV_AND(a, b) _mm256_and_si256(a, b)
+# define BV_OR(a, b) _mm256_or_si256(a, b)
+# define BV_XOR(a, b) _mm256_xor_si256(a, b)
+# define BV_ANDNOT(a, b) _mm256_andnot_si256(b, a)
+# define BV_ONES _mm256_set1_epi32(-1)
+#elif defined(__SSE2__)
+# define BV_VEC_WORDS 2
+# define BV_VEC __m128i
+# define BV_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+# define BV_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+# define BV_AND(a, b) _mm_and_si128(a, b)
+# define BV_OR(a, b) _mm_or_si128(a, b)
+# define BV_XOR(a, b) _mm_xor_si128(a, b)
+# define BV_ANDNOT(a, b) _mm_andnot_si128(b, a)
+# define BV_ONES _mm_set1_epi32(-1)
+#endif
+
+#ifdef BV_VEC_WORDS
+# define BV_WORDS_KERNEL(name, vec_op, op)                                \
+void name(u64 *dest, const u64 *a, const u64 *b, int n)                 \
+{                                                                       \
+    int i = 0;                                                          \
+    for (; i + BV_VEC_WORDS <= n; i += BV_VEC_WORDS) {                  \
+        BV_STORE(dest + i, vec_op(BV_LOAD(a + i), BV_LOAD(b + i)));     \
+    }                                                                   \
+    for (; i < n; i++) {                                                \
+        dest[i] = a[i] op b[i];                                         \
+    }                                                                   \
+}
+#else
+# define BV_WORDS_KERNEL(name, vec_op, op)                                \
+void name(u64 *dest, const u64 *a, const u64 *b, int n)                 \
+{                                                                       \
+    int i;                                                              \
+    for (i = 0; i < n; i++) {                                           \
+        dest[i] = a[i] op b[i];                                         \
+    }                                                                   \
+}
+#endif
+
+BV_WORDS_KERNEL(bv_and_words, BV_AND, &)
+BV_WORDS_KERNEL(bv_or_words, BV_OR, |)
+BV_WORDS_KERNEL(bv_xor_words, BV_XOR, ^)
+BV_WORDS_KERNEL(bv_andnot_words, BV_ANDNOT, & ~)
+
+void bv_not_words(u64 *dest, const u64 *a, int n)
+{
+    int i = 0;
+#ifdef BV_VEC_WORDS
+    const BV_VEC ones = BV_ONES;
+    for (; i + BV_VEC_WORDS <= n; i += BV_VEC_WORDS) {
+        BV_STORE(dest + i, BV_XOR(BV_LOAD(a + i), ones));
+    }
+#endif
+    for (; i < n; i++) {
+        dest[i] = ~a[i];
+    }
+}
+
+#if defined(__AVX2__)
+/* Count the bits in each byte using a nibble lookup table and then sum the
+ * bytes of each 64-bit lane. See Mula, Kurz and Lemire, "Faster Population
+ * Counts Using AVX2 Instructions". */
+static INLINE __m256i bv_popcount256(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                  _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+#endif
+
+int bv_count_words(const u64 *bits, int n)
+{
+    int i = 0;
+    u64 count = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    u64 lanes[4];
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_add_epi64(acc, bv_popcount256(
+                _mm256_loadu_si256((const __m256i *)(bits + i))));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; i++) {
+        count += count_ones64(bits[i]);
+    }
+    return (int)count;
+}
@@ -0,0 +1,107 @@
+#include "bloom_filter.h"
+#include "internal.h"
+
+#define BF_MAX_HASHES 16
+
+/* 64-bit FNV-1a followed by the MurmurHash3 finalizer so that both halves of
+ * the hash are well mixed for the double hashing in bf_add */
+u64 bf_hash(const char *term, int term_len)
+{
+    const uchar *s = (const uchar *)term;
+    const uchar *end = s + term_len;
+    u64 h = 0xcbf29ce484222325ULL;
+    while (s < end) {
+        h ^= *s++;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+BloomFilter *bf_new(int term_cnt)
+{
+    BloomFilter *bf = ALLOC(BloomFilter);
+    int word_cnt = 1;
+    int num_hashes;
+
+    if (term_cnt < 1) {
+        term_cnt = 1;
+    }
+    /* round up to a power of 2 so probes can be masked rather than divided */
+    while (((u64)word_cnt << 6) < (u64)term_cnt * BF_BITS_PER_TERM) {
+        word_cnt <<= 1;
+    }
+    /* the optimal number of hashes is ln(2) * bits per term */
+    num_hashes = (int)(((u64)word_cnt << 6) * 69 / ((u64)term_cnt * 100));
+    bf->num_hashes = max2(1, min2(num_hashes, BF_MAX_HASHES));
+    bf->word_cnt = word_cnt;
+    bf->words = ALLOC_AND_ZERO_N(u64, word_cnt);
+    return bf;
+}
+
+#define BF_PROBE_INIT(bf, hash)\
+    const u64 mask = ((u64)(bf)->word_cnt << 6) - 1;\
+    const u64 delta = ((hash) >> 32) | ((hash) << 32) | 1;\
+    u64 h = (hash);\
+    int i
+
+void bf_add(BloomFilter *bf, u64 hash)
+{
+    BF_PROBE_INIT(bf, hash);
+    for (i = bf->num_hashes; i > 0; i--) {
+        const u64 bit = h & mask;
+        bf->words[bit >> 6] |= (u64)1 << (bit & 63);
+        h += delta;
+    }
+}
+
+bool bf_may_contain(BloomFilter *bf, u64 hash)
+{
+    BF_PROBE_INIT(bf, hash);
+    for (i = bf->num_hashes; i > 0; i--) {
+        const u64 bit = h & mask;
+        if (0 == (bf->words[bit >> 6] & ((u64)1 << (bit & 63)))) {
+            return false;
+        }
+        h += delta;
+    }
+    return true;
+}
+
+void bf_write(BloomFilter *bf, OutStream *os)
+{
+    int i;
+    os_write_vint(os, bf->num_hashes);
+    os_write_vint(os, bf->word_cnt);
+    for (i = 0; i < bf->word_cnt; i++) {
+        os_write_u64(os, bf->words[i]);
+    }
+}
+
+BloomFilter *bf_read(InStream *is)
+{
+    BloomFilter *bf = ALLOC(BloomFilter);
+    int i;
+    bf->num_hashes = is_read_vint(is);
+    bf->word_cnt = is_read_vint(is);
+    if (bf->word_cnt <= 0 || (bf->word_cnt & (bf->word_cnt - 1)) != 0) {
+        const int word_cnt = bf->word_cnt;
+        free(bf);
+        RAISE(IO_ERROR, "corrupt bloom filter with %d words", word_cnt);
+    }
+    bf->words = ALLOC_N(u64, bf->word_cnt);
+    for (i = 0; i < bf->word_cnt; i++) {
+        bf->words[i] = is_read_u64(is);
+    }
+    return bf;
+}
+
+void bf_destroy(BloomFilter *bf)
+{
+    free(bf->words);
+    free(bf);
+}
@@ -142,11 +142,24 @@ static void cmpdi_read_i(InStream *is, uchar *b, int len)
     is_read_bytes(cis->sub, b, len);
 }
 
+static const uchar *cmpdi_map_i(InStream *is, off_t pos, int len)
+{
+    CompoundInStream *cis = is->d.cis;
+
+    if ((pos + len) > cis->length) {
+        RAISE(EOF_ERROR, "Tried to map past end of file. File length is "
+              "<%"OFF_T_PFX"d> and tried to map to <%"OFF_T_PFX"d>",
+              cis->length, pos + len);
+    }
+    return is_map(cis->sub, cis->offset + pos, len);
+}
+
 static const struct InStreamMethods CMPD_IN_STREAM_METHODS = {
     cmpdi_read_i,
     cmpdi_seek_i,
     cmpdi_length_i,
-    cmpdi_close_i
+    cmpdi_close_i,
+    cmpdi_map_i
 };
 
 static InStream *cmpd_create_input(InStream *sub_is, off_t offset, off_t length)
@@ -0,0 +1,541 @@
+#include "doc_set.h"
+#include <string.h>
+#include "internal.h"
+
+#define DS_KEY(doc_num) ((doc_num) >> 16)
+#define DS_LOW(doc_num) ((doc_num) & 0xFFFF)
+#define DS_CONTAINER_BITS (DS_BITMAP_WORDS << 6)
+
+/****************************************************************************
+ *
+ * DocSetContainer
+ *
+ ****************************************************************************/
+
+/* index of the first value >= +low+ in values[lo..hi) */
+static INLINE int dsc_array_lower_bound(const u16 *values, int lo, int hi,
+                                       int low)
+{
+    while (lo < hi) {
+        const int mid = (lo + hi) >> 1;
+        if (values[mid] < low) lo = mid + 1;
+        else                   hi = mid;
+    }
+    return lo;
+}
+
+/* index of the first run in runs[lo..hi) which ends at or after +low+ */
+static INLINE int dsc_run_lower_bound(const DocSetRun *runs, int lo, int hi,
+                                     int low)
+{
+    while (lo < hi) {
+        const int mid = (lo + hi) >> 1;
+        if (runs[mid].start + runs[mid].len < low) lo = mid + 1;
+        else                                       hi = mid;
+    }
+    return lo;
+}
+
+static INLINE int dsc_bitmap_next_from(const u64 *words, int low)
+{
+    int i = low >> 6;
+    u64 word = words[i] & (BV_ALL_ONES << (low & 63));
+    while (!word) {
+        if (++i >= DS_BITMAP_WORDS) {
+            return -1;
+        }
+        word = words[i];
+    }
+    return (i << 6) + count_trailing_zeros64(word);
+}
+
+/* returns DS_CONTAINER_BITS if all bits from +low+ on are set */
+static int dsc_bitmap_next_unset_from(const u64 *words, int low)
+{
+    int i = low >> 6;
+    u64 word = ~words[i] & (BV_ALL_ONES << (low & 63));
+    while (!word) {
+        if (++i >= DS_BITMAP_WORDS) {
+            return DS_CONTAINER_BITS;
+        }
+        word = ~words[i];
+    }
+    return (i << 6) + count_trailing_zeros64(word);
+}
+
+/* set bits +first+ to +last+ inclusive */
+static void dsc_bitmap_set_range(u64 *words, int first, int last)
+{
+    const int first_word = first >> 6;
+    const int last_word = last >> 6;
+    const u64 first_mask = BV_ALL_ONES << (first & 63);
+    const u64 last_mask = BV_ALL_ONES >> (63 - (last & 63));
+    int i;
+
+    if (first_word == last_word) {
+        words[first_word] |= first_mask & last_mask;
+        return;
+    }
+    words[first_word] |= first_mask;
+    for (i = first_word + 1; i < last_word; i++) {
+        words[i] = BV_ALL_ONES;
+    }
+    words[last_word] |= last_mask;
+}
+
+static void dsc_init(DocSetContainer *con, int key)
+{
+    con->key = key;
+    con->type = DS_ARRAY;
+    con->card = 0;
+    con->size = 0;
+    con->capa = 4;
+    con->data.values = ALLOC_N(u16, 4);
+}
+
+static void dsc_to_bitmap(DocSetContainer *con)
+{
+    u64 *words;
+    int i;
+
+    if (con->type == DS_BITMAP) {
+        return;
+    }
+    words = ALLOC_AND_ZERO_N(u64, DS_BITMAP_WORDS);
+    if (con->type == DS_ARRAY) {
+        const u16 *values = con->data.values;
+        for (i = 0; i < con->size; i++) {
+            words[values[i] >> 6] |= (u64)1 << (values[i] & 63);
+        }
+        free(con->data.values);
+    }
+    else {
+        const DocSetRun *runs = con->data.runs;
+        for (i = 0; i < con->size; i++) {
+            dsc_bitmap_set_range(words, runs[i].start,
+                                 runs[i].start + runs[i].len);
+        }
+        free(con->data.runs);
+    }
+    con->type = DS_BITMAP;
+    con->size = con->capa = DS_BITMAP_WORDS;
+    con->data.words = words;
+}
+
+static void dsc_bitmap_to_array(DocSetContainer *con)
+{
+    const u64 *words = con->data.words;
+    u16 *values = ALLOC_N(u16, con->card);
+    int i, n = 0;
+
+    for (i = 0; i < DS_BITMAP_WORDS; i++) {
+        u64 word = words[i];
+        while (word) {
+            values[n++] = (u16)((i << 6) + count_trailing_zeros64(word));
+            word &= word - 1;
+        }
+    }
+    free(con->data.words);
+    con->type = DS_ARRAY;
+    con->size = con->capa = con->card;
+    con->data.values = values;
+}
+
+static void dsc_bitmap_to_runs(DocSetContainer *con, int run_cnt)
+{
+    const u64 *words = con->data.words;
+    DocSetRun *runs = ALLOC_N(DocSetRun, run_cnt);
+    int n = 0;
+    int low = dsc_bitmap_next_from(words, 0);
+
+    while (low >= 0) {
+        const int end = dsc_bitmap_next_unset_from(words, low);
+        runs[n].start = (u16)low;
+        runs[n].len = (u16)(end - 1 - low);
+        n++;
+        if (end >= DS_CONTAINER_BITS) {
+            break;
+        }
+        low = dsc_bitmap_next_from(words, end);
+    }
+    free(con->data.words);
+    con->type = DS_RUN;
+    con->size = con->capa = n;
+    con->data.runs = runs;
+}
+
+static int dsc_count_runs(const DocSetContainer *con)
+{
+    int i, run_cnt = 0;
+    switch (con->type) {
+        case DS_ARRAY: {
+            const u16 *values = con->data.values;
+            for (i = 0; i < con->size; i++) {
+                if (i == 0 || values[i] != values[i - 1] + 1) {
+                    run_cnt++;
+                }
+            }
+            break;
+        }
+        case DS_BITMAP: {
+            /* a run starts at every set bit whose lower neighbour is unset */
+            const u64 *words = con->data.words;
+            u64 carry = 0;
+            for (i = 0; i < DS_BITMAP_WORDS; i++) {
+                const u64 word = words[i];
+                run_cnt += count_ones64(word & ~((word << 1) | carry));
+                carry = word >> 63;
+            }
+            break;
+        }
+        default:
+            run_cnt = con->size;
+            break;
+    }
+    return run_cnt;
+}
+
+static void dsc_optimize(DocSetContainer *con)
+{
+    const int run_cnt = dsc_count_runs(con);
+    const size_t run_bytes = run_cnt * sizeof(DocSetRun);
+    const size_t array_bytes = con->card * sizeof(u16);
+    const size_t bitmap_bytes = DS_BITMAP_WORDS * sizeof(u64);
+    int type = DS_BITMAP;
+
+    if (run_bytes < bitmap_bytes && run_bytes < array_bytes) {
+        type = DS_RUN;
+    }
+    else if (con->card <= DS_ARRAY_MAX && array_bytes < bitmap_bytes) {
+        type = DS_ARRAY;
+    }
+
+    if (type == con->type) {
+        /* release any unused space */
+        if (type == DS_ARRAY && con->capa > con->size) {
+            REALLOC_N(con->data.values, u16, con->size);
+            con->capa = con->size;
+        }
+        else if (type == DS_RUN && con->capa > con->size) {
+            REALLOC_N(con->data.runs, DocSetRun, con->size);
+            con->capa = con->size;
+        }
+        return;
+    }
+    dsc_to_bitmap(con);
+    if (type == DS_ARRAY) {
+        dsc_bitmap_to_array(con);
+    }
+    else if (type == DS_RUN) {
+        dsc_bitmap_to_runs(con, run_cnt);
+    }
+}
+
+static bool dsc_get(const DocSetContainer *con, int low)
+{
+    int i;
+    switch (con->type) {
+        case DS_ARRAY:
+            i = dsc_array_lower_bound(con->data.values, 0, con->size, low);
+            return i < con->size && con->data.values[i] == low;
+        case DS_BITMAP:
+            return (con->data.words[low >> 6] >> (low & 63)) & 1;
+        default:
+            i = dsc_run_lower_bound(con->data.runs, 0, con->size, low);
+            return i < con->size && con->data.runs[i].start <= low;
+    }
+}
+
+/* returns true if +low+ wasn't already in the container */
+static bool dsc_add(DocSetContainer *con, int low)
+{
+    u64 *word, bit;
+
+    if (con->type == DS_ARRAY) {
+        u16 *values = con->data.values;
+        const int size = con->size;
+        int i = (size > 0 && values[size - 1] < low)
+            ? size
+            : dsc_array_lower_bound(values, 0, size, low);
+        if (i < size && values[i] == low) {
+            return false;
+        }
+        if (size < DS_ARRAY_MAX) {
+            if (size == con->capa) {
+                con->capa = min2(con->capa << 1, DS_ARRAY_MAX);
+                REALLOC_N(con->data.values, u16, con->capa);
+                values = con->data.values;
+            }
+            memmove(values + i + 1, values + i, (size - i) * sizeof(u16));
+            values[i] = (u16)low;
+            con->size++;
+            con->card++;
+            return true;
+        }
+    }
+    else if (con->type == DS_RUN && dsc_get(con, low)) {
+        return false;
+    }
+
+    dsc_to_bitmap(con);
+    word = con->data.words + (low >> 6);
+    bit = (u64)1 << (low & 63);
+    if (*word & bit) {
+        return false;
+    }
+    *word |= bit;
+    con->card++;
+    return true;
+}
+
+/* returns the lowest value >= +low+ in the container or -1. +pos+ is the
+ * index of the value or run we stopped at last time, which lets sequential
+ * calls avoid a full search */
+static INLINE int dsc_next_from(const DocSetContainer *con, int low, int *pos)
+{
+    int i = *pos;
+    switch (con->type) {
+        case DS_ARRAY: {
+            const u16 *values = con->data.values;
+            if (i < con->size && values[i] < low) {
+                if (++i < con->size && values[i] < low) {
+                    i = dsc_array_lower_bound(values, i + 1, con->size, low);
+                }
+            }
+            *pos = i;
+            return i < con->size ? values[i] : -1;
+        }
+        case DS_BITMAP:
+            return dsc_bitmap_next_from(con->data.words, low);
+        default: {
+            const DocSetRun *runs = con->data.runs;
+            if (i < con->size && runs[i].start + runs[i].len < low) {
+                if (++i < con->size && runs[i].start + runs[i].len < low) {
+                    i = dsc_run_lower_bound(runs, i + 1, con->size, low);
+                }
+            }
+            *pos = i;
+            return i < con->size ? max2(low, (int)runs[i].start) : -1;
+        }
+    }
+}
+
+/****************************************************************************
+ *
+ * DocSet
+ *
+ ****************************************************************************/
+
+DocSet *ds_new()
+{
+    return ALLOC_AND_ZERO(DocSet);
+}
+
+void ds_destroy(DocSet *ds)
+{
+    int i;
+    for (i = 0; i < ds->size; i++) {
+        free(ds->cons[i].data.values);
+    }
+    free(ds->cons);
+    free(ds);
+}
+
+/* index of the first container in cons[lo..size) with a key >= +key+ */
+static INLINE int ds_lower_bound(const DocSet *ds, int lo, int key)
+{
+    int hi = ds->size;
+    while (lo < hi) {
+        const int mid = (lo + hi) >> 1;
+        if (ds->cons[mid].key < key) lo = mid + 1;
+        else                         hi = mid;
+    }
+    return lo;
+}
+
+static DocSetContainer *ds_insert_container(DocSet *ds, int i, int key)
+{
+    if (ds->size == ds->capa) {
+        ds->capa = max2(ds->capa << 1, 4);
+        REALLOC_N(ds->cons, DocSetContainer, ds->capa);
+    }
+    memmove(ds->cons + i + 1, ds->cons + i,
+            (ds->size - i) * sizeof(DocSetContainer));
+    ds->size++;
+    dsc_init(ds->cons + i, key);
+    return ds->cons + i;
+}
+
+void ds_add(DocSet *ds, int doc_num)
+{
+    const int key = DS_KEY(doc_num);
+    const int size = ds->size;
+    DocSetContainer *con;
+
+    if (size == 0 || ds->cons[size - 1].key < key) {
+        con = ds_insert_container(ds, size, key);
+    }
+    else if (ds->cons[size - 1].key == key) {
+        con = ds->cons + size - 1;
+    }
+    else {
+        const int i = ds_lower_bound(ds, 0, key);
+        con = (ds->cons[i].key == key)
+            ? ds->cons + i
+            : ds_insert_container(ds, i, key);
+    }
+    if (dsc_add(con, DS_LOW(doc_num))) {
+        ds->count++;
+    }
+}
+
+bool ds_get(DocSet *ds, int doc_num)
+{
+    const int key = DS_KEY(doc_num);
+    const int i = ds_lower_bound(ds, 0, key);
+    return i < ds->size && ds->cons[i].key == key
+        && dsc_get(ds->cons + i, DS_LOW(doc_num));
+}
+
+void ds_optimize(DocSet *ds)
+{
+    int i;
+    for (i = 0; i < ds->size; i++) {
+        dsc_optimize(ds->cons + i);
+    }
+    if (ds->capa > ds->size) {
+        ds->capa = ds->size;
+        REALLOC_N(ds->cons, DocSetContainer, ds->capa);
+    }
+}
+
+DocSet *ds_from_bv(BitVector *bv, int max_doc)
+{
+    DocSet *ds = ds_new();
+    const int bv_words = bv->size > 0 ? BV_TO_WORD(bv->size) : 0;
+    const int word_size = max_doc > 0 ? BV_TO_WORD(max_doc) : 0;
+    const u64 ext = bv->extends_as_ones ? BV_ALL_ONES : 0;
+    u64 *words = NULL;
+    int i;
+
+    for (i = 0; i < word_size; i += DS_BITMAP_WORDS) {
+        const int n = min2(DS_BITMAP_WORDS, word_size - i);
+        const int copy = min2(n, max2(bv_words - i, 0));
+        int card;
+
+        if (!words) {
+            words = ALLOC_N(u64, DS_BITMAP_WORDS);
+        }
+        memcpy(words, bv->bits + i, copy * sizeof(u64));
+        memset(words + copy, (int)(ext & 0xFF),
+               (n - copy) * sizeof(u64));
+        memset(words + n, 0, (DS_BITMAP_WORDS - n) * sizeof(u64));
+        if (copy > 0 && i + copy == bv_words && (bv->size & 63)) {
+            /* the bits past the end of the BitVector are all +ext+ */
+            const u64 mask = ((u64)1 << (bv->size & 63)) - 1;
+            words[copy - 1] = (words[copy - 1] & mask) | (ext & ~mask);
+        }
+        if (i + n == word_size && (max_doc & 63)) {
+            words[n - 1] &= ((u64)1 << (max_doc & 63)) - 1;
+        }
+        card = bv_count_words(words, n);
+        if (card > 0) {
+            DocSetContainer *con = ds_insert_container(ds, ds->size,
+                                                       i / DS_BITMAP_WORDS);
+            free(con->data.values);
+            con->type = DS_BITMAP;
+            con->card = card;
+            con->size = con->capa = DS_BITMAP_WORDS;
+            con->data.words = words;
+            words = NULL;
+            dsc_optimize(con);
+            ds->count += card;
+        }
+    }
+    free(words);
+    if (ds->capa > ds->size) {
+        ds->capa = ds->size;
+        REALLOC_N(ds->cons, DocSetContainer, ds->capa);
+    }
+    return ds;
+}
+
+BitVector *ds_to_bv(DocSet *ds)
+{
+    BitVector *bv = bv_new_capa(ds->size > 0
+                                ? (ds->cons[ds->size - 1].key + 1) << 16
+                                : 0);
+    DocSetIterator dsi;
+    int doc_num;
+
+    dsi_init(&dsi, ds);
+    while ((doc_num = dsi_next(&dsi)) >= 0) {
+        bv_set_fast(bv, doc_num);
+    }
+    return bv;
+}
+
+size_t ds_memsize(DocSet *ds)
+{
+    size_t size = sizeof(DocSet) + ds->capa * sizeof(DocSetContainer);
+    int i;
+    for (i = 0; i < ds->size; i++) {
+        const DocSetContainer *con = ds->cons + i;
+        switch (con->type) {
+            case DS_ARRAY:  size += con->capa * sizeof(u16);       break;
+            case DS_BITMAP: size += con->capa * sizeof(u64);       break;
+            default:        size += con->capa * sizeof(DocSetRun); break;
+        }
+    }
+    return size;
+}
+
+/****************************************************************************
+ *
+ * DocSetIterator
+ *
+ ****************************************************************************/
+
+void dsi_init(DocSetIterator *dsi, DocSet *ds)
+{
+    dsi->ds = ds;
+    dsi->ci = 0;
+    dsi->pos = 0;
+    dsi->doc = -1;
+}
+
+int dsi_next(DocSetIterator *dsi)
+{
+    return dsi_skip_to(dsi, dsi->doc + 1);
+}
+
+int dsi_skip_to(DocSetIterator *dsi, int doc_num)
+{
+    const DocSet *ds = dsi->ds;
+    int key, low;
+
+    if (dsi->doc >= doc_num) {
+        return dsi->doc;
+    }
+    key = DS_KEY(doc_num);
+    low = DS_LOW(doc_num);
+    while (dsi->ci < ds->size) {
+        const DocSetContainer *con = ds->cons + dsi->ci;
+        if (con->key < key) {
+            dsi->ci = ds_lower_bound(ds, dsi->ci + 1, key);
+            dsi->pos = 0;
+            continue;
+        }
+        if (con->key > key) {
+            low = 0;
+        }
+        low = dsc_next_from(con, low, &dsi->pos);
+        if (low >= 0) {
+            return dsi->doc = (con->key << 16) | low;
+        }
+        dsi->ci++;
+        dsi->pos = 0;
+        low = 0;
+    }
+    return dsi->doc = -1;
+}
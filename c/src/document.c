@@ -3,6 +3,56 @@
 #include <string.h>
 #include "internal.h"
 
+/****************************************************************************
+ *
+ * TokenList
+ *
+ ****************************************************************************/
+
+TokenList *tkl_new()
+{
+    TokenList *tkl = ALLOC(TokenList);
+    tkl->size = 0;
+    tkl->capa = TKL_INIT_CAPA;
+    tkl->tokens = ALLOC_N(DocToken, tkl->capa);
+    tkl->buf_size = 0;
+    tkl->buf_capa = TKL_INIT_CAPA * 8;
+    tkl->buf = ALLOC_N(char, tkl->buf_capa);
+    return tkl;
+}
+
+void tkl_add(TokenList *tkl, const char *text, int len,
+             int pos_inc, off_t start, off_t end)
+{
+    DocToken *dtk;
+    if (tkl->size >= tkl->capa) {
+        tkl->capa <<= 1;
+        REALLOC_N(tkl->tokens, DocToken, tkl->capa);
+    }
+    if (tkl->buf_size + len + 1 > tkl->buf_capa) {
+        do {
+            tkl->buf_capa <<= 1;
+        } while (tkl->buf_size + len + 1 > tkl->buf_capa);
+        REALLOC_N(tkl->buf, char, tkl->buf_capa);
+    }
+    dtk = tkl->tokens + tkl->size++;
+    dtk->text = tkl->buf_size;
+    dtk->len = len;
+    dtk->pos_inc = pos_inc;
+    dtk->start = start;
+    dtk->end = end;
+    memcpy(tkl->buf + tkl->buf_size, text, len);
+    tkl->buf[tkl->buf_size + len] = '\0';
+    tkl->buf_size += len + 1;
+}
+
+void tkl_destroy(TokenList *tkl)
+{
+    free(tkl->tokens);
+    free(tkl->buf);
+    free(tkl);
+}
+
 /****************************************************************************
  *
  * DocField
@@ -19,6 +69,7 @@ DocField *df_new(Symbol name)
     df->lengths = ALLOC_N(int, df->capa);
     df->destroy_data = false;
     df->boost = 1.0;
+    df->tokens = NULL;
     return df;
 }
 
@@ -35,6 +86,16 @@ DocField *df_add_data_len(DocField *df, char *data, int len)
     return df;
 }
 
+DocField *df_add_token(DocField *df, const char *text, int len,
+                       int pos_inc, off_t start, off_t end)
+{
+    if (!df->tokens) {
+        df->tokens = tkl_new();
+    }
+    tkl_add(df->tokens, text, len, pos_inc, start, end);
+    return df;
+}
+
 DocField *df_add_data(DocField *df, char *data)
 {
     return df_add_data_len(df, data, strlen(data));
@@ -48,6 +109,9 @@ void df_destroy(DocField *df)
             free(df->data[i]);
         }
     }
+    if (df->tokens) {
+        tkl_destroy(df->tokens);
+    }
     free(df->data);
     free(df->lengths);
     free(df);
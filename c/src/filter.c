@@ -21,20 +21,55 @@ void filt_deref(Filter *filt)
     }
 }
 
-BitVector *filt_get_bv(Filter *filt, IndexReader *ir)
+/* the cached result of a Filter for one IndexReader. The BitVector is only
+ * built if it is asked for with filt_get_bv */
+typedef struct FilterResult
+{
+    DocSet *ds;
+    BitVector *bv;
+} FilterResult;
+
+static void fr_destroy(FilterResult *fr)
+{
+    ds_destroy(fr->ds);
+    if (fr->bv) {
+        bv_destroy(fr->bv);
+    }
+    free(fr);
+}
+
+static FilterResult *filt_get_result(Filter *filt, IndexReader *ir)
 {
     CacheObject *co = (CacheObject *)h_get(filt->cache, ir);
 
     if (!co) {
+        FilterResult *fr = ALLOC(FilterResult);
         BitVector *bv;
         if (!ir->cache) {
             ir_add_cache(ir);
         }
         bv = filt->get_bv_i(filt, ir);
+        fr->ds = ds_from_bv(bv, ir->max_doc(ir));
+        fr->bv = NULL;
+        bv_destroy(bv);
         co = co_create(filt->cache, ir->cache, filt, ir,
-                       (free_ft)&bv_destroy, (void *)bv);
+                       (free_ft)&fr_destroy, (void *)fr);
+    }
+    return (FilterResult *)co->obj;
+}
+
+DocSet *filt_get_ds(Filter *filt, IndexReader *ir)
+{
+    return filt_get_result(filt, ir)->ds;
+}
+
+BitVector *filt_get_bv(Filter *filt, IndexReader *ir)
+{
+    FilterResult *fr = filt_get_result(filt, ir);
+    if (!fr->bv) {
+        fr->bv = ds_to_bv(fr->ds);
     }
-    return (BitVector *)co->obj;
+    return fr->bv;
 }
 
 static char *filt_to_s_i(Filter *filt)
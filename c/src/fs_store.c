@@ -28,6 +28,7 @@
 # define DIR_SEPARATOR_CHAR '/'
 # include <unistd.h>
 # include <dirent.h>
+# include <sys/mman.h>
 #endif
 #ifndef O_BINARY
 # define O_BINARY 0
@@ -329,7 +330,8 @@ static const struct InStreamMethods FS_IN_STREAM_METHODS = {
     fsi_read_i,
     fsi_seek_i,
     fsi_length_i,
-    fsi_close_i
+    fsi_close_i,
+    NULL
 };
 
 static InStream *fs_open_input(Store *store, const char *filename)
@@ -349,6 +351,95 @@ static InStream *fs_open_input(Store *store, const char *filename)
     return is;
 }
 
+#ifndef POSH_OS_WIN32
+/*
+ * MMapIn streams map the whole file when it is opened. Reads are then just a
+ * memcpy from the mapping and is_map can hand out pointers into it. The
+ * mapping is shared by all clones of the stream so it is only unmapped when
+ * the last clone is closed.
+ */
+static void mmapi_read_i(InStream *is, uchar *buf, int len)
+{
+    off_t pos = is_pos(is);
+    if ((pos + len) > is->d.length) {
+        RAISE(EOF_ERROR, "Tried to read past end of file. File length is "
+              "<%"OFF_T_PFX"d> and tried to read to <%"OFF_T_PFX"d>",
+              is->d.length, pos + len);
+    }
+    memcpy(buf, is->file.map + pos, len);
+}
+
+static void mmapi_seek_i(InStream *is, off_t pos)
+{
+    (void)is;
+    (void)pos;
+}
+
+static void mmapi_close_i(InStream *is)
+{
+    if (is->file.map && munmap(is->file.map, (size_t)is->d.length)) {
+        RAISE(IO_ERROR, "%s", strerror(errno));
+    }
+}
+
+static off_t mmapi_length_i(InStream *is)
+{
+    return is->d.length;
+}
+
+static const uchar *mmapi_map_i(InStream *is, off_t pos, int len)
+{
+    if ((pos + len) > is->d.length) {
+        RAISE(EOF_ERROR, "Tried to map past end of file. File length is "
+              "<%"OFF_T_PFX"d> and tried to map to <%"OFF_T_PFX"d>",
+              is->d.length, pos + len);
+    }
+    return is->file.map + pos;
+}
+
+static const struct InStreamMethods MMAP_IN_STREAM_METHODS = {
+    mmapi_read_i,
+    mmapi_seek_i,
+    mmapi_length_i,
+    mmapi_close_i,
+    mmapi_map_i
+};
+
+static InStream *mmap_open_input(Store *store, const char *filename)
+{
+    InStream *is;
+    struct stat stt;
+    void *map = NULL;
+    char path[MAX_FILE_PATH];
+    int fd = open(join_path(path, store->dir.path, filename), O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        RAISE(FILE_NOT_FOUND_ERROR,
+              "tried to open \"%s\" but it doesn't exist: <%s>",
+              path, strerror(errno));
+    }
+    if (fstat(fd, &stt)) {
+        close(fd);
+        RAISE(IO_ERROR, "fstat failed: <%s>", strerror(errno));
+    }
+    /* empty files can't be mapped but there is nothing to read anyway */
+    if (stt.st_size > 0) {
+        map = mmap(NULL, (size_t)stt.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            RAISE(IO_ERROR, "couldn't map \"%s\": <%s>", path,
+                  strerror(errno));
+        }
+    }
+    /* the mapping stays valid after the file is closed */
+    close(fd);
+    is = is_new();
+    is->file.map = (uchar *)map;
+    is->d.length = stt.st_size;
+    is->m = &MMAP_IN_STREAM_METHODS;
+    return is;
+}
+#endif
+
 #define LOCK_OBTAIN_TIMEOUT 10
 
 static int fs_lock_obtain(Lock *lock)
@@ -414,6 +505,7 @@ static void fs_close_lock_i(Lock *lock)
 }
 
 static Hash *stores = NULL;
+static Hash *mmap_stores = NULL;
 
 #ifndef UNTHREADED
 static mutex_t stores_mutex = MUTEX_INITIALIZER;
@@ -426,6 +518,13 @@ static void fs_close_i(Store *store)
     mutex_unlock(&stores_mutex);
 }
 
+static void mmap_close_i(Store *store)
+{
+    mutex_lock(&stores_mutex);
+    h_del(mmap_stores, store->dir.path);
+    mutex_unlock(&stores_mutex);
+}
+
 static Store *fs_store_new(const char *pathname)
 {
     struct stat stt;
@@ -475,17 +574,18 @@ static Store *fs_store_new(const char *pathname)
     return new_store;
 }
 
-Store *open_fs_store(const char *pathname)
+static Store *open_fs_store_i(Hash **stores_p, const char *pathname,
+                              bool use_mmap)
 {
     Store *store = NULL;
 
-    if (!stores) {
-        stores = h_new_str(NULL, (free_ft)fs_destroy);
-        register_for_cleanup(stores, (free_ft)h_destroy);
+    if (!*stores_p) {
+        *stores_p = h_new_str(NULL, (free_ft)fs_destroy);
+        register_for_cleanup(*stores_p, (free_ft)h_destroy);
     }
 
     mutex_lock(&stores_mutex);
-    store = (Store *)h_get(stores, pathname);
+    store = (Store *)h_get(*stores_p, pathname);
     if (store) {
         mutex_lock(&store->mutex);
         store->ref_cnt++;
@@ -493,9 +593,25 @@ Store *open_fs_store(const char *pathname)
     }
     else {
         store = fs_store_new(pathname);
-        h_set(stores, store->dir.path, store);
+        if (use_mmap) {
+#ifndef POSH_OS_WIN32
+            store->open_input = &mmap_open_input;
+#endif
+            store->close_i = &mmap_close_i;
+        }
+        h_set(*stores_p, store->dir.path, store);
     }
     mutex_unlock(&stores_mutex);
 
     return store;
 }
+
+Store *open_fs_store(const char *pathname)
+{
+    return open_fs_store_i(&stores, pathname, false);
+}
+
+Store *open_mmap_store(const char *pathname)
+{
+    return open_fs_store_i(&mmap_stores, pathname, true);
+}
@@ -1,5 +1,6 @@
 #include "hash.h"
 #include "global.h"
+#include "threading.h"
 #include <string.h>
 #include "internal.h"
 
@@ -20,6 +21,10 @@ static char *dummy_int_key = "i";
 
 static Hash *free_hts[MAX_FREE_HASH_TABLES];
 static int num_free_hts = 0;
+#ifndef UNTHREADED
+/* the free list is shared by every thread creating hashes */
+static mutex_t free_hts_mutex = MUTEX_INITIALIZER;
+#endif
 
 unsigned long str_hash(const char *const str)
 {
@@ -81,6 +86,14 @@ static INLINE HashEntry *h_resize_lookup(Hash *self,
     }
 }
 
+/* The lookups only read the table so any number of threads can look up keys
+ * in a hash nobody is changing. The hash of a new entry is set when it is
+ * added instead. */
+static INLINE unsigned long h_hash(Hash *self, const void *key)
+{
+    return self->hash_i ? self->hash_i(key) : (unsigned long)key;
+}
+
 static HashEntry *h_lookup_ptr(Hash *self, const void *key)
 {
     register const unsigned long hash = (long)key;
@@ -92,7 +105,6 @@ static HashEntry *h_lookup_ptr(Hash *self, const void *key)
     register HashEntry *freeslot = NULL;
 
     if (he->key == NULL || he->hash == hash) {
-        he->hash = hash;
         return he;
     }
     if (he->key == dummy_key) {
@@ -106,7 +118,6 @@ static HashEntry *h_lookup_ptr(Hash *self, const void *key)
             if (freeslot != NULL) {
                 he = freeslot;
             }
-            he->hash = hash;
             return he;
         }
         if (he->hash == hash) {
@@ -130,7 +141,6 @@ HashEntry *h_lookup(Hash *self, register const void *key)
     eq_ft eq = self->eq_i;
 
     if (he->key == NULL || he->key == key) {
-        he->hash = hash;
         return he;
     }
     if (he->key == dummy_key) {
@@ -149,7 +159,6 @@ HashEntry *h_lookup(Hash *self, register const void *key)
             if (freeslot != NULL) {
                 he = freeslot;
             }
-            he->hash = hash;
             return he;
         }
         if (he->key == key
@@ -165,11 +174,13 @@ HashEntry *h_lookup(Hash *self, register const void *key)
 
 Hash *h_new_str(free_ft free_key, free_ft free_value)
 {
-    Hash *self;
+    Hash *self = NULL;
+    mutex_lock(&free_hts_mutex);
     if (num_free_hts > 0) {
         self = free_hts[--num_free_hts];
     }
-    else {
+    mutex_unlock(&free_hts_mutex);
+    if (self == NULL) {
         self = ALLOC(Hash);
     }
     self->fill = 0;
@@ -242,12 +253,13 @@ void h_destroy(Hash *self)
             free(self->table);
         }
 
+        mutex_lock(&free_hts_mutex);
         if (num_free_hts < MAX_FREE_HASH_TABLES) {
             free_hts[num_free_hts++] = self;
+            self = NULL;
         }
-        else {
-            free(self);
-        }
+        mutex_unlock(&free_hts_mutex);
+        free(self);
     }
 }
 
@@ -348,11 +360,13 @@ INLINE bool h_set_ext(Hash *self, const void *key, HashEntry **he)
             h_resize(self, self->size * ((self->size > SLOW_DOWN) ? 4 : 2));
             *he = self->lookup_i(self, key);
         }
+        (*he)->hash = h_hash(self, key);
         self->fill++;
         self->size++;
         return true;
     }
     else if ((*he)->key == dummy_key) {
+        (*he)->hash = h_hash(self, key);
         self->size++;
         return true;
     }
@@ -240,6 +240,14 @@ static INLINE void index_del_doc_with_key_i(Index *self, Document *doc,
 static INLINE void index_add_doc_i(Index *self, Document *doc)
 {
     if (self->key) {
+        DocField *df;
+        if (self->key->size == 1
+            && (df = doc_get_field(doc, (Symbol)self->key->first->elem))) {
+            ensure_writer_open(self);
+            iw_update_doc(self->iw, df->name, df->data[0], doc);
+            AUTOFLUSH_IW(self);
+            return;
+        }
         index_del_doc_with_key_i(self, doc, self->key);
     }
     ensure_writer_open(self);
@@ -279,11 +287,19 @@ void index_add_array(Index *self, char **fields)
 Query *index_get_query(Index *self, char *qstr)
 {
     int i;
+    bool added = false;
     FieldInfos *fis;
     ensure_searcher_open(self);
     fis = self->ir->fis;
     for (i = fis->size - 1; i >= 0; i--) {
-        hs_add(self->qp->all_fields, (char *)fis->fields[i]->name);
+        if (HASH_KEY_DOES_NOT_EXIST
+            == hs_add(self->qp->all_fields, (char *)fis->fields[i]->name)) {
+            added = true;
+        }
+    }
+    if (added) {
+        /* "*" now covers the new fields */
+        qp_clear_cache(self->qp);
     }
     return qp_parse(self->qp, qstr);
 }
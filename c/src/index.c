@@ -6,11 +6,13 @@
 #include <string.h>
 #include <limits.h>
 #include <ctype.h>
+#include <math.h>
 #ifdef USE_ZLIB
 # include <zlib.h>
 #else
 # include "bzlib.h"
 #endif
+#include "lz.h"
 #include "internal.h"
 
 #define GET_LOCK(lock, name, store, err_msg) do {\
@@ -32,28 +34,32 @@ const Config default_config = {
     SKIP_INTERVAL,  /* skip interval */
     10,             /* default merge factor */
     10000,          /* max_buffered_docs */
+    1000,           /* max_buffered_delete_terms */
     INT_MAX,        /* max_merge_docs */
     10000,          /* maximum field length (number of terms) */
-    true            /* use compound file by default */
+    true,           /* use compound file by default */
+    0,              /* don't sort the segments */
+    {{NULL, INDEX_SORT_STRING, false}}
 };
 
 static void ste_reset(TermEnum *te);
 static char *ste_next(TermEnum *te);
 
-#define FORMAT 0
+/* format 1 added the index sort each segment is sorted by */
+#define FORMAT 1
 #define SEGMENTS_GEN_FILE_NAME "segments"
 #define MAX_EXT_LEN 10
 #define ZIP_BUFFER_SIZE 16348
-#define ZIP_LEVEL 9
 
 /* *** Must be three characters *** */
 static const char *INDEX_EXTENSIONS[] = {
-    "frq", "prx", "fdx", "fdt", "tfx", "tix", "tis", "del", "gen", "cfs"
+    "frq", "prx", "fdx", "fdt", "fdz", "tfx", "tix", "tis", "trp", "blm", "del",
+    "gen", "cfs"
 };
 
 /* *** Must be three characters *** */
 static const char *COMPOUND_EXTENSIONS[] = {
-    "frq", "prx", "fdx", "fdt", "tfx", "tix", "tis"
+    "frq", "prx", "fdx", "fdt", "fdz", "tfx", "tix", "tis", "trp", "blm"
 };
 
 static const char BASE36_DIGITMAP[] = "0123456789abcdefghijklmnopqrstuvwxyz";
@@ -310,7 +316,7 @@ char *fi_to_s(FieldInfo *fi)
 {
     char *str = ALLOC_N(char, strlen((char *)fi->name) + 200);
     char *s = str;
-    s += sprintf(str, "[\"%s\":(%s%s%s%s%s%s%s%s", (char *)fi->name,
+    s += sprintf(str, "[\"%s\":(%s%s%s%s%s%s%s%s%s", (char *)fi->name,
                  fi_is_stored(fi) ? "is_stored, " : "",
                  fi_is_compressed(fi) ? "is_compressed, " : "",
                  fi_is_indexed(fi) ? "is_indexed, " : "",
@@ -318,7 +324,8 @@ char *fi_to_s(FieldInfo *fi)
                  fi_omit_norms(fi) ? "omit_norms, " : "",
                  fi_store_term_vector(fi) ? "store_term_vector, " : "",
                  fi_store_positions(fi) ? "store_positions, " : "",
-                 fi_store_offsets(fi) ? "store_offsets, " : "");
+                 fi_store_offsets(fi) ? "store_offsets, " : "",
+                 fi_has_bloom_filter(fi) ? "bloom_filter, " : "");
     s -= 2;
     if (*s != ',') {
         s += 2;
@@ -543,19 +550,6 @@ void fis_deref(FieldInfos *fis)
     }
 }
 
-static bool fis_has_vectors(FieldInfos *fis)
-{
-    int i;
-    const int fis_size = fis->size;
-
-    for (i = 0; i < fis_size; i++) {
-        if (fi_store_term_vector(fis->fields[i])) {
-            return true;
-        }
-    }
-    return false;
-}
-
 /****************************************************************************
  *
  * SegmentInfo
@@ -573,10 +567,11 @@ SegmentInfo *si_new(char *name, int doc_cnt, Store *store)
     si->norm_gens_size = 0;
     si->ref_cnt = 1;
     si->use_compound_file = false;
+    si->sorted_by = NULL;
     return si;
 }
 
-static SegmentInfo *si_read(Store *store, InStream *is)
+static SegmentInfo *si_read(Store *store, InStream *is, int format)
 {
     SegmentInfo *volatile si = ALLOC_AND_ZERO(SegmentInfo);
     TRY
@@ -594,8 +589,16 @@ static SegmentInfo *si_read(Store *store, InStream *is)
             }
         }
         si->use_compound_file = (bool)is_read_byte(is);
+        if (format >= 1) {
+            si->sorted_by = is_read_string_safe(is);
+            if ('\0' == si->sorted_by[0]) {
+                free(si->sorted_by);
+                si->sorted_by = NULL;
+            }
+        }
     XCATCHALL
         free(si->name);
+        free(si->norm_gens);
         free(si);
     XENDTRY
     return si;
@@ -614,6 +617,7 @@ static void si_write(SegmentInfo *si, OutStream *os)
         }
     }
     os_write_byte(os, (uchar)si->use_compound_file);
+    os_write_string(os, si->sorted_by ? si->sorted_by : "");
 }
 
 void si_deref(SegmentInfo *si)
@@ -621,6 +625,7 @@ void si_deref(SegmentInfo *si)
     if (--si->ref_cnt <= 0) {
         free(si->name);
         free(si->norm_gens);
+        free(si->sorted_by);
         free(si);
     }
 }
@@ -768,6 +773,8 @@ static void si_put(SegmentInfo *si, FILE *stream)
         fprintf(stream, "\t\t\t%d\n", si->norm_gens[i]);
     }
     fprintf(stream, "\t\t}\n");
+    fprintf(stream, "\t\tsorted_by = %s\n",
+            si->sorted_by ? si->sorted_by : "");
     fprintf(stream, "\t\tref_cnt = %d\n", si->ref_cnt);
     fprintf(stream, "\t}\n");
 }
@@ -1094,7 +1101,7 @@ static void sis_read_i(Store *store, FindSegmentsFile *fsf)
         sis->store = store;
 
         sis->generation = fsf->generation;
-        sis->format = is_read_u32(is); /* do nothing. it's the first version */
+        sis->format = is_read_u32(is);
         sis->version = is_read_u64(is);
         sis->counter = is_read_u64(is);
         seg_cnt = is_read_vint(is);
@@ -1106,7 +1113,7 @@ static void sis_read_i(Store *store, FindSegmentsFile *fsf)
         sis->segs = ALLOC_N(SegmentInfo *, sis->capa);
 
         for (i = 0; i < seg_cnt; i++) {
-            sis_add_si(sis, si_read(store, is));
+            sis_add_si(sis, si_read(store, is, sis->format));
         }
         sis->fis = fis_read(is);
         success = true;
@@ -1394,13 +1401,20 @@ char *lazy_df_get_data(LazyDocField *self, int i)
         text = self->data[i].text;
         if (NULL == text) {
             const int read_len = self->data[i].length + 1;
-            is_seek(self->doc->fields_in, self->data[i].start);
-            if (self->is_compressed) {
+            FieldsBlock *fb = self->doc->fields_block;
+            if (self->is_compressed && fb) {
+                self->data[i].text = text = ALLOC_N(char, read_len);
+                memcpy(text, fb->data + self->data[i].start, read_len - 1);
+                text[read_len - 1] = '\0';
+            }
+            else if (self->is_compressed) {
+                is_seek(self->doc->fields_in, self->data[i].start);
                 text = self->data[i].text =
                     is_read_zipped_bytes(self->doc->fields_in, read_len,
                                          &(self->data[i].length));
             }
             else {
+                is_seek(self->doc->fields_in, self->data[i].start);
                 self->data[i].text = text = ALLOC_N(char, read_len);
                 is_read_bytes(self->doc->fields_in, (uchar *)text, read_len);
                 text[read_len - 1] = '\0';
@@ -1411,6 +1425,29 @@ char *lazy_df_get_data(LazyDocField *self, int i)
     return text;
 }
 
+const char *lazy_df_get_view(LazyDocField *self, int i)
+{
+    const char *view = NULL;
+    if (i < self->size && i >= 0) {
+        FieldsBlock *fb = self->doc->fields_block;
+        if (self->data[i].text) {
+            view = self->data[i].text;
+        }
+        else if (self->is_compressed && fb) {
+            view = fb->data + self->data[i].start;
+        }
+        else if (!self->is_compressed) {
+            view = (const char *)is_map(self->doc->fields_in,
+                                        self->data[i].start,
+                                        self->data[i].length);
+        }
+        if (NULL == view) {
+            view = lazy_df_get_data(self, i);
+        }
+    }
+    return view;
+}
+
 void lazy_df_get_bytes(LazyDocField *self, char *buf, int start, int len)
 {
     if (self->is_compressed == 1) {
@@ -1480,6 +1517,7 @@ static LazyDoc *lazy_doc_new(int size, InStream *fdt_in)
     self->size = size;
     self->fields = ALLOC_AND_ZERO_N(LazyDocField *, size);
     self->fields_in = is_clone(fdt_in);
+    self->fields_block = NULL;
     return self;
 }
 
@@ -1487,6 +1525,9 @@ void lazy_doc_close(LazyDoc *self)
 {
     h_destroy(self->field_dictionary);
     is_close(self->fields_in);
+    if (self->fields_block) {
+        fb_deref(self->fields_block);
+    }
     free(self->fields);
     free(self);
 }
@@ -1503,13 +1544,98 @@ LazyDocField *frt_lazy_doc_get(LazyDoc *self, Symbol field)
     return (LazyDocField *)h_get(self->field_dictionary, field);
 }
 
+#define FIELDS_IDX_PTR_SIZE 12
+/* the .fdz file ends with the block count and the block index pointer */
+#define FIELDS_BLOCK_FOOTER_SIZE 12
+
+/****************************************************************************
+ * FieldsBlock
+ ****************************************************************************/
+
+void fb_deref(FieldsBlock *fb)
+{
+    if (--(fb->ref_cnt) <= 0) {
+        free(fb->offsets);
+        free(fb->data);
+        free(fb);
+    }
+}
+
+/* Each block is the zipped data of its documents followed by the length of
+ * each document's data as a 4 byte little-endian integer. */
+static FieldsBlock *fb_read(InStream *fdz_in, FieldsBlockInfo *fbi)
+{
+    FieldsBlock *fb = ALLOC(FieldsBlock);
+    const int doc_cnt = fbi->doc_cnt;
+    const uchar *lens;
+    int i, data_len;
+
+    fb->first_doc = fbi->first_doc;
+    fb->doc_cnt = doc_cnt;
+    fb->ref_cnt = 1;
+    fb->data = ALLOC_N(char, fbi->raw_len);
+    is_seek(fdz_in, fbi->ptr);
+    if (fbi->zip_len == fbi->raw_len) {
+        /* the block didn't compress so it was stored as is */
+        is_read_bytes(fdz_in, (uchar *)fb->data, fbi->raw_len);
+    }
+    else {
+        char *zip_buf = ALLOC_N(char, fbi->zip_len);
+        int raw_len;
+        is_read_bytes(fdz_in, (uchar *)zip_buf, fbi->zip_len);
+        raw_len = lz_decompress(zip_buf, fbi->zip_len, fb->data, fbi->raw_len);
+        free(zip_buf);
+        if (raw_len != fbi->raw_len) {
+            free(fb->data);
+            free(fb);
+            RAISE(IO_ERROR, "corrupt stored fields block for document %d",
+                  fbi->first_doc);
+        }
+    }
+
+    data_len = fbi->raw_len - 4 * doc_cnt;
+    lens = (uchar *)fb->data + data_len;
+    fb->offsets = ALLOC_N(int, doc_cnt + 1);
+    fb->offsets[0] = 0;
+    for (i = 0; i < doc_cnt; i++, lens += 4) {
+        fb->offsets[i + 1] = fb->offsets[i] + (int)(lens[0] | (lens[1] << 8)
+                                                    | (lens[2] << 16)
+                                                    | ((u32)lens[3] << 24));
+    }
+    if (fb->offsets[doc_cnt] != data_len) {
+        fb_deref(fb);
+        RAISE(IO_ERROR, "corrupt stored fields block for document %d",
+              fbi->first_doc);
+    }
+    return fb;
+}
+
 /****************************************************************************
  *
  * FieldsReader
  *
  ****************************************************************************/
 
-#define FIELDS_IDX_PTR_SIZE 12
+static void fr_read_block_index(FieldsReader *fr)
+{
+    InStream *fdz_in = fr->fdz_in;
+    off_t ptr = 0;
+    int i;
+
+    is_seek(fdz_in, is_length(fdz_in) - FIELDS_BLOCK_FOOTER_SIZE);
+    fr->block_cnt = (int)is_read_u32(fdz_in);
+    is_seek(fdz_in, (off_t)is_read_u64(fdz_in));
+    fr->blocks = ALLOC_N(FieldsBlockInfo, fr->block_cnt);
+    for (i = 0; i < fr->block_cnt; i++) {
+        FieldsBlockInfo *fbi = &fr->blocks[i];
+        fbi->first_doc = is_read_vint(fdz_in);
+        fbi->doc_cnt = is_read_vint(fdz_in);
+        fbi->raw_len = is_read_vint(fdz_in);
+        fbi->zip_len = is_read_vint(fdz_in);
+        fbi->ptr = ptr;
+        ptr += fbi->zip_len;
+    }
+}
 
 FieldsReader *fr_open(Store *store, const char *segment, FieldInfos *fis)
 {
@@ -1529,6 +1655,16 @@ FieldsReader *fr_open(Store *store, const char *segment, FieldInfos *fis)
     fr->size = is_length(fdx_in) / FIELDS_IDX_PTR_SIZE;
     fr->store = store;
 
+    fr->fdz_in = NULL;
+    fr->block_cnt = 0;
+    fr->blocks = NULL;
+    fr->block = NULL;
+    strcpy(file_name + segment_len, ".fdz");
+    if (store->exists(store, file_name)) {
+        fr->fdz_in = store->open_input(store, file_name);
+        fr_read_block_index(fr);
+    }
+
     return fr;
 }
 
@@ -1539,6 +1675,13 @@ FieldsReader *fr_clone(FieldsReader *orig)
     memcpy(fr, orig, sizeof(FieldsReader));
     fr->fdx_in = is_clone(orig->fdx_in);
     fr->fdt_in = is_clone(orig->fdt_in);
+    if (orig->fdz_in) {
+        fr->fdz_in = is_clone(orig->fdz_in);
+        fr->blocks = ALLOC_N(FieldsBlockInfo, orig->block_cnt);
+        memcpy(fr->blocks, orig->blocks,
+               orig->block_cnt * sizeof(FieldsBlockInfo));
+    }
+    fr->block = NULL;
 
     return fr;
 }
@@ -1547,9 +1690,63 @@ void fr_close(FieldsReader *fr)
 {
     is_close(fr->fdt_in);
     is_close(fr->fdx_in);
+    if (fr->fdz_in) {
+        is_close(fr->fdz_in);
+        free(fr->blocks);
+    }
+    if (fr->block) {
+        fb_deref(fr->block);
+    }
     free(fr);
 }
 
+/* Get the block holding +doc_num+'s compressed fields, or NULL if it has
+ * none. The last block read is kept so reading consecutive documents only
+ * decompresses each block once. */
+static FieldsBlock *fr_get_block(FieldsReader *fr, int doc_num)
+{
+    FieldsBlock *fb = fr->block;
+    int lo = 0, hi = fr->block_cnt - 1;
+
+    if (fb && doc_num >= fb->first_doc
+        && doc_num < fb->first_doc + fb->doc_cnt) {
+        return fb;
+    }
+    while (lo <= hi) {
+        const int mid = (lo + hi) >> 1;
+        if (fr->blocks[mid].first_doc <= doc_num) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    if (hi < 0 || doc_num >= fr->blocks[hi].first_doc
+                             + fr->blocks[hi].doc_cnt) {
+        return NULL;
+    }
+    fb = fb_read(fr->fdz_in, &fr->blocks[hi]);
+    if (fr->block) {
+        fb_deref(fr->block);
+    }
+    return fr->block = fb;
+}
+
+/* the compressed field data of +doc_num+ which must have some */
+static const char *fr_get_block_data(FieldsReader *fr, int doc_num, int *len)
+{
+    FieldsBlock *fb = fr_get_block(fr, doc_num);
+    int i;
+    if (NULL == fb) {
+        RAISE(IO_ERROR, "no stored fields block for document %d", doc_num);
+    }
+    i = doc_num - fb->first_doc;
+    if (len) {
+        *len = fb->offsets[i + 1] - fb->offsets[i];
+    }
+    return fb->data + fb->offsets[i];
+}
+
 static DocField *fr_df_new(Symbol name, int size, bool is_compressed)
 {
     DocField *df = ALLOC(DocField);
@@ -1560,6 +1757,7 @@ static DocField *fr_df_new(Symbol name, int size, bool is_compressed)
     df->destroy_data = true;
     df->boost = 1.0;
     df->is_compressed = is_compressed;
+    df->tokens = NULL;
     return df;
 }
 
@@ -1575,35 +1773,82 @@ static void fr_read_zipped_fields(FieldsReader *fr, DocField *df)
     }
 }
 
-Document *fr_get_doc(FieldsReader *fr, int doc_num)
+static void fr_read_block_fields(const char *data, DocField *df)
+{
+    int i;
+    const int df_size = df->size;
+
+    for (i = 0; i < df_size; i++) {
+        const int len = df->lengths[i];
+        df->data[i] = ALLOC_N(char, len + 1);
+        memcpy(df->data[i], data, len);
+        df->data[i][len] = '\0';
+        data += len;
+    }
+}
+
+Document *fr_get_doc_fields(FieldsReader *fr, int doc_num, BitVector *fields)
 {
     int i, j;
     off_t pos;
-    int stored_cnt;
+    int stored_cnt, block_len = 0;
     Document *doc = doc_new();
     InStream *fdx_in = fr->fdx_in;
     InStream *fdt_in = fr->fdt_in;
+    const char *block_data = NULL;
+    DocField **dfs;
+    /* for fields in the block, the offset of their data in the block. For
+     * skipped fields in the .fdt file, the number of bytes to skip */
+    int *offsets;
 
     is_seek(fdx_in, doc_num * FIELDS_IDX_PTR_SIZE);
     pos = (off_t)is_read_u64(fdx_in);
     is_seek(fdt_in, pos);
     stored_cnt = is_read_vint(fdt_in);
+    dfs = ALLOC_N(DocField *, stored_cnt);
+    offsets = ALLOC_AND_ZERO_N(int, stored_cnt);
 
     for (i = 0; i < stored_cnt; i++) {
         const int field_num = is_read_vint(fdt_in);
         FieldInfo *fi = fr->fis->fields[field_num];
         const int df_size = is_read_vint(fdt_in);
-        DocField *df = fr_df_new(fi->name, df_size, fi_is_compressed(fi));
+        const bool in_block = fi_is_compressed(fi) && fr->fdz_in;
+        DocField *df = NULL;
 
+        if (NULL == fields || bv_get(fields, field_num)) {
+            df = fr_df_new(fi->name, df_size, fi_is_compressed(fi));
+            doc_add_field(doc, df);
+        }
+        if (in_block && df) {
+            offsets[i] = block_len;
+        }
         for (j = 0; j < df_size; j++) {
-            df->lengths[j] = is_read_vint(fdt_in);
+            const int len = is_read_vint(fdt_in);
+            if (df) {
+                df->lengths[j] = len;
+            }
+            if (in_block) {
+                block_len += len;
+            }
+            else if (NULL == df) {
+                offsets[i] += len + 1; /* Each field has one ' ' byte */
+            }
         }
-
-        doc_add_field(doc, df);
+        dfs[i] = df;
     }
     for (i = 0; i < stored_cnt; i++) {
-        DocField *df = doc->fields[i];
-        if (df->is_compressed) {
+        DocField *df = dfs[i];
+        if (NULL == df) {
+            /* skipped block fields have no bytes in the .fdt so offset is 0 */
+            is_seek(fdt_in, is_pos(fdt_in) + offsets[i]);
+        }
+        else if (df->is_compressed && fr->fdz_in) {
+            if (NULL == block_data) {
+                block_data = fr_get_block_data(fr, doc_num, NULL);
+            }
+            fr_read_block_fields(block_data + offsets[i], df);
+        }
+        else if (df->is_compressed) {
             fr_read_zipped_fields(fr, df);
         }
         else {
@@ -1616,13 +1861,20 @@ Document *fr_get_doc(FieldsReader *fr, int doc_num)
             }
         }
     }
+    free(offsets);
+    free(dfs);
 
     return doc;
 }
 
+Document *fr_get_doc(FieldsReader *fr, int doc_num)
+{
+    return fr_get_doc_fields(fr, doc_num, NULL);
+}
+
 LazyDoc *fr_get_lazy_doc(FieldsReader *fr, int doc_num)
 {
-    int start = 0;
+    int start = 0, block_start = -1;
     int i, j;
     off_t pos;
     int stored_cnt;
@@ -1643,12 +1895,32 @@ LazyDoc *fr_get_lazy_doc(FieldsReader *fr, int doc_num)
                                             fi_is_compressed(fi));
         const int field_start = start;
 
-        /* get the starts relative positions this time around */
-        for (j = 0; j < data_cnt; j++) {
-            lazy_df->data[j].start = start;
-            start += 1 + (lazy_df->data[j].length = is_read_vint(fdt_in));
+        if (lazy_df->is_compressed && fr->fdz_in) {
+            /* compressed data is read from the block, not the .fdt file */
+            if (block_start < 0) {
+                FieldsBlock *fb;
+                block_start = (int)(fr_get_block_data(fr, doc_num, NULL)
+                                    - fr->block->data);
+                fb = lazy_doc->fields_block = fr->block;
+                fb->ref_cnt++;
+            }
+            for (j = 0; j < data_cnt; j++) {
+                lazy_df->data[j].start = block_start;
+                block_start += lazy_df->data[j].length = is_read_vint(fdt_in);
+            }
+            lazy_df->len = -1;
+            for (j = 0; j < data_cnt; j++) {
+                lazy_df->len += lazy_df->data[j].length + 1;
+            }
+        }
+        else {
+            /* get the starts relative positions this time around */
+            for (j = 0; j < data_cnt; j++) {
+                lazy_df->data[j].start = start;
+                start += 1 + (lazy_df->data[j].length = is_read_vint(fdt_in));
+            }
+            lazy_df->len = start - field_start - 1;
         }
-        lazy_df->len = start - field_start - 1;
 
         lazy_doc_add_field(lazy_doc, lazy_df, i);
     }
@@ -1657,6 +1929,9 @@ LazyDoc *fr_get_lazy_doc(FieldsReader *fr, int doc_num)
         LazyDocField *lazy_df = lazy_doc->fields[i];
         const int data_cnt = lazy_df->size;
         const off_t start = is_pos(fdt_in);
+        if (lazy_df->is_compressed && fr->fdz_in) {
+            continue;
+        }
         for (j = 0; j < data_cnt; j++) {
             lazy_df->data[j].start += start;
         }
@@ -1807,7 +2082,7 @@ TermVector *fr_get_field_tv(FieldsReader *fr, int doc_num, int field_num)
 
 FieldsWriter *fw_open(Store *store, const char *segment, FieldInfos *fis)
 {
-    FieldsWriter *fw = ALLOC(FieldsWriter);
+    FieldsWriter *fw = ALLOC_AND_ZERO(FieldsWriter);
     char file_name[SEGMENT_NAME_MAX_LENGTH];
     size_t segment_len = strlen(segment);
 
@@ -1819,7 +2094,12 @@ FieldsWriter *fw_open(Store *store, const char *segment, FieldInfos *fis)
     strcpy(file_name + segment_len, ".fdx");
     fw->fdx_out = store->new_output(store, file_name);
 
+    strcpy(file_name + segment_len, ".fdz");
+    fw->fdz_out = store->new_output(store, file_name);
+
     fw->buffer = ram_new_buffer();
+    fw->block_index = ram_new_buffer();
+    fw->block_first_doc = -1;
 
     fw->fis = fis;
     fw->tv_fields = ary_new_type_capa(TVField, TV_FIELD_INIT_CAPA);
@@ -1827,72 +2107,103 @@ FieldsWriter *fw_open(Store *store, const char *segment, FieldInfos *fis)
     return fw;
 }
 
-void fw_close(FieldsWriter *fw)
+static void fw_write_block(FieldsWriter *fw)
 {
-    os_close(fw->fdt_out);
-    os_close(fw->fdx_out);
-    ram_destroy_buffer(fw->buffer);
-    ary_free(fw->tv_fields);
-    free(fw);
-}
+    int i, raw_len, zip_len;
+    char *zip_buf;
+    uchar *lens;
 
-#ifdef USE_ZLIB
-static int os_write_zipped_bytes(OutStream* out_stream, uchar *data, int length)
-{
-    int ret, buf_size, zip_len = 0;
-    uchar out_buffer[ZIP_BUFFER_SIZE];
-    z_stream zstrm;
-    zstrm.zalloc = Z_NULL;
-    zstrm.zfree  = Z_NULL;
-    zstrm.opaque = Z_NULL;
-    if ((ret = deflateInit(&zstrm, ZIP_LEVEL)) != Z_OK) zraise(ret);
+    REALLOC_N(fw->block_data, char,
+              fw->block_data_size + 4 * fw->block_doc_cnt);
+    lens = (uchar *)fw->block_data + fw->block_data_size;
+    for (i = 0; i < fw->block_doc_cnt; i++) {
+        const u32 len = (u32)fw->block_doc_lens[i];
+        *lens++ = (uchar)len;
+        *lens++ = (uchar)(len >> 8);
+        *lens++ = (uchar)(len >> 16);
+        *lens++ = (uchar)(len >> 24);
+    }
+    raw_len = fw->block_data_size + 4 * fw->block_doc_cnt;
+    fw->block_data_capa = raw_len;
 
-    zstrm.avail_in = length;
-    zstrm.next_in = data;
-    zstrm.avail_out = ZIP_BUFFER_SIZE;
-    zstrm.next_out = out_buffer;
+    zip_buf = ALLOC_N(char, LZ_COMPRESS_BOUND(raw_len));
+    zip_len = lz_compress(fw->block_data, raw_len, zip_buf);
+    if (zip_len >= raw_len) {
+        /* store blocks that don't compress as they are */
+        zip_len = raw_len;
+        os_write_bytes(fw->fdz_out, (uchar *)fw->block_data, raw_len);
+    }
+    else {
+        os_write_bytes(fw->fdz_out, (uchar *)zip_buf, zip_len);
+    }
+    free(zip_buf);
 
-    do {
-        ret = deflate(&zstrm, Z_FINISH); /* no bad return value */
-        assert(ret != Z_STREAM_ERROR) ;  /* state not clobbered */
-        zip_len += buf_size = ZIP_BUFFER_SIZE - zstrm.avail_out;
-        os_write_bytes(out_stream, out_buffer, buf_size);
-    } while (zstrm.avail_out == 0);
-    assert(zstrm.avail_in == 0);         /* all input will be used */
+    os_write_vint(fw->block_index, fw->block_first_doc);
+    os_write_vint(fw->block_index, fw->block_doc_cnt);
+    os_write_vint(fw->block_index, raw_len);
+    os_write_vint(fw->block_index, zip_len);
+    fw->block_cnt++;
 
-    /* clean up */
-    (void)deflateEnd(&zstrm);
-    return zip_len;
+    fw->block_first_doc = -1;
+    fw->block_data_size = fw->block_doc_start = 0;
+    fw->block_doc_cnt = 0;
 }
-#else
-static int os_write_zipped_bytes(OutStream* out_stream, uchar *data, int length)
+
+/* add compressed field data to the current document */
+static void fw_add_block_data(FieldsWriter *fw, const char *data, int len)
 {
-    int ret, buf_size, zip_len = 0;
-    char out_buffer[ZIP_BUFFER_SIZE];
-    bz_stream zstrm;
-    zstrm.bzalloc = NULL;
-    zstrm.bzfree  = NULL;
-    zstrm.opaque = NULL;
-    if ((ret = BZ2_bzCompressInit(&zstrm, ZIP_LEVEL, 0, 0)) != BZ_OK) zraise(ret);
+    if (fw->block_first_doc < 0) {
+        fw->block_first_doc = fw->doc_num;
+    }
+    if (fw->block_data_size + len > fw->block_data_capa) {
+        fw->block_data_capa = max2(fw->block_data_capa << 1,
+                                   fw->block_data_size + len);
+        REALLOC_N(fw->block_data, char, fw->block_data_capa);
+    }
+    memcpy(fw->block_data + fw->block_data_size, data, len);
+    fw->block_data_size += len;
+}
 
-    zstrm.avail_in = length;
-    zstrm.next_in = (char *)data;
-    zstrm.avail_out = ZIP_BUFFER_SIZE;
-    zstrm.next_out = out_buffer;
+/* must be called once for every document added to the FieldsWriter */
+static void fw_end_doc(FieldsWriter *fw)
+{
+    if (fw->block_first_doc >= 0) {
+        if (fw->block_doc_cnt >= fw->block_doc_capa) {
+            fw->block_doc_capa = fw->block_doc_capa
+                ? fw->block_doc_capa << 1 : 64;
+            REALLOC_N(fw->block_doc_lens, int, fw->block_doc_capa);
+        }
+        fw->block_doc_lens[fw->block_doc_cnt++]
+            = fw->block_data_size - fw->block_doc_start;
+        fw->block_doc_start = fw->block_data_size;
+        if (fw->block_data_size >= FIELDS_BLOCK_SIZE) {
+            fw_write_block(fw);
+        }
+    }
+    fw->doc_num++;
+}
 
-    do {
-        ret = BZ2_bzCompress(&zstrm, BZ_FINISH); /* no bad return value */
-        assert(ret != BZ_SEQUENCE_ERROR);        /* state not clobbered */
-        zip_len += buf_size = ZIP_BUFFER_SIZE - zstrm.avail_out;
-        os_write_bytes(out_stream, (uchar *)out_buffer, buf_size);
-    } while (zstrm.avail_out == 0);
-    assert(zstrm.avail_in == 0);       /* all input will be used */
+void fw_close(FieldsWriter *fw)
+{
+    off_t block_index_ptr;
+    if (fw->block_first_doc >= 0) {
+        fw_write_block(fw);
+    }
+    block_index_ptr = os_pos(fw->fdz_out);
+    ramo_write_to(fw->block_index, fw->fdz_out);
+    os_write_u32(fw->fdz_out, (u32)fw->block_cnt);
+    os_write_u64(fw->fdz_out, (u64)block_index_ptr);
 
-    /* clean up */
-    (void)BZ2_bzCompressEnd(&zstrm);
-    return zip_len;
+    os_close(fw->fdt_out);
+    os_close(fw->fdx_out);
+    os_close(fw->fdz_out);
+    ram_destroy_buffer(fw->buffer);
+    ram_destroy_buffer(fw->block_index);
+    free(fw->block_data);
+    free(fw->block_doc_lens);
+    ary_free(fw->tv_fields);
+    free(fw);
 }
-#endif
 
 void fw_add_doc(FieldsWriter *fw, Document *doc)
 {
@@ -1925,10 +2236,8 @@ void fw_add_doc(FieldsWriter *fw, Document *doc)
             if (fi_is_compressed(fi)) {
                 for (j = 0; j < df_size; j++) {
                     const int length = df->lengths[j];
-                    int zip_len = os_write_zipped_bytes(fw->buffer,
-                                                        (uchar*)df->data[j],
-                                                        length);
-                    os_write_vint(fdt_out, zip_len - 1);
+                    os_write_vint(fdt_out, length);
+                    fw_add_block_data(fw, df->data[j], length);
                 }
             }
             else {
@@ -1944,6 +2253,7 @@ void fw_add_doc(FieldsWriter *fw, Document *doc)
         }
     }
     ramo_write_to(fw->buffer, fdt_out);
+    fw_end_doc(fw);
 }
 
 void fw_write_tv_index(FieldsWriter *fw)
@@ -2077,17 +2387,22 @@ static void sti_destroy(SegmentTermIndex *sti)
         free(sti->index_term_lens);
         free(sti->index_term_infos);
         free(sti->index_ptrs);
+        free(sti->restart_offsets);
+    }
+    if (sti->bloom) {
+        bf_destroy(sti->bloom);
     }
     free(sti);
 }
 
 static void sti_ensure_index_is_read(SegmentTermIndex *sti,
-                                     TermEnum *index_te)
+                                     SegmentFieldIndex *sfi)
 {
     if (NULL == sti->index_terms) {
         int i;
         int index_cnt = sti->index_cnt;
         off_t index_ptr = 0;
+        TermEnum *index_te = sfi->index_te;
         ste_reset(index_te);
         is_seek(STE(index_te)->is, sti->index_ptr);
         STE(index_te)->size = sti->index_cnt;
@@ -2109,6 +2424,16 @@ static void sti_ensure_index_is_read(SegmentTermIndex *sti,
             index_ptr += is_read_voff_t(STE(index_te)->is);
             sti->index_ptrs[i] = index_ptr;
         }
+
+        if (sfi->restart_in) {
+            const int restart_cnt =
+                index_cnt * (sfi->index_interval / sfi->restart_interval - 1);
+            sti->restart_offsets = ALLOC_N(u32, restart_cnt);
+            is_seek(sfi->restart_in, sti->restart_ptr);
+            for (i = 0; i < restart_cnt; i++) {
+                sti->restart_offsets[i] = is_read_u32(sfi->restart_in);
+            }
+        }
     }
 }
 
@@ -2142,7 +2467,7 @@ static int sti_get_index_offset(SegmentTermIndex *sti, const char *term)
 #define SFI_ENSURE_INDEX_IS_READ(sfi, sti) do {\
     if (NULL == sti->index_terms) {\
         mutex_lock(&sfi->mutex);\
-        sti_ensure_index_is_read(sti, sfi->index_te);\
+        sti_ensure_index_is_read(sti, sfi);\
         mutex_unlock(&sfi->mutex);\
     }\
 } while (0)
@@ -2153,6 +2478,8 @@ SegmentFieldIndex *sfi_open(Store *store, const char *segment)
     SegmentFieldIndex *sfi = ALLOC(SegmentFieldIndex);
     char file_name[SEGMENT_NAME_MAX_LENGTH];
     InStream *is;
+    off_t restart_ptr = sizeof(u32);
+    int restarts_per_block = 0;
 
     mutex_init(&sfi->mutex, NULL);
 
@@ -2162,6 +2489,18 @@ SegmentFieldIndex *sfi_open(Store *store, const char *segment)
     sfi->index_interval = is_read_vint(is);
     sfi->skip_interval = is_read_vint(is);
 
+    /* segments written before restart points were added have no .trp file */
+    sprintf(file_name, "%s.trp", segment);
+    if (store->exists(store, file_name)) {
+        sfi->restart_in = store->open_input(store, file_name);
+        sfi->restart_interval = (int)is_read_u32(sfi->restart_in);
+        restarts_per_block = sfi->index_interval / sfi->restart_interval - 1;
+    }
+    else {
+        sfi->restart_in = NULL;
+        sfi->restart_interval = 0;
+    }
+
     sfi->field_dict = h_new_int((free_ft)&sti_destroy);
 
     for (; field_count > 0; field_count--) {
@@ -2171,13 +2510,38 @@ SegmentFieldIndex *sfi_open(Store *store, const char *segment)
         sti->ptr = is_read_voff_t(is);
         sti->index_cnt = is_read_vint(is);
         sti->size = is_read_vint(is);
+        /* the restart tables are stored field by field in .tfx order */
+        sti->restart_ptr = restart_ptr;
+        restart_ptr += (off_t)sti->index_cnt * restarts_per_block
+            * sizeof(u32);
         h_set_int(sfi->field_dict, field_num, sti);
     }
     is_close(is);
 
+    /* segments written before bloom filters were added have no .blm file */
+    sprintf(file_name, "%s.blm", segment);
+    if (store->exists(store, file_name)) {
+        is = store->open_input(store, file_name);
+        for (field_count = (int)is_read_u32(is); field_count > 0;
+             field_count--) {
+            int field_num = is_read_vint(is);
+            BloomFilter *bf = bf_read(is);
+            SegmentTermIndex *sti =
+                (SegmentTermIndex *)h_get_int(sfi->field_dict, field_num);
+            if (sti) {
+                sti->bloom = bf;
+            }
+            else {
+                bf_destroy(bf);
+            }
+        }
+        is_close(is);
+    }
+
     sprintf(file_name, "%s.tix", segment);
     is = store->open_input(store, file_name);
     sfi->index_te = ste_new(is, sfi);
+    STE(sfi->index_te)->restart_interval = 0;
     return sfi;
 }
 
@@ -2185,6 +2549,9 @@ void sfi_close(SegmentFieldIndex *sfi)
 {
     mutex_destroy(&sfi->mutex);
     ste_close(sfi->index_te);
+    if (sfi->restart_in) {
+        is_close(sfi->restart_in);
+    }
     h_destroy(sfi->field_dict);
     free(sfi);
 }
@@ -2219,6 +2586,11 @@ static char *ste_next(TermEnum *te)
     te->curr_term_len = term_read(te->curr_term, is);
 
     ti = &(te->curr_ti);
+    if (STE(te)->restart_interval
+        && 0 == (STE(te)->pos % STE(te)->restart_interval)) {
+        /* restart points hold absolute pointers */
+        ZEROSET(ti, TermInfo);
+    }
     ti->doc_freq = is_read_vint(is);     /* read doc freq */
     ti->frq_ptr += is_read_voff_t(is);   /* read freq ptr */
     ti->prx_ptr += is_read_voff_t(is);   /* read prox ptr */
@@ -2265,12 +2637,74 @@ static void ste_index_seek(TermEnum *te, SegmentTermIndex *sti, int idx_offset)
     te->curr_ti = sti->index_term_infos[idx_offset];
 }
 
+/* The position in the .tis file of the +restart+th restart point of index
+ * block +idx_offset+. The first restart point in each block, numbered 0, is
+ * reached through the index term so it isn't in the restart table. */
+static INLINE off_t ste_restart_ptr(SegmentTermEnum *ste,
+                                    SegmentTermIndex *sti,
+                                    int idx_offset, int restart)
+{
+    const int restarts_per_block =
+        ste->sfi->index_interval / ste->restart_interval - 1;
+    return sti->index_ptrs[idx_offset]
+        + sti->restart_offsets[idx_offset * restarts_per_block + restart - 1];
+}
+
+/* Binary search the restart points of index block +idx_offset+ for the last
+ * one at or before +term+ and move the enum to it. The enum is only ever
+ * moved forward so it is left where it is if it is already past that restart
+ * point. */
+static void ste_restart_scan_to(TermEnum *te, SegmentTermIndex *sti,
+                                int idx_offset, const char *term)
+{
+    SegmentTermEnum *ste = STE(te);
+    const int restart_interval = ste->restart_interval;
+    const int block_start = idx_offset * ste->sfi->index_interval;
+    const int block_size = min2(ste->sfi->index_interval,
+                                ste->size - block_start);
+    int lo = 1;
+    int hi = (block_size - 1) / restart_interval;
+    off_t orig_ptr;
+    char buf[MAX_WORD_SIZE];
+
+    if (NULL == sti->restart_offsets || hi < lo) {
+        return;
+    }
+    orig_ptr = is_pos(ste->is);
+    while (hi >= lo) {
+        int mid = (lo + hi) >> 1;
+        int delta;
+        is_seek(ste->is, ste_restart_ptr(ste, sti, idx_offset, mid));
+        term_read(buf, ste->is);
+        delta = strcmp(term, buf);
+        if (delta < 0) {
+            hi = mid - 1;
+        }
+        else if (delta > 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+            break;
+        }
+    }
+    if (hi > 0 && ste->pos < block_start + hi * restart_interval) {
+        is_seek(ste->is, ste_restart_ptr(ste, sti, idx_offset, hi));
+        ste->pos = block_start + hi * restart_interval - 1;
+        ste_next(te);
+    }
+    else {
+        is_seek(ste->is, orig_ptr);
+    }
+}
+
 static char *ste_scan_to(TermEnum *te, const char *term)
 {
     SegmentFieldIndex *sfi = STE(te)->sfi;
     SegmentTermIndex *sti
         = (SegmentTermIndex *)h_get_int(sfi->field_dict, te->field_num);
     if (sti && sti->size > 0) {
+        int idx_offset;
         SFI_ENSURE_INDEX_IS_READ(sfi, sti);
         if (term[0] == '\0') {
             ste_index_seek(te, sti, 0);
@@ -2280,13 +2714,16 @@ static char *ste_scan_to(TermEnum *te, const char *term)
         if (STE(te)->pos < STE(te)->size && strcmp(te->curr_term, term) <= 0) {
             int enum_offset = (int)(STE(te)->pos / sfi->index_interval) + 1;
             /* if we are at the end of the index or before the next index
-             * ptr then a simple scan suffices */
+             * ptr then we can stay in the current block */
             if (sti->index_cnt == enum_offset ||
                 strcmp(term, sti->index_terms[enum_offset]) < 0) {
+                ste_restart_scan_to(te, sti, enum_offset - 1, term);
                 return te_skip_to(te, term);
             }
         }
-        ste_index_seek(te, sti, sti_get_index_offset(sti, term));
+        idx_offset = sti_get_index_offset(sti, term);
+        ste_index_seek(te, sti, idx_offset);
+        ste_restart_scan_to(te, sti, idx_offset, term);
         return te_skip_to(te, term);
     }
     else {
@@ -2348,6 +2785,17 @@ static char *ste_get_term(TermEnum *te, int pos)
             SFI_ENSURE_INDEX_IS_READ(ste->sfi, sti);
             ste_index_seek(te, sti, pos / idx_int);
         }
+        if (ste->restart_interval && pos % idx_int >= ste->restart_interval
+            && pos - ste->pos > ste->restart_interval) {
+            /* jump to the last restart point before +pos+ */
+            const int restart = (pos % idx_int) / ste->restart_interval;
+            SegmentTermIndex *sti = (SegmentTermIndex *)h_get_int(
+                ste->sfi->field_dict, te->field_num);
+            SFI_ENSURE_INDEX_IS_READ(ste->sfi, sti);
+            is_seek(ste->is, ste_restart_ptr(ste, sti, pos / idx_int,
+                                             restart));
+            ste->pos = pos - pos % ste->restart_interval - 1;
+        }
         while (ste->pos < pos) {
             if (NULL == ste_next(te)) {
                 return NULL;
@@ -2368,6 +2816,7 @@ TermEnum *ste_new(InStream *is, SegmentFieldIndex *sfi)
     ste->pos = -1;
     ste->sfi = sfi;
     ste->skip_interval = sfi ? sfi->skip_interval : INT_MAX;
+    ste->restart_interval = sfi ? sfi->restart_interval : 0;
 
     return TE(ste);
 }
@@ -2615,17 +3064,119 @@ TermEnum *mte_new(MultiReader *mr, int field_num, const char *term)
  *
  ****************************************************************************/
 
+#define TI_CACHE_STRIPE_SIZE (TI_CACHE_SIZE / TI_CACHE_STRIPES)
+
+static unsigned long tice_hash(const TermInfoCacheEntry *entry)
+{
+    return str_hash(entry->term) * 31 + entry->field_num;
+}
+
+static int tice_eq(const TermInfoCacheEntry *e1, const TermInfoCacheEntry *e2)
+{
+    return e1->field_num == e2->field_num && 0 == strcmp(e1->term, e2->term);
+}
+
+static void tics_unlink(TermInfoCacheStripe *stripe,
+                        TermInfoCacheEntry *entry)
+{
+    if (entry->prev) entry->prev->next = entry->next;
+    else             stripe->head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else             stripe->tail = entry->prev;
+}
+
+static void tics_push(TermInfoCacheStripe *stripe, TermInfoCacheEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = stripe->head;
+    if (stripe->head) stripe->head->prev = entry;
+    else              stripe->tail = entry;
+    stripe->head = entry;
+}
+
+/* Each stripe's Hash places its entries by the low bits of tice_hash so the
+ * stripe is picked from the high bits of a multiplicative mix instead. Picked
+ * from the low bits, every key in a stripe would share them and crowd into
+ * the same few slots. */
+static INLINE TermInfoCacheStripe *tir_cache_stripe(TermInfosReader *tir,
+                                                    TermInfoCacheEntry *key)
+{
+    const u32 mix = (u32)tice_hash(key) * 2654435761U;
+    return &tir->cache[(mix >> 16) % TI_CACHE_STRIPES];
+}
+
+/* copy the cached TermInfo for +key+ into +ti+ and mark it as most recently
+ * used. Returns false if it isn't cached. */
+static bool tir_cache_get(TermInfosReader *tir, TermInfoCacheEntry *key,
+                          TermInfo *ti)
+{
+    TermInfoCacheStripe *stripe = tir_cache_stripe(tir, key);
+    TermInfoCacheEntry *entry;
+
+    mutex_lock(&stripe->mutex);
+    if (NULL != (entry = (TermInfoCacheEntry *)h_get(stripe->entries, key))) {
+        *ti = entry->ti;
+        if (entry != stripe->head) {
+            tics_unlink(stripe, entry);
+            tics_push(stripe, entry);
+        }
+        stripe->hits++;
+    }
+    else {
+        stripe->misses++;
+    }
+    mutex_unlock(&stripe->mutex);
+    return NULL != entry;
+}
+
+static void tir_cache_add(TermInfosReader *tir, TermInfoCacheEntry *key,
+                          TermInfo *ti)
+{
+    TermInfoCacheStripe *stripe = tir_cache_stripe(tir, key);
+    const int term_len = (int)strlen(key->term);
+    TermInfoCacheEntry *entry;
+
+    mutex_lock(&stripe->mutex);
+    /* another thread may have added it since we missed */
+    if (NULL == h_get(stripe->entries, key)) {
+        if (stripe->entries->size >= TI_CACHE_STRIPE_SIZE) {
+            entry = stripe->tail;
+            tics_unlink(stripe, entry);
+            h_rem(stripe->entries, entry, false);
+            free(entry);
+        }
+        entry = (TermInfoCacheEntry *)emalloc(sizeof(TermInfoCacheEntry)
+                                              + term_len + 1);
+        entry->term = (char *)(entry + 1);
+        memcpy(entry->term, key->term, term_len + 1);
+        entry->field_num = key->field_num;
+        entry->ti = *ti;
+        h_set(stripe->entries, entry, entry);
+        tics_push(stripe, entry);
+    }
+    mutex_unlock(&stripe->mutex);
+}
+
 TermInfosReader *tir_open(Store *store,
                           SegmentFieldIndex *sfi, const char *segment)
 {
     TermInfosReader *tir = ALLOC(TermInfosReader);
     char file_name[SEGMENT_NAME_MAX_LENGTH];
+    int i;
 
     sprintf(file_name, "%s.tis", segment);
     tir->orig_te = ste_new(store->open_input(store, file_name), sfi);
     thread_key_create(&tir->thread_te, NULL);
     tir->te_bucket = ary_new();
     tir->field_num = -1;
+    for (i = 0; i < TI_CACHE_STRIPES; i++) {
+        TermInfoCacheStripe *stripe = &tir->cache[i];
+        mutex_init(&stripe->mutex, NULL);
+        stripe->entries = h_new((hash_ft)&tice_hash, (eq_ft)&tice_eq,
+                                NULL, &free);
+        stripe->head = stripe->tail = NULL;
+        stripe->hits = stripe->misses = 0;
+    }
 
     return tir;
 }
@@ -2651,34 +3202,67 @@ TermInfosReader *tir_set_field(TermInfosReader *tir, int field_num)
     return tir;
 }
 
-TermInfo *tir_get_ti(TermInfosReader *tir, const char *term)
+/* false if the field's bloom filter rules out +term+ in this segment.
+ * +hash+ is the term's bf_hash, or 0 if it hasn't been hashed yet in which
+ * case it is set here so that lookups in other segments can reuse it */
+static INLINE bool tir_may_contain(TermEnum *te, const char *term, u64 *hash)
 {
-    TermEnum *te = tir_enum(tir);
+    SegmentTermIndex *sti = (SegmentTermIndex *)
+        h_get_int(STE(te)->sfi->field_dict, te->field_num);
+    if (NULL == sti || NULL == sti->bloom) {
+        return true;
+    }
+    if (0 == *hash) {
+        *hash = bf_hash(term, (int)strlen(term));
+    }
+    return bf_may_contain(sti->bloom, *hash);
+}
+
+/* The TermInfo returned is the thread's own copy so it is only good until the
+ * thread's next lookup. */
+static TermInfo *tir_lookup(TermInfosReader *tir, TermEnum *te,
+                            const char *term, u64 *hash)
+{
+    TermInfoCacheEntry key;
     char *match;
 
+    if (!tir_may_contain(te, term, hash)) {
+        return NULL;
+    }
+    key.field_num = te->field_num;
+    key.term = (char *)term;
+    if (tir_cache_get(tir, &key, &(te->curr_ti))) {
+        /* curr_ti no longer matches the enum's position so make sure the
+         * next scan seeks rather than reading on from here */
+        STE(te)->pos = STE(te)->size;
+        return &(te->curr_ti);
+    }
     if (NULL != (match = ste_scan_to(te, term))
         && 0 == strcmp(match, term)) {
+        tir_cache_add(tir, &key, &(te->curr_ti));
         return &(te->curr_ti);
     }
     return NULL;
 }
 
+TermInfo *tir_get_ti(TermInfosReader *tir, const char *term)
+{
+    u64 hash = 0;
+    return tir_lookup(tir, tir_enum(tir), term, &hash);
+}
+
 static TermInfo *tir_get_ti_field(TermInfosReader *tir, int field_num,
                                   const char *term)
 {
     TermEnum *te = tir_enum(tir);
-    char *match;
+    u64 hash = 0;
 
     if (field_num != tir->field_num) {
         ste_set_field(te, field_num);
         tir->field_num = field_num;
     }
 
-    if (NULL != (match = ste_scan_to(te, term))
-        && 0 == strcmp(match, term)) {
-        return &(te->curr_ti);
-    }
-    return NULL;
+    return tir_lookup(tir, te, term, &hash);
 }
 
 char *tir_get_term(TermInfosReader *tir, int pos)
@@ -2691,11 +3275,30 @@ char *tir_get_term(TermInfosReader *tir, int pos)
     }
 }
 
-void tir_close(TermInfosReader *tir)
+void tir_cache_stats(TermInfosReader *tir, TermInfoCacheStats *stats)
 {
-    ary_destroy(tir->te_bucket, (free_ft)&ste_close);
-    ste_close(tir->orig_te);
-
+    int i;
+    ZEROSET(stats, TermInfoCacheStats);
+    for (i = 0; i < TI_CACHE_STRIPES; i++) {
+        TermInfoCacheStripe *stripe = &tir->cache[i];
+        mutex_lock(&stripe->mutex);
+        stats->hits += stripe->hits;
+        stats->misses += stripe->misses;
+        stats->size += stripe->entries->size;
+        mutex_unlock(&stripe->mutex);
+    }
+}
+
+void tir_close(TermInfosReader *tir)
+{
+    int i;
+    for (i = 0; i < TI_CACHE_STRIPES; i++) {
+        mutex_destroy(&tir->cache[i].mutex);
+        h_destroy(tir->cache[i].entries);
+    }
+    ary_destroy(tir->te_bucket, (free_ft)&ste_close);
+    ste_close(tir->orig_te);
+
     /* fix for some dodgy old versions of pthread */
     thread_setspecific(tir->thread_te, NULL);
 
@@ -2725,18 +3328,25 @@ static void tw_close(TermWriter *tw)
 
 TermInfosWriter *tiw_open(Store *store,
                           const char *segment,
+                          FieldInfos *fis,
                           int index_interval,
                           int skip_interval)
 {
     char file_name[SEGMENT_NAME_MAX_LENGTH];
     TermInfosWriter *tiw = ALLOC(TermInfosWriter);
     size_t segment_len = strlen(segment);
+    int i;
 
     memcpy(file_name, segment, segment_len);
 
     tiw->field_count = 0;
     tiw->index_interval = index_interval;
     tiw->skip_interval = skip_interval;
+    /* restart points must fall evenly in the index blocks */
+    for (tiw->restart_interval = RESTART_INTERVAL;
+         index_interval % tiw->restart_interval;
+         tiw->restart_interval--) {
+    }
     tiw->last_index_ptr = 0;
 
     strcpy(file_name + segment_len, ".tix");
@@ -2746,6 +3356,25 @@ TermInfosWriter *tiw_open(Store *store,
     strcpy(file_name + segment_len, ".tfx");
     tiw->tfx_out = store->new_output(store, file_name);
     os_write_u32(tiw->tfx_out, 0); /* make space for field_count */
+    strcpy(file_name + segment_len, ".trp");
+    tiw->trp_out = store->new_output(store, file_name);
+    os_write_u32(tiw->trp_out, tiw->restart_interval);
+    /* the .blm file is only written if a field has a bloom filter */
+    tiw->blm_out = NULL;
+    for (i = fis ? fis->size - 1 : -1; i >= 0; i--) {
+        if (fi_has_bloom_filter(fis->fields[i])) {
+            strcpy(file_name + segment_len, ".blm");
+            tiw->blm_out = store->new_output(store, file_name);
+            os_write_u32(tiw->blm_out, 0); /* make space for bloom_count */
+            break;
+        }
+    }
+
+    tiw->fis = fis;
+    tiw->bloom_count = 0;
+    tiw->bloom_field_num = -1;
+    tiw->bloom_hashes = NULL;
+    tiw->bloom_hashes_size = tiw->bloom_hashes_capa = 0;
 
     /* The following two numbers are the first numbers written to the field
      * index when tiw_start_field is called. But they'll be zero to start with
@@ -2811,25 +3440,78 @@ void tiw_add(TermInfosWriter *tiw,
              int term_len,
              TermInfo *ti)
 {
+    TermWriter *tis_writer = tiw->tis_writer;
     off_t tis_pos;
 
     /*
     printf("%s:%d:%d:%d:%d\n", term, term_len, ti->doc_freq,
            ti->frq_ptr, ti->prx_ptr);
     */
-    if (0 == (tiw->tis_writer->counter % tiw->index_interval)) {
+    if (0 == (tis_writer->counter % tiw->index_interval)) {
         /* add an index term */
         tw_add(tiw->tix_writer,
-               tiw->tis_writer->last_term,
-               strlen(tiw->tis_writer->last_term),
-               &(tiw->tis_writer->last_term_info),
+               tis_writer->last_term,
+               strlen(tis_writer->last_term),
+               &(tis_writer->last_term_info),
                tiw->skip_interval);
-        tis_pos = os_pos(tiw->tis_writer->os);
+        tis_pos = os_pos(tis_writer->os);
         os_write_voff_t(tiw->tix_writer->os, tis_pos - tiw->last_index_ptr);
         tiw->last_index_ptr = tis_pos;  /* write ptr */
     }
+    else if (0 == (tis_writer->counter % tiw->restart_interval)) {
+        os_write_u32(tiw->trp_out,
+                     (u32)(os_pos(tis_writer->os) - tiw->last_index_ptr));
+    }
+    if (0 == (tis_writer->counter % tiw->restart_interval)) {
+        /* write a restart point with the whole term and absolute pointers */
+        tis_writer->last_term = EMPTY_STRING;
+        ZEROSET(&(tis_writer->last_term_info), TermInfo);
+    }
+
+    tw_add(tis_writer, term, term_len, ti, tiw->skip_interval);
+
+    if (tiw->bloom_field_num >= 0) {
+        if (tiw->bloom_hashes_size >= tiw->bloom_hashes_capa) {
+            tiw->bloom_hashes_capa = tiw->bloom_hashes_capa
+                ? tiw->bloom_hashes_capa << 1 : 1024;
+            REALLOC_N(tiw->bloom_hashes, u64, tiw->bloom_hashes_capa);
+        }
+        tiw->bloom_hashes[tiw->bloom_hashes_size++] = bf_hash(term, term_len);
+    }
+}
+
+/* The number of terms in a field isn't known until the field is finished so
+ * the term hashes are collected until then and the bloom filter is sized to
+ * fit. */
+static void tiw_write_bloom_filter(TermInfosWriter *tiw)
+{
+    if (tiw->bloom_field_num >= 0) {
+        BloomFilter *bf = bf_new(tiw->bloom_hashes_size);
+        int i;
+        for (i = 0; i < tiw->bloom_hashes_size; i++) {
+            bf_add(bf, tiw->bloom_hashes[i]);
+        }
+        os_write_vint(tiw->blm_out, tiw->bloom_field_num);
+        bf_write(bf, tiw->blm_out);
+        bf_destroy(bf);
+        tiw->bloom_count++;
+        tiw->bloom_field_num = -1;
+        tiw->bloom_hashes_size = 0;
+    }
+}
 
-    tw_add(tiw->tis_writer, term, term_len, ti, tiw->skip_interval);
+/* Every index block has the same number of entries in the restart table so
+ * pad out the last block of the field. */
+static void tiw_pad_restart_table(TermInfosWriter *tiw)
+{
+    const int block_size = tiw->tis_writer->counter % tiw->index_interval;
+    if (block_size > 0) {
+        int i = tiw->index_interval / tiw->restart_interval - 1
+            - (block_size - 1) / tiw->restart_interval;
+        for (; i > 0; i--) {
+            os_write_u32(tiw->trp_out, 0);
+        }
+    }
 }
 
 static INLINE void tw_reset(TermWriter *tw)
@@ -2842,6 +3524,14 @@ static INLINE void tw_reset(TermWriter *tw)
 void tiw_start_field(TermInfosWriter *tiw, int field_num)
 {
     OutStream *tfx_out = tiw->tfx_out;
+    FieldInfo *fi = tiw->fis ? fis_by_number(tiw->fis, field_num) : NULL;
+    if (tiw->field_count > 0) {
+        tiw_pad_restart_table(tiw);
+    }
+    tiw_write_bloom_filter(tiw);
+    if (fi && fi_has_bloom_filter(fi)) {
+        tiw->bloom_field_num = field_num;
+    }
     os_write_vint(tfx_out, tiw->tix_writer->counter);    /* write tix size */
     os_write_vint(tfx_out, tiw->tis_writer->counter);    /* write tis size */
     os_write_vint(tfx_out, field_num);
@@ -2862,6 +3552,19 @@ void tiw_close(TermInfosWriter *tiw)
     os_write_u32(tfx_out, tiw->field_count);
     os_close(tfx_out);
 
+    if (tiw->field_count > 0) {
+        tiw_pad_restart_table(tiw);
+    }
+    os_close(tiw->trp_out);
+
+    if (tiw->blm_out) {
+        tiw_write_bloom_filter(tiw);
+        os_seek(tiw->blm_out, 0);
+        os_write_u32(tiw->blm_out, tiw->bloom_count);
+        os_close(tiw->blm_out);
+    }
+    free(tiw->bloom_hashes);
+
     tw_close(tiw->tix_writer);
     tw_close(tiw->tis_writer);
 
@@ -4039,6 +4742,78 @@ void ir_delete_doc(IndexReader *ir, int doc_num)
     }
 }
 
+typedef struct DocNumIndex
+{
+    int doc_num;
+    int index;
+} DocNumIndex;
+
+static int dni_cmp(const void *p1, const void *p2)
+{
+    const DocNumIndex *dni1 = (const DocNumIndex *)p1;
+    const DocNumIndex *dni2 = (const DocNumIndex *)p2;
+    if (dni1->doc_num != dni2->doc_num) {
+        return dni1->doc_num < dni2->doc_num ? -1 : 1;
+    }
+    return dni1->index - dni2->index;
+}
+
+/**
+ * Load the documents +doc_nums+, in any order, in a single pass. The
+ * documents are read in doc_num order, segment by segment, so the stored
+ * fields files are read mostly sequentially rather than seeking back and
+ * forth. If +fields+ isn't NULL only those +field_cnt+ fields are loaded.
+ *
+ * Returns a newly allocated array of +cnt+ documents in the same order as
+ * +doc_nums+. Deleted documents are NULL. The caller must destroy the
+ * documents and free the array.
+ */
+Document **ir_get_docs(IndexReader *ir, const int *doc_nums, int cnt,
+                       Symbol *fields, int field_cnt)
+{
+    Document **docs = ALLOC_N(Document *, cnt);
+    const int max_doc = ir->max_doc(ir);
+    bool is_sorted = true;
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        if (doc_nums[i] < 0 || doc_nums[i] >= max_doc) {
+            free(docs);
+            RAISE(INDEX_ERROR, "Document %d doesn't exist in the index. The "
+                  "max_doc is %d", doc_nums[i], max_doc);
+        }
+        if (i > 0 && doc_nums[i] < doc_nums[i - 1]) {
+            is_sorted = false;
+        }
+    }
+
+    if (is_sorted) {
+        ir->get_docs_i(ir, doc_nums, cnt, fields, field_cnt, docs);
+    }
+    else {
+        DocNumIndex *dnis = ALLOC_N(DocNumIndex, cnt);
+        int *sorted_doc_nums = ALLOC_N(int, cnt);
+        Document **sorted_docs = ALLOC_N(Document *, cnt);
+        for (i = 0; i < cnt; i++) {
+            dnis[i].doc_num = doc_nums[i];
+            dnis[i].index = i;
+        }
+        qsort(dnis, cnt, sizeof(DocNumIndex), &dni_cmp);
+        for (i = 0; i < cnt; i++) {
+            sorted_doc_nums[i] = dnis[i].doc_num;
+        }
+        ir->get_docs_i(ir, sorted_doc_nums, cnt, fields, field_cnt,
+                       sorted_docs);
+        for (i = 0; i < cnt; i++) {
+            docs[dnis[i].index] = sorted_docs[i];
+        }
+        free(sorted_docs);
+        free(sorted_doc_nums);
+        free(dnis);
+    }
+    return docs;
+}
+
 Document *ir_get_doc_with_term(IndexReader *ir, Symbol field,
                                const char *term)
 {
@@ -4265,6 +5040,9 @@ typedef struct SegmentReader {
 #define SR(ir) ((SegmentReader *)(ir))
 #define SR_SIZE(ir) (SR(ir)->fr->size)
 
+/* The thread's own FieldsReader. Each keeps the last block of compressed
+ * fields it read so threads don't evict each other's blocks. The streams are
+ * still shared with sr->fr so it must be used with the reader's mutex held. */
 static INLINE FieldsReader *sr_fr(SegmentReader *sr)
 {
     FieldsReader *fr;
@@ -4355,13 +5133,15 @@ static void sr_set_deleter_i(IndexReader *ir, Deleter *deleter)
   ir->deleter = deleter;
 }
 
+/* The deletions file stores the bits as 32-bit words so we write each 64-bit
+ * word as two halves, low half first */
 static void bv_write(BitVector *bv, Store *store, char *name)
 {
     int i;
     OutStream *os = store->new_output(store, name);
     os_write_vint(os, bv->size);
     for (i = ((bv->size-1) >> 5); i >= 0; i--) {
-        os_write_u32(os, bv->bits[i]);
+        os_write_u32(os, (u32)(bv->bits[i >> 1] >> ((i & 1) << 5)));
     }
     os_close(os);
 }
@@ -4373,12 +5153,12 @@ static BitVector *bv_read(Store *store, char *name)
     InStream *volatile is = store->open_input(store, name);
     BitVector *volatile bv = ALLOC_AND_ZERO(BitVector);
     bv->size = (int)is_read_vint(is);
-    bv->capa = (bv->size >> 5) + 1;
-    bv->bits = ALLOC_AND_ZERO_N(u32, bv->capa);
+    bv->capa = (bv->size >> 6) + 1;
+    bv->bits = ALLOC_AND_ZERO_N(u64, bv->capa);
     bv->ref_cnt = 1;
     TRY
         for (i = ((bv->size-1) >> 5); i >= 0; i--) {
-            bv->bits[i] = is_read_u32(is);
+            bv->bits[i >> 1] |= ((u64)is_read_u32(is)) << ((i & 1) << 5);
         }
         bv_recount(bv);
         success = true;
@@ -4480,7 +5260,7 @@ static Document *sr_get_doc(IndexReader *ir, int doc_num)
         mutex_unlock(&ir->mutex);
         RAISE(STATE_ERROR, "Document %d has already been deleted", doc_num);
     }
-    doc = fr_get_doc(SR(ir)->fr, doc_num);
+    doc = fr_get_doc(sr_fr(SR(ir)), doc_num);
     mutex_unlock(&ir->mutex);
     return doc;
 }
@@ -4493,11 +5273,39 @@ static LazyDoc *sr_get_lazy_doc(IndexReader *ir, int doc_num)
         mutex_unlock(&ir->mutex);
         RAISE(STATE_ERROR, "Document %d has already been deleted", doc_num);
     }
-    lazy_doc = fr_get_lazy_doc(SR(ir)->fr, doc_num);
+    lazy_doc = fr_get_lazy_doc(sr_fr(SR(ir)), doc_num);
     mutex_unlock(&ir->mutex);
     return lazy_doc;
 }
 
+static void sr_get_docs_i(IndexReader *ir, const int *doc_nums, int cnt,
+                          Symbol *fields, int field_cnt, Document **docs)
+{
+    int i;
+    FieldsReader *fr;
+    BitVector *field_mask = NULL;
+    if (fields) {
+        field_mask = bv_new_capa(ir->fis->size);
+        for (i = 0; i < field_cnt; i++) {
+            const int field_num = fis_get_field_num(ir->fis, fields[i]);
+            if (field_num >= 0) {
+                bv_set(field_mask, field_num);
+            }
+        }
+    }
+    mutex_lock(&ir->mutex);
+    fr = sr_fr(SR(ir));
+    for (i = 0; i < cnt; i++) {
+        docs[i] = sr_is_deleted_i(SR(ir), doc_nums[i])
+            ? NULL
+            : fr_get_doc_fields(fr, doc_nums[i], field_mask);
+    }
+    mutex_unlock(&ir->mutex);
+    if (field_mask) {
+        bv_destroy(field_mask);
+    }
+}
+
 static uchar *sr_get_norms(IndexReader *ir, int field_num)
 {
     uchar *norms;
@@ -4532,12 +5340,22 @@ static TermEnum *sr_terms_from(IndexReader *ir, int field_num, const char *term)
     return te;
 }
 
-static int sr_doc_freq(IndexReader *ir, int field_num, const char *term)
+/* +hash+ is passed on to tir_lookup so a MultiReader hashes the term once
+ * for all of its segments */
+static int sr_doc_freq_hashed(IndexReader *ir, int field_num,
+                              const char *term, u64 *hash)
 {
-    TermInfo *ti = tir_get_ti(tir_set_field(SR(ir)->tir, field_num), term);
+    TermInfosReader *tir = tir_set_field(SR(ir)->tir, field_num);
+    TermInfo *ti = tir_lookup(tir, tir_enum(tir), term, hash);
     return ti ? ti->doc_freq : 0;
 }
 
+static int sr_doc_freq(IndexReader *ir, int field_num, const char *term)
+{
+    u64 hash = 0;
+    return sr_doc_freq_hashed(ir, field_num, term, &hash);
+}
+
 static TermDocEnum *sr_term_docs(IndexReader *ir)
 {
     return stde_new(SR(ir)->tir, SR(ir)->frq_in, SR(ir)->deleted_docs,
@@ -4555,24 +5373,29 @@ static TermVector *sr_term_vector(IndexReader *ir, int doc_num,
                                   Symbol field)
 {
     FieldInfo *fi = (FieldInfo *)h_get(ir->fis->field_dict, field);
-    FieldsReader *fr;
+    TermVector *tv;
 
-    if (!fi || !fi_store_term_vector(fi) || !SR(ir)->fr ||
-        !(fr = sr_fr(SR(ir)))) {
+    if (!fi || !fi_store_term_vector(fi) || !SR(ir)->fr) {
         return NULL;
     }
 
-    return fr_get_field_tv(fr, doc_num, fi->number);
+    mutex_lock(&ir->mutex);
+    tv = fr_get_field_tv(sr_fr(SR(ir)), doc_num, fi->number);
+    mutex_unlock(&ir->mutex);
+    return tv;
 }
 
 static Hash *sr_term_vectors(IndexReader *ir, int doc_num)
 {
-    FieldsReader *fr;
-    if (!SR(ir)->fr || NULL == (fr = sr_fr(SR(ir)))) {
+    Hash *tvs;
+    if (!SR(ir)->fr) {
         return NULL;
     }
 
-    return fr_get_tv(fr, doc_num);
+    mutex_lock(&ir->mutex);
+    tvs = fr_get_tv(sr_fr(SR(ir)), doc_num);
+    mutex_unlock(&ir->mutex);
+    return tvs;
 }
 
 static bool sr_is_deleted(IndexReader *ir, int doc_num)
@@ -4619,6 +5442,7 @@ static IndexReader *sr_setup_i(SegmentReader *sr)
     ir->max_doc             = &sr_max_doc;
     ir->get_doc             = &sr_get_doc;
     ir->get_lazy_doc        = &sr_get_lazy_doc;
+    ir->get_docs_i          = &sr_get_docs_i;
     ir->get_norms           = &sr_get_norms;
     ir->get_norms_into      = &sr_get_norms_into;
     ir->terms               = &sr_terms;
@@ -4666,10 +5490,8 @@ static IndexReader *sr_setup_i(SegmentReader *sr)
         sr->prx_in = store->open_input(store, file_name);
         sr->norms = h_new_int((free_ft)&norm_destroy);
         sr_open_norms(ir, store);
-        if (fis_has_vectors(ir->fis)) {
-            thread_key_create(&sr->thread_fr, NULL);
-            sr->fr_bucket = ary_new();
-        }
+        thread_key_create(&sr->thread_fr, NULL);
+        sr->fr_bucket = ary_new();
     XCATCHALL
         ir->sis = NULL;
         ir_close(ir);
@@ -4758,6 +5580,26 @@ static LazyDoc *mr_get_lazy_doc(IndexReader *ir, int doc_num)
     return reader->get_lazy_doc(reader, doc_num - MR(ir)->starts[i]);
 }
 
+static void mr_get_docs_i(IndexReader *ir, const int *doc_nums, int cnt,
+                          Symbol *fields, int field_cnt, Document **docs)
+{
+    int i = 0, j;
+    int *sub_doc_nums = ALLOC_N(int, cnt);
+    /* doc_nums are sorted so each sub-reader's docs are together */
+    while (i < cnt) {
+        const int r = mr_reader_index_i(MR(ir), doc_nums[i]);
+        const int start = MR(ir)->starts[r], end = MR(ir)->starts[r + 1];
+        IndexReader *reader = MR(ir)->sub_readers[r];
+        for (j = i; j < cnt && doc_nums[j] < end; j++) {
+            sub_doc_nums[j - i] = doc_nums[j] - start;
+        }
+        reader->get_docs_i(reader, sub_doc_nums, j - i, fields, field_cnt,
+                           docs + i);
+        i = j;
+    }
+    free(sub_doc_nums);
+}
+
 int mr_get_field_num(MultiReader *mr, int ir_num, int f_num)
 {
     if (mr->field_num_map) {
@@ -4832,11 +5674,17 @@ static int mr_doc_freq(IndexReader *ir, int field_num, const char *t)
 {
     int total = 0;          /* sum freqs in segments */
     int i = MR(ir)->r_cnt;
+    u64 hash = 0;           /* the term's bloom filter hash once it's made */
     for (i = MR(ir)->r_cnt - 1; i >= 0; i--) {
         int fnum = mr_get_field_num(MR(ir), i, field_num);
         if (fnum >= 0) {
             IndexReader *reader = MR(ir)->sub_readers[i];
-            total += reader->doc_freq(reader, fnum, t);
+            if (reader->doc_freq == &sr_doc_freq) {
+                total += sr_doc_freq_hashed(reader, fnum, t, &hash);
+            }
+            else {
+                total += reader->doc_freq(reader, fnum, t);
+            }
         }
     }
     return total;
@@ -4988,6 +5836,7 @@ static IndexReader *mr_new(IndexReader **sub_readers, const int r_cnt)
     ir->max_doc             = &mr_max_doc;
     ir->get_doc             = &mr_get_doc;
     ir->get_lazy_doc        = &mr_get_lazy_doc;
+    ir->get_docs_i          = &mr_get_docs_i;
     ir->get_norms           = &mr_get_norms;
     ir->get_norms_into      = &mr_get_norms_into;
     ir->terms               = &mr_terms;
@@ -5213,7 +6062,11 @@ PostingList *pl_new(MemoryPool *mp, const char *term,
                            int term_len, Posting *p)
 {
     PostingList *pl = MP_ALLOC(mp, PostingList);
-    pl->term = (char *)mp_memdup(mp, term, term_len + 1);
+    /* the term may be a reference into the field's text */
+    char *pl_term = (char *)mp_alloc(mp, term_len + 1);
+    memcpy(pl_term, term, term_len);
+    pl_term[term_len] = '\0';
+    pl->term = pl_term;
     pl->term_len = term_len;
     pl->first = pl->last = p;
     pl->last_occ = p->first_occ;
@@ -5256,14 +6109,14 @@ static FieldInverter *fld_inv_new(DocWriter *dw, FieldInfo *fi)
     fld_inv->fi = fi;
 
     /* this will alloc it's own memory so must be destroyed */
-    fld_inv->plists = h_new_str(NULL, NULL);
+    fld_inv->plists = th_new();
 
     return fld_inv;
 }
 
 static void fld_inv_destroy(FieldInverter *fld_inv)
 {
-    h_destroy(fld_inv->plists);
+    th_destroy(fld_inv->plists);
 }
 
 /****************************************************************************
@@ -5343,18 +6196,16 @@ static void dw_write_norms(DocWriter *dw, FieldInverter *fld_inv)
     os_close(norms_out);
 }
 
-/* we'll use the postings Hash's table area to sort the postings as it is
- * going to be zeroset soon anyway */
-static PostingList **dw_sort_postings(Hash *plists_ht)
+/* we'll use the postings TermHash's slot area to sort the postings as it is
+ * going to be cleared soon anyway */
+static PostingList **dw_sort_postings(TermHash *plists_ht)
 {
     int i, j;
-    HashEntry *he;
-    PostingList **plists = (PostingList **)plists_ht->table;
+    PostingList **plists = (PostingList **)plists_ht->slots;
     const int num_entries = plists_ht->mask + 1;
     for (i = 0, j = 0; i < num_entries; i++) {
-        he = &plists_ht->table[i];
-        if (he->value) {
-            plists[j++] = (PostingList *)he->value;
+        if (th_slot_is_full(plists_ht, i)) {
+            plists[j++] = (PostingList *)plists_ht->slots[i].value;
         }
     }
 
@@ -5385,7 +6236,7 @@ static void dw_flush(DocWriter *dw)
     Posting *p;
     Occurence *occ;
     Store *store = dw->store;
-    TermInfosWriter *tiw = tiw_open(store, dw->si->name,
+    TermInfosWriter *tiw = tiw_open(store, dw->si->name, fis,
                                     dw->index_interval, skip_interval);
     TermInfo ti;
     char file_name[SEGMENT_NAME_MAX_LENGTH];
@@ -5468,7 +6319,7 @@ DocWriter *dw_open(IndexWriter *iw, SegmentInfo *si)
     dw->fw          = fw_open(store, si->name, iw->fis);
     dw->si          = si;
 
-    dw->curr_plists = h_new_str(NULL, NULL);
+    dw->curr_plists = th_new();
     dw->fields      = h_new_int((free_ft)fld_inv_destroy);
     dw->doc_num     = 0;
 
@@ -5499,7 +6350,7 @@ void dw_close(DocWriter *dw)
     if (dw->fw) {
         fw_close(dw->fw);
     }
-    h_destroy(dw->curr_plists);
+    th_destroy(dw->curr_plists);
     h_destroy(dw->fields);
     mp_destroy(dw->mp);
     free(dw->offsets);
@@ -5518,32 +6369,34 @@ FieldInverter *dw_get_fld_inv(DocWriter *dw, FieldInfo *fi)
 }
 
 static void dw_add_posting(MemoryPool *mp,
-                           Hash *curr_plists,
-                           Hash *fld_plists,
+                           TermHash *curr_plists,
+                           TermHash *fld_plists,
                            int doc_num,
                            const char *text,
                            int len,
                            int pos)
 {
-    HashEntry *pl_he;
-    if (h_set_ext(curr_plists, text, &pl_he)) {
+    TermHashSlot *pl_slot;
+    /* the hash is calculated once and shared by both tables */
+    const frt_u32 hash = th_hash(text, len);
+    if (th_set_ext(curr_plists, text, len, hash, &pl_slot)) {
         Posting *p =  p_new(mp, doc_num, pos);
-        HashEntry *fld_pl_he;
+        TermHashSlot *fld_pl_slot;
         PostingList *pl;
 
-        if (h_set_ext(fld_plists, text, &fld_pl_he)) {
-            fld_pl_he->value = pl = pl_new(mp, text, len, p);
-            pl_he->key = fld_pl_he->key = (char *)pl->term;
+        if (th_set_ext(fld_plists, text, len, hash, &fld_pl_slot)) {
+            fld_pl_slot->value = pl = pl_new(mp, text, len, p);
+            fld_pl_slot->term = pl->term;
         }
         else {
-            pl = (PostingList *)fld_pl_he->value;
+            pl = (PostingList *)fld_pl_slot->value;
             pl_add_posting(pl, p);
-            pl_he->key = (char *)pl->term;
         }
-        pl_he->value = pl;
+        pl_slot->term = pl->term;
+        pl_slot->value = pl;
     }
     else {
-        pl_add_occ(mp, (PostingList *)pl_he->value, pos);
+        pl_add_occ(mp, (PostingList *)pl_slot->value, pos);
     }
 }
 
@@ -5562,27 +6415,62 @@ static INLINE void dw_add_offsets(DocWriter *dw, int pos, off_t start, off_t end
     dw->offsets_size = pos + 1;
 }
 
-Hash *dw_invert_field(DocWriter *dw,
-                           FieldInverter *fld_inv,
-                           DocField *df)
+/* index tokens which were analyzed ahead of time, see dw_invert_field */
+static int dw_invert_tokens(DocWriter *dw, FieldInverter *fld_inv,
+                            TokenList *tkl)
+{
+    MemoryPool *mp = dw->mp;
+    const bool store_offsets = fld_inv->store_offsets;
+    int size = tkl->size;
+    int pos = -1, i;
+
+    if (size > dw->max_field_length) {
+        size = dw->max_field_length + 1;
+    }
+    for (i = 0; i < size; i++) {
+        const DocToken *dtk = tkl->tokens + i;
+        pos += dtk->pos_inc;
+        if (store_offsets && pos < 0) {
+            pos = 0;
+        }
+        dw_add_posting(mp, dw->curr_plists, fld_inv->plists, dw->doc_num,
+                       tkl->buf + dtk->text, dtk->len, pos);
+        if (store_offsets) {
+            dw_add_offsets(dw, pos, dtk->start, dtk->end);
+        }
+    }
+    return size;
+}
+
+TermHash *dw_invert_field(DocWriter *dw,
+                          FieldInverter *fld_inv,
+                          DocField *df)
 {
     MemoryPool *mp = dw->mp;
     Analyzer *a = dw->analyzer;
-    Hash *curr_plists = dw->curr_plists;
-    Hash *fld_plists = fld_inv->plists;
+    TermHash *curr_plists = dw->curr_plists;
+    TermHash *fld_plists = fld_inv->plists;
     const bool store_offsets = fld_inv->store_offsets;
     int doc_num = dw->doc_num;
     int i;
     const int df_size = df->size;
     off_t start_offset = 0;
 
-    if (fld_inv->is_tokenized) {
+    if (fld_inv->is_tokenized && df->tokens) {
+        fld_inv->length = dw_invert_tokens(dw, fld_inv, df->tokens);
+    }
+    else if (fld_inv->is_tokenized) {
         Token *tk;
         int pos = -1, num_terms = 0;
 
-        for (i = 0; i < df_size; i++) {
+        /* max_field_length limits the terms in the whole field, not in
+         * each of its values */
+        for (i = 0; i < df_size && num_terms <= dw->max_field_length; i++) {
             TokenStream *ts = a_get_ts(a, df->name, df->data[i]);
             /* ts->reset(ts, df->data[i]); no longer being called */
+            /* the terms are copied into the memory pool so the tokens don't
+             * need their own copy of the text */
+            ts->zero_copy = true;
             if (store_offsets) {
                 while (NULL != (tk = ts->next(ts))) {
                     pos += tk->pos_inc;
@@ -5592,7 +6480,7 @@ Hash *dw_invert_field(DocWriter *dw,
                         pos = 0;
                     }
                     dw_add_posting(mp, curr_plists, fld_plists, doc_num,
-                                   tk->text, tk->len, pos);
+                                   TK_PTR(tk), tk->len, pos);
                     dw_add_offsets(dw, pos,
                                    start_offset + tk->start,
                                    start_offset + tk->end);
@@ -5605,7 +6493,7 @@ Hash *dw_invert_field(DocWriter *dw,
                 while (NULL != (tk = ts->next(ts))) {
                     pos += tk->pos_inc;
                     dw_add_posting(mp, curr_plists, fld_plists, doc_num,
-                                   tk->text, tk->len, pos);
+                                   TK_PTR(tk), tk->len, pos);
                     if (num_terms++ >= dw->max_field_length) {
                         break;
                     }
@@ -5639,10 +6527,9 @@ Hash *dw_invert_field(DocWriter *dw,
     return curr_plists;
 }
 
-void dw_reset_postings(Hash *postings)
+void dw_reset_postings(TermHash *postings)
 {
-    ZEROSET_N(postings->table, HashEntry, postings->mask + 1);
-    postings->fill = postings->size = 0;
+    th_clear(postings);
 }
 
 void dw_add_doc(DocWriter *dw, Document *doc)
@@ -5651,7 +6538,7 @@ void dw_add_doc(DocWriter *dw, Document *doc)
     float boost;
     DocField *df;
     FieldInverter *fld_inv;
-    Hash *postings;
+    TermHash *postings;
     FieldInfo *fi;
     const int doc_size = doc->size;
 
@@ -5802,8 +6689,8 @@ static void smi_destroy(SegmentMergeInfo *smi)
     }
     if (smi->deleted_docs) {
         bv_destroy(smi->deleted_docs);
-        free(smi->doc_map);
     }
+    free(smi->doc_map);
     free(smi);
 }
 
@@ -5833,6 +6720,12 @@ typedef struct SegmentMerger {
     SkipBuffer *skip_buf;
     OutStream *frq_out;
     OutStream *prx_out;
+    /* the documents in their new order when the index is sorted */
+    struct SortedDoc *sorted_docs;
+    struct SortedPosting *postings;
+    int postings_capa;
+    int *positions;
+    int positions_capa;
 } SegmentMerger;
 
 static SegmentMerger *sm_create(IndexWriter *iw, SegmentInfo *si,
@@ -5863,74 +6756,411 @@ static void sm_destroy(SegmentMerger *sm)
         smi_destroy(sm->smis[i]);
     }
     free(sm->smis);
+    free(sm->sorted_docs);
+    free(sm->postings);
+    free(sm->positions);
     free(sm);
 }
 
+/****************************************************************************
+ * Index Sorting
+ *
+ * When the IndexWriter is configured with an index sort, every document is
+ * given a key which compares with memcmp in the sort order. The documents are
+ * sorted by their keys and each SegmentMergeInfo's doc_map is set to map its
+ * documents straight to their new numbers in the merged segment.
+ ****************************************************************************/
+
+/* Describe the index sort so that each segment can record the sort its
+ * documents are in, eg "num:integer:reverse,id:string". Returns NULL if the
+ * index isn't sorted. */
+static char *index_sort_desc(const Config *config)
+{
+    static const char *type_names[] = {"string", "integer", "float"};
+    char *desc, *p;
+    int i, len = 0;
+
+    if (config->index_sort_cnt <= 0) {
+        return NULL;
+    }
+    for (i = 0; i < config->index_sort_cnt; i++) {
+        len += (int)strlen(S(config->index_sort[i].field)) + 20;
+    }
+    p = desc = ALLOC_N(char, len);
+    for (i = 0; i < config->index_sort_cnt; i++) {
+        const IndexSortField *isf = &config->index_sort[i];
+        p += sprintf(p, "%s%s:%s%s", i ? "," : "", S(isf->field),
+                     type_names[isf->type], isf->reverse ? ":reverse" : "");
+    }
+    return desc;
+}
+
+/* true if the segment's documents are not in the index sort order */
+static bool si_needs_sort(SegmentInfo *si, const Config *config)
+{
+    char *desc;
+    bool needs_sort;
+    if (config->index_sort_cnt <= 0) {
+        return false;
+    }
+    desc = index_sort_desc(config);
+    needs_sort = NULL == si->sorted_by || 0 != strcmp(desc, si->sorted_by);
+    free(desc);
+    return needs_sort;
+}
+
+typedef struct SortedDoc {
+    int seg;
+    int doc;
+    int key_len;
+    uchar *key;
+} SortedDoc;
+
+typedef struct SortKeyBuf {
+    uchar *data;
+    int size;
+    int capa;
+} SortKeyBuf;
+
+static uchar *skb_reserve(SortKeyBuf *skb, int len)
+{
+    uchar *p;
+    if (skb->size + len > skb->capa) {
+        do {
+            skb->capa = skb->capa ? skb->capa << 1 : 1024;
+        } while (skb->size + len > skb->capa);
+        REALLOC_N(skb->data, uchar, skb->capa);
+    }
+    p = skb->data + skb->size;
+    skb->size += len;
+    return p;
+}
+
+static void skb_add_u64(SortKeyBuf *skb, u64 u, bool reverse)
+{
+    uchar *p = skb_reserve(skb, 8);
+    int i;
+    if (reverse) {
+        u = ~u;
+    }
+    for (i = 7; i >= 0; i--) {
+        p[i] = (uchar)u;
+        u >>= 8;
+    }
+}
+
+static void skb_add_value(SortKeyBuf *skb, IndexSortField *isf, DocField *df)
+{
+    const u64 sign_bit = (u64)1 << 63;
+    if (NULL == df || 0 == df->size) {
+        /* missing values sort last whatever the direction */
+        *skb_reserve(skb, 1) = 1;
+        return;
+    }
+    *skb_reserve(skb, 1) = 0;
+    switch (isf->type) {
+        case INDEX_SORT_INTEGER:
+            skb_add_u64(skb, (u64)strtoll(df->data[0], NULL, 10) ^ sign_bit,
+                        isf->reverse);
+            break;
+        case INDEX_SORT_FLOAT: {
+            double d = strtod(df->data[0], NULL);
+            u64 u;
+            memcpy(&u, &d, sizeof(u));
+            /* flip every bit of negative numbers and just the sign bit of
+             * positive ones so that the bits compare in numeric order */
+            skb_add_u64(skb, (u & sign_bit) ? ~u : u | sign_bit,
+                        isf->reverse);
+            break;
+        }
+        default: {
+            const int len = (int)strlen(df->data[0]) + 1;
+            uchar *p = skb_reserve(skb, len);
+            int i;
+            memcpy(p, df->data[0], len);
+            if (isf->reverse) {
+                for (i = 0; i < len; i++) {
+                    p[i] = ~p[i];
+                }
+            }
+            break;
+        }
+    }
+}
+
+static int sorted_doc_cmp(const void *p1, const void *p2)
+{
+    const SortedDoc *sd1 = (const SortedDoc *)p1;
+    const SortedDoc *sd2 = (const SortedDoc *)p2;
+    const int cmp = memcmp(sd1->key, sd2->key, min2(sd1->key_len,
+                                                    sd2->key_len));
+    return cmp ? cmp : sd1->key_len - sd2->key_len;
+}
+
+static void sm_sort_docs(SegmentMerger *sm)
+{
+    const Config *config = sm->config;
+    BitVector *fields = bv_new();
+    SortKeyBuf skb = {NULL, 0, 0};
+    SortedDoc *sds = ALLOC_N(SortedDoc, sm->doc_cnt + 1);
+    int *key_starts = ALLOC_N(int, sm->doc_cnt + 1);
+    int i, j, k, n = 0;
+
+    for (i = 0; i < config->index_sort_cnt; i++) {
+        FieldInfo *fi = fis_get_field(sm->fis, config->index_sort[i].field);
+        if (fi) {
+            bv_set(fields, fi->number);
+        }
+    }
+
+    for (i = 0; i < sm->seg_cnt; i++) {
+        SegmentMergeInfo *smi = sm->smis[i];
+        FieldsReader *fr = fr_open(smi->store, smi->si->name, sm->fis);
+        for (j = 0; j < smi->max_doc; j++) {
+            Document *doc;
+            if (smi->deleted_docs && bv_get(smi->deleted_docs, j)) {
+                continue;
+            }
+            doc = fr_get_doc_fields(fr, j, fields);
+            key_starts[n] = skb.size;
+            for (k = 0; k < config->index_sort_cnt; k++) {
+                IndexSortField *isf = (IndexSortField *)&config->index_sort[k];
+                skb_add_value(&skb, isf, doc_get_field(doc, isf->field));
+            }
+            /* equal documents keep the order they would have been merged in */
+            skb_add_u64(&skb, (u64)n, false);
+            doc_destroy(doc);
+            sds[n].seg = i;
+            sds[n].doc = j;
+            sds[n].key_len = skb.size - key_starts[n];
+            n++;
+        }
+        fr_close(fr);
+    }
+    for (i = 0; i < n; i++) {
+        sds[i].key = skb.data + key_starts[i];
+    }
+    qsort(sds, n, sizeof(SortedDoc), &sorted_doc_cmp);
+
+    for (i = 0; i < sm->seg_cnt; i++) {
+        SegmentMergeInfo *smi = sm->smis[i];
+        if (NULL == smi->doc_map) {
+            smi->doc_map = ALLOC_N(int, smi->max_doc);
+        }
+        for (j = 0; j < smi->max_doc; j++) {
+            smi->doc_map[j] = -1;
+        }
+        smi->base = 0;
+    }
+    for (i = 0; i < n; i++) {
+        sm->smis[sds[i].seg]->doc_map[sds[i].doc] = i;
+        sds[i].key = NULL;
+    }
+
+    free(skb.data);
+    free(key_starts);
+    bv_destroy(fields);
+    sm->sorted_docs = sds;
+}
+
+/* Segments written before compressed fields were stored in blocks zip each
+ * value in the .fdt file. Their documents are read and added again so that
+ * the compressed values go into the new segment's blocks. The term vectors
+ * which follow the stored fields are copied as they are. */
+static void sm_rewrite_doc(FieldsWriter *fw, FieldsReader *fr, int doc_num,
+                           off_t start, off_t end, u32 tv_idx_offset)
+{
+    Document *doc = fr_get_doc(fr, doc_num);
+    const off_t stored_end = is_pos(fr->fdt_in);
+    off_t new_stored_len;
+
+    fw_add_doc(fw, doc);
+    doc_destroy(doc);
+    new_stored_len = os_pos(fw->fdt_out) - fw->start_ptr;
+    os_write_u32(fw->fdx_out, (u32)(new_stored_len + tv_idx_offset
+                                    - (stored_end - start)));
+    is2os_copy_bytes(fr->fdt_in, fw->fdt_out, (int)(end - stored_end));
+}
+
+/* copy document +doc_num+ from the FieldsReader to the new segment */
+static void sm_copy_doc(FieldsWriter *fw, FieldsReader *fr, int doc_num,
+                        bool has_compressed_fields)
+{
+    InStream *fdx_in = fr->fdx_in, *fdt_in = fr->fdt_in;
+    off_t start, end;
+    u32 tv_idx_offset;
+
+    is_seek(fdx_in, (off_t)doc_num * FIELDS_IDX_PTR_SIZE);
+    start = (off_t)is_read_u64(fdx_in);
+    tv_idx_offset = is_read_u32(fdx_in);
+    if (doc_num == fr->size - 1) {
+        end = is_length(fdt_in);
+    }
+    else {
+        end = (off_t)is_read_u64(fdx_in);
+    }
+
+    if (has_compressed_fields && NULL == fr->fdz_in) {
+        sm_rewrite_doc(fw, fr, doc_num, start, end, tv_idx_offset);
+    }
+    else {
+        os_write_u64(fw->fdx_out, os_pos(fw->fdt_out));
+        os_write_u32(fw->fdx_out, tv_idx_offset);
+        is_seek(fdt_in, start);
+        is2os_copy_bytes(fdt_in, fw->fdt_out, end - start);
+        if (fr->fdz_in && fr_get_block(fr, doc_num)) {
+            int len;
+            const char *data = fr_get_block_data(fr, doc_num, &len);
+            fw_add_block_data(fw, data, len);
+        }
+        fw_end_doc(fw);
+    }
+}
+
 static void sm_merge_fields(SegmentMerger *sm)
 {
     int i, j;
-    off_t start, end = 0;
-    char file_name[SEGMENT_NAME_MAX_LENGTH];
-    OutStream *fdt_out, *fdx_out;
-    Store *store = sm->store;
+    FieldsWriter *fw = fw_open(sm->store, sm->si->name, sm->fis);
     const int seg_cnt = sm->seg_cnt;
+    FieldsReader **frs = ALLOC_N(FieldsReader *, seg_cnt);
+    bool has_compressed_fields = false;
 
-    sprintf(file_name, "%s.fdt", sm->si->name);
-    fdt_out = store->new_output(store, file_name);
-
-    sprintf(file_name, "%s.fdx", sm->si->name);
-    fdx_out = store->new_output(store, file_name);
+    for (i = 0; i < sm->fis->size; i++) {
+        if (fi_is_compressed(sm->fis->fields[i])) {
+            has_compressed_fields = true;
+        }
+    }
 
     for (i = 0; i < seg_cnt; i++) {
         SegmentMergeInfo *smi = sm->smis[i];
-        const int max_doc = smi->max_doc;
-        InStream *fdt_in, *fdx_in;
-        char *segment = smi->si->name;
-        store = smi->store;
-        sprintf(file_name, "%s.fdt", segment);
-        fdt_in = store->open_input(store, file_name);
-        sprintf(file_name, "%s.fdx", segment);
-        fdx_in = store->open_input(store, file_name);
-
-        if (max_doc > 0) {
-            end = (off_t)is_read_u64(fdx_in);
-        }
-        for (j = 0; j < max_doc; j++) {
-            u32 tv_idx_offset = is_read_u32(fdx_in);
-            start = end;
-            if (j == max_doc - 1) {
-                end = is_length(fdt_in);
+        frs[i] = fr_open(smi->store, smi->si->name, sm->fis);
+    }
+
+    if (sm->sorted_docs) {
+        for (i = 0; i < sm->doc_cnt; i++) {
+            const SortedDoc *sd = &sm->sorted_docs[i];
+            sm_copy_doc(fw, frs[sd->seg], sd->doc, has_compressed_fields);
+        }
+    }
+    else {
+        for (i = 0; i < seg_cnt; i++) {
+            SegmentMergeInfo *smi = sm->smis[i];
+            const int max_doc = smi->max_doc;
+            for (j = 0; j < max_doc; j++) {
+                /* skip deleted docs */
+                if (smi->deleted_docs && bv_get(smi->deleted_docs, j)) {
+                    continue;
+                }
+                sm_copy_doc(fw, frs[i], j, has_compressed_fields);
             }
-            else {
-                end = (off_t)is_read_u64(fdx_in);
+        }
+    }
+
+    for (i = 0; i < seg_cnt; i++) {
+        fr_close(frs[i]);
+    }
+    free(frs);
+    fw_close(fw);
+}
+
+static void sm_write_posting(SegmentMerger *sm, int df, int *last_doc,
+                             int doc, int freq)
+{
+    /* use low bit to flag freq=1 */
+    const int doc_code = (doc - *last_doc) << 1;
+
+    if (0 == (df % sm->config->skip_interval)) {
+        skip_buf_add(sm->skip_buf, *last_doc);
+    }
+    *last_doc = doc;
+
+    if (freq == 1) {
+        os_write_vint(sm->frq_out, doc_code | 1); /* doc & freq=1 */
+    }
+    else {
+        os_write_vint(sm->frq_out, doc_code); /* write doc */
+        os_write_vint(sm->frq_out, freq);     /* write freqency in doc */
+    }
+}
+
+typedef struct SortedPosting {
+    int doc;
+    int freq;
+    int prx_start;
+} SortedPosting;
+
+static int sorted_posting_cmp(const void *p1, const void *p2)
+{
+    return ((const SortedPosting *)p1)->doc - ((const SortedPosting *)p2)->doc;
+}
+
+/* In a sorted index the documents of each segment are spread through the
+ * merged segment so a term's postings are gathered and sorted by their new
+ * document numbers before being written. */
+static int sm_append_sorted_postings(SegmentMerger *sm,
+                                     SegmentMergeInfo **matches,
+                                     const int match_size)
+{
+    int i, j;
+    int last_doc = 0, df = 0, pos_cnt = 0;
+
+    for (i = 0; i < match_size; i++) {
+        SegmentMergeInfo *smi = matches[i];
+        TermDocEnum *tde = smi->tde;
+        InStream *prx_in = STDE(tde)->prx_in;
+        stpe_seek_ti(STDE(tde), &smi->te->curr_ti);
+
+        while (stde_next(tde)) {
+            const int freq = stde_freq(tde);
+            SortedPosting *sp;
+            if (df >= sm->postings_capa) {
+                sm->postings_capa = sm->postings_capa
+                                  ? sm->postings_capa << 1 : 256;
+                REALLOC_N(sm->postings, SortedPosting, sm->postings_capa);
             }
-            /* skip deleted docs */
-            if (!smi->deleted_docs || !bv_get(smi->deleted_docs, j)) {
-                os_write_u64(fdx_out, os_pos(fdt_out));
-                os_write_u32(fdx_out, tv_idx_offset);
-                is_seek(fdt_in, start);
-                is2os_copy_bytes(fdt_in, fdt_out, end - start);
+            if (pos_cnt + freq > sm->positions_capa) {
+                do {
+                    sm->positions_capa = sm->positions_capa
+                                       ? sm->positions_capa << 1 : 1024;
+                } while (pos_cnt + freq > sm->positions_capa);
+                REALLOC_N(sm->positions, int, sm->positions_capa);
+            }
+            sp = &sm->postings[df++];
+            sp->doc = smi->doc_map[stde_doc_num(tde)];
+            sp->freq = freq;
+            sp->prx_start = pos_cnt;
+            for (j = 0; j < freq; j++) {
+                sm->positions[pos_cnt++] = is_read_vint(prx_in);
             }
         }
-        is_close(fdt_in);
-        is_close(fdx_in);
     }
-    os_close(fdt_out);
-    os_close(fdx_out);
+
+    qsort(sm->postings, df, sizeof(SortedPosting), &sorted_posting_cmp);
+    for (i = 0; i < df; i++) {
+        const SortedPosting *sp = &sm->postings[i];
+        const int *positions = sm->positions + sp->prx_start;
+        sm_write_posting(sm, i + 1, &last_doc, sp->doc, sp->freq);
+        for (j = 0; j < sp->freq; j++) {
+            os_write_vint(sm->prx_out, positions[j]);
+        }
+    }
+    return df;
 }
 
 static int sm_append_postings(SegmentMerger *sm, SegmentMergeInfo **matches,
                               const int match_size)
 {
     int i;
-    int last_doc = 0, base, doc, doc_code, freq;
-    int skip_interval = sm->config->skip_interval;
+    int last_doc = 0, base, doc, freq;
     int *doc_map = NULL;
     int df = 0;            /* number of docs w/ term */
     TermDocEnum *tde;
     SegmentMergeInfo *smi;
-    SkipBuffer *skip_buf = sm->skip_buf;
-    skip_buf_reset(skip_buf);
+    skip_buf_reset(sm->skip_buf);
+
+    if (sm->sorted_docs) {
+        return sm_append_sorted_postings(sm, matches, match_size);
+    }
 
     for (i = 0; i < match_size; i++) {
         smi = matches[i];
@@ -5949,22 +7179,8 @@ static int sm_append_postings(SegmentMerger *sm, SegmentMergeInfo **matches,
             doc += base;          /* convert to merged space */
             assert(doc == 0 || doc > last_doc);
 
-            df++;
-            if (0 == (df % skip_interval)) {
-                skip_buf_add(skip_buf, last_doc);
-            }
-
-            doc_code = (doc - last_doc) << 1;    /* use low bit to flag freq=1 */
-            last_doc = doc;
-
             freq = stde_freq(tde);
-            if (freq == 1) {
-                os_write_vint(sm->frq_out, doc_code | 1); /* doc & freq=1 */
-            }
-            else {
-                os_write_vint(sm->frq_out, doc_code); /* write doc */
-                os_write_vint(sm->frq_out, freq);     /* write freqency in doc */
-            }
+            sm_write_posting(sm, ++df, &last_doc, doc, freq);
 
             /* copy position deltas */
             is2os_copy_vints(STDE(tde)->prx_in, sm->prx_out, freq);
@@ -6073,8 +7289,8 @@ static void sm_merge_terms(SegmentMerger *sm)
     sprintf(file_name, "%s.prx", sm->si->name);
     sm->prx_out = sm->store->new_output(sm->store, file_name);
 
-    sm->tiw = tiw_open(sm->store, sm->si->name, sm->config->index_interval,
-                       sm->config->skip_interval);
+    sm->tiw = tiw_open(sm->store, sm->si->name, sm->fis,
+                       sm->config->index_interval, sm->config->skip_interval);
     sm->skip_buf = skip_buf_new(sm->frq_out, sm->prx_out);
 
     /* terms_buf_ptr holds a buffer of terms since the TermInfosWriter needs
@@ -6109,6 +7325,8 @@ static void sm_merge_norms(SegmentMerger *sm)
     char file_name[SEGMENT_NAME_MAX_LENGTH];
     SegmentMergeInfo *smi;
     const int seg_cnt = sm->seg_cnt;
+    /* the norms of a sorted index are permuted here before being written */
+    uchar *norms = sm->sorted_docs ? ALLOC_N(uchar, sm->doc_cnt + 1) : NULL;
     for (i = sm->fis->size - 1; i >= 0; i--) {
         fi = sm->fis->fields[i];
         if (fi_has_norms(fi))  {
@@ -6125,10 +7343,18 @@ static void sm_merge_norms(SegmentMerger *sm)
                     store = (si->use_compound_file && si->norm_gens[i])
                              ? smi->orig_store : smi->store;
                     is = store->open_input(store, file_name);
-                    if (deleted_docs) {
+                    if (sm->sorted_docs) {
                         for (k = 0; k < max_doc; k++) {
                             byte = is_read_byte(is);
-                            if (!bv_get(deleted_docs, k)) {
+                            if (smi->doc_map[k] >= 0) {
+                                norms[smi->doc_map[k]] = byte;
+                            }
+                        }
+                    }
+                    else if (deleted_docs) {
+                        for (k = 0; k < max_doc; k++) {
+                            byte = is_read_byte(is);
+                            if (!bv_get(deleted_docs, k)) {
                                 os_write_byte(os, byte);
                             }
                         }
@@ -6138,6 +7364,14 @@ static void sm_merge_norms(SegmentMerger *sm)
                     }
                     is_close(is);
                 }
+                else if (sm->sorted_docs) {
+                    const int max_doc = smi->max_doc;
+                    for (k = 0; k < max_doc; k++) {
+                        if (smi->doc_map[k] >= 0) {
+                            norms[smi->doc_map[k]] = '\0';
+                        }
+                    }
+                }
                 else {
                     const int doc_cnt = smi->doc_cnt;
                     for (k = 0; k < doc_cnt; k++) {
@@ -6145,13 +7379,20 @@ static void sm_merge_norms(SegmentMerger *sm)
                     }
                 }
             }
+            if (sm->sorted_docs) {
+                os_write_bytes(os, norms, sm->doc_cnt);
+            }
             os_close(os);
         }
     }
+    free(norms);
 }
 
 static int sm_merge(SegmentMerger *sm)
 {
+    if (sm->config->index_sort_cnt > 0) {
+        sm_sort_docs(sm);
+    }
     sm_merge_fields(sm);
     sm_merge_terms(sm);
     sm_merge_norms(sm);
@@ -6159,6 +7400,256 @@ static int sm_merge(SegmentMerger *sm)
 }
 
 
+/****************************************************************************
+ * MergePolicy
+ ****************************************************************************/
+
+/* The merge_factor and max_merge_docs are read from the IndexWriter's config
+ * each time so that they can be changed while the IndexWriter is open */
+static bool lmp_find_merge(MergePolicy *mp, IndexWriter *iw,
+                           int *min_seg, int *max_seg)
+{
+    int target_merge_docs = iw->config.merge_factor;
+    int min_segment, merge_docs;
+    SegmentInfo *si;
+    (void)mp;
+
+    while (target_merge_docs > 0
+           && target_merge_docs <= iw->config.max_merge_docs) {
+        /* find segments smaller than current target size */
+        min_segment = iw->sis->size - 1;
+        merge_docs = 0;
+        while (min_segment >= 0) {
+            si = iw->sis->segs[min_segment];
+            if (si->doc_cnt >= target_merge_docs) {
+                break;
+            }
+            merge_docs += si->doc_cnt;
+            min_segment--;
+        }
+
+        if (merge_docs >= target_merge_docs) { /* found a merge to do */
+            *min_seg = min_segment + 1;
+            *max_seg = iw->sis->size;
+            return true;
+        }
+        else if (min_segment <= 0) {
+            break;
+        }
+
+        target_merge_docs *= iw->config.merge_factor;
+    }
+    return false;
+}
+
+static void merge_policy_destroy(MergePolicy *mp)
+{
+    free(mp);
+}
+
+MergePolicy *log_merge_policy_new()
+{
+    MergePolicy *mp = ALLOC(MergePolicy);
+    mp->find_merge = &lmp_find_merge;
+    mp->destroy = &merge_policy_destroy;
+    return mp;
+}
+
+typedef struct TMPSegment {
+    i64 bytes;          /* size of the live documents */
+    i64 raw_bytes;      /* size on disk including deleted documents */
+    double del_pct;
+    bool too_large;
+} TMPSegment;
+
+static i64 si_byte_size(SegmentInfo *si)
+{
+    Store *store = si->store;
+    char file_name[SEGMENT_NAME_MAX_LENGTH];
+    i64 size = 0;
+    int i;
+
+    if (si->use_compound_file) {
+        sprintf(file_name, "%s.cfs", si->name);
+        return (i64)store->length(store, file_name);
+    }
+    for (i = 0; i < NELEMS(COMPOUND_EXTENSIONS); i++) {
+        sprintf(file_name, "%s.%s", si->name, COMPOUND_EXTENSIONS[i]);
+        if (store->exists(store, file_name)) {
+            size += (i64)store->length(store, file_name);
+        }
+    }
+    return size;
+}
+
+static void tmp_load_segment(TieredMergePolicy *tmp, SegmentInfo *si,
+                             TMPSegment *seg)
+{
+    int del_cnt = 0;
+    seg->raw_bytes = si_byte_size(si);
+    if (si->del_gen >= 0 && si->doc_cnt > 0) {
+        char file_name[SEGMENT_NAME_MAX_LENGTH];
+        BitVector *bv = bv_read(si->store, fn_for_generation(file_name,
+                                                             si->name, "del",
+                                                             si->del_gen));
+        del_cnt = bv->count;
+        bv_destroy(bv);
+    }
+    seg->del_pct = si->doc_cnt > 0 ? 100.0 * del_cnt / si->doc_cnt : 0.0;
+    seg->bytes = (i64)(seg->raw_bytes * (1.0 - seg->del_pct / 100.0));
+    seg->too_large = seg->bytes > tmp->max_merged_segment_bytes / 2;
+}
+
+#define I64_MAX2(a, b) ((a) > (b) ? (a) : (b))
+
+static i64 tmp_floor_size(TieredMergePolicy *tmp, i64 bytes)
+{
+    return I64_MAX2(bytes, tmp->floor_segment_bytes);
+}
+
+/* Score the merge of segs[min_seg..max_seg). Lower scores are better.
+ * Merges of evenly sized segments score well as they don't rewrite one big
+ * segment to add a few small ones, and merges that drop a lot of deleted
+ * documents score well as they give the most space back. */
+static double tmp_score(TieredMergePolicy *tmp, TMPSegment *segs,
+                        int min_seg, int max_seg)
+{
+    i64 total = 0, live_total = 0, raw_total = 0, largest = 0;
+    double skew;
+    int i;
+    for (i = min_seg; i < max_seg; i++) {
+        const i64 floored = tmp_floor_size(tmp, segs[i].bytes);
+        total += floored;
+        live_total += segs[i].bytes;
+        raw_total += segs[i].raw_bytes;
+        largest = I64_MAX2(largest, floored);
+    }
+    skew = (double)largest / (double)I64_MAX2(total, 1);
+    return skew * pow((double)I64_MAX2(total, 1), 0.05)
+        * pow((double)live_total / (double)I64_MAX2(raw_total, 1), 2.0);
+}
+
+/* The number of segments the index is allowed before it needs merging. Each
+ * tier may hold segs_per_tier segments with each tier max_merge_at_once times
+ * larger than the last. */
+static int tmp_allowed_seg_cnt(TieredMergePolicy *tmp, TMPSegment *segs,
+                               int seg_cnt)
+{
+    i64 total = 0, min_bytes = -1, level_size;
+    double allowed = 0.0;
+    int i;
+    for (i = 0; i < seg_cnt; i++) {
+        if (!segs[i].too_large) {
+            total += segs[i].bytes;
+            if (min_bytes < 0 || segs[i].bytes < min_bytes) {
+                min_bytes = segs[i].bytes;
+            }
+        }
+    }
+    level_size = tmp_floor_size(tmp, I64_MAX2(min_bytes, 1));
+    while (true) {
+        const double level_seg_cnt = (double)total / (double)level_size;
+        if (level_seg_cnt < tmp->segs_per_tier
+            || level_size >= tmp->max_merged_segment_bytes) {
+            allowed += ceil(level_seg_cnt);
+            break;
+        }
+        allowed += tmp->segs_per_tier;
+        total -= (i64)tmp->segs_per_tier * level_size;
+        level_size *= tmp->max_merge_at_once;
+        if (level_size > tmp->max_merged_segment_bytes) {
+            level_size = tmp->max_merged_segment_bytes;
+        }
+    }
+    return max2((int)allowed, tmp->segs_per_tier);
+}
+
+/* Merged segments replace the segments they came from so only runs of
+ * neighbouring segments are merged, keeping the documents in order. */
+static bool tmp_find_merge(MergePolicy *mp, IndexWriter *iw,
+                           int *min_seg, int *max_seg)
+{
+    TieredMergePolicy *tmp = TIERED_MP(mp);
+    const int seg_cnt = iw->sis->size;
+    TMPSegment *segs;
+    double best_score = 0.0;
+    int i, j, eligible_cnt = 0, best_min = -1, best_max = -1;
+    bool over_budget;
+
+    if (seg_cnt == 0) {
+        return false;
+    }
+    segs = ALLOC_N(TMPSegment, seg_cnt);
+    for (i = 0; i < seg_cnt; i++) {
+        tmp_load_segment(tmp, iw->sis->segs[i], &segs[i]);
+        if (!segs[i].too_large) {
+            eligible_cnt++;
+        }
+    }
+    over_budget = eligible_cnt > tmp_allowed_seg_cnt(tmp, segs, seg_cnt);
+
+    for (i = 0; i < seg_cnt; i++) {
+        i64 total = 0;
+        if (segs[i].too_large) {
+            /* big segments are only rewritten to reclaim their deletions */
+            if (segs[i].del_pct > tmp->deletes_pct_allowed) {
+                const double score = tmp_score(tmp, segs, i, i + 1);
+                if (best_min < 0 || score < best_score) {
+                    best_score = score;
+                    best_min = i;
+                    best_max = i + 1;
+                }
+            }
+            continue;
+        }
+        for (j = i; j < seg_cnt && j - i < tmp->max_merge_at_once; j++) {
+            double score;
+            if (segs[j].too_large) {
+                break;
+            }
+            total += segs[j].bytes;
+            if (total > tmp->max_merged_segment_bytes) {
+                break;
+            }
+            /* a single segment is only worth rewriting for its deletions
+             * and others only need merging when there are too many */
+            if (j == i ? segs[i].del_pct <= tmp->deletes_pct_allowed
+                       : !over_budget) {
+                continue;
+            }
+            score = tmp_score(tmp, segs, i, j + 1);
+            if (best_min < 0 || score < best_score
+                /* prefer the bigger merge when scores are the same */
+                || (score == best_score && j + 1 - i > best_max - best_min)) {
+                best_score = score;
+                best_min = i;
+                best_max = j + 1;
+            }
+        }
+    }
+    free(segs);
+
+    if (best_min < 0) {
+        return false;
+    }
+    *min_seg = best_min;
+    *max_seg = best_max;
+    return true;
+}
+
+MergePolicy *tiered_merge_policy_new()
+{
+    TieredMergePolicy *tmp = ALLOC(TieredMergePolicy);
+    tmp->super.find_merge = &tmp_find_merge;
+    tmp->super.destroy = &merge_policy_destroy;
+    tmp->max_merged_segment_bytes = (i64)5 * 1024 * 1024 * 1024;
+    tmp->floor_segment_bytes = 2 * 1024 * 1024;
+    tmp->segs_per_tier = 10;
+    tmp->max_merge_at_once = 10;
+    tmp->deletes_pct_allowed = 33.0;
+    return (MergePolicy *)tmp;
+}
+
 /****************************************************************************
  * IndexWriter
  ****************************************************************************/
@@ -6215,7 +7706,10 @@ static void iw_create_compound_file(Store *store, FieldInfos *fis,
     cw = open_cw(store, cfs_file_name);
     for (i = 0; i < NELEMS(COMPOUND_EXTENSIONS); i++) {
         memcpy(ext, COMPOUND_EXTENSIONS[i], 4);
-        MOVE_TO_COMPOUND_DIR(file_name);
+        /* segments copied from older indexes may be missing newer files */
+        if (store->exists(store, file_name)) {
+            MOVE_TO_COMPOUND_DIR(file_name);
+        }
     }
 
     /* Field norm file_names */
@@ -6250,6 +7744,7 @@ static void iw_merge_segments(IndexWriter *iw, const int min_seg,
 
     /* This is where all the action happens. */
     si->doc_cnt = sm_merge(merger);
+    si->sorted_by = index_sort_desc(&iw->config);
 
     mutex_lock(&iw->store->mutex);
     /* delete merged segments */
@@ -6258,6 +7753,10 @@ static void iw_merge_segments(IndexWriter *iw, const int min_seg,
     }
 
     sis_del_from_to(sis, min_seg, max_seg);
+    /* the new segment takes the place of the segments it replaces */
+    memmove(sis->segs + min_seg + 1, sis->segs + min_seg,
+            (sis->size - 1 - min_seg) * sizeof(SegmentInfo *));
+    sis->segs[min_seg] = si;
 
     if (iw->config.use_compound_file) {
         iw_commit_compound_file(iw, si);
@@ -6279,33 +7778,71 @@ static void iw_merge_segments_from(IndexWriter *iw, int min_segment)
 
 static void iw_maybe_merge_segments(IndexWriter *iw)
 {
-    int target_merge_docs = iw->config.merge_factor;
-    int min_segment, merge_docs;
-    SegmentInfo *si;
+    int min_seg, max_seg;
+    while (iw->merge_policy->find_merge(iw->merge_policy, iw,
+                                        &min_seg, &max_seg)) {
+        iw_merge_segments(iw, min_seg, max_seg);
+    }
+}
 
-    while (target_merge_docs > 0
-           && target_merge_docs <= iw->config.max_merge_docs) {
-        /* find segments smaller than current target size */
-        min_segment = iw->sis->size - 1;
-        merge_docs = 0;
-        while (min_segment >= 0) {
-            si = iw->sis->segs[min_segment];
-            if (si->doc_cnt >= target_merge_docs) {
-                break;
-            }
-            merge_docs += si->doc_cnt;
-            min_segment--;
-        }
+static int del_term_cmp(const void *p1, const void *p2)
+{
+    const DelTerm *dt1 = (const DelTerm *)p1;
+    const DelTerm *dt2 = (const DelTerm *)p2;
+    if (dt1->field_num != dt2->field_num) {
+        return dt1->field_num - dt2->field_num;
+    }
+    return strcmp(dt1->term, dt2->term);
+}
 
-        if (merge_docs >= target_merge_docs) { /* found a merge to do */
-            iw_merge_segments_from(iw, min_segment + 1);
-        }
-        else if (min_segment <= 0) {
-            break;
-        }
+static void iw_clear_del_terms(IndexWriter *iw)
+{
+    int i;
+    for (i = 0; i < iw->del_terms_size; i++) {
+        free(iw->del_terms[i].term);
+    }
+    iw->del_terms_size = 0;
+}
 
-        target_merge_docs *= iw->config.merge_factor;
+/*
+ * Apply all of the buffered delete terms, writing at most one new .del file
+ * per segment. +flushed_seg+ is the index of the segment that was just
+ * flushed from the DocWriter or -1 if there wasn't one. Returns true if any
+ * documents were deleted.
+ */
+static bool iw_apply_deletes(IndexWriter *iw, const int flushed_seg)
+{
+    SegmentInfos *sis = iw->sis;
+    DelTerm *del_terms = iw->del_terms;
+    const int del_cnt = iw->del_terms_size;
+    bool did_delete = false;
+    int i, j;
+
+    if (del_cnt == 0) {
+        return false;
     }
+    /* seek the terms in order */
+    qsort(del_terms, del_cnt, sizeof(DelTerm), &del_term_cmp);
+    for (i = 0; i < sis->size; i++) {
+        IndexReader *ir = sr_open(sis, iw->fis, i, false);
+        TermDocEnum *tde = ir->term_docs(ir);
+        ir->deleter = iw->deleter;
+        for (j = 0; j < del_cnt; j++) {
+            const int doc_limit = (i == flushed_seg)
+                ? del_terms[j].doc_limit
+                : INT_MAX;
+            stde_seek(tde, del_terms[j].field_num, del_terms[j].term);
+            while (tde->next(tde) && STDE(tde)->doc_num < doc_limit) {
+                did_delete = true;
+                sr_delete_doc_i(ir, STDE(tde)->doc_num);
+            }
+        }
+        tde_destroy(tde);
+        sr_commit_i(ir);
+        ir_close(ir);
+    }
+    iw_clear_del_terms(iw);
+    return did_delete;
 }
 
 static void iw_flush_ram_segment(IndexWriter *iw)
@@ -6316,6 +7853,10 @@ static void iw_flush_ram_segment(IndexWriter *iw)
     si = sis->segs[sis->size - 1];
     si->doc_cnt = iw->dw->doc_num;
     dw_flush(iw->dw);
+    iw_apply_deletes(iw, sis->size - 1);
+
+    /* a flushed segment is left in the order its documents were added and
+     * is sorted when it is merged. Its sorted_by stays NULL to say so. */
 
     mutex_lock(&iw->store->mutex);
 
@@ -6332,9 +7873,8 @@ static void iw_flush_ram_segment(IndexWriter *iw)
     iw_maybe_merge_segments(iw);
 }
 
-void iw_add_doc(IndexWriter *iw, Document *doc)
+static void iw_add_doc_i(IndexWriter *iw, Document *doc)
 {
-    mutex_lock(&iw->mutex);
     if (NULL == iw->dw) {
         iw->dw = dw_open(iw, sis_new_segment(iw->sis, 0, iw->store));
     }
@@ -6346,6 +7886,12 @@ void iw_add_doc(IndexWriter *iw, Document *doc)
         || iw->dw->doc_num >= iw->config.max_buffered_docs) {
         iw_flush_ram_segment(iw);
     }
+}
+
+void iw_add_doc(IndexWriter *iw, Document *doc)
+{
+    mutex_lock(&iw->mutex);
+    iw_add_doc_i(iw, doc);
     mutex_unlock(&iw->mutex);
 }
 
@@ -6354,6 +7900,13 @@ static void iw_commit_i(IndexWriter *iw)
     if (iw->dw && iw->dw->doc_num > 0) {
         iw_flush_ram_segment(iw);
     }
+    else if (iw_apply_deletes(iw, -1)) {
+        mutex_lock(&iw->store->mutex);
+        sis_write(iw->sis, iw->store, iw->deleter);
+        mutex_unlock(&iw->store->mutex);
+        /* the deletes may have left segments worth merging */
+        iw_maybe_merge_segments(iw);
+    }
 }
 
 void iw_commit(IndexWriter *iw)
@@ -6363,40 +7916,55 @@ void iw_commit(IndexWriter *iw)
     mutex_unlock(&iw->mutex);
 }
 
+/*
+ * Buffer a delete term. It will only delete documents that were added
+ * before it, so remember how many documents the DocWriter is holding.
+ */
+static void iw_buffer_del_term(IndexWriter *iw, int field_num,
+                               const char *term)
+{
+    DelTerm *dt;
+    if (iw->del_terms_size >= iw->del_terms_capa) {
+        iw->del_terms_capa = max2(iw->del_terms_capa << 1, 16);
+        REALLOC_N(iw->del_terms, DelTerm, iw->del_terms_capa);
+    }
+    dt = iw->del_terms + iw->del_terms_size++;
+    dt->field_num = field_num;
+    dt->term = estrdup(term);
+    dt->doc_limit = iw->dw ? iw->dw->doc_num : 0;
+}
+
+static void iw_maybe_apply_deletes(IndexWriter *iw)
+{
+    if (iw->del_terms_size >= iw->config.max_buffered_delete_terms) {
+        iw_commit_i(iw);
+    }
+}
+
 void iw_delete_term(IndexWriter *iw, Symbol field, const char *term)
 {
     int field_num = fis_get_field_num(iw->fis, field);
     if (field_num >= 0) {
-        int i;
         mutex_lock(&iw->mutex);
-        iw_commit_i(iw);
-        do {
-            SegmentInfos *sis = iw->sis;
-            const int seg_cnt = sis->size;
-            bool did_delete = false;
-            for (i = 0; i < seg_cnt; i++) {
-                IndexReader *ir = sr_open(sis, iw->fis, i, false);
-                TermDocEnum *tde = ir->term_docs(ir);
-                ir->deleter = iw->deleter;
-                stde_seek(tde, field_num, term);
-                while (tde->next(tde)) {
-                    did_delete = true;
-                    sr_delete_doc_i(ir, STDE(tde)->doc_num);
-                }
-                tde_destroy(tde);
-                sr_commit_i(ir);
-                ir_close(ir);
-            }
-            if (did_delete) {
-                mutex_lock(&iw->store->mutex);
-                sis_write(iw->sis, iw->store, iw->deleter);
-                mutex_unlock(&iw->store->mutex);
-            }
-        } while (0);
+        iw_buffer_del_term(iw, field_num, term);
+        iw_maybe_apply_deletes(iw);
         mutex_unlock(&iw->mutex);
     }
 }
 
+void iw_update_doc(IndexWriter *iw, Symbol field, const char *term,
+                   Document *doc)
+{
+    int field_num = fis_get_field_num(iw->fis, field);
+    mutex_lock(&iw->mutex);
+    if (field_num >= 0) {
+        iw_buffer_del_term(iw, field_num, term);
+    }
+    iw_add_doc_i(iw, doc);
+    iw_maybe_apply_deletes(iw);
+    mutex_unlock(&iw->mutex);
+}
+
 void iw_delete_terms(IndexWriter *iw, Symbol field,
                      char **terms, const int term_cnt)
 {
@@ -6404,34 +7972,10 @@ void iw_delete_terms(IndexWriter *iw, Symbol field,
     if (field_num >= 0) {
         int i;
         mutex_lock(&iw->mutex);
-        iw_commit_i(iw);
-        do {
-            SegmentInfos *sis = iw->sis;
-            const int seg_cnt = sis->size;
-            bool did_delete = false;
-            for (i = 0; i < seg_cnt; i++) {
-                IndexReader *ir = sr_open(sis, iw->fis, i, false);
-                TermDocEnum *tde = ir->term_docs(ir);
-                int j;
-                for (j = 0 ; j < term_cnt; j++) {
-                    const char *term = terms[j];
-                    ir->deleter = iw->deleter;
-                    stde_seek(tde, field_num, term);
-                    while (tde->next(tde)) {
-                        did_delete = true;
-                        sr_delete_doc_i(ir, STDE(tde)->doc_num);
-                    }
-                }
-                tde_destroy(tde);
-                sr_commit_i(ir);
-                ir_close(ir);
-            }
-            if (did_delete) {
-                mutex_lock(&iw->store->mutex);
-                sis_write(iw->sis, iw->store, iw->deleter);
-                mutex_unlock(&iw->store->mutex);
-            }
-        } while (0);
+        for (i = 0; i < term_cnt; i++) {
+            iw_buffer_del_term(iw, field_num, terms[i]);
+        }
+        iw_maybe_apply_deletes(iw);
         mutex_unlock(&iw->mutex);
     }
 }
@@ -6443,6 +7987,7 @@ static void iw_optimize_i(IndexWriter *iw)
     while (iw->sis->size > 1
            || (iw->sis->size == 1
                && (si_has_deletions(iw->sis->segs[0])
+                   || si_needs_sort(iw->sis->segs[0], &iw->config)
                    || (iw->sis->segs[0]->store != iw->store)
                    || (iw->config.use_compound_file
                        && (!iw->sis->segs[0]->use_compound_file
@@ -6459,6 +8004,14 @@ void iw_optimize(IndexWriter *iw)
     mutex_unlock(&iw->mutex);
 }
 
+void iw_set_merge_policy(IndexWriter *iw, MergePolicy *mp)
+{
+    mutex_lock(&iw->mutex);
+    iw->merge_policy->destroy(iw->merge_policy);
+    iw->merge_policy = mp;
+    mutex_unlock(&iw->mutex);
+}
+
 void iw_close(IndexWriter *iw)
 {
     mutex_lock(&iw->mutex);
@@ -6466,10 +8019,13 @@ void iw_close(IndexWriter *iw)
     if (iw->dw) {
         dw_close(iw->dw);
     }
+    iw_clear_del_terms(iw);
+    free(iw->del_terms);
     a_deref(iw->analyzer);
     sis_destroy(iw->sis);
     fis_deref(iw->fis);
     sim_destroy(iw->similarity);
+    iw->merge_policy->destroy(iw->merge_policy);
 
     iw->write_lock->release(iw->write_lock);
     close_lock(iw->write_lock);
@@ -6514,6 +8070,7 @@ IndexWriter *iw_open(Store *store, Analyzer *volatile analyzer,
     XENDTRY
 
     iw->similarity = sim_create_default();
+    iw->merge_policy = log_merge_policy_new();
     iw->analyzer = analyzer ? (Analyzer *)analyzer
                             : mb_standard_analyzer_new(true);
 
@@ -6536,6 +8093,20 @@ static void iw_cp_fields(IndexWriter *iw, SegmentReader *sr,
     Store *store_in = sr->cfs_store ? sr->cfs_store : sr->ir.store;
     Store *store_out = iw->store;
     char *sr_segment = sr->si->name;
+    FieldInfos *sr_fis = IR(sr)->fis;
+    bool has_blocks;
+
+    sprintf(file_name, "%s.fdz", sr_segment);
+    if ((has_blocks = store_in->exists(store_in, file_name))) {
+        /* compressed fields don't refer to field numbers so can be copied */
+        OutStream *fdz_out;
+        InStream *fdz_in = store_in->open_input(store_in, file_name);
+        sprintf(file_name, "%s.fdz", segment);
+        fdz_out = store_out->new_output(store_out, file_name);
+        is2os_copy_bytes(fdz_in, fdz_out, is_length(fdz_in));
+        is_close(fdz_in);
+        os_close(fdz_out);
+    }
 
     sprintf(file_name, "%s.fdt", segment);
     fdt_out = store_out->new_output(store_out, file_name);
@@ -6571,8 +8142,12 @@ static void iw_cp_fields(IndexWriter *iw, SegmentReader *sr,
 
             for (j = 0; j < field_cnt; j++) {
                 int k;
-                const int field_num = map[is_read_vint(fdt_in)];
+                const int sr_field_num = is_read_vint(fdt_in);
+                const int field_num = map[sr_field_num];
                 const int df_size = is_read_vint(fdt_in);
+                /* compressed data is in the .fdz file, not the .fdt */
+                const bool in_block = has_blocks
+                    && fi_is_compressed(sr_fis->fields[sr_field_num]);
                 os_write_vint(fdt_out, field_num);
                 os_write_vint(fdt_out, df_size);
                 /* sum total lengths of DocField */
@@ -6580,7 +8155,9 @@ static void iw_cp_fields(IndexWriter *iw, SegmentReader *sr,
                     /* Each field has one ' ' byte so add 1 */
                     const int flen = is_read_vint(fdt_in);
                     os_write_vint(fdt_out, flen);
-                    data_len +=  flen + 1;
+                    if (!in_block) {
+                        data_len +=  flen + 1;
+                    }
                 }
             }
             is2os_copy_bytes(fdt_in, fdt_out, data_len);
@@ -6614,6 +8191,40 @@ static void iw_cp_fields(IndexWriter *iw, SegmentReader *sr,
     os_close(fdx_out);
 }
 
+static void iw_cp_bloom_filters(Store *store_in, const char *sr_segment,
+                                Store *store_out, const char *segment,
+                                int *map)
+{
+    char file_name[SEGMENT_NAME_MAX_LENGTH];
+    OutStream *blm_out;
+    InStream *blm_in;
+
+    sprintf(file_name, "%s.blm", sr_segment);
+    if (!store_in->exists(store_in, file_name)) {
+        return; /* no field in the segment has a bloom filter */
+    }
+    blm_in = store_in->open_input(store_in, file_name);
+    sprintf(file_name, "%s.blm", segment);
+    blm_out = store_out->new_output(store_out, file_name);
+    if (map) {
+        int bloom_cnt, word_cnt;
+        bloom_cnt = is_read_u32(blm_in);
+        os_write_u32(blm_out, bloom_cnt);
+        for (; bloom_cnt > 0; bloom_cnt--) {
+            os_write_vint(blm_out, map[is_read_vint(blm_in)]);/* mapped field */
+            os_write_vint(blm_out, is_read_vint(blm_in));     /* num hashes */
+            word_cnt = is_read_vint(blm_in);
+            os_write_vint(blm_out, word_cnt);
+            is2os_copy_bytes(blm_in, blm_out, word_cnt * sizeof(u64));
+        }
+    }
+    else {
+        is2os_copy_bytes(blm_in, blm_out, is_length(blm_in));
+    }
+    is_close(blm_in);
+    os_close(blm_out);
+}
+
 static void iw_cp_terms(IndexWriter *iw, SegmentReader *sr,
                         const char *segment, int *map)
 {
@@ -6681,6 +8292,20 @@ static void iw_cp_terms(IndexWriter *iw, SegmentReader *sr,
     os_close(frq_out);
     is_close(prx_in);
     os_close(prx_out);
+
+    /* the restart tables are in field order so don't need to be mapped */
+    sprintf(file_name, "%s.trp", sr_segment);
+    if (store_in->exists(store_in, file_name)) {
+        OutStream *trp_out;
+        InStream *trp_in = store_in->open_input(store_in, file_name);
+        sprintf(file_name, "%s.trp", segment);
+        trp_out = store_out->new_output(store_out, file_name);
+        is2os_copy_bytes(trp_in, trp_out, is_length(trp_in));
+        is_close(trp_in);
+        os_close(trp_out);
+    }
+
+    iw_cp_bloom_filters(store_in, sr_segment, store_out, segment, map);
 }
 
 static void iw_cp_norms(IndexWriter *iw, SegmentReader *sr,
@@ -6809,3 +8434,401 @@ void iw_add_readers(IndexWriter *iw, IndexReader **readers, const int r_cnt)
     iw_optimize_i(iw);
     mutex_unlock(&iw->mutex);
 }
+
+/****************************************************************************
+ *
+ * Pre-analyzed Documents
+ *
+ * A document is written as;
+ *
+ *   doc:     vint field count, u32 boost, fields
+ *   field:   string name, u32 boost, vint value count, values as strings,
+ *            vint token count + 1 (0 if the field has no tokens), tokens
+ *   token:   string text, vint pos_inc, vll start - previous start,
+ *            vint end - start
+ *
+ * Boosts are written with float2int. The offset deltas are written unsigned
+ * so a token starting before the previous one still round trips, it just
+ * takes more bytes.
+ *
+ ****************************************************************************/
+
+/* analyze a field the same way dw_invert_field would */
+static TokenList *df_analyze_i(DocField *df, Analyzer *a,
+                               int max_field_length)
+{
+    TokenList *tkl = tkl_new();
+    off_t start_offset = 0;
+    int i;
+
+    for (i = 0; i < df->size && tkl->size <= max_field_length; i++) {
+        TokenStream *ts = a_get_ts(a, df->name, df->data[i]);
+        Token *tk;
+        ts->zero_copy = true;
+        while (tkl->size <= max_field_length && NULL != (tk = ts->next(ts))) {
+            tkl_add(tkl, TK_PTR(tk), tk->len, tk->pos_inc,
+                    start_offset + tk->start, start_offset + tk->end);
+        }
+        ts_deref(ts);
+        start_offset += df->lengths[i] + 1;
+    }
+    return tkl;
+}
+
+void df_analyze(DocField *df, Analyzer *a)
+{
+    TokenList *tkl = df_analyze_i(df, a, INT_MAX);
+    if (df->tokens) {
+        tkl_destroy(df->tokens);
+    }
+    df->tokens = tkl;
+}
+
+void doc_write(Document *doc, OutStream *os)
+{
+    int i, j;
+    os_write_vint(os, doc->size);
+    os_write_u32(os, (u32)float2int(doc->boost));
+    for (i = 0; i < doc->size; i++) {
+        DocField *df = doc->fields[i];
+        TokenList *tkl = df->tokens;
+        os_write_string(os, S(df->name));
+        os_write_u32(os, (u32)float2int(df->boost));
+        os_write_vint(os, df->size);
+        for (j = 0; j < df->size; j++) {
+            os_write_string_len(os, df->data[j], df->lengths[j]);
+        }
+        if (!tkl) {
+            os_write_vint(os, 0);
+            continue;
+        }
+        os_write_vint(os, tkl->size + 1);
+        for (j = 0; j < tkl->size; j++) {
+            const DocToken *dtk = tkl->tokens + j;
+            const off_t last_start = j ? dtk[-1].start : 0;
+            os_write_string_len(os, tkl->buf + dtk->text, dtk->len);
+            os_write_vint(os, dtk->pos_inc);
+            os_write_vll(os, (u64)(dtk->start - last_start));
+            os_write_vint(os, (unsigned int)(dtk->end - dtk->start));
+        }
+    }
+}
+
+/* read a length and check there are that many bytes left to read */
+static int doc_read_len(InStream *is)
+{
+    const unsigned int len = is_read_vint(is);
+    if (len > (unsigned int)(is->m->length_i(is) - is_pos(is))) {
+        RAISE(IO_ERROR, "corrupt document, %u bytes past the end of the "
+              "stream", len);
+    }
+    return (int)len;
+}
+
+static char *doc_read_bytes(InStream *is, int len)
+{
+    char *buf = ALLOC_N(char, len + 1);
+    is_read_bytes(is, (uchar *)buf, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+static void df_read_tokens(DocField *df, InStream *is, int size)
+{
+    TokenList *tkl = df->tokens = tkl_new();
+    char buf[MAX_WORD_SIZE];
+    off_t start = 0;
+    int i;
+    for (i = 0; i < size; i++) {
+        const int len = doc_read_len(is);
+        char *text = len < MAX_WORD_SIZE
+            ? (char *)is_read_bytes(is, (uchar *)buf, len)
+            : doc_read_bytes(is, len);
+        const int pos_inc = (int)is_read_vint(is);
+        start += (off_t)is_read_vll(is);
+        tkl_add(tkl, text, len, pos_inc, start, start + is_read_vint(is));
+        if (text != buf) {
+            free(text);
+        }
+    }
+}
+
+Document *doc_read(InStream *is)
+{
+    Document *volatile doc = doc_new();
+    int i, j, field_cnt;
+    TRY
+        field_cnt = (int)is_read_vint(is);
+        doc->boost = int2float((i32)is_read_u32(is));
+        for (i = 0; i < field_cnt; i++) {
+            Symbol name = intern_and_free(is_read_string_safe(is));
+            DocField *df = doc_add_field(doc, df_new(name));
+            int size;
+            df->destroy_data = true;
+            df->boost = int2float((i32)is_read_u32(is));
+            size = (int)is_read_vint(is);
+            for (j = 0; j < size; j++) {
+                const int len = doc_read_len(is);
+                df_add_data_len(df, doc_read_bytes(is, len), len);
+            }
+            size = (int)is_read_vint(is);
+            if (size > 0) {
+                df_read_tokens(df, is, size - 1);
+            }
+        }
+    XCATCHALL
+        doc_destroy(doc);
+    XENDTRY
+    return doc;
+}
+
+int iw_load_docs(IndexWriter *iw, InStream *is)
+{
+    const off_t length = is->m->length_i(is);
+    int cnt = 0;
+    while (is_pos(is) < length) {
+        Document *doc = doc_read(is);
+        TRY
+            iw_add_doc(iw, doc);
+        XFINALLY
+            doc_destroy(doc);
+        XENDTRY
+        cnt++;
+    }
+    return cnt;
+}
+
+/****************************************************************************
+ *
+ * IndexPipeline
+ *
+ * Documents are queued in a ring buffer. The analysis threads take the next
+ * unanalyzed document from the ring and attach a TokenList to each of its
+ * fields. The inverter thread adds the document at the head of the ring to
+ * the IndexWriter once it has been analyzed, so documents are added in the
+ * order they were queued however the analysis threads get scheduled.
+ *
+ ****************************************************************************/
+
+#ifndef UNTHREADED
+
+struct FrtIndexPipeline
+{
+    IndexWriter *iw;
+    mutex_t      mutex;
+    cond_t       cond;
+    Document   **docs;
+    bool        *analyzed;
+    int          capa;
+    int          head;          /* next document to add to the index */
+    int          next;          /* next document to analyze */
+    int          size;          /* documents in the ring */
+    int          unanalyzed;    /* documents from next not yet analyzed */
+    bool         closing;
+    /* fields we've seen aren't indexed or tokenized so needn't be analyzed */
+    HashSet     *plain_fields;
+    int          excode;
+    char         msg[XMSG_BUFFER_SIZE];
+    int          thread_cnt;
+    thread_t    *threads;
+    thread_t     inverter;
+};
+
+/* remember the first error. Called with ip->mutex locked */
+static void ip_set_error(IndexPipeline *ip, int excode, const char *msg)
+{
+    if (!ip->excode) {
+        ip->excode = excode;
+        snprintf(ip->msg, XMSG_BUFFER_SIZE, "%s", msg);
+    }
+}
+
+static void ip_analyze_doc(IndexPipeline *ip, Document *doc)
+{
+    Analyzer *a = ip->iw->analyzer;
+    const int max_field_length = ip->iw->config.max_field_length;
+    int i;
+
+    for (i = 0; i < doc->size; i++) {
+        DocField *df = doc->fields[i];
+        bool plain;
+        if (df->tokens) {
+            continue;
+        }
+        mutex_lock(&ip->mutex);
+        plain = hs_exists(ip->plain_fields, df->name) == HASH_KEY_EQUAL;
+        mutex_unlock(&ip->mutex);
+        if (!plain) {
+            df->tokens = df_analyze_i(df, a, max_field_length);
+        }
+    }
+}
+
+static void *ip_analyze_run(void *arg)
+{
+    IndexPipeline *ip = (IndexPipeline *)arg;
+
+    mutex_lock(&ip->mutex);
+    while (true) {
+        int i;
+        while (0 == ip->unanalyzed && !ip->closing) {
+            cond_wait(&ip->cond, &ip->mutex);
+        }
+        if (0 == ip->unanalyzed) {
+            break;
+        }
+        i = ip->next;
+        ip->next = (i + 1) % ip->capa;
+        ip->unanalyzed--;
+        mutex_unlock(&ip->mutex);
+
+        TRY
+            ip_analyze_doc(ip, ip->docs[i]);
+        XCATCHALL
+            HANDLED();
+            mutex_lock(&ip->mutex);
+            ip_set_error(ip, xcontext.excode, xcontext.msg);
+            mutex_unlock(&ip->mutex);
+        XENDTRY
+
+        mutex_lock(&ip->mutex);
+        ip->analyzed[i] = true;
+        cond_broadcast(&ip->cond);
+    }
+    mutex_unlock(&ip->mutex);
+    return NULL;
+}
+
+/* add an analyzed document to the index. Called with iw->mutex locked */
+static void ip_invert_doc(IndexPipeline *ip, Document *doc)
+{
+    IndexWriter *iw = ip->iw;
+    int i;
+
+    iw_add_doc_i(iw, doc);
+    mutex_lock(&ip->mutex);
+    for (i = 0; i < doc->size; i++) {
+        FieldInfo *fi = fis_get_field(iw->fis, doc->fields[i]->name);
+        if (!fi_is_indexed(fi) || !fi_is_tokenized(fi)) {
+            hs_add(ip->plain_fields, fi->name);
+        }
+    }
+    mutex_unlock(&ip->mutex);
+}
+
+static void *ip_invert_run(void *arg)
+{
+    IndexPipeline *ip = (IndexPipeline *)arg;
+
+    mutex_lock(&ip->mutex);
+    while (true) {
+        Document *doc;
+        bool failed;
+        while ((0 == ip->size || !ip->analyzed[ip->head]) && !ip->closing) {
+            cond_wait(&ip->cond, &ip->mutex);
+        }
+        if (0 == ip->size) {
+            break;
+        }
+        if (!ip->analyzed[ip->head]) {
+            /* closing but the analysis threads haven't caught up */
+            cond_wait(&ip->cond, &ip->mutex);
+            continue;
+        }
+        doc = ip->docs[ip->head];
+        failed = ip->excode != 0;
+        mutex_unlock(&ip->mutex);
+
+        if (!failed) {
+            mutex_lock(&ip->iw->mutex);
+            TRY
+                ip_invert_doc(ip, doc);
+            XCATCHALL
+                HANDLED();
+                mutex_lock(&ip->mutex);
+                ip_set_error(ip, xcontext.excode, xcontext.msg);
+                mutex_unlock(&ip->mutex);
+            XENDTRY
+            mutex_unlock(&ip->iw->mutex);
+        }
+        doc_destroy(doc);
+
+        mutex_lock(&ip->mutex);
+        ip->analyzed[ip->head] = false;
+        ip->head = (ip->head + 1) % ip->capa;
+        ip->size--;
+        cond_broadcast(&ip->cond);
+    }
+    mutex_unlock(&ip->mutex);
+    return NULL;
+}
+
+IndexPipeline *ip_new(IndexWriter *iw, int thread_cnt, int queue_size)
+{
+    IndexPipeline *ip = ALLOC_AND_ZERO(IndexPipeline);
+    int i;
+
+    if (thread_cnt < 1) {
+        thread_cnt = 1;
+    }
+    if (queue_size < thread_cnt) {
+        queue_size = thread_cnt;
+    }
+    ip->iw = iw;
+    mutex_init(&ip->mutex, NULL);
+    cond_init(&ip->cond, NULL);
+    ip->capa = queue_size;
+    ip->docs = ALLOC_N(Document *, queue_size);
+    ip->analyzed = ALLOC_AND_ZERO_N(bool, queue_size);
+    ip->plain_fields = hs_new_ptr(NULL);
+    ip->thread_cnt = thread_cnt;
+    ip->threads = ALLOC_N(thread_t, thread_cnt);
+    for (i = 0; i < thread_cnt; i++) {
+        thread_create(&ip->threads[i], &ip_analyze_run, ip);
+    }
+    thread_create(&ip->inverter, &ip_invert_run, ip);
+    return ip;
+}
+
+void ip_add_doc(IndexPipeline *ip, Document *doc)
+{
+    mutex_lock(&ip->mutex);
+    while (ip->size >= ip->capa) {
+        cond_wait(&ip->cond, &ip->mutex);
+    }
+    ip->docs[(ip->head + ip->size) % ip->capa] = doc;
+    ip->size++;
+    ip->unanalyzed++;
+    cond_broadcast(&ip->cond);
+    mutex_unlock(&ip->mutex);
+}
+
+void ip_close(IndexPipeline *ip)
+{
+    char msg[XMSG_BUFFER_SIZE];
+    int excode, i;
+
+    mutex_lock(&ip->mutex);
+    ip->closing = true;
+    cond_broadcast(&ip->cond);
+    mutex_unlock(&ip->mutex);
+    for (i = 0; i < ip->thread_cnt; i++) {
+        thread_join(ip->threads[i]);
+    }
+    thread_join(ip->inverter);
+
+    excode = ip->excode;
+    memcpy(msg, ip->msg, XMSG_BUFFER_SIZE);
+    hs_destroy(ip->plain_fields);
+    free(ip->threads);
+    free(ip->analyzed);
+    free(ip->docs);
+    cond_destroy(&ip->cond);
+    mutex_destroy(&ip->mutex);
+    free(ip);
+    if (excode) {
+        RAISE(excode, "%s", msg);
+    }
+}
+
+#endif
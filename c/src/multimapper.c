@@ -1,3 +1,6 @@
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 #include "multimapper.h"
 #include "array.h"
 #include "bitvector.h"
@@ -221,11 +224,22 @@ void mulmap_compile(MultiMapper *self)
     unsigned char alphabet[256];
     nstates[0] = (State *)start;
     memset(alphabet, 0, 256);
+    memset(self->first_bytes, 0, sizeof(self->first_bytes));
+    self->ascii_unmapped = true;
+    self->never_grows = true;
 
     for (i = self->size - 1; i >= 0; i--) {
         const char *pattern = mappings[i]->pattern;
         const int plen = (int)strlen(pattern);
-        ndstate_add(start, UCtoI(pattern[0]), size);
+        const int first = UCtoI(pattern[0]);
+        ndstate_add(start, first, size);
+        self->first_bytes[first >> 3] |= 1 << (first & 7);
+        if (first < 0x80) {
+            self->ascii_unmapped = false;
+        }
+        if ((int)strlen(mappings[i]->replacement) > plen) {
+            self->never_grows = false;
+        }
         if (size + plen + 1 >= capa) {
             capa <<= 2;
             REALLOC_N(nstates, State *, capa);
@@ -288,6 +302,36 @@ int mulmap_map_len(MultiMapper *self, char *to, char *from, int capa)
     return d - to;
 }
 
+int mulmap_scan(MultiMapper *self, const char *text, int len)
+{
+    const uchar *s = (const uchar *)text;
+    const uchar *const end = s + len;
+    if (self->d_size == 0) {
+        mulmap_compile(self);
+    }
+#ifdef __SSE2__
+    /* when only non-ASCII bytes can start a match, skip 16 bytes at a time
+     * to the first byte with its high bit set */
+    if (self->ascii_unmapped) {
+        while (s + 16 <= end) {
+            const int mask
+                = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)s));
+            if (mask) {
+                s += count_trailing_zeros(mask);
+                break;
+            }
+            s += 16;
+        }
+    }
+#endif
+    for (; s < end; s++) {
+        if (MULMAP_IS_FIRST(self, *s)) {
+            break;
+        }
+    }
+    return (int)(s - (const uchar *)text);
+}
+
 char *mulmap_map(MultiMapper *self, char *to, char *from, int capa)
 {
     mulmap_map_len(self, to, from, capa);
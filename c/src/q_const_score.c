@@ -14,7 +14,7 @@
 typedef struct ConstantScoreScorer
 {
     Scorer      super;
-    BitVector  *bv;
+    DocSetIterator dsi;
     float       score;
 } ConstantScoreScorer;
 
@@ -25,12 +25,12 @@ static float cssc_score(Scorer *self)
 
 static bool cssc_next(Scorer *self)
 {
-    return ((self->doc = bv_scan_next(CScSc(self)->bv)) >= 0);
+    return ((self->doc = dsi_next(&CScSc(self)->dsi)) >= 0);
 }
 
 static bool cssc_skip_to(Scorer *self, int doc_num)
 {
-    return ((self->doc = bv_scan_next_from(CScSc(self)->bv, doc_num)) >= 0);
+    return ((self->doc = dsi_skip_to(&CScSc(self)->dsi, doc_num)) >= 0);
 }
 
 static Explanation *cssc_explain(Scorer *self, int doc_num)
@@ -45,7 +45,7 @@ static Scorer *cssc_new(Weight *weight, IndexReader *ir)
     Filter *filter  = CScQ(weight->query)->filter;
 
     CScSc(self)->score  = weight->value;
-    CScSc(self)->bv     = filt_get_bv(filter, ir);
+    dsi_init(&CScSc(self)->dsi, filt_get_ds(filter, ir));
 
     self->score     = &cssc_score;
     self->next      = &cssc_next;
@@ -71,9 +71,9 @@ static Explanation *csw_explain(Weight *self, IndexReader *ir, int doc_num)
     Filter *filter = CScQ(self->query)->filter;
     Explanation *expl;
     char *filter_str = filter->to_s(filter);
-    BitVector *bv = filt_get_bv(filter, ir);
+    DocSet *ds = filt_get_ds(filter, ir);
 
-    if (bv_get(bv, doc_num)) {
+    if (ds_get(ds, doc_num)) {
         expl = expl_new(self->value,
                         "ConstantScoreQuery(%s), product of:", filter_str);
         expl_add_detail(expl, expl_new(self->query->boost, "boost"));
@@ -15,7 +15,7 @@ typedef struct FilteredQueryScorer
 {
     Scorer      super;
     Scorer     *sub_scorer;
-    BitVector  *bv;
+    DocSetIterator dsi;
 } FilteredQueryScorer;
 
 static float fqsc_score(Scorer *self)
@@ -27,10 +27,10 @@ static float fqsc_score(Scorer *self)
 static bool fqsc_next(Scorer *self)
 {
     Scorer *sub_sc = FQSc(self)->sub_scorer;
-    BitVector *bv = FQSc(self)->bv;
-    while (sub_sc->next(sub_sc)) {
+    DocSetIterator *dsi = &FQSc(self)->dsi;
+    if (scorer_leapfrog(sub_sc, dsi, dsi->doc + 1)) {
         self->doc = sub_sc->doc;
-        if (bv_get(bv, self->doc)) return true;
+        return true;
     }
     return false;
 }
@@ -38,14 +38,10 @@ static bool fqsc_next(Scorer *self)
 static bool fqsc_skip_to(Scorer *self, int doc_num)
 {
     Scorer *sub_sc = FQSc(self)->sub_scorer;
-    BitVector *bv = FQSc(self)->bv;
-    if (sub_sc->skip_to(sub_sc, doc_num)) {
-        do {
-            self->doc = sub_sc->doc;
-            if (bv_get(bv, self->doc)) {
-                return true;
-            }
-        } while (sub_sc->next(sub_sc));
+    DocSetIterator *dsi = &FQSc(self)->dsi;
+    if (scorer_leapfrog(sub_sc, dsi, max2(doc_num, dsi->doc + 1))) {
+        self->doc = sub_sc->doc;
+        return true;
     }
     return false;
 }
@@ -63,12 +59,12 @@ static void fqsc_destroy(Scorer *self)
     scorer_destroy_i(self);
 }
 
-static Scorer *fqsc_new(Scorer *scorer, BitVector *bv, Similarity *sim)
+static Scorer *fqsc_new(Scorer *scorer, DocSet *ds, Similarity *sim)
 {
     Scorer *self            = scorer_new(FilteredQueryScorer, sim);
 
     FQSc(self)->sub_scorer  = scorer;
-    FQSc(self)->bv          = bv;
+    dsi_init(&FQSc(self)->dsi, ds);
 
     self->score   = &fqsc_score;
     self->next    = &fqsc_next;
@@ -127,7 +123,7 @@ static Scorer *fqw_scorer(Weight *self, IndexReader *ir)
     Scorer *scorer = sub_weight->scorer(sub_weight, ir);
     Filter *filter = FQQ(self->query)->filter;
 
-    return fqsc_new(scorer, filt_get_bv(filter, ir), self->similarity);
+    return fqsc_new(scorer, filt_get_ds(filter, ir), self->similarity);
 }
 
 static void fqw_destroy(Weight *self)
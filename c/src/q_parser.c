@@ -2190,10 +2190,6 @@ static int yyerror(QParser *qp, char const *msg)
         char buf[1024];
         buf[1023] = '\0';
         strncpy(buf, qp->qstr, 1023);
-        if (qp->clean_str) {
-            free(qp->qstr);
-        }
-        mutex_unlock(&qp->mutex);
         snprintf(xmsg_buffer, XMSG_BUFFER_SIZE,
                  "couldn't parse query ``%s''. Error message "
                  " was %s", buf, (char *)msg);
@@ -2220,7 +2216,11 @@ static TokenStream *get_cached_ts(QParser *qp, Symbol field, char *text)
     if (hs_exists(qp->tokenized_fields, field)) {
         ts = (TokenStream *)h_get(qp->ts_cache, field);
         if (!ts) {
-            ts = a_get_ts(qp->analyzer, field, text);
+            /* keep a clone of our own. Holding the analyzer's stream would
+             * make it clone one for every other a_get_ts in this thread */
+            TokenStream *a_ts = a_get_ts(qp->analyzer, field, text);
+            ts = ts_clone(a_ts);
+            ts_deref(a_ts);
             h_set(qp->ts_cache, field, ts);
         }
         else {
@@ -2856,6 +2856,173 @@ static void qp_pop_fields(QParser *self)
     free(fs);
 }
 
+/****************************************************************************
+ *
+ * QParserCache
+ *
+ ****************************************************************************/
+
+static void qpce_destroy(QParserCacheEntry *entry)
+{
+    q_deref(entry->query);
+    free(entry->key);
+    free(entry);
+}
+
+static QParserCache *qpc_new(QParser *qp)
+{
+    QParserCache *cache = ALLOC_AND_ZERO(QParserCache);
+    cache->qp = qp;
+    cache->entries = h_new_str(NULL, (free_ft)&qpce_destroy);
+    cache->ts_cache = h_new_ptr((free_ft)&ts_deref);
+    cache->non_tokenizer = non_tokenizer_new();
+    return cache;
+}
+
+static void qpc_destroy(QParserCache *cache)
+{
+    h_destroy(cache->entries);
+    h_destroy(cache->ts_cache);
+    ts_deref(cache->non_tokenizer);
+    free(cache->key_buf);
+    free(cache);
+}
+
+static void qpc_unlink(QParserCache *cache, QParserCacheEntry *entry)
+{
+    if (entry->prev) entry->prev->next = entry->next;
+    else             cache->head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev;
+    else             cache->tail = entry->prev;
+}
+
+static void qpc_push(QParserCache *cache, QParserCacheEntry *entry)
+{
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head) cache->head->prev = entry;
+    else             cache->tail = entry;
+    cache->head = entry;
+}
+
+#ifndef UNTHREADED
+/* guards adding a thread's cache to a parser's cache_bucket. It isn't kept in
+ * the parser as qp_parse copies the parser while other threads may lock it */
+static mutex_t qp_cache_bucket_mutex = MUTEX_INITIALIZER;
+#endif
+
+/* called when a thread exits so that its cache isn't kept until the parser
+ * is destroyed */
+static void qpc_thread_exit(void *p)
+{
+    QParserCache *cache = (QParserCache *)p;
+    mutex_lock(&qp_cache_bucket_mutex);
+    hs_rem(cache->qp->cache_bucket, cache);
+    mutex_unlock(&qp_cache_bucket_mutex);
+    qpc_destroy(cache);
+}
+
+/* the calling thread's caches. The cached queries are cleared if the parser
+ * has changed since they were parsed */
+static QParserCache *qp_thread_cache(QParser *self)
+{
+    QParserCache *cache
+        = (QParserCache *)thread_getspecific(self->thread_cache);
+    if (NULL == cache) {
+        cache = qpc_new(self);
+        cache->gen = self->cache_gen;
+        mutex_lock(&qp_cache_bucket_mutex);
+        hs_add(self->cache_bucket, cache);
+        mutex_unlock(&qp_cache_bucket_mutex);
+        thread_setspecific(self->thread_cache, cache);
+    }
+    else if (cache->gen != self->cache_gen) {
+        h_clear(cache->entries);
+        cache->head = cache->tail = NULL;
+        cache->gen = self->cache_gen;
+    }
+    return cache;
+}
+
+/* Write the cache key for +qstr+ into the cache's key_buf. Everything which
+ * changes how a query string is parsed goes in the key, apart from the field
+ * sets. Changing those clears the cache instead. */
+static char *qp_cache_key(QParser *self, QParserCache *cache,
+                          const char *qstr)
+{
+    const int flags = self->or_default
+        | self->wild_lower << 1
+        | self->clean_str << 2
+        | self->handle_parse_errors << 3
+        | self->allow_any_fields << 4
+        | self->use_keywords << 5
+        | self->use_typed_range_query << 6;
+    HashSetEntry *hse;
+    int len = (int)strlen(qstr) + 40;
+    char *k;
+
+    for (hse = self->def_fields->first; hse; hse = hse->next) {
+        len += (int)sym_len(hse->elem) + 12;
+    }
+    if (len > cache->key_capa) {
+        cache->key_capa = len;
+        REALLOC_N(cache->key_buf, char, len);
+    }
+    k = cache->key_buf;
+    k += sprintf(k, "%d,%d,%d:", flags, self->def_slop, self->max_clauses);
+    for (hse = self->def_fields->first; hse; hse = hse->next) {
+        k += sprintf(k, "%d:%s", (int)sym_len(hse->elem), S(hse->elem));
+    }
+    *k++ = '|';
+    strcpy(k, qstr);
+    return cache->key_buf;
+}
+
+static Query *qpc_get(QParserCache *cache, const char *key)
+{
+    QParserCacheEntry *entry
+        = (QParserCacheEntry *)h_get(cache->entries, key);
+    if (NULL == entry) {
+        cache->misses++;
+        return NULL;
+    }
+    if (entry != cache->head) {
+        qpc_unlink(cache, entry);
+        qpc_push(cache, entry);
+    }
+    cache->hits++;
+    REF(entry->query);
+    return entry->query;
+}
+
+static void qpc_add(QParserCache *cache, int size, const char *key, Query *q)
+{
+    QParserCacheEntry *entry;
+    if (cache->entries->size >= size) {
+        entry = cache->tail;
+        qpc_unlink(cache, entry);
+        h_del(cache->entries, entry->key);
+    }
+    entry = ALLOC(QParserCacheEntry);
+    entry->key = estrdup(key);
+    entry->query = q;
+    REF(q);
+    h_set(cache->entries, entry->key, entry);
+    qpc_push(cache, entry);
+}
+
+void qp_set_cache_size(QParser *self, int size)
+{
+    self->cache_size = size;
+    self->cache_gen++;
+}
+
+void qp_clear_cache(QParser *self)
+{
+    /* each thread clears its own cache when it next parses */
+    self->cache_gen++;
+}
+
 /**
  * Free all memory allocated by the QueryParser.
  */
@@ -2869,11 +3036,9 @@ void qp_destroy(QParser *self)
     }
     hs_destroy(self->all_fields);
 
-    qp_pop_fields(self);
-    assert(NULL == self->fields_top);
-
-    h_destroy(self->ts_cache);
-    tk_destroy(self->non_tokenizer);
+    thread_setspecific(self->thread_cache, NULL);
+    thread_key_delete(self->thread_cache);
+    hs_destroy(self->cache_bucket);
     a_deref(self->analyzer);
     free(self);
 }
@@ -2901,16 +3066,23 @@ QParser *qp_new(Analyzer *analyzer)
     self->all_fields = hs_new_ptr(NULL);
     self->def_fields = hs_new_ptr(NULL);
 
+    /* the parse state is set up by qp_parse in its own copy of the parser */
+    self->qstr = self->qstrp = NULL;
+    self->dynbuf = NULL;
+    self->buf_index = 0;
+    self->fields = NULL;
     self->fields_top = NULL;
-    qp_push_fields(self, self->def_fields, false);
+    self->ts_cache = NULL;
+    self->result = NULL;
+    self->non_tokenizer = NULL;
+    self->destruct = self->recovering = false;
 
     /* make sure all_fields contains the default fields */
     self->analyzer = analyzer;
-    self->ts_cache = h_new_ptr((free_ft)&ts_deref);
-    self->buf_index = 0;
-    self->dynbuf = NULL;
-    self->non_tokenizer = non_tokenizer_new();
-    mutex_init(&self->mutex, NULL);
+    self->cache_size = 0;
+    self->cache_gen = 0;
+    thread_key_create(&self->thread_cache, &qpc_thread_exit);
+    self->cache_bucket = hs_new_ptr((free_ft)&qpc_destroy);
     return self;
 }
 
@@ -2926,6 +3098,8 @@ void qp_add_field(QParser *self,
     if (is_tokenized) {
         hs_add(self->tokenized_fields, field);
     }
+    /* queries already cached may have been parsed differently */
+    self->cache_gen++;
 }
 
 /* these chars have meaning within phrases */
@@ -3067,37 +3241,53 @@ static Query *qp_get_bad_query(QParser *qp, char *str)
 Query *qp_parse(QParser *self, char *qstr)
 {
     Query *result = NULL;
-    mutex_lock(&self->mutex);
-    /* if qp->fields_top->next is not NULL we have a left over field-stack
-     * object that was not popped during the last query parse */
-    assert(NULL == self->fields_top->next);
-
-    self->recovering = self->destruct = false;
-    if (self->clean_str) {
-        self->qstrp = self->qstr = qp_clean_str(qstr);
+    QParserCache *cache = qp_thread_cache(self);
+    QParser qp;
+    if (self->cache_size > 0
+        && NULL != (result = qpc_get(cache,
+                                     qp_cache_key(self, cache, qstr)))) {
+        return result;
+    }
+
+    /* All the state of the parse is kept in a copy of the parser on the
+     * stack and the token streams come from this thread's cache, so +self+
+     * is only read and any number of threads can parse with it at once. */
+    qp = *self;
+    qp.ts_cache = cache->ts_cache;
+    qp.non_tokenizer = cache->non_tokenizer;
+    qp.fields_top = NULL;
+    qp_push_fields(&qp, qp.def_fields, false);
+
+    if (qp.clean_str) {
+        qp.qstrp = qp.qstr = qp_clean_str(qstr);
     }
     else {
-        self->qstrp = self->qstr = qstr;
+        qp.qstrp = qp.qstr = qstr;
     }
-    self->fields = self->def_fields;
-    self->result = NULL;
 
-    if (0 == yyparse(self)) result = self->result;
-    if (!result && self->handle_parse_errors) {
-        self->destruct = false;
-        result = qp_get_bad_query(self, self->qstr);
+    if (0 == yyparse(&qp)) result = qp.result;
+    if (!result && qp.handle_parse_errors) {
+        qp.destruct = false;
+        result = qp_get_bad_query(&qp, qp.qstr);
     }
-    if (self->destruct && !self->handle_parse_errors) {
+    /* yyerror leaves the bottom of the field stack */
+    qp_pop_fields(&qp);
+    free(qp.dynbuf);
+    if (qp.clean_str) {
+        free(qp.qstr);
+    }
+    if (qp.destruct && !qp.handle_parse_errors) {
         xraise(PARSE_ERROR, xmsg_buffer);
     }
     if (!result) {
         result = bq_new(false);
     }
-    if (self->clean_str) {
-        free(self->qstr);
-    }
 
-    mutex_unlock(&self->mutex);
+    if (self->cache_size > 0) {
+        /* key_buf still holds the key, nothing else uses this thread's
+         * cache while it parses */
+        qpc_add(cache, self->cache_size, cache->key_buf, result);
+    }
     return result;
 }
 
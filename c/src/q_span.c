@@ -242,24 +242,33 @@ static bool spansc_skip_to(Scorer *self, int target)
 {
     SpanScorer *spansc = SpSc(self);
     SpanEnum *se = spansc->spans;
+    int match_length;
+
+    /* after a next the spans are already on the following doc so only skip
+     * if that is before +target+ */
+    if (spansc->first_time) {
+        spansc->more = se->skip_to(se, target);
+        spansc->first_time = false;
+    }
+    else if (spansc->more && (se->doc(se) < target)) {
+        spansc->more = se->skip_to(se, target);
+    }
 
-    spansc->more = se->skip_to(se, target);
     if (!spansc->more) {
         return false;
     }
 
+    /* score whichever doc we landed on, just like spansc_next */
     spansc->freq = 0.0;
     self->doc = se->doc(se);
 
-    while (spansc->more && (se->doc(se) == target)) {
-        spansc->freq += sim_sloppy_freq(spansc->sim, se->end(se) - se->start(se));
+    do {
+        match_length = se->end(se) - se->start(se);
+        spansc->freq += sim_sloppy_freq(spansc->sim, match_length);
         spansc->more = se->next(se);
-        if (spansc->first_time) {
-            spansc->first_time = false;
-        }
-    }
+    } while (spansc->more && (self->doc == se->doc(se)));
 
-    return (spansc->more || (spansc->freq != 0.0));
+    return true;
 }
 
 static Explanation *spansc_explain(Scorer *self, int target)
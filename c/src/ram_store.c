@@ -343,7 +343,8 @@ static const struct InStreamMethods RAM_IN_STREAM_METHODS = {
     rami_read_i,
     rami_seek_i,
     rami_length_i,
-    rami_close_i
+    rami_close_i,
+    NULL
 };
 
 static InStream *ram_open_input(Store *store, const char *filename)
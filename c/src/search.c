@@ -500,6 +500,24 @@ int scorer_doc_cmp(const void *p1, const void *p2)
     return (*(Scorer **)p1)->doc - (*(Scorer **)p2)->doc;
 }
 
+bool scorer_leapfrog(Scorer *self, DocSetIterator *dsi, int doc_num)
+{
+    int doc = dsi_skip_to(dsi, doc_num);
+    while (doc >= 0) {
+        if (!self->skip_to(self, doc)) {
+            return false;
+        }
+        if (self->doc == doc) {
+            return true;
+        }
+        doc = dsi_skip_to(dsi, self->doc);
+        if (doc == self->doc) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /***************************************************************************
  *
  * Highlighter
@@ -833,19 +851,23 @@ static char *highlight_field(MatchVector *mv,
     return excerpt_str;
 }
 
-char **searcher_highlight(Searcher *self,
-                          Query *query,
-                          const int doc_num,
-                          Symbol field,
-                          const int excerpt_len,
-                          const int num_excerpts,
-                          const char *pre_tag,
-                          const char *post_tag,
-                          const char *ellipsis)
+/* if +rewrite+ is false then +query+ must already have been rewritten by
+ * +self+ */
+static char **sea_highlight_i(Searcher *self,
+                              Query *query,
+                              bool rewrite,
+                              const int doc_num,
+                              Symbol field,
+                              const int excerpt_len,
+                              const int num_excerpts,
+                              const char *pre_tag,
+                              const char *post_tag,
+                              const char *ellipsis)
 {
     char **excerpt_strs = NULL;
-    TermVector *tv = self->get_term_vector(self, doc_num, field);
+    /* get_lazy_doc raises on a deleted document so load it first */
     LazyDoc *lazy_doc = self->get_lazy_doc(self, doc_num);
+    TermVector *tv = self->get_term_vector(self, doc_num, field);
     LazyDocField *lazy_df = NULL;
     if (lazy_doc) {
         lazy_df = lazy_doc_get(lazy_doc, field);
@@ -853,9 +875,13 @@ char **searcher_highlight(Searcher *self,
     if (tv && lazy_df && tv->term_cnt > 0 && tv->terms[0].positions != NULL
         && tv->offsets != NULL) {
         MatchVector *mv;
-        query = self->rewrite(self, query);
+        if (rewrite) {
+            query = self->rewrite(self, query);
+        }
         mv = query->get_matchv_i(query, matchv_new(), tv);
-        q_deref(query);
+        if (rewrite) {
+            q_deref(query);
+        }
         if (lazy_df->len < (excerpt_len * num_excerpts)) {
             excerpt_strs = ary_new_type_capa(char *, 1);
             ary_push(excerpt_strs,
@@ -963,6 +989,107 @@ char **searcher_highlight(Searcher *self,
     return excerpt_strs;
 }
 
+char **searcher_highlight(Searcher *self,
+                          Query *query,
+                          const int doc_num,
+                          Symbol field,
+                          const int excerpt_len,
+                          const int num_excerpts,
+                          const char *pre_tag,
+                          const char *post_tag,
+                          const char *ellipsis)
+{
+    return sea_highlight_i(self, query, true, doc_num, field, excerpt_len,
+                           num_excerpts, pre_tag, post_tag, ellipsis);
+}
+
+typedef struct HighlightSlot
+{
+    int doc_num;
+    int index;
+} HighlightSlot;
+
+static int hl_slot_cmp(const void *p1, const void *p2)
+{
+    const HighlightSlot *s1 = (const HighlightSlot *)p1;
+    const HighlightSlot *s2 = (const HighlightSlot *)p2;
+    if (s1->doc_num != s2->doc_num) {
+        return s1->doc_num < s2->doc_num ? -1 : 1;
+    }
+    return s1->index - s2->index;
+}
+
+char ***searcher_highlight_docs(Searcher *self,
+                                Query *query,
+                                const int *doc_nums,
+                                const int doc_cnt,
+                                Symbol field,
+                                const int excerpt_len,
+                                const int num_excerpts,
+                                const char *pre_tag,
+                                const char *post_tag,
+                                const char *ellipsis)
+{
+    char ***highlights = ALLOC_AND_ZERO_N(char **, doc_cnt > 0 ? doc_cnt : 1);
+    HighlightSlot *slots;
+    int i;
+    if (doc_cnt <= 0) {
+        return highlights;
+    }
+
+    /* visit the documents in doc-id order so that term vectors and stored
+     * fields are read sequentially */
+    slots = ALLOC_N(HighlightSlot, doc_cnt);
+    for (i = 0; i < doc_cnt; i++) {
+        slots[i].doc_num = doc_nums[i];
+        slots[i].index = i;
+    }
+    qsort(slots, doc_cnt, sizeof(HighlightSlot), &hl_slot_cmp);
+
+    query = self->rewrite(self, query);
+    TRY
+        for (i = 0; i < doc_cnt; i++) {
+            highlights[slots[i].index] =
+                sea_highlight_i(self, query, false, slots[i].doc_num, field,
+                                excerpt_len, num_excerpts,
+                                pre_tag, post_tag, ellipsis);
+        }
+    XCATCHALL
+        for (i = 0; i < doc_cnt; i++) {
+            if (highlights[i]) ary_destroy(highlights[i], &free);
+        }
+        free(highlights);
+        q_deref(query);
+        free(slots);
+    XENDTRY
+    q_deref(query);
+    free(slots);
+    return highlights;
+}
+
+char ***searcher_highlight_td(Searcher *self,
+                              Query *query,
+                              TopDocs *td,
+                              Symbol field,
+                              const int excerpt_len,
+                              const int num_excerpts,
+                              const char *pre_tag,
+                              const char *post_tag,
+                              const char *ellipsis)
+{
+    char ***highlights;
+    int *doc_nums = ALLOC_N(int, td->size > 0 ? td->size : 1);
+    int i;
+    for (i = 0; i < td->size; i++) {
+        doc_nums[i] = td->hits[i]->doc;
+    }
+    highlights = searcher_highlight_docs(self, query, doc_nums, td->size,
+                                         field, excerpt_len, num_excerpts,
+                                         pre_tag, post_tag, ellipsis);
+    free(doc_nums);
+    return highlights;
+}
+
 static Weight *sea_create_weight(Searcher *self, Query *query)
 {
     return q_weight(query, self);
@@ -1011,6 +1138,12 @@ static LazyDoc *isea_get_lazy_doc(Searcher *self, int doc_num)
     return ir->get_lazy_doc(ir, doc_num);
 }
 
+static Document **isea_get_docs(Searcher *self, const int *doc_nums, int cnt,
+                                Symbol *fields, int field_cnt)
+{
+    return ir_get_docs(ISEA(self)->ir, doc_nums, cnt, fields, field_cnt);
+}
+
 static int isea_max_doc(Searcher *self)
 {
     IndexReader *ir = ISEA(self)->ir;
@@ -1041,15 +1174,17 @@ static TopDocs *isea_search_w(Searcher *self,
     int total_hits = 0;
     float score, max_score = 0.0;
     float filter_factor = 1.0;
-    BitVector *bits = (filter
-                       ? filt_get_bv(filter, ISEA(self)->ir)
-                       : NULL);
+    DocSetIterator dsi;
+    DocSet *bits = (filter
+                    ? filt_get_ds(filter, ISEA(self)->ir)
+                    : NULL);
     Hit *(*hq_pop)(PriorityQueue *pq);
     void (*hq_insert)(PriorityQueue *pq, Hit *hit);
     void (*hq_destroy)(PriorityQueue *self);
     PriorityQueue *hq;
 
     sea_check_args(num_docs, first_doc);
+    dsi_init(&dsi, bits);
 
     scorer = weight->scorer(weight, ISEA(self)->ir);
     if (!scorer || 0 == ISEA(self)->ir->num_docs(ISEA(self)->ir)) {
@@ -1075,8 +1210,9 @@ static TopDocs *isea_search_w(Searcher *self,
         hq_destroy = &pq_destroy;
     }
 
-    while (scorer->next(scorer)) {
-        if (bits && !bv_get(bits, scorer->doc)) continue;
+    while (bits
+           ? scorer_leapfrog(scorer, &dsi, dsi.doc + 1)
+           : scorer->next(scorer)) {
         score = scorer->score(scorer);
         if (post_filter &&
             !(filter_factor = post_filter->filter_func(scorer->doc,
@@ -1139,18 +1275,21 @@ static void isea_search_each_w(Searcher *self, Weight *weight, Filter *filter,
 {
     Scorer *scorer;
     float filter_factor = 1.0;
-    BitVector *bits = (filter
-                       ? filt_get_bv(filter, ISEA(self)->ir)
-                       : NULL);
+    DocSetIterator dsi;
+    DocSet *bits = (filter
+                    ? filt_get_ds(filter, ISEA(self)->ir)
+                    : NULL);
 
     scorer = weight->scorer(weight, ISEA(self)->ir);
     if (!scorer) {
         return;
     }
+    dsi_init(&dsi, bits);
 
-    while (scorer->next(scorer)) {
+    while (bits
+           ? scorer_leapfrog(scorer, &dsi, dsi.doc + 1)
+           : scorer->next(scorer)) {
         float score;
-        if (bits && !bv_get(bits, scorer->doc)) continue;
         score = scorer->score(scorer);
         if (post_filter &&
             !(filter_factor = post_filter->filter_func(scorer->doc,
@@ -1270,6 +1409,7 @@ Searcher *isea_new(IndexReader *ir)
     self->doc_freq          = &isea_doc_freq;
     self->get_doc           = &isea_get_doc;
     self->get_lazy_doc      = &isea_get_lazy_doc;
+    self->get_docs          = &isea_get_docs;
     self->max_doc           = &isea_max_doc;
     self->create_weight     = &sea_create_weight;
     self->search            = &isea_search;
@@ -1319,6 +1459,14 @@ static Document *cdfsea_get_doc(Searcher *self, int doc_num)
     return NULL;
 }
 
+static Document **cdfsea_get_docs(Searcher *self, const int *doc_nums,
+                                  int cnt, Symbol *fields, int field_cnt)
+{
+    (void)self; (void)doc_nums; (void)cnt; (void)fields; (void)field_cnt;
+    RAISE(UNSUPPORTED_ERROR, "%s", UNSUPPORTED_ERROR_MSG);
+    return NULL;
+}
+
 static int cdfsea_max_doc(Searcher *self)
 {
     (void)self;
@@ -1418,6 +1566,7 @@ static Searcher *cdfsea_new(Hash *df_map, int max_doc)
     self->similarity        = sim_create_default();
     self->doc_freq          = &cdfsea_doc_freq;
     self->get_doc           = &cdfsea_get_doc;
+    self->get_docs          = &cdfsea_get_docs;
     self->max_doc           = &cdfsea_max_doc;
     self->create_weight     = &cdfsea_create_weight;
     self->search            = &cdfsea_search;
@@ -1496,6 +1645,65 @@ static LazyDoc *msea_get_lazy_doc(Searcher *self, int doc_num)
     return s->get_lazy_doc(s, doc_num - msea->starts[i]);
 }
 
+static Document **msea_get_docs(Searcher *self, const int *doc_nums, int cnt,
+                                Symbol *fields, int field_cnt)
+{
+    MultiSearcher *msea = MSEA(self);
+    Document **docs;
+    int *sub_doc_nums, *indexes, *searcher_indexes;
+    int i, j;
+
+    for (j = 0; j < cnt; j++) {
+        if (doc_nums[j] < 0 || doc_nums[j] >= msea->max_doc) {
+            RAISE(INDEX_ERROR, "Document %d doesn't exist in the index. The "
+                  "max_doc is %d", doc_nums[j], msea->max_doc);
+        }
+    }
+    docs = ALLOC_AND_ZERO_N(Document *, cnt);
+    sub_doc_nums = ALLOC_N(int, cnt);
+    indexes = ALLOC_N(int, cnt);
+    searcher_indexes = ALLOC_N(int, cnt);
+    for (j = 0; j < cnt; j++) {
+        searcher_indexes[j] = msea_get_searcher_index(self, doc_nums[j]);
+    }
+    /* fetch each searcher's documents in one batch */
+    TRY
+        for (i = 0; i < msea->s_cnt; i++) {
+            Searcher *s = msea->searchers[i];
+            Document **sub_docs;
+            int sub_cnt = 0;
+            for (j = 0; j < cnt; j++) {
+                if (searcher_indexes[j] == i) {
+                    sub_doc_nums[sub_cnt] = doc_nums[j] - msea->starts[i];
+                    indexes[sub_cnt++] = j;
+                }
+            }
+            if (sub_cnt == 0) {
+                continue;
+            }
+            sub_docs = s->get_docs(s, sub_doc_nums, sub_cnt, fields,
+                                   field_cnt);
+            for (j = 0; j < sub_cnt; j++) {
+                docs[indexes[j]] = sub_docs[j];
+            }
+            free(sub_docs);
+        }
+    XCATCHALL
+        /* free the documents the other searchers have already loaded */
+        for (j = 0; j < cnt; j++) {
+            if (docs[j]) doc_destroy(docs[j]);
+        }
+        free(docs);
+        free(searcher_indexes);
+        free(indexes);
+        free(sub_doc_nums);
+    XENDTRY
+    free(searcher_indexes);
+    free(indexes);
+    free(sub_doc_nums);
+    return docs;
+}
+
 static int msea_max_doc(Searcher *self)
 {
     return MSEA(self)->max_doc;
@@ -1847,6 +2055,7 @@ Searcher *msea_new(Searcher **searchers, int s_cnt, bool close_subs)
     self->doc_freq              = &msea_doc_freq;
     self->get_doc               = &msea_get_doc;
     self->get_lazy_doc          = &msea_get_lazy_doc;
+    self->get_docs              = &msea_get_docs;
     self->max_doc               = &msea_max_doc;
     self->create_weight         = &msea_create_weight;
     self->search                = &msea_search;
@@ -274,6 +274,11 @@ uchar *is_read_bytes(InStream *is, uchar *buf, int len)
     return buf;
 }
 
+const uchar *is_map(InStream *is, off_t pos, int len)
+{
+    return is->m->map_i ? is->m->map_i(is, pos, len) : NULL;
+}
+
 void is_seek(InStream *is, off_t pos)
 {
     if (pos >= is->buf.start && pos < (is->buf.start + is->buf.len)) {
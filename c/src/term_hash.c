@@ -0,0 +1,202 @@
+#include "term_hash.h"
+#include <string.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#include "internal.h"
+
+/****************************************************************************
+ *
+ * TermHash
+ *
+ * The layout follows the "Swiss table" design. The hash of each term is
+ * split in two. The high bits (h1) choose the group of slots where probing
+ * starts and the low 7 bits (h2) are stored in the slot's control byte. A
+ * lookup loads a group of control bytes and compares them all against h2 at
+ * once, so only slots that are likely to hold the term are ever touched.
+ * Since there are no deletes a group containing an empty slot ends the
+ * probe.
+ ****************************************************************************/
+
+#define TH_H1(hash) ((hash) >> 7)
+#define TH_H2(hash) ((uchar)((hash) & 0x7f))
+
+frt_u32 th_hash(const char *term, int len)
+{
+    /* FNV-1a followed by the murmur3 finalizer so that the low bits we use
+     * for h2 are well mixed */
+    register frt_u32 h = 2166136261U;
+    register const uchar *p = (const uchar *)term;
+    register const uchar *end = p + len;
+    for (; p < end; p++) {
+        h = (h ^ *p) * 16777619U;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+/* return a bitmask with bit i set if group[i] == b */
+static INLINE unsigned int th_group_match(const uchar *group, uchar b)
+{
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)b)));
+#else
+    unsigned int mask = 0;
+    int i;
+    for (i = 0; i < TH_GROUP_WIDTH; i++) {
+        if (group[i] == b) {
+            mask |= 1U << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+static INLINE void th_set_ctrl(TermHash *self, int i, uchar c)
+{
+    self->ctrl[i] = c;
+    if (i < TH_GROUP_WIDTH) {
+        self->ctrl[self->mask + 1 + i] = c;
+    }
+}
+
+static INLINE int th_max_fill(int capa)
+{
+    return capa - (capa >> 3);
+}
+
+static void th_alloc_table(TermHash *self, int capa)
+{
+    self->mask = capa - 1;
+    self->size = 0;
+    self->growth_left = th_max_fill(capa);
+    self->ctrl = ALLOC_N(uchar, capa + TH_GROUP_WIDTH);
+    self->slots = ALLOC_N(TermHashSlot, capa);
+    memset(self->ctrl, TH_EMPTY, capa + TH_GROUP_WIDTH);
+}
+
+/* find the first empty slot in +hash+'s probe sequence */
+static INLINE int th_find_empty(TermHash *self, frt_u32 hash)
+{
+    const int mask = self->mask;
+    int pos = TH_H1(hash) & mask;
+    int step = 0;
+    while (true) {
+        unsigned int empties = th_group_match(self->ctrl + pos, TH_EMPTY);
+        if (empties) {
+            return (pos + count_trailing_zeros(empties)) & mask;
+        }
+        step += TH_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+static void th_grow(TermHash *self)
+{
+    const int old_capa = self->mask + 1;
+    const int size = self->size;
+    uchar *old_ctrl = self->ctrl;
+    TermHashSlot *old_slots = self->slots;
+    int i;
+
+    th_alloc_table(self, old_capa << 1);
+    for (i = 0; i < old_capa; i++) {
+        if ((old_ctrl[i] & TH_EMPTY) == 0) {
+            TermHashSlot *slot = old_slots + i;
+            const int j = th_find_empty(self, slot->hash);
+            th_set_ctrl(self, j, TH_H2(slot->hash));
+            self->slots[j] = *slot;
+        }
+    }
+    self->size = size;
+    self->growth_left -= size;
+    free(old_ctrl);
+    free(old_slots);
+}
+
+TermHash *th_new()
+{
+    TermHash *self = ALLOC(TermHash);
+    th_alloc_table(self, TH_MIN_CAPA);
+    return self;
+}
+
+void th_destroy(TermHash *self)
+{
+    free(self->ctrl);
+    free(self->slots);
+    free(self);
+}
+
+void th_clear(TermHash *self)
+{
+    const int capa = self->mask + 1;
+    if (self->size > 0) {
+        memset(self->ctrl, TH_EMPTY, capa + TH_GROUP_WIDTH);
+        self->size = 0;
+        self->growth_left = th_max_fill(capa);
+    }
+}
+
+/* returns the index of +term+'s slot or -1 if it isn't in the table */
+static INLINE int th_find(TermHash *self, const char *term, int len,
+                          frt_u32 hash)
+{
+    const int mask = self->mask;
+    const uchar h2 = TH_H2(hash);
+    int pos = TH_H1(hash) & mask;
+    int step = 0;
+    while (true) {
+        const uchar *group = self->ctrl + pos;
+        unsigned int matches = th_group_match(group, h2);
+        while (matches) {
+            const int i = (pos + count_trailing_zeros(matches)) & mask;
+            const TermHashSlot *slot = self->slots + i;
+            if (slot->hash == hash && slot->len == len
+                && memcmp(slot->term, term, len) == 0) {
+                return i;
+            }
+            matches &= matches - 1;
+        }
+        if (th_group_match(group, TH_EMPTY)) {
+            return -1;
+        }
+        step += TH_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+void *th_get(TermHash *self, const char *term, int len)
+{
+    const int i = th_find(self, term, len, th_hash(term, len));
+    return i < 0 ? NULL : self->slots[i].value;
+}
+
+bool th_set_ext(TermHash *self, const char *term, int len, frt_u32 hash,
+                TermHashSlot **slot)
+{
+    int i = th_find(self, term, len, hash);
+    if (i >= 0) {
+        *slot = self->slots + i;
+        return false;
+    }
+    if (self->growth_left == 0) {
+        th_grow(self);
+    }
+    i = th_find_empty(self, hash);
+    th_set_ctrl(self, i, TH_H2(hash));
+    self->size++;
+    self->growth_left--;
+    *slot = self->slots + i;
+    (*slot)->hash = hash;
+    (*slot)->len = len;
+    (*slot)->term = term;
+    (*slot)->value = NULL;
+    return true;
+}
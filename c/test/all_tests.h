@@ -8,7 +8,9 @@ TestSuite *ts_1710(TestSuite *suite);
 TestSuite *ts_analysis(TestSuite *suite);
 TestSuite *ts_array(TestSuite *suite);
 TestSuite *ts_bitvector(TestSuite *suite);
+TestSuite *ts_bloom_filter(TestSuite *suite);
 TestSuite *ts_compound_io(TestSuite *suite);
+TestSuite *ts_doc_set(TestSuite *suite);
 TestSuite *ts_document(TestSuite *suite);
 TestSuite *ts_except(TestSuite *suite);
 TestSuite *ts_fields(TestSuite *suite);
@@ -22,7 +24,9 @@ TestSuite *ts_helper(TestSuite *suite);
 TestSuite *ts_highlighter(TestSuite *suite);
 TestSuite *ts_index(TestSuite *suite);
 TestSuite *ts_lang(TestSuite *suite);
+TestSuite *ts_lz(TestSuite *suite);
 TestSuite *ts_mem_pool(TestSuite *suite);
+TestSuite *ts_mmap_store(TestSuite *suite);
 TestSuite *ts_multimapper(TestSuite *suite);
 TestSuite *ts_priorityqueue(TestSuite *suite);
 TestSuite *ts_q_const_score(TestSuite *suite);
@@ -38,6 +42,7 @@ TestSuite *ts_similarity(TestSuite *suite);
 TestSuite *ts_sort(TestSuite *suite);
 TestSuite *ts_symbol(TestSuite *suite);
 TestSuite *ts_term(TestSuite *suite);
+TestSuite *ts_term_hash(TestSuite *suite);
 TestSuite *ts_term_vectors(TestSuite *suite);
 TestSuite *ts_test(TestSuite *suite);
 TestSuite *ts_threading(TestSuite *suite);
@@ -50,7 +55,9 @@ const struct test_list
     {ts_analysis},
     {ts_array},
     {ts_bitvector},
+    {ts_bloom_filter},
     {ts_compound_io},
+    {ts_doc_set},
     {ts_document},
     {ts_except},
     {ts_fields},
@@ -64,7 +71,9 @@ const struct test_list
     {ts_highlighter},
     {ts_index},
     {ts_lang},
+    {ts_lz},
     {ts_mem_pool},
+    {ts_mmap_store},
     {ts_multimapper},
     {ts_priorityqueue},
     {ts_q_const_score},
@@ -80,6 +89,7 @@ const struct test_list
     {ts_sort},
     {ts_symbol},
     {ts_term},
+    {ts_term_hash},
     {ts_term_vectors},
     {ts_test},
     {ts_threading}
@@ -1,9 +1,12 @@
 #include "analysis.h"
+#include "scanner.h"
 #include <string.h>
 #include <locale.h>
 #include <libstemmer.h>
 #include "test.h"
 
+#define StemFilt(filter) ((StemFilter *)(filter))
+
 #define test_token(mtk, mstr, mstart, mend) \
   tt_token(mtk, mstr, mstart, mend, tc, __LINE__)
 
@@ -867,6 +870,81 @@ static void test_long_word(TestCase *tc, void *data)
     tk_destroy(tk);
 }
 
+static const char *STD_PIECES[] = {
+    "the", "Quick", "brown42", "7", " ", "  ", "\t", "\n", ",", ";", "(", ")",
+    "\"", "'", "'s", "-", "_", "+", ".", "@", ":", "/", "&", "[", "]", "!",
+    "3.14", "-12", "a.b.c", "e-mail", "dbalmain@gmail.com", "http://", "com",
+    "www.", "\xc3\xa9t\xc3\xa9", "\xc3\xbc", "\xe2\x82\xac", "\x80", "AT&T",
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+};
+#define STD_PIECE_CNT (int)(sizeof(STD_PIECES) / sizeof(STD_PIECES[0]))
+
+static void check_std_scan(TestCase *tc, TokenStream *ts, char *text,
+                           void (*scan)(const char *, char *, size_t,
+                                        const char **, const char **, int *))
+{
+    char buf[MAX_WORD_SIZE];
+    const char *t = text, *start, *end;
+    int len;
+    Token *tk;
+
+    ts->reset(ts, text);
+    while (true) {
+        scan(t, buf, sizeof(buf) - 1, &start, &end, &len);
+        tk = ts_next(ts);
+        if (len == 0) {
+            break;
+        }
+        if (!Apnotnull(tk)) {
+            return;
+        }
+        Asequal(buf, tk->text);
+        Aiequal(len, tk->len);
+        Aiequal(start - text, tk->start);
+        Aiequal(end - text, tk->end);
+        t = end;
+    }
+    Apnull(tk);
+}
+
+/**
+ * The standard tokenizers skip the scanner for plain ASCII words. Check they
+ * still return exactly what the scanner does for all sorts of text.
+ */
+static void test_std_fast_path(TestCase *tc, void *data)
+{
+    TokenStream *ts = standard_tokenizer_new();
+    TokenStream *utf8_ts = utf8_standard_tokenizer_new();
+    char text[2000];
+    int i;
+    (void)data;
+
+    strcpy(text, "  plain words\tonly\n ");
+    check_std_scan(tc, ts, text, &std_scan);
+    strcpy(text, "");
+    check_std_scan(tc, ts, text, &std_scan);
+    for (i = 0; i < 200; i++) {
+        int len = 0;
+        while (true) {
+            const char *piece = STD_PIECES[rand() % STD_PIECE_CNT];
+            const int piece_len = (int)strlen(piece);
+            if (len + piece_len >= (int)sizeof(text)) {
+                break;
+            }
+            memcpy(text + len, piece, piece_len);
+            len += piece_len;
+        }
+        text[len] = '\0';
+        check_std_scan(tc, ts, text, &std_scan);
+        check_std_scan(tc, utf8_ts, text, &std_scan_utf8);
+    }
+    ts_deref(ts);
+    ts_deref(utf8_ts);
+}
+
 /****************************************************************************
  *
  * Filters
@@ -901,6 +979,45 @@ static void test_lowercase_filter(TestCase *tc, void *data)
     ts_deref(ts);
 }
 
+static void test_utf8_downcase(TestCase *tc, void *data)
+{
+    char buf[100];
+    char text[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 \xC3\x80\xC3\x89\xC3\x8E"
+        " \xCE\xA3\xCE\x91\xCE\xA3 \xD0\x94\xD0\x9E\xD0\x9C \xC4\xB0" "STANBUL"
+        " \xC8\xBA \xE2\x84\xAA \xF0\x90\x90\x80 \xFF!";
+    char small[] = "\xC3\x80\xC3\x89";
+    int len;
+    (void)data;
+
+    len = utf8_downcase(buf, text, (int)strlen(text), sizeof(buf));
+    Asequal("abcdefghijklmnopqrstuvwxyz0123456789 \xC3\xA0\xC3\xA9\xC3\xAE"
+            " \xCF\x83\xCE\xB1\xCF\x83 \xD0\xB4\xD0\xBE\xD0\xBC istanbul"
+            " \xE2\xB1\xA5 k \xF0\x90\x90\xA8 \xFF!", buf);
+    Aiequal(strlen(buf), len);
+
+    /* the output is cut at a character boundary when it won't fit */
+    Aiequal(2, utf8_downcase(buf, small, (int)strlen(small), 4));
+    Asequal("\xC3\xA0", buf);
+    Aiequal(0, utf8_downcase(buf, small, (int)strlen(small), 2));
+    Asequal("", buf);
+}
+
+static void test_utf8_lowercase_filter(TestCase *tc, void *data)
+{
+    TokenStream *ts = utf8_lowercase_filter_new(whitespace_tokenizer_new());
+    char text[] = "DBalmain \xC3\x89T\xC3\x89 \xCE\x9A\xCE\x91\xCE\x9B\xCE\x97"
+                  "\xCE\x9C\xCE\x95\xCE\xA1\xCE\x91";
+    (void)data;
+
+    ts->reset(ts, text);
+    test_token(ts_next(ts), "dbalmain", 0, 8);
+    test_token(ts_next(ts), "\xC3\xA9t\xC3\xA9", 9, 14);
+    test_token(ts_next(ts), "\xCE\xBA\xCE\xB1\xCE\xBB\xCE\xB7\xCE\xBC\xCE\xB5"
+               "\xCF\x81\xCE\xB1", 15, 31);
+    Apnull(ts_next(ts));
+    ts_deref(ts);
+}
+
 static void test_hyphen_filter(TestCase *tc, void *data)
 {
     Token *tk = tk_new();
@@ -1017,6 +1134,78 @@ static void test_mapping_filter(TestCase *tc, void *data)
     ts_deref(ts);
 }
 
+static const char *MF_PIECES[] = {
+    "a", "e", "ne", "f", "four", "th", "xyzzy", "\xc3\xa0", "\xc3\xa9",
+    "\xc3", "\xc2\xa0", "\xc5\x93", "plain", "0123456789abcdef"
+};
+
+/* map each token of +text+ with mapping_filter and check it against mapping
+ * the whole token with the mapper */
+static void check_mapping_filter(TestCase *tc, TokenStream *ts, char *text)
+{
+    TokenStream *ws_ts = whitespace_tokenizer_new();
+    MultiMapper *mapper = ((MappingFilter *)ts)->mapper;
+    char buf[MAX_WORD_SIZE];
+    Token *tk, *ws_tk;
+
+    ts->reset(ts, text);
+    ts->zero_copy = true;
+    ws_ts->reset(ws_ts, text);
+    while (NULL != (ws_tk = ts_next(ws_ts))) {
+        const int len = mulmap_map_len(mapper, buf, ws_tk->text,
+                                       MAX_WORD_SIZE);
+        tk = ts_next(ts);
+        if (!Apnotnull(tk)) break;
+        Aiequal(len, tk->len);
+        Atrue(0 == memcmp(buf, TK_PTR(tk), len));
+        if (mulmap_scan(mapper, ws_tk->text, ws_tk->len) == ws_tk->len) {
+            /* nothing could be mapped so the token was never copied */
+            Apequal(text + ws_tk->start, tk->ref);
+        }
+    }
+    Apnull(ts_next(ts));
+    ts_deref(ws_ts);
+}
+
+/**
+ * The MappingFilter skips tokens with nothing to map and maps in place when
+ * it can. Either way the result must be the same as mapping the whole token.
+ */
+static void test_mapping_filter_fast_path(TestCase *tc, void *data)
+{
+    TokenStream *ts = mapping_filter_new(whitespace_tokenizer_new());
+    TokenStream *accent_ts = mapping_filter_new(whitespace_tokenizer_new());
+    char text[1000];
+    int i, j;
+    (void)data;
+
+    mapping_filter_add(ts, "ne", "hello");
+    mapping_filter_add(ts, "four", "4");
+    mapping_filter_add(ts, "xyzzy", "");
+    mapping_filter_add(accent_ts, "\xc3\xa0", "a");
+    mapping_filter_add(accent_ts, "\xc3\xa9", "e");
+    mapping_filter_add(accent_ts, "\xc5\x93", "oe");
+    mapping_filter_add(accent_ts, "\xc2\xa0", "_");
+
+    for (i = 0; i < 200; i++) {
+        char *t = text;
+        for (j = rand() % 40; j > 0; j--) {
+            const char *piece = MF_PIECES[rand() % NELEMS(MF_PIECES)];
+            t += sprintf(t, "%s", piece);
+            if (rand() % 3 == 0) *t++ = ' ';
+        }
+        *t = '\0';
+        check_mapping_filter(tc, ts, text);
+        check_mapping_filter(tc, accent_ts, text);
+    }
+    Atrue(!((MappingFilter *)ts)->mapper->never_grows);
+    Atrue(!((MappingFilter *)ts)->mapper->ascii_unmapped);
+    Atrue(((MappingFilter *)accent_ts)->mapper->never_grows);
+    Atrue(((MappingFilter *)accent_ts)->mapper->ascii_unmapped);
+    ts_deref(ts);
+    ts_deref(accent_ts);
+}
+
 static void test_stemmer(TestCase *tc, void *data)
 {
     int stemmer_cnt = 0;
@@ -1078,6 +1267,183 @@ static void test_stem_filter(TestCase *tc, void *data)
     ts_deref(ts2);
 }
 
+static void test_stem_filter_cache(TestCase *tc, void *data)
+{
+    TokenStream *ts = stem_filter_new(letter_tokenizer_new(), "english",
+                                      NULL);
+    TokenStream *ts2;
+    char text[] = "debates running debates debated running "
+                  "antidisestablishmentarianisms antidisestablishmentarianisms";
+    (void)data;
+
+    ts->reset(ts, text);
+    test_token(ts_next(ts), "debat", 0, 7);
+    test_token(ts_next(ts), "run", 8, 15);
+    test_token(ts_next(ts), "debat", 16, 23);
+    test_token(ts_next(ts), "debat", 24, 31);
+    test_token(ts_next(ts), "run", 32, 39);
+    test_token(ts_next(ts), "antidisestablishmentarian", 40, 69);
+    test_token(ts_next(ts), "antidisestablishmentarian", 70, 99);
+    Apnull(ts_next(ts));
+    /* long words aren't cached */
+    Aiequal(2, StemFilt(ts)->cache_hits);
+    Aiequal(3, StemFilt(ts)->cache_misses);
+
+    /* clones start with an empty cache */
+    ts2 = ts_clone(ts);
+    Aiequal(0, StemFilt(ts2)->cache_hits);
+    ts2->reset(ts2, text);
+    test_token(ts_next(ts2), "debat", 0, 7);
+    Aiequal(1, StemFilt(ts2)->cache_misses);
+    ts_deref(ts2);
+
+    /* every word collides in a single entry cache */
+    stem_filter_set_cache_size(ts, 1);
+    ts->reset(ts, text);
+    test_token(ts_next(ts), "debat", 0, 7);
+    test_token(ts_next(ts), "run", 8, 15);
+    test_token(ts_next(ts), "debat", 16, 23);
+    Aiequal(2, StemFilt(ts)->cache_hits);
+    Aiequal(6, StemFilt(ts)->cache_misses);
+
+    stem_filter_set_cache_size(ts, 0);
+    ts->reset(ts, text);
+    test_token(ts_next(ts), "debat", 0, 7);
+    test_token(ts_next(ts), "run", 8, 15);
+    Aiequal(6, StemFilt(ts)->cache_misses);
+    ts_deref(ts);
+}
+
+static void *get_ts_thread(void *p)
+{
+    Analyzer *a = (Analyzer *)p;
+    TokenStream *ts = a_get_ts(a, I("field"), "thread");
+    ts_deref(ts);
+    return ts;
+}
+
+/**
+ * Each thread reuses its own TokenStream as long as the last one it was
+ * given has been released.
+ */
+static void test_analyzer_ts_reuse(TestCase *tc, void *data)
+{
+    Analyzer *a = standard_analyzer_new(true);
+    TokenStream *ts1, *ts2;
+    pthread_t thread_id;
+    void *thread_ts;
+    int i;
+    char text1[] = "One two", text2[] = "Three", text3[] = "four";
+    (void)data;
+
+    ts1 = a_get_ts(a, I("field"), text1);
+    test_token(ts_next(ts1), "one", 0, 3);
+    /* ts1 is still in use */
+    ts2 = a_get_ts(a, I("field"), text2);
+    Atrue(ts1 != ts2);
+    test_token(ts_next(ts2), "three", 0, 5);
+    test_token(ts_next(ts1), "two", 4, 7);
+    Apnull(ts_next(ts1));
+    ts_deref(ts2);
+    ts_deref(ts1);
+
+    ts2 = a_get_ts(a, I("field"), text3);
+    Apequal(ts1, ts2);
+    test_token(ts_next(ts2), "four", 0, 4);
+    Apnull(ts_next(ts2));
+    ts_deref(ts2);
+
+    pthread_create(&thread_id, NULL, &get_ts_thread, a);
+    pthread_join(thread_id, &thread_ts);
+    Atrue(thread_ts != ts1);
+    /* a thread's stream is freed when the thread exits */
+    for (i = 0; i < 10; i++) {
+        pthread_create(&thread_id, NULL, &get_ts_thread, a);
+        pthread_join(thread_id, &thread_ts);
+    }
+    Aiequal(1, a->ts_bucket->size);
+
+    /* a stream can be held after its analyzer is gone */
+    ts1 = a_get_ts(a, I("field"), text1);
+    a_deref(a);
+    test_token(ts_next(ts1), "one", 0, 3);
+    ts_deref(ts1);
+
+    /* a reused HyphenFilter forgets the rest of the last hyphenated word */
+    a = analyzer_new(hyphen_filter_new(whitespace_tokenizer_new()), NULL,
+                     NULL);
+    ts1 = a_get_ts(a, I("field"), "cat-dog");
+    test_token(ts_next(ts1), "catdog", 0, 7);
+    ts_deref(ts1);
+    ts1 = a_get_ts(a, I("field"), "bird");
+    test_token(ts_next(ts1), "bird", 0, 4);
+    Apnull(ts_next(ts1));
+    ts_deref(ts1);
+    a_deref(a);
+}
+
+/**
+ * With zero_copy set, tokens which aren't rewritten reference the text
+ * rather than being copied into the token.
+ */
+static void test_zero_copy_tokens(TestCase *tc, void *data)
+{
+    Analyzer *a = standard_analyzer_new(true);
+    TokenStream *ts = whitespace_tokenizer_new();
+    char text[100] = "The quick Brown foxes";
+    Token *tk;
+    (void)data;
+
+    ts->reset(ts, text);
+    ts->zero_copy = true;
+    tk = ts_next(ts);
+    Apequal(text, tk->ref);
+    Aiequal(3, tk->len);
+    Atrue(0 == memcmp("The", TK_PTR(tk), 3));
+    Asequal("The", tk_text(tk));
+    Apnull(tk->ref);
+    Apequal(text + 4, ts_next(ts)->ref);
+
+    /* reset turns it off again */
+    ts->reset(ts, text);
+    tk = ts_next(ts);
+    Apnull(tk->ref);
+    Asequal("The", tk->text);
+    ts_deref(ts);
+
+    /* the lowercase filter only copies tokens it changes */
+    ts = a_get_ts(a, I("field"), text);
+    ts->zero_copy = true;
+    tk = ts_next(ts);
+    Apequal(text + 4, tk->ref);
+    Aiequal(5, tk->len);
+    Aiequal(4, tk->start);
+    Aiequal(2, tk->pos_inc);
+    tk = ts_next(ts);
+    Apnull(tk->ref);
+    test_token(tk, "brown", 10, 15);
+    tk = ts_next(ts);
+    Apequal(text + 16, tk->ref);
+    Asequal("foxes", tk_text(tk));
+    Apnull(ts_next(ts));
+    ts_deref(ts);
+
+    /* stemming always writes the token */
+    ts = stem_filter_new(lowercase_filter_new(standard_tokenizer_new()),
+                         "english", NULL);
+    ts->reset(ts, text);
+    ts->zero_copy = true;
+    tk = ts_next(ts);
+    Apnull(tk->ref);
+    test_token(tk, "the", 0, 3);
+    test_token(ts_next(ts), "quick", 4, 9);
+    test_token(ts_next(ts), "brown", 10, 15);
+    test_token(ts_next(ts), "fox", 16, 21);
+    Apnull(ts_next(ts));
+    ts_deref(ts);
+    a_deref(a);
+}
+
 static void test_per_field_analyzer(TestCase *tc, void *data)
 {
     TokenStream *ts;
@@ -1206,19 +1572,26 @@ TestSuite *ts_analysis(TestSuite *suite)
     }
 
     tst_run_test(suite, test_long_word, NULL);
+    tst_run_test(suite, test_std_fast_path, NULL);
 
     /* PerField */
     tst_run_test(suite, test_per_field_analyzer, NULL);
+    tst_run_test(suite, test_analyzer_ts_reuse, NULL);
+    tst_run_test(suite, test_zero_copy_tokens, NULL);
 
     /* Filters */
     tst_run_test(suite, test_lowercase_filter, NULL);
+    tst_run_test(suite, test_utf8_downcase, NULL);
+    tst_run_test(suite, test_utf8_lowercase_filter, NULL);
     tst_run_test(suite, test_hyphen_filter, NULL);
     tst_run_test(suite, test_stop_filter, NULL);
     tst_run_test(suite, test_mapping_filter, NULL);
+    tst_run_test(suite, test_mapping_filter_fast_path, NULL);
     tst_run_test(suite, test_stemmer, NULL);
     if (u) {
         tst_run_test(suite, test_stem_filter, NULL);
     }
+    tst_run_test(suite, test_stem_filter_cache, NULL);
 
     return suite;
 }
@@ -582,6 +582,110 @@ static void test_bv_scan_stress(TestCase *tc, void *data)
 }
 
 
+static void test_bv_andnot(TestCase *tc, void *data)
+{
+#   define ANDNOT_SIZE 1000
+    static const int andnot_cnt = 500;
+    BitVector *andnot_bv, *not_bv1, *not_bv2, *and_bv;
+    BitVector *bv1 = bv_new();
+    BitVector *bv2 = bv_new();
+    char set[ANDNOT_SIZE];
+    int i;
+    int count = 0;
+    (void)data;
+
+    memset(set, 0, ANDNOT_SIZE);
+    for (i = 0; i < andnot_cnt; i++) {
+        int bit = rand() % ANDNOT_SIZE;
+        bv_set(bv1, bit);
+        set[bit] = 1;
+    }
+    for (i = 0; i < andnot_cnt; i++) {
+        /* bv2 is shorter than bv1 */
+        int bit = rand() % (ANDNOT_SIZE / 2);
+        bv_set(bv2, bit);
+        set[bit] = 0;
+    }
+    for (i = 0; i < ANDNOT_SIZE; i++) {
+        count += set[i];
+    }
+
+    andnot_bv = bv_andnot(bv1, bv2);
+    Aiequal(count, andnot_bv->count);
+    for (i = 0; i < ANDNOT_SIZE; i++) {
+        Aiequal(set[i], bv_get(andnot_bv, i));
+    }
+
+    not_bv2 = bv_not(bv2);
+    and_bv = bv_and(bv1, not_bv2);
+    Assert(bv_eq(and_bv, andnot_bv), "a & ~b should equal bv_andnot(a, b)");
+    bv_destroy(and_bv);
+
+    /* extends_as_ones on the left hand side with a longer right hand side */
+    not_bv1 = bv_not(bv1);
+    and_bv = bv_and(not_bv2, not_bv1);
+    bv_destroy(andnot_bv);
+    andnot_bv = bv_andnot(not_bv2, bv1);
+    Assert(bv_eq(and_bv, andnot_bv), "~b & ~a should equal andnot(~b, a)");
+    bv_destroy(and_bv);
+    bv_destroy(not_bv1);
+    bv_destroy(not_bv2);
+
+    bv1 = bv_andnot_x(bv1, bv2);
+    Aiequal(count, bv1->count);
+    for (i = 0; i < ANDNOT_SIZE; i++) {
+        Aiequal(set[i], bv_get(bv1, i));
+    }
+
+    bv_destroy(bv1);
+    bv_destroy(bv2);
+    bv_destroy(andnot_bv);
+}
+
+/**
+ * Make sure scanning and counting work across the boundaries of the words
+ * that the bits are stored in.
+ */
+static void test_bv_word_boundaries(TestCase *tc, void *data)
+{
+    static const int bits[] = {0, 31, 32, 63, 64, 65, 127, 128, 191, 200};
+    const int bit_cnt = NELEMS(bits);
+    BitVector *bv = bv_new_capa(8);
+    int i, bit;
+    (void)data;
+
+    for (i = 0; i < bit_cnt; i++) {
+        bv_set(bv, bits[i]);
+    }
+    Aiequal(bit_cnt, bv->count);
+    Aiequal(bit_cnt, bv_recount(bv));
+
+    bv_scan_reset(bv);
+    for (i = 0; i < bit_cnt; i++) {
+        Aiequal(bits[i], bv_scan_next(bv));
+    }
+    Aiequal(-1, bv_scan_next(bv));
+    Aiequal(64, bv_scan_next_from(bv, 64));
+    Aiequal(127, bv_scan_next_from(bv, 66));
+    Aiequal(-1, bv_scan_next_from(bv, 201));
+
+    bv_scan_reset(bv);
+    i = 0;
+    while ((bit = bv_scan_next_unset(bv)) >= 0 && bit < bv->size) {
+        Atrue(!bv_get(bv, bit));
+        i++;
+    }
+    Aiequal(bv->size - bit_cnt, i);
+
+    bv_not_x(bv);
+    Aiequal(bit_cnt, bv->count);
+    Aiequal(bit_cnt, bv_recount(bv));
+    Aiequal(1, bv_scan_next_from(bv, 0));
+    Aiequal(66, bv_scan_next_from(bv, 63));
+    Aiequal(63, bv_scan_next_unset_from(bv, 32 + 1));
+    bv_destroy(bv);
+}
+
 TestSuite *ts_bitvector(TestSuite *suite)
 {
     suite = ADD_SUITE(suite);
@@ -592,9 +696,11 @@ TestSuite *ts_bitvector(TestSuite *suite)
     tst_run_test(suite, test_bv_or, NULL);
     tst_run_test(suite, test_bv_xor, NULL);
     tst_run_test(suite, test_bv_not, NULL);
+    tst_run_test(suite, test_bv_andnot, NULL);
     tst_run_test(suite, test_bv_combined_boolean_ops, NULL);
     tst_run_test(suite, test_bv_scan, NULL);
     tst_run_test(suite, test_bv_scan_stress, NULL);
+    tst_run_test(suite, test_bv_word_boundaries, NULL);
 
     return suite;
 }
@@ -0,0 +1,102 @@
+#include "testhelper.h"
+#include "bloom_filter.h"
+#include "test.h"
+
+#define BF_TERM_CNT 5000
+
+static char *bf_term(char *buf, const char *prefix, int i)
+{
+    sprintf(buf, "%s%d", prefix, i);
+    return buf;
+}
+
+static bool bf_contains_term(BloomFilter *bf, const char *term)
+{
+    return bf_may_contain(bf, bf_hash(term, (int)strlen(term)));
+}
+
+/**
+ * Every term added must be found and only a small percentage of the terms
+ * not added should be false positives.
+ */
+static void test_bf(TestCase *tc, void *data)
+{
+    BloomFilter *bf = bf_new(BF_TERM_CNT);
+    char buf[100];
+    int i, false_positives = 0;
+    (void)data;
+
+    Atrue(!bf_contains_term(bf, "id1"));
+    for (i = 0; i < BF_TERM_CNT; i++) {
+        bf_term(buf, "id", i);
+        bf_add(bf, bf_hash(buf, (int)strlen(buf)));
+    }
+    for (i = 0; i < BF_TERM_CNT; i++) {
+        Assert(bf_contains_term(bf, bf_term(buf, "id", i)),
+               "%s should be in the filter", buf);
+    }
+    for (i = 0; i < BF_TERM_CNT; i++) {
+        if (bf_contains_term(bf, bf_term(buf, "missing", i))) {
+            false_positives++;
+        }
+    }
+    Assert(false_positives < BF_TERM_CNT / 50,
+           "%d false positives is too many", false_positives);
+    bf_destroy(bf);
+
+    /* an empty filter still works */
+    bf = bf_new(0);
+    Atrue(!bf_contains_term(bf, "id1"));
+    bf_add(bf, bf_hash("id1", 3));
+    Atrue(bf_contains_term(bf, "id1"));
+    bf_destroy(bf);
+}
+
+/**
+ * Write a BloomFilter to a store and read it back.
+ */
+static void test_bf_read_write(TestCase *tc, void *data)
+{
+    Store *store = open_ram_store();
+    BloomFilter *bf = bf_new(100), *bf2;
+    OutStream *os;
+    InStream *is;
+    char buf[100];
+    int i;
+    (void)data;
+
+    for (i = 0; i < 100; i++) {
+        bf_term(buf, "id", i);
+        bf_add(bf, bf_hash(buf, (int)strlen(buf)));
+    }
+    os = store->new_output(store, "_0.blm");
+    bf_write(bf, os);
+    os_write_vint(os, 99);
+    os_close(os);
+
+    is = store->open_input(store, "_0.blm");
+    bf2 = bf_read(is);
+    Aiequal(99, is_read_vint(is));
+    is_close(is);
+
+    Aiequal(bf->num_hashes, bf2->num_hashes);
+    Aiequal(bf->word_cnt, bf2->word_cnt);
+    Atrue(0 == memcmp(bf->words, bf2->words, bf->word_cnt * sizeof(u64)));
+    for (i = 0; i < 100; i++) {
+        Atrue(bf_contains_term(bf2, bf_term(buf, "id", i)));
+    }
+
+    bf_destroy(bf);
+    bf_destroy(bf2);
+    store_deref(store);
+}
+
+TestSuite *ts_bloom_filter(TestSuite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    tst_run_test(suite, test_bf, NULL);
+    tst_run_test(suite, test_bf_read_write, NULL);
+
+    return suite;
+}
@@ -0,0 +1,204 @@
+#include "testhelper.h"
+#include "doc_set.h"
+#include "test.h"
+
+#define DS_TEST_SIZE 300000
+
+/**
+ * Test basic DocSet add/get operations and iteration, adding docs out of
+ * order and more than once.
+ */
+static void test_ds(TestCase *tc, void *data)
+{
+    static const int docs[] = {0, 1, 70, 65535, 65536, 200000, 1000000};
+    const int doc_cnt = NELEMS(docs);
+    DocSet *ds = ds_new();
+    DocSetIterator dsi;
+    int i;
+    (void)data;
+
+    Aiequal(0, ds->count);
+    Atrue(!ds_get(ds, 0));
+    dsi_init(&dsi, ds);
+    Aiequal(-1, dsi_next(&dsi));
+
+    for (i = doc_cnt - 1; i >= 0; i--) {
+        ds_add(ds, docs[i]);
+        ds_add(ds, docs[i]);
+    }
+    Aiequal(doc_cnt, ds->count);
+    Aiequal(4, ds->size);
+    for (i = 0; i < doc_cnt; i++) {
+        Atrue(ds_get(ds, docs[i]));
+        Atrue(!ds_get(ds, docs[i] + 2));
+    }
+
+    dsi_init(&dsi, ds);
+    for (i = 0; i < doc_cnt; i++) {
+        Aiequal(docs[i], dsi_next(&dsi));
+    }
+    Aiequal(-1, dsi_next(&dsi));
+    Aiequal(-1, dsi_next(&dsi));
+
+    dsi_init(&dsi, ds);
+    Aiequal(70, dsi_skip_to(&dsi, 2));
+    Aiequal(70, dsi_skip_to(&dsi, 70));
+    Aiequal(65535, dsi_skip_to(&dsi, 71));
+    Aiequal(200000, dsi_skip_to(&dsi, 65537));
+    Aiequal(1000000, dsi_next(&dsi));
+    Aiequal(-1, dsi_skip_to(&dsi, 1000001));
+    ds_destroy(ds);
+}
+
+/**
+ * Make sure ds_optimize picks the smallest container for each block of docs
+ * without changing the docs in the set.
+ */
+static void test_ds_optimize(TestCase *tc, void *data)
+{
+    DocSet *ds = ds_new();
+    BitVector *bv = bv_new();
+    DocSetIterator dsi;
+    int i, doc_num;
+    (void)data;
+
+    /* a long run of docs, a sparse block and a dense random block */
+    for (i = 0; i < 70000; i++) {
+        ds_add(ds, i);
+        bv_set(bv, i);
+    }
+    for (i = 0; i < 100; i++) {
+        doc_num = (3 << 16) + (rand() % 65536);
+        ds_add(ds, doc_num);
+        bv_set(bv, doc_num);
+    }
+    for (i = 0; i < 40000; i++) {
+        doc_num = (4 << 16) + (rand() % 65536);
+        ds_add(ds, doc_num);
+        bv_set(bv, doc_num);
+    }
+    Aiequal(bv->count, ds->count);
+    Aiequal(DS_BITMAP, ds->cons[0].type);
+    Aiequal(DS_ARRAY, ds->cons[2].type);
+
+    ds_optimize(ds);
+    Aiequal(bv->count, ds->count);
+    Aiequal(4, ds->size);
+    Aiequal(DS_RUN, ds->cons[0].type);
+    Aiequal(DS_RUN, ds->cons[1].type);
+    Aiequal(DS_ARRAY, ds->cons[2].type);
+    Aiequal(DS_BITMAP, ds->cons[3].type);
+
+    dsi_init(&dsi, ds);
+    bv_scan_reset(bv);
+    while ((doc_num = bv_scan_next(bv)) >= 0) {
+        Aiequal(doc_num, dsi_next(&dsi));
+    }
+    Aiequal(-1, dsi_next(&dsi));
+
+    /* adding to a run container still works */
+    ds_add(ds, 70001);
+    ds_add(ds, 100);
+    Atrue(ds_get(ds, 70001));
+    Atrue(ds_get(ds, 69999));
+    Atrue(!ds_get(ds, 70000));
+    Aiequal(bv->count + 1, ds->count);
+
+    ds_destroy(ds);
+    bv_destroy(bv);
+}
+
+/**
+ * Convert BitVectors of different densities to and from DocSets.
+ */
+static void test_ds_bv(TestCase *tc, void *data)
+{
+    static const int densities[] = {1, 100, 5000, 60000};
+    int i, j, doc_num;
+    (void)data;
+
+    for (i = 0; i < (int)NELEMS(densities); i++) {
+        BitVector *bv = bv_new(), *bv2;
+        DocSet *ds;
+        DocSetIterator dsi;
+
+        for (j = 0; j < densities[i] * (DS_TEST_SIZE >> 16); j++) {
+            bv_set(bv, rand() % DS_TEST_SIZE);
+        }
+        ds = ds_from_bv(bv, DS_TEST_SIZE);
+        Aiequal(bv->count, ds->count);
+
+        dsi_init(&dsi, ds);
+        bv_scan_reset(bv);
+        while ((doc_num = bv_scan_next(bv)) >= 0) {
+            Aiequal(doc_num, dsi_next(&dsi));
+            Atrue(ds_get(ds, doc_num));
+        }
+        Aiequal(-1, dsi_next(&dsi));
+
+        for (j = 0; j < 100; j++) {
+            doc_num = rand() % DS_TEST_SIZE;
+            dsi_init(&dsi, ds);
+            Aiequal(bv_scan_next_from(bv, doc_num),
+                    dsi_skip_to(&dsi, doc_num));
+            Aiequal(bv_get(bv, doc_num), ds_get(ds, doc_num));
+        }
+
+        bv2 = ds_to_bv(ds);
+        Assert(bv_eq(bv, bv2), "BitVector should survive the round trip");
+        if (densities[i] < 5000) {
+            Atrue(ds_memsize(ds) < (size_t)(bv->capa * sizeof(u64)));
+        }
+        bv_destroy(bv2);
+        ds_destroy(ds);
+        bv_destroy(bv);
+    }
+}
+
+/**
+ * A BitVector which extends as ones holds every doc from its size up to
+ * max_doc.
+ */
+static void test_ds_bv_extends_as_ones(TestCase *tc, void *data)
+{
+    static const int max_docs[] = {1, 64, 100, 70000, 200000};
+    int i;
+    (void)data;
+
+    for (i = 0; i < (int)NELEMS(max_docs); i++) {
+        const int max_doc = max_docs[i];
+        BitVector *bv = bv_new();
+        DocSet *ds;
+        DocSetIterator dsi;
+        int doc_num, expected = 0;
+
+        bv_set(bv, 0);
+        bv_set(bv, 66);
+        bv_not_x(bv);
+        ds = ds_from_bv(bv, max_doc);
+        dsi_init(&dsi, ds);
+        for (doc_num = 0; doc_num < max_doc; doc_num++) {
+            Aiequal(bv_get(bv, doc_num), ds_get(ds, doc_num));
+            if (bv_get(bv, doc_num)) {
+                Aiequal(doc_num, dsi_next(&dsi));
+                expected++;
+            }
+        }
+        Aiequal(-1, dsi_next(&dsi));
+        Aiequal(expected, ds->count);
+        ds_destroy(ds);
+        bv_destroy(bv);
+    }
+}
+
+TestSuite *ts_doc_set(TestSuite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    tst_run_test(suite, test_ds, NULL);
+    tst_run_test(suite, test_ds_optimize, NULL);
+    tst_run_test(suite, test_ds_bv, NULL);
+    tst_run_test(suite, test_ds_bv_extends_as_ones, NULL);
+
+    return suite;
+}
@@ -570,6 +570,137 @@ static void test_lazy_field_loading(TestCase *tc, void *data)
     lazy_doc_close(lazy_doc);
 }
 
+#define BLOCK_TEST_DOC_CNT 300
+
+static char *block_test_data(char *buf, int i)
+{
+    sprintf(buf, "compressed field data for document number %d. This is "
+            "padded out so that the documents fill several blocks. %d", i, i);
+    return buf;
+}
+
+/**
+ * Compressed fields are written in blocks. Make sure docs can be read from
+ * every block, in any order, whether loaded whole or lazily.
+ */
+static void test_fields_compressed_blocks(TestCase *tc, void *data)
+{
+    Store *store = open_ram_store();
+    FieldInfos *fis = prepare_fis();
+    FieldsWriter *fw;
+    FieldsReader *fr, *fr2;
+    Document *doc;
+    DocField *df;
+    LazyDoc *lazy_doc;
+    LazyDocField *lazy_df;
+    char buf[200], buf2[200];
+    int i;
+    (void)data;
+
+    fw = fw_open(store, "_0", fis);
+    for (i = 0; i < BLOCK_TEST_DOC_CNT; i++) {
+        doc = doc_new();
+        sprintf(buf2, "doc %d", i);
+        doc_add_field(doc, df_add_data(df_new(I("stored")), buf2));
+        df = doc_add_field(doc, df_new(I("stored_array")));
+        df_add_data(df, block_test_data(buf, i));
+        df_add_data(df, "");
+        fw_add_doc(fw, doc);
+        fw_write_tv_index(fw);
+        doc_destroy(doc);
+    }
+    fw_close(fw);
+
+    Atrue(store->exists(store, "_0.fdz"));
+    fr = fr_open(store, "_0", fis);
+    Atrue(fr->block_cnt > 1);
+    fr2 = fr_clone(fr);
+    for (i = BLOCK_TEST_DOC_CNT - 1; i >= 0; i -= 7) {
+        doc = fr_get_doc(i % 2 ? fr : fr2, i);
+        sprintf(buf2, "doc %d", i);
+        check_df_data(doc_get_field(doc, I("stored")), 0, buf2);
+        df = doc_get_field(doc, I("stored_array"));
+        Aiequal(2, df->size);
+        check_df_data(df, 0, block_test_data(buf, i));
+        check_df_data(df, 1, "");
+        doc_destroy(doc);
+    }
+
+    lazy_doc = fr_get_lazy_doc(fr, 150);
+    fr_close(fr2);
+    fr_close(fr);
+    lazy_df = lazy_doc_get(lazy_doc, I("stored_array"));
+    Asequal(block_test_data(buf, 150), lazy_df_get_data(lazy_df, 0));
+    Asequal("", lazy_df_get_data(lazy_df, 1));
+    lazy_df_get_bytes(lazy_df, buf2, 0, 8);
+    buf2[8] = '\0';
+    Asequal("compress", buf2);
+    lazy_df = lazy_doc_get(lazy_doc, I("stored"));
+    Asequal("doc 150", lazy_df_get_data(lazy_df, 0));
+    lazy_doc_close(lazy_doc);
+
+    fis_deref(fis);
+    store_deref(store);
+}
+
+/**
+ * Stored data can be read without copying it when using a memory mapped
+ * store.
+ */
+static void test_lazy_field_views(TestCase *tc, void *data)
+{
+    Store *store = open_mmap_store("./test/testdir/store");
+    Document *doc;
+    FieldInfos *fis = prepare_fis();
+    FieldsWriter *fw;
+    FieldsReader *fr;
+    DocField *df;
+    LazyDoc *lazy_doc;
+    LazyDocField *lazy_df;
+    const char *view;
+    (void)data;
+
+    store->clear_all(store);
+    fw = fw_open(store, "_0", fis);
+    doc = doc_new();
+    df = doc_add_field(doc, df_new(I("stored")));
+    df_add_data(df, "one");
+    df_add_data(df, "two");
+    df = doc_add_field(doc, df_new(I("stored_array")));
+    df_add_data(df, "compressed");
+    fw_add_doc(fw, doc);
+    fw_write_tv_index(fw);
+    doc_destroy(doc);
+    fw_close(fw);
+
+    fr = fr_open(store, "_0", fis);
+    lazy_doc = fr_get_lazy_doc(fr, 0);
+    fr_close(fr);
+
+    lazy_df = lazy_doc_get(lazy_doc, I("stored"));
+    view = lazy_df_get_view(lazy_df, 1);
+    Aiequal(3, lazy_df->data[1].length);
+    Atrue(0 == memcmp("two", view, 3));
+#ifndef POSH_OS_WIN32
+    /* nothing was copied */
+    Apnull(lazy_df->data[1].text);
+#endif
+    Asequal("one", lazy_df_get_data(lazy_df, 0));
+    Apequal(lazy_df->data[0].text, lazy_df_get_view(lazy_df, 0));
+    Apnull(lazy_df_get_view(lazy_df, 2));
+
+    lazy_df = lazy_doc_get(lazy_doc, I("stored_array"));
+    view = lazy_df_get_view(lazy_df, 0);
+    Aiequal(10, lazy_df->data[0].length);
+    Atrue(0 == memcmp("compressed", view, 10));
+    Apnull(lazy_df->data[0].text);
+
+    lazy_doc_close(lazy_doc);
+    store->clear_all(store);
+    fis_deref(fis);
+    store_deref(store);
+}
+
 TestSuite *ts_fields(TestSuite *suite)
 {
     suite = ADD_SUITE(suite);
@@ -581,6 +712,8 @@ TestSuite *ts_fields(TestSuite *suite)
     tst_run_test(suite, test_fields_rw_single, NULL);
     tst_run_test(suite, test_fields_rw_multi, NULL);
     tst_run_test(suite, test_lazy_field_loading, NULL);
+    tst_run_test(suite, test_fields_compressed_blocks, NULL);
+    tst_run_test(suite, test_lazy_field_views, NULL);
 
     return suite;
 }
@@ -12,9 +12,12 @@ const Config lucene_config = {
     SKIP_INTERVAL,  /* skip interval */
     10,             /* default merge factor */
     10,             /* max_buffered_docs */
+    10,             /* max_buffered_delete_terms */
     INT_MAX,        /* max_merged_docs */
     10000,          /* maximum field length (number of terms) */
-    true            /* use compound file by default */
+    true,           /* use compound file by default */
+    0,              /* don't sort the segments */
+    {{NULL, INDEX_SORT_STRING, false}}
 };
 
 
@@ -53,9 +53,9 @@ void prepare_filter_index(Store *store)
     return;
 }
 
-static void check_filtered_hits(TestCase *tc, Searcher *searcher, Query *query,
-                                Filter *f, PostFilter *post_filter,
-                                char *expected_hits, int top)
+void check_filtered_hits(TestCase *tc, Searcher *searcher, Query *query,
+                         Filter *f, PostFilter *post_filter,
+                         char *expected_hits, int top)
 {
     static int num_array[ARRAY_SIZE];
     int i;
@@ -245,6 +245,35 @@ static void test_query_filter_hash(TestCase *tc, void *data)
     filt_deref(f1);
 }
 
+static BitVector *not_doc_1_get_bv(Filter *filt, IndexReader *ir)
+{
+    BitVector *bv = bv_new();
+    (void)filt; (void)ir;
+    bv_set(bv, 1);
+    return bv_not_x(bv);
+}
+
+/**
+ * A negated BitVector only holds the bits up to the last one set but every
+ * doc past that is in the filter too.
+ */
+static void test_negated_bv_filter(TestCase *tc, void *data)
+{
+    Searcher *searcher = (Searcher *)data;
+    Query *q = maq_new();
+    Filter *f = filt_create(sizeof(Filter), I("NotDoc1Filter"));
+    BitVector *bv;
+    f->get_bv_i = &not_doc_1_get_bv;
+
+    check_filtered_hits(tc, searcher, q, f, NULL, "0,2,3,4,5,6,7,8,9", -1);
+    bv = filt_get_bv(f, ((IndexSearcher *)searcher)->ir);
+    Atrue(bv_get(bv, 0));
+    Atrue(!bv_get(bv, 1));
+    Atrue(bv_get(bv, FILTER_DOCS_SIZE - 1));
+    filt_deref(f);
+    q_deref(q);
+}
+
 static float odd_number_filter(int doc_num, float score, Searcher *sea, void *arg)
 {
     float is_ok = 0.0;
@@ -329,6 +358,7 @@ TestSuite *ts_filter(TestSuite *suite)
     tst_run_test(suite, test_range_filter_hash, NULL);
     tst_run_test(suite, test_query_filter, (void *)searcher);
     tst_run_test(suite, test_query_filter_hash, NULL);
+    tst_run_test(suite, test_negated_bv_filter, (void *)searcher);
     tst_run_test(suite, test_filter_func, searcher);
     tst_run_test(suite, test_score_altering_filter_func, searcher);
 
@@ -532,6 +532,80 @@ static void test_searcher_highlight(TestCase *tc, void *data)
     searcher_close(sea);
 }
 
+static void test_searcher_highlight_docs(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data;
+    Query *q;
+    IndexReader *ir;
+    Searcher *sea;
+    TopDocs *td;
+    char ***highlights;
+    char **single;
+    int i;
+    const int doc_nums[] = {2, 0, 3, 2};
+    const char *docs[] = {
+        "one two three four five six seven eight nine ten",
+        "nothing to see here",
+        "ten nine eight seven six five four three two one",
+        "one is the loneliest number that you'll ever do",
+        NULL
+    };
+
+    make_index(store);
+    add_string_docs(store, docs);
+
+    ir = ir_open(store);
+    sea = isea_new(ir);
+
+    q = tq_new(I("field"), "one");
+    highlights = searcher_highlight_docs(sea, q, doc_nums, 4, I("field"), 10,
+                                         1, "<b>", "</b>", "...");
+    for (i = 0; i < 4; i++) {
+        single = searcher_highlight(sea, q, doc_nums[i], I("field"), 10, 1,
+                                    "<b>", "</b>", "...");
+        Apnotnull(highlights[i]);
+        Aiequal(1, ary_size(highlights[i]));
+        Asequal(single[0], highlights[i][0]);
+        ary_destroy(single, &free);
+        ary_destroy(highlights[i], &free);
+    }
+    free(highlights);
+
+    td = searcher_search(sea, q, 0, 10, NULL, NULL, NULL);
+    Aiequal(3, td->size);
+    highlights = searcher_highlight_td(sea, q, td, I("field"), 10, 1,
+                                       "<b>", "</b>", "...");
+    for (i = 0; i < td->size; i++) {
+        single = searcher_highlight(sea, q, td->hits[i]->doc, I("field"), 10,
+                                    1, "<b>", "</b>", "...");
+        Asequal(single[0], highlights[i][0]);
+        ary_destroy(single, &free);
+        ary_destroy(highlights[i], &free);
+    }
+    free(highlights);
+    td_destroy(td);
+
+    highlights = searcher_highlight_docs(sea, q, doc_nums, 1,
+                                         I("not_a_field"), 10, 1,
+                                         "<b>", "</b>", "...");
+    Apnull(highlights[0]);
+    free(highlights);
+
+    /* the excerpts already made are freed when a later document raises */
+    ir_delete_doc(ir, 3);
+    TRY
+        highlights = searcher_highlight_docs(sea, q, doc_nums, 3, I("field"),
+                                             10, 1, "<b>", "</b>", "...");
+        Assert(false, "highlighting a deleted document should raise");
+    XCATCHALL
+        HANDLED();
+        Aiequal(STATE_ERROR, xcontext.excode);
+    XENDTRY
+    q_deref(q);
+
+    searcher_close(sea);
+}
+
 TestSuite *ts_highlighter(TestSuite *suite)
 {
     Store *store = open_ram_store();
@@ -547,6 +621,7 @@ TestSuite *ts_highlighter(TestSuite *suite)
 
     tst_run_test(suite, test_searcher_get_match_vector, store);
     tst_run_test(suite, test_searcher_highlight, store);
+    tst_run_test(suite, test_searcher_highlight_docs, store);
 
     store_deref(store);
     return suite;
@@ -1,6 +1,11 @@
 #include "index.h"
 #include "testhelper.h"
 #include "test.h"
+#ifdef USE_ZLIB
+# include <zlib.h>
+#else
+# include "bzlib.h"
+#endif
 
 static Symbol body, title, text, author, year, changing_field, compressed_field, tag;
 
@@ -787,8 +792,8 @@ static void test_index_undelete_all_after_close(TestCase *tc, void *data)
 static void test_fld_inverter(TestCase *tc, void *data)
 {
     Store *store = (Store *)data;
-    Hash *plists;
-    Hash *curr_plists;
+    TermHash *plists;
+    TermHash *curr_plists;
     Posting *p;
     PostingList *pl;
     DocWriter *dw;
@@ -814,7 +819,7 @@ static void test_fld_inverter(TestCase *tc, void *data)
             dw->fields, fis_get_field(dw->fis, df->name)->number))->plists;
 
 
-    pl = (PostingList *)h_get(curr_plists, "one");
+    pl = (PostingList *)th_get(curr_plists, "one", 3);
     if (Apnotnull(pl)) {
         Asequal("one", pl->term);
         Aiequal(3, pl->term_len);
@@ -824,10 +829,10 @@ static void test_fld_inverter(TestCase *tc, void *data)
         Apequal(p->first_occ, pl->last_occ);
         Apnull(p->first_occ->next);
         Aiequal(0, p->first_occ->pos);
-        Apequal(pl, ((PostingList *)h_get(plists, "one")));
+        Apequal(pl, ((PostingList *)th_get(plists, "one", 3)));
     }
 
-    pl = (PostingList *)h_get(curr_plists, "five");
+    pl = (PostingList *)th_get(curr_plists, "five", 4);
     if (Apnotnull(pl)) {
         Asequal("five", pl->term);
         Aiequal(4, pl->term_len);
@@ -839,7 +844,7 @@ static void test_fld_inverter(TestCase *tc, void *data)
         Aiequal(11, p->first_occ->next->next->pos);
         Aiequal(13, p->first_occ->next->next->next->pos);
         Aiequal(35, p->first_occ->next->next->next->next->pos);
-        Apequal(pl, ((PostingList *)h_get(plists, "five")));
+        Apequal(pl, ((PostingList *)th_get(plists, "five", 4)));
     }
 
     df_destroy(df);
@@ -858,7 +863,7 @@ static void test_fld_inverter(TestCase *tc, void *data)
 
     Aiequal(13, curr_plists->size);
 
-    pl = (PostingList *)h_get(curr_plists, "one");
+    pl = (PostingList *)th_get(curr_plists, "one", 3);
     if (Apnotnull(pl)) {
         Asequal("one", pl->term);
         Aiequal(3, pl->term_len);
@@ -873,7 +878,7 @@ static void test_fld_inverter(TestCase *tc, void *data)
         Apequal(p->first_occ, pl->last_occ);
         Apnull(p->first_occ->next);
         Aiequal(9, p->first_occ->pos);
-        Apequal(pl, ((PostingList *)h_get(plists, "one")));
+        Apequal(pl, ((PostingList *)th_get(plists, "one", 3)));
     }
 
     df_destroy(df);
@@ -1273,6 +1278,646 @@ static void test_iw_del_terms(TestCase *tc, void *data)
     ir_close(ir);
 }
 
+static void add_title_doc(IndexWriter *iw, char *title_str)
+{
+    Document *doc = doc_new();
+    doc_add_field(doc, df_add_data(df_new(title), title_str));
+    iw_add_doc(iw, doc);
+    doc_destroy(doc);
+}
+
+/**
+ * Deletes are buffered until the IndexWriter commits and they only delete
+ * documents that were added before them.
+ */
+static void test_iw_del_terms_buffered(TestCase *tc, void *data)
+{
+    Config config = default_config;
+    Store *store = (Store *)data;
+    IndexWriter *iw;
+    IndexReader *ir;
+    config.max_buffered_docs = 100;
+
+    iw = create_book_iw_conf(store, &config);
+    add_title_doc(iw, "1999");
+    add_title_doc(iw, "2000");
+    iw_commit(iw);
+
+    iw_delete_term(iw, title, "2000");
+    ir = ir_open(store);
+    Aiequal(2, ir->num_docs(ir));
+    ir_close(ir);
+
+    add_title_doc(iw, "2000");
+    add_title_doc(iw, "2001");
+    iw_delete_term(iw, title, "2001");
+    add_title_doc(iw, "2001");
+    iw_commit(iw);
+
+    ir = ir_open(store);
+    Aiequal(5, ir->max_doc(ir));
+    Aiequal(3, ir->num_docs(ir));
+    Atrue(!ir->is_deleted(ir, 0));
+    Atrue(ir->is_deleted(ir, 1));
+    Atrue(!ir->is_deleted(ir, 2));
+    Atrue(ir->is_deleted(ir, 3));
+    Atrue(!ir->is_deleted(ir, 4));
+    ir_close(ir);
+
+    /* or once max_buffered_delete_terms terms have been buffered */
+    iw->config.max_buffered_delete_terms = 2;
+    iw_delete_term(iw, title, "2000");
+    ir = ir_open(store);
+    Aiequal(3, ir->num_docs(ir));
+    ir_close(ir);
+    iw_delete_term(iw, title, "2001");
+    ir = ir_open(store);
+    Aiequal(1, ir->num_docs(ir));
+    Atrue(ir->is_deleted(ir, 2));
+    Atrue(ir->is_deleted(ir, 4));
+    ir_close(ir);
+
+    /* buffered deletes are applied when the writer is closed */
+    iw_delete_term(iw, title, "1999");
+    iw_close(iw);
+    ir = ir_open(store);
+    Aiequal(0, ir->num_docs(ir));
+    Atrue(ir->is_deleted(ir, 0));
+    ir_close(ir);
+}
+
+/**
+ * iw_update_doc replaces older documents with the key but never the new
+ * document itself, whether the old document is in the RAM segment or not.
+ */
+static void test_iw_update_doc(TestCase *tc, void *data)
+{
+    Config config = default_config;
+    Store *store = (Store *)data;
+    IndexWriter *iw;
+    IndexReader *ir;
+    Document *doc;
+    config.max_buffered_docs = 100;
+
+    iw = create_book_iw_conf(store, &config);
+    add_title_doc(iw, "one");
+    add_title_doc(iw, "two");
+    iw_commit(iw);
+    add_title_doc(iw, "three");
+
+    doc = doc_new();
+    doc_add_field(doc, df_add_data(df_new(title), "one"));
+    doc_add_field(doc, df_add_data(df_new(author), "updated"));
+    iw_update_doc(iw, title, "one", doc);
+    iw_update_doc(iw, title, "three", doc);
+    iw_update_doc(iw, title, "four", doc);
+    doc_destroy(doc);
+    Aiequal(6, iw_doc_count(iw));
+    iw_close(iw);
+
+    ir = ir_open(store);
+    Aiequal(6, ir->max_doc(ir));
+    Aiequal(4, ir->num_docs(ir));
+    Atrue(ir->is_deleted(ir, 0));
+    Atrue(!ir->is_deleted(ir, 1));
+    Atrue(ir->is_deleted(ir, 2));
+    Atrue(!ir->is_deleted(ir, 3));
+    Atrue(!ir->is_deleted(ir, 4));
+    Atrue(!ir->is_deleted(ir, 5));
+    ir_close(ir);
+}
+
+static bool seg_has_bloom_filter(Store *store, const char *segment,
+                                 int field_num)
+{
+    SegmentFieldIndex *sfi = sfi_open(store, segment);
+    SegmentTermIndex *sti =
+        (SegmentTermIndex *)h_get_int(sfi->field_dict, field_num);
+    bool has_bloom = sti && sti->bloom;
+    sfi_close(sfi);
+    return has_bloom;
+}
+
+/**
+ * Fields flagged with FI_BLOOM_FILTER_BM get a bloom filter in each segment
+ * written by a flush or a merge and lookups still find every term.
+ */
+static void test_iw_bloom_filter(TestCase *tc, void *data)
+{
+    Config config = default_config;
+    Store *store = (Store *)data;
+    FieldInfos *fis = fis_new(STORE_YES, INDEX_YES, TERM_VECTOR_NO);
+    Symbol id = intern("id");
+    FieldInfo *fi = fis_add_field(fis, fi_new(id, STORE_YES,
+                                              INDEX_UNTOKENIZED,
+                                              TERM_VECTOR_NO));
+    IndexWriter *iw;
+    IndexReader *ir;
+    Document *doc;
+    char buf[20];
+    int i;
+    fi->bits |= FI_BLOOM_FILTER_BM;
+    config.use_compound_file = false;
+
+    index_create(store, fis);
+    fis_deref(fis);
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    for (i = 0; i < 30; i++) {
+        sprintf(buf, "id%d", i);
+        doc = doc_new();
+        doc_add_field(doc, df_add_data(df_new(id), buf));
+        doc_add_field(doc, df_add_data(df_new(title), "title"));
+        iw_add_doc(iw, doc);
+        doc_destroy(doc);
+        if (9 == i % 10) {
+            iw_commit(iw);
+        }
+    }
+    Aiequal(3, iw->sis->size);
+    for (i = 0; i < iw->sis->size; i++) {
+        Atrue(seg_has_bloom_filter(store, iw->sis->segs[i]->name, 0));
+        Atrue(!seg_has_bloom_filter(store, iw->sis->segs[i]->name, 1));
+    }
+    iw_close(iw);
+
+    ir = ir_open(store);
+    for (i = 0; i < 30; i++) {
+        sprintf(buf, "id%d", i);
+        Aiequal(1, ir->doc_freq(ir, 0, buf));
+        sprintf(buf, "id%d", i + 30);
+        Aiequal(0, ir->doc_freq(ir, 0, buf));
+    }
+    ir_close(ir);
+
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    iw_optimize(iw);
+    Aiequal(1, iw->sis->size);
+    Atrue(seg_has_bloom_filter(store, iw->sis->segs[0]->name, 0));
+    iw_close(iw);
+
+    ir = ir_open(store);
+    for (i = 0; i < 30; i++) {
+        sprintf(buf, "id%d", i);
+        Aiequal(1, ir->doc_freq(ir, 0, buf));
+        doc = ir_get_doc_with_term(ir, id, buf);
+        Asequal(buf, doc_get_field(doc, id)->data[0]);
+        doc_destroy(doc);
+    }
+    Aiequal(30, ir->doc_freq(ir, 1, "title"));
+    ir_close(ir);
+
+    /* segments without a bloom filter field have no .blm file */
+    fis = fis_new(STORE_YES, INDEX_YES, TERM_VECTOR_NO);
+    index_create(store, fis);
+    fis_deref(fis);
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    doc = doc_new();
+    doc_add_field(doc, df_add_data(df_new(id), "id0"));
+    iw_add_doc(iw, doc);
+    doc_destroy(doc);
+    iw_commit(iw);
+    sprintf(buf, "%s.blm", iw->sis->segs[0]->name);
+    Atrue(!store->exists(store, buf));
+    iw_close(iw);
+}
+
+#define LEGACY_DOC_CNT 20
+/* each .fdx entry is the u64 .fdt pointer and the u32 term vector offset */
+#define LEGACY_IDX_PTR_SIZE 12
+
+/* zip +len+ bytes of +data+ the way stored fields were zipped before they
+ * were written in blocks. Returns a newly allocated buffer */
+static char *legacy_zip(const char *data, int len, int *zip_len)
+{
+    unsigned int capa = len + len / 100 + 700;
+    char *zip = ALLOC_N(char, capa);
+#ifdef USE_ZLIB
+    uLongf dest_len = capa;
+    compress2((Bytef *)zip, &dest_len, (const Bytef *)data, len, 9);
+    *zip_len = (int)dest_len;
+#else
+    BZ2_bzBuffToBuffCompress(zip, &capa, (char *)data, len, 9, 0, 0);
+    *zip_len = (int)capa;
+#endif
+    return zip;
+}
+
+/* Rewrite the stored fields of +segment+ in the format used before
+ * compressed fields were stored in blocks. Compressed values are zipped one
+ * by one in the .fdt file and there is no .fdz file. The term vectors which
+ * follow the stored fields are copied as they are. */
+static void seg_to_legacy_fields(Store *store, const char *segment,
+                                 FieldInfos *fis)
+{
+    FieldsReader *fr = fr_open(store, segment, fis);
+    OutStream *fdx_out = store->new_output(store, "legacy.fdx");
+    OutStream *fdt_out = store->new_output(store, "legacy.fdt");
+    char from[SEGMENT_NAME_MAX_LENGTH], to[SEGMENT_NAME_MAX_LENGTH];
+    int i, j, k;
+
+    for (i = 0; i < fr->size; i++) {
+        /* the stored fields end where fr_get_doc stops reading */
+        Document *doc = fr_get_doc(fr, i);
+        const off_t stored_end = is_pos(fr->fdt_in);
+        char **zips = ALLOC_AND_ZERO_N(char *, 100);
+        int *zip_lens = ALLOC_N(int, 100), zip_cnt = 0;
+        const off_t start_ptr = os_pos(fdt_out);
+        off_t start, tv_start, end;
+
+        is_seek(fr->fdx_in, (off_t)i * LEGACY_IDX_PTR_SIZE);
+        start = (off_t)is_read_u64(fr->fdx_in);
+        tv_start = start + is_read_u32(fr->fdx_in);
+        end = (i == fr->size - 1)
+            ? is_length(fr->fdt_in)
+            : (off_t)is_read_u64(fr->fdx_in);
+
+        os_write_u64(fdx_out, start_ptr);
+        os_write_vint(fdt_out, doc->size);
+        for (j = 0; j < doc->size; j++) {
+            DocField *df = doc->fields[j];
+            FieldInfo *fi = fis_get_field(fis, df->name);
+            os_write_vint(fdt_out, fi->number);
+            os_write_vint(fdt_out, df->size);
+            for (k = 0; k < df->size; k++) {
+                if (fi_is_compressed(fi)) {
+                    zips[zip_cnt] = legacy_zip(df->data[k], df->lengths[k],
+                                               &zip_lens[zip_cnt]);
+                    os_write_vint(fdt_out, zip_lens[zip_cnt++] - 1);
+                }
+                else {
+                    os_write_vint(fdt_out, df->lengths[k]);
+                }
+            }
+        }
+        for (j = 0, zip_cnt = 0; j < doc->size; j++) {
+            DocField *df = doc->fields[j];
+            const bool compressed
+                = fi_is_compressed(fis_get_field(fis, df->name));
+            for (k = 0; k < df->size; k++) {
+                if (compressed) {
+                    os_write_bytes(fdt_out, (uchar *)zips[zip_cnt],
+                                   zip_lens[zip_cnt]);
+                    free(zips[zip_cnt++]);
+                }
+                else {
+                    os_write_bytes(fdt_out, (uchar *)df->data[k],
+                                   df->lengths[k]);
+                    os_write_byte(fdt_out, ' ');
+                }
+            }
+        }
+        /* the term vectors are followed by their index */
+        os_write_u32(fdx_out, (u32)(os_pos(fdt_out) - start_ptr
+                                    + (tv_start - stored_end)));
+        is_seek(fr->fdt_in, stored_end);
+        is2os_copy_bytes(fr->fdt_in, fdt_out, (int)(end - stored_end));
+        free(zip_lens);
+        free(zips);
+        doc_destroy(doc);
+    }
+    os_close(fdt_out);
+    os_close(fdx_out);
+    fr_close(fr);
+
+    sprintf(from, "%s.fdz", segment);
+    store->remove(store, from);
+    sprintf(to, "%s.fdx", segment);
+    store->rename(store, "legacy.fdx", to);
+    sprintf(to, "%s.fdt", segment);
+    store->rename(store, "legacy.fdt", to);
+}
+
+static char *legacy_test_text(char *buf, int i)
+{
+    sprintf(buf, "zipped text for document %d which is zipped value by "
+            "value in legacy segments", i);
+    return buf;
+}
+
+static void check_legacy_test_docs(TestCase *tc, IndexReader *ir,
+                                   Symbol id, Symbol zipped)
+{
+    char buf[200];
+    int i;
+    Aiequal(LEGACY_DOC_CNT * 2, ir->num_docs(ir));
+    for (i = 0; i < LEGACY_DOC_CNT * 2; i++) {
+        Document *doc = ir->get_doc(ir, i);
+        TermVector *tv;
+        sprintf(buf, "%d", i);
+        Asequal(buf, doc_get_field(doc, id)->data[0]);
+        Asequal(legacy_test_text(buf, i), doc_get_field(doc, zipped)->data[0]);
+        Asequal("second value", doc_get_field(doc, zipped)->data[1]);
+        tv = ir->term_vector(ir, i, zipped);
+        if (Apnotnull(tv)) {
+            Aiequal(13, tv->term_cnt);
+            tv_destroy(tv);
+        }
+        doc_destroy(doc);
+    }
+}
+
+/**
+ * Segments written before compressed fields went in blocks are rewritten
+ * when they are merged, so the merged segment stores them in blocks.
+ */
+static void test_iw_merge_legacy_fields(TestCase *tc, void *data)
+{
+    Config config = default_config;
+    Store *store = (Store *)data;
+    FieldInfos *fis = fis_new(STORE_YES, INDEX_UNTOKENIZED, TERM_VECTOR_NO);
+    Symbol id = intern("id"), zipped = intern("zipped");
+    IndexWriter *iw;
+    IndexReader *ir;
+    char buf[200], id_buf[20], *segment = NULL;
+    int i;
+    config.use_compound_file = false;
+
+    fis_add_field(fis, fi_new(zipped, STORE_COMPRESS, INDEX_YES,
+                              TERM_VECTOR_WITH_POSITIONS_OFFSETS));
+    index_create(store, fis);
+    fis_deref(fis);
+
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    for (i = 0; i < LEGACY_DOC_CNT * 2; i++) {
+        Document *doc = doc_new();
+        DocField *df = df_new(zipped);
+        sprintf(id_buf, "%d", i);
+        doc_add_field(doc, df_add_data(df_new(id), id_buf));
+        df_add_data(df, legacy_test_text(buf, i));
+        df_add_data(df, "second value");
+        doc_add_field(doc, df);
+        iw_add_doc(iw, doc);
+        doc_destroy(doc);
+        if (i == LEGACY_DOC_CNT - 1) {
+            iw_commit(iw);
+            segment = estrdup(iw->sis->segs[0]->name);
+            fis = iw->fis;
+            REF(fis);
+        }
+    }
+    iw_close(iw);
+
+    sprintf(buf, "%s.fdz", segment);
+    Atrue(store->exists(store, buf));
+    seg_to_legacy_fields(store, segment, fis);
+    Atrue(!store->exists(store, buf));
+    fis_deref(fis);
+
+    /* the legacy segment can be read as it is */
+    ir = ir_open(store);
+    check_legacy_test_docs(tc, ir, id, zipped);
+    ir_close(ir);
+
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    iw_optimize(iw);
+    Aiequal(1, iw->sis->size);
+    sprintf(buf, "%s.fdz", iw->sis->segs[0]->name);
+    Atrue(store->exists(store, buf));
+    iw_close(iw);
+
+    ir = ir_open(store);
+    check_legacy_test_docs(tc, ir, id, zipped);
+    ir_close(ir);
+    free(segment);
+}
+
+static void add_id_doc(IndexWriter *iw, int i)
+{
+    Document *doc = doc_new();
+    char buf[20];
+    sprintf(buf, "id%d", i);
+    doc_add_field(doc, df_add_data(df_new(intern("id")), buf));
+    doc_add_field(doc, df_add_data(df_new(intern("body")),
+                                   "some text to give the segment a size"));
+    iw_add_doc(iw, doc);
+    doc_destroy(doc);
+}
+
+static void test_iw_tiered_merge_policy(TestCase *tc, void *data)
+{
+    Config config = default_config;
+    Store *store = (Store *)data;
+    FieldInfos *fis = fis_new(STORE_YES, INDEX_YES, TERM_VECTOR_NO);
+    MergePolicy *mp;
+    IndexWriter *iw;
+    IndexReader *ir;
+    char *del_terms[70];
+    char buf[20];
+    int i;
+
+    fis_add_field(fis, fi_new(intern("id"), STORE_YES, INDEX_UNTOKENIZED,
+                              TERM_VECTOR_NO));
+    config.max_buffered_docs = 5;
+    index_create(store, fis);
+    fis_deref(fis);
+
+    /* the segment count is kept within the tiers' budget */
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    mp = tiered_merge_policy_new();
+    TIERED_MP(mp)->floor_segment_bytes = 1;
+    TIERED_MP(mp)->segs_per_tier = 3;
+    TIERED_MP(mp)->max_merge_at_once = 3;
+    iw_set_merge_policy(iw, mp);
+    for (i = 0; i < 200; i++) {
+        add_id_doc(iw, i);
+        if (4 == i % 5) {
+            Atrue(iw->sis->size <= 10);
+        }
+    }
+    iw_commit(iw);
+    Atrue(iw->sis->size > 1);
+    Aiequal(200, iw_doc_count(iw));
+    iw_optimize(iw);
+    Aiequal(1, iw->sis->size);
+
+    /* a segment too large to merge is rewritten once enough of it has been
+     * deleted, but not before */
+    TIERED_MP(mp)->max_merged_segment_bytes = 2;
+    TIERED_MP(mp)->deletes_pct_allowed = 25.0;
+    for (i = 0; i < 70; i++) {
+        sprintf(buf, "id%d", i);
+        del_terms[i] = estrdup(buf);
+    }
+    iw_delete_terms(iw, intern("id"), del_terms, 40);
+    iw_commit(iw);
+    Aiequal(1, iw->sis->size);
+    Atrue(si_has_deletions(iw->sis->segs[0]));
+    iw_delete_terms(iw, intern("id"), del_terms + 40, 30);
+    iw_commit(iw);
+    Aiequal(1, iw->sis->size);
+    Atrue(!si_has_deletions(iw->sis->segs[0]));
+    Aiequal(130, iw->sis->segs[0]->doc_cnt);
+    iw_close(iw);
+
+    ir = ir_open(store);
+    Aiequal(130, ir->num_docs(ir));
+    for (i = 0; i < 200; i++) {
+        sprintf(buf, "id%d", i);
+        Aiequal(i < 70 ? 0 : 1, ir->doc_freq(ir, 0, buf));
+    }
+    ir_close(ir);
+    for (i = 0; i < 70; i++) {
+        free(del_terms[i]);
+    }
+}
+
+#define SORT_DOC_CNT 30
+
+static void add_sort_doc(IndexWriter *iw, int i)
+{
+    static const char *extra[] = {"", " x", " x x", " x x x"};
+    Document *doc = doc_new();
+    char id_buf[20], num_buf[20], body_buf[50];
+    sprintf(id_buf, "id%02d", i);
+    doc_add_field(doc, df_add_data(df_new(intern("id")), id_buf));
+    /* a couple of documents have no value to sort by */
+    if (i % 10 != 5) {
+        sprintf(num_buf, "%d", (i % 7) - 3);
+        doc_add_field(doc, df_add_data(df_new(intern("num")), num_buf));
+    }
+    sprintf(body_buf, "word tag%d word%s", i % 3, extra[i % 4]);
+    doc_add_field(doc, df_add_data(df_new(intern("body")), body_buf));
+    iw_add_doc(iw, doc);
+    doc_destroy(doc);
+}
+
+/* the documents must be sorted by num descending then id ascending, the
+ * postings must point to the right documents and the norms must have moved
+ * with their documents */
+static void check_sorted_index(TestCase *tc, Store *store, int doc_cnt)
+{
+    IndexReader *ir = ir_open(store);
+    const int id_fnum = fis_get_field_num(ir->fis, intern("id"));
+    const int body_fnum = fis_get_field_num(ir->fis, intern("body"));
+    TermDocEnum *tde = ir->term_positions(ir);
+    uchar *norms = ir->get_norms(ir, body_fnum);
+    int class_norms[4] = {-1, -1, -1, -1};
+    char last_id[20] = "";
+    int i, last_num = INT_MAX;
+    bool seen_missing = false;
+
+    Aiequal(doc_cnt, ir->num_docs(ir));
+    Aiequal(doc_cnt, ir->max_doc(ir));
+    for (i = 0; i < doc_cnt; i++) {
+        Document *doc = ir->get_doc(ir, i);
+        DocField *num_df = doc_get_field(doc, intern("num"));
+        const char *id = doc_get_field(doc, intern("id"))->data[0];
+        const int id_num = atoi(id + 2);
+
+        if (NULL == num_df) {
+            if (seen_missing) {
+                Assert(strcmp(last_id, id) < 0, "%s is out of order", id);
+            }
+            seen_missing = true;
+        }
+        else {
+            const int num = atoi(num_df->data[0]);
+            Assert(!seen_missing, "%s has a value but follows a missing one",
+                   id);
+            Assert(num <= last_num, "%s is out of order", id);
+            if (num == last_num) {
+                Assert(strcmp(last_id, id) < 0, "%s is out of order", id);
+            }
+            last_num = num;
+        }
+        strcpy(last_id, id);
+
+        tde->seek(tde, id_fnum, id);
+        Atrue(tde->next(tde));
+        Aiequal(i, tde->doc_num(tde));
+        Atrue(!tde->next(tde));
+
+        if (class_norms[id_num % 4] < 0) {
+            class_norms[id_num % 4] = norms[i];
+        }
+        Aiequal(class_norms[id_num % 4], norms[i]);
+        doc_destroy(doc);
+    }
+    Atrue(seen_missing);
+    Atrue(class_norms[0] != class_norms[3]);
+
+    tde->seek(tde, body_fnum, "word");
+    for (i = 0; i < doc_cnt; i++) {
+        Atrue(tde->next(tde));
+        Aiequal(i, tde->doc_num(tde));
+        Aiequal(2, tde->freq(tde));
+        Aiequal(0, tde->next_position(tde));
+        Aiequal(2, tde->next_position(tde));
+    }
+    Atrue(!tde->next(tde));
+
+    tde->seek(tde, body_fnum, "tag1");
+    for (i = -1; tde->next(tde); i = tde->doc_num(tde)) {
+        Document *doc = ir->get_doc(ir, tde->doc_num(tde));
+        Atrue(tde->doc_num(tde) > i);
+        Aiequal(1, atoi(doc_get_field(doc, intern("id"))->data[0] + 2) % 3);
+        Aiequal(1, tde->next_position(tde));
+        doc_destroy(doc);
+    }
+    tde->close(tde);
+    ir_close(ir);
+}
+
+static void test_iw_index_sort(TestCase *tc, void *data)
+{
+    Config config = default_config;
+    Store *store = (Store *)data;
+    FieldInfos *fis = fis_new(STORE_YES, INDEX_YES, TERM_VECTOR_NO);
+    IndexWriter *iw;
+    int i;
+
+    fis_add_field(fis, fi_new(intern("id"), STORE_YES, INDEX_UNTOKENIZED,
+                              TERM_VECTOR_NO));
+    fis_add_field(fis, fi_new(intern("num"), STORE_YES, INDEX_UNTOKENIZED,
+                              TERM_VECTOR_NO));
+    config.max_buffered_docs = 10;
+    config.merge_factor = 3;
+    config.index_sort_cnt = 2;
+    config.index_sort[0].field = intern("num");
+    config.index_sort[0].type = INDEX_SORT_INTEGER;
+    config.index_sort[0].reverse = true;
+    config.index_sort[1].field = intern("id");
+    config.index_sort[1].type = INDEX_SORT_STRING;
+    config.index_sort[1].reverse = false;
+
+    index_create(store, fis);
+    fis_deref(fis);
+
+    /* a segment written before the index was sorted */
+    iw = iw_open(store, whitespace_analyzer_new(false), &default_config);
+    for (i = 0; i < 8; i++) {
+        add_sort_doc(iw, i);
+    }
+    iw_close(iw);
+
+    /* is sorted when the index is optimized */
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    Aiequal(1, iw->sis->size);
+    Apnull(iw->sis->segs[0]->sorted_by);
+    iw_optimize(iw);
+    Aiequal(1, iw->sis->size);
+    Asequal("num:integer:reverse,id:string", iw->sis->segs[0]->sorted_by);
+    iw_close(iw);
+    check_sorted_index(tc, store, 8);
+
+    /* flushed segments are left unsorted until they are merged */
+    config.max_buffered_docs = 4;
+    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    for (i = 8; i < SORT_DOC_CNT; i++) {
+        add_sort_doc(iw, i);
+    }
+    iw_delete_term(iw, intern("id"), "id03");
+    iw_delete_term(iw, intern("id"), "id20");
+    iw_commit(iw);
+    Aiequal(2, iw->sis->segs[iw->sis->size - 1]->doc_cnt);
+    Apnull(iw->sis->segs[iw->sis->size - 1]->sorted_by);
+    iw_optimize(iw);
+    Aiequal(1, iw->sis->size);
+    Asequal("num:integer:reverse,id:string", iw->sis->segs[0]->sorted_by);
+    iw_close(iw);
+    check_sorted_index(tc, store, SORT_DOC_CNT - 2);
+}
+
 /****************************************************************************
  *
  * IndexReader
@@ -1412,13 +2057,9 @@ static ReaderTestEnvironment *reader_test_env_new(int type)
     return rte;
 }
 
-static void write_ir_test_docs(Store *store)
+static IndexWriter *ir_test_iw_open(Store *store)
 {
-    int i;
     Config config = default_config;
-    IndexWriter *iw;
-    Document **docs = prep_ir_test_docs();
-
     FieldInfos *fis = fis_new(STORE_YES, INDEX_YES,
                               TERM_VECTOR_WITH_POSITIONS_OFFSETS);
     fis_add_field(fis, fi_new(author, STORE_YES, INDEX_YES,
@@ -1435,7 +2076,14 @@ static void write_ir_test_docs(Store *store)
     fis_deref(fis);
     config.max_buffered_docs = 5;
 
-    iw = iw_open(store, whitespace_analyzer_new(false), &config);
+    return iw_open(store, whitespace_analyzer_new(false), &config);
+}
+
+static void write_ir_test_docs(Store *store)
+{
+    int i;
+    IndexWriter *iw = ir_test_iw_open(store);
+    Document **docs = prep_ir_test_docs();
 
     for (i = 0; i < IR_TEST_DOC_CNT; i++) {
         iw_add_doc(iw, docs[i]);
@@ -1793,6 +2441,374 @@ static void test_ir_get_doc(TestCase *tc, void *data)
     doc_destroy(doc);
 }
 
+static void check_docs_equal(TestCase *tc, Document *expected,
+                             Document *doc, Symbol *fields, int field_cnt)
+{
+    int i, j, field_size = 0;
+    for (i = 0; i < expected->size; i++) {
+        DocField *edf = expected->fields[i];
+        DocField *df = doc_get_field(doc, edf->name);
+        bool wanted = fields == NULL;
+        for (j = 0; j < field_cnt; j++) {
+            if (fields[j] == edf->name) wanted = true;
+        }
+        if (!wanted) {
+            Apnull(df);
+            continue;
+        }
+        field_size++;
+        Assert(NULL != df, "%s should have been loaded", S(edf->name));
+        if (!df) continue;
+        Aiequal(edf->size, df->size);
+        for (j = 0; j < edf->size; j++) {
+            Aiequal(edf->lengths[j], df->lengths[j]);
+            Asequal(edf->data[j], df->data[j]);
+        }
+    }
+    Aiequal(field_size, doc->size);
+}
+
+static void check_term_vectors_equal(TestCase *tc, TermVector *expected,
+                                     TermVector *tv)
+{
+    int i, j;
+    if (!expected || !tv) {
+        Apequal(expected, tv);
+        return;
+    }
+    Aiequal(expected->term_cnt, tv->term_cnt);
+    for (i = 0; i < expected->term_cnt && i < tv->term_cnt; i++) {
+        TVTerm *etvt = &expected->terms[i], *tvt = &tv->terms[i];
+        Asequal(etvt->text, tvt->text);
+        Aiequal(etvt->freq, tvt->freq);
+        for (j = 0; etvt->positions && j < etvt->freq; j++) {
+            Aiequal(etvt->positions[j], tvt->positions[j]);
+        }
+    }
+    Aiequal(expected->offset_cnt, tv->offset_cnt);
+    for (i = 0; i < expected->offset_cnt && i < tv->offset_cnt; i++) {
+        Aiequal(expected->offsets[i].start, tv->offsets[i].start);
+        Aiequal(expected->offsets[i].end, tv->offsets[i].end);
+    }
+}
+
+/* check the index in +store+ has the same documents, terms, positions and
+ * term vectors as the index in +expected_store+ */
+static void check_indexes_equal(TestCase *tc, Store *expected_store,
+                                Store *store)
+{
+    IndexReader *ir = ir_open(expected_store), *ir2 = ir_open(store);
+    int i, j;
+
+    Aiequal(ir->num_docs(ir), ir2->num_docs(ir2));
+    Aiequal(ir->fis->size, ir2->fis->size);
+    for (i = 0; i < ir->num_docs(ir); i++) {
+        Document *doc = ir->get_doc(ir, i), *doc2 = ir2->get_doc(ir2, i);
+        check_docs_equal(tc, doc, doc2, NULL, 0);
+        doc_destroy(doc);
+        doc_destroy(doc2);
+    }
+
+    for (i = 0; i < ir->fis->size; i++) {
+        FieldInfo *fi = ir->fis->fields[i];
+        TermEnum *te = ir_terms(ir, fi->name), *te2 = ir_terms(ir2, fi->name);
+        TermDocEnum *tde = ir->term_positions(ir);
+        TermDocEnum *tde2 = ir2->term_positions(ir2);
+        const int field_num2 = fis_get_field_num(ir2->fis, fi->name);
+        char *term;
+        while (NULL != (term = te->next(te))) {
+            if (!Asequal(term, te2->next(te2))) break;
+            Aiequal(te->curr_ti.doc_freq, te2->curr_ti.doc_freq);
+            tde->seek(tde, fi->number, term);
+            tde2->seek(tde2, field_num2, term);
+            while (tde->next(tde)) {
+                Atrue(tde2->next(tde2));
+                Aiequal(tde->doc_num(tde), tde2->doc_num(tde2));
+                Aiequal(tde->freq(tde), tde2->freq(tde2));
+                for (j = tde->freq(tde); j > 0; j--) {
+                    Aiequal(tde->next_position(tde),
+                            tde2->next_position(tde2));
+                }
+            }
+            Atrue(!tde2->next(tde2));
+        }
+        Apnull(te2->next(te2));
+        te->close(te);
+        te2->close(te2);
+        tde->close(tde);
+        tde2->close(tde2);
+
+        for (j = 0; j < ir->num_docs(ir); j++) {
+            TermVector *tv = ir->term_vector(ir, j, fi->name);
+            TermVector *tv2 = ir2->term_vector(ir2, j, fi->name);
+            check_term_vectors_equal(tc, tv, tv2);
+            if (tv) tv_destroy(tv);
+            if (tv2) tv_destroy(tv2);
+        }
+    }
+    ir_close(ir);
+    ir_close(ir2);
+}
+
+#ifndef UNTHREADED
+/**
+ * Indexing through an IndexPipeline should give exactly the same index as
+ * adding the documents one at a time.
+ */
+static void test_iw_pipeline(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data, *store2 = open_ram_store();
+    IndexWriter *iw = ir_test_iw_open(store2);
+    IndexPipeline *ip = ip_new(iw, 4, 8);
+    Document **docs = prep_ir_test_docs();
+    int i;
+
+    write_ir_test_docs(store);
+    for (i = 0; i < IR_TEST_DOC_CNT; i++) {
+        /* the pipeline takes ownership of the documents */
+        ip_add_doc(ip, docs[i]);
+    }
+    free(docs);
+    ip_close(ip);
+    iw_close(iw);
+
+    check_indexes_equal(tc, store, store2);
+    store_deref(store2);
+}
+#endif
+
+/**
+ * Documents analyzed ahead of time and written with doc_write should index
+ * the same as the original documents.
+ */
+static void test_iw_pre_analyzed_docs(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data, *store2 = open_ram_store();
+    /* the documents go in a store of their own as ir_test_iw_open clears
+     * store2 */
+    Store *doc_store = open_ram_store();
+    Analyzer *a = whitespace_analyzer_new(false);
+    Document **docs = prep_ir_test_docs();
+    IndexWriter *iw;
+    OutStream *os;
+    InStream *is;
+    int i, j;
+
+    write_ir_test_docs(store);
+
+    os = doc_store->new_output(doc_store, "docs.bin");
+    for (i = 0; i < IR_TEST_DOC_CNT; i++) {
+        for (j = 0; j < docs[i]->size; j++) {
+            DocField *df = docs[i]->fields[j];
+            if (df->name != title && df->name != year) {
+                df_analyze(df, a);
+            }
+        }
+        doc_write(docs[i], os);
+    }
+    os_close(os);
+    destroy_docs(docs, IR_TEST_DOC_CNT);
+    a_deref(a);
+
+    iw = ir_test_iw_open(store2);
+    is = doc_store->open_input(doc_store, "docs.bin");
+    Aiequal(IR_TEST_DOC_CNT, iw_load_docs(iw, is));
+    is_close(is);
+    iw_close(iw);
+
+    check_indexes_equal(tc, store, store2);
+    store_deref(doc_store);
+    store_deref(store2);
+}
+
+/**
+ * Tokens are indexed in place of the field's data and survive a round trip
+ * through doc_write and doc_read.
+ */
+static void test_iw_doc_tokens(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data;
+    Document *doc = doc_new(), *doc2;
+    DocField *df;
+    IndexWriter *iw;
+    IndexReader *ir;
+    TermVector *tv;
+    OutStream *os;
+    InStream *is;
+    FieldInfos *fis = fis_new(STORE_YES, INDEX_YES,
+                              TERM_VECTOR_WITH_POSITIONS_OFFSETS);
+    index_create(store, fis);
+    fis_deref(fis);
+
+    df = doc_add_field(doc, df_new(body));
+    df_add_data(df, "data isn't indexed");
+    df_add_token(df, "tokens", 6, 1, 3, 9);
+    df_add_token(df, "instead", 7, 1, 100, 107);
+    /* a token can go back to an earlier offset and position */
+    df_add_token(df, "synonym", 7, 0, 1, 2);
+    df->boost = 2.0f;
+    doc->boost = 3.0f;
+    doc_add_field(doc, df_add_data(df_new(title), "untokenized"));
+
+    os = store->new_output(store, "doc.bin");
+    doc_write(doc, os);
+    os_close(os);
+    is = store->open_input(store, "doc.bin");
+    doc2 = doc_read(is);
+    Aiequal(is->m->length_i(is), is_pos(is));
+    is_close(is);
+
+    Aiequal(2, doc2->size);
+    Afequal(3.0f, doc2->boost);
+    df = doc_get_field(doc2, body);
+    Afequal(2.0f, df->boost);
+    Aiequal(1, df->size);
+    Asequal("data isn't indexed", df->data[0]);
+    Aiequal(18, df->lengths[0]);
+    if (Apnotnull(df->tokens)) {
+        TokenList *tkl = df->tokens;
+        Aiequal(3, tkl->size);
+        Asequal("instead", tkl->buf + tkl->tokens[1].text);
+        Aiequal(7, tkl->tokens[1].len);
+        Aiequal(1, tkl->tokens[1].pos_inc);
+        Aiequal(100, tkl->tokens[1].start);
+        Aiequal(107, tkl->tokens[1].end);
+        Asequal("synonym", tkl->buf + tkl->tokens[2].text);
+        Aiequal(0, tkl->tokens[2].pos_inc);
+        Aiequal(1, tkl->tokens[2].start);
+        Aiequal(2, tkl->tokens[2].end);
+    }
+    Apnull(doc_get_field(doc2, title)->tokens);
+    doc_destroy(doc);
+
+    iw = iw_open(store, whitespace_analyzer_new(false), &default_config);
+    iw_add_doc(iw, doc2);
+    iw_close(iw);
+    doc_destroy(doc2);
+
+    ir = ir_open(store);
+    Aiequal(0, ir->doc_freq(ir, fis_get_field_num(ir->fis, body), "data"));
+    tv = ir->term_vector(ir, 0, body);
+    if (Apnotnull(tv)) {
+        Aiequal(3, tv->term_cnt);
+        Asequal("instead", tv->terms[0].text);
+        Aiequal(1, tv->terms[0].positions[0]);
+        Asequal("synonym", tv->terms[1].text);
+        Aiequal(1, tv->terms[1].positions[0]);
+        Asequal("tokens", tv->terms[2].text);
+        Aiequal(0, tv->terms[2].positions[0]);
+        /* offsets are kept per position so the synonym's replace those of
+         * the term before it */
+        Aiequal(2, tv->offset_cnt);
+        Aiequal(3, tv->offsets[0].start);
+        Aiequal(1, tv->offsets[1].start);
+        Aiequal(2, tv->offsets[1].end);
+        tv_destroy(tv);
+    }
+    ir_close(ir);
+}
+
+static void test_ir_get_docs(TestCase *tc, void *data)
+{
+    IndexReader *ir = (IndexReader *)data;
+    int doc_nums[] = {255, 3, 0, 2, 3, 100, 21};
+    const int cnt = NELEMS(doc_nums);
+    Symbol fields[] = {title, compressed_field, tag};
+    Document **docs;
+    int i, k;
+
+    for (k = 0; k < 2; k++) {
+        Symbol *fs = k ? fields : NULL;
+        const int field_cnt = k ? NELEMS(fields) : 0;
+        docs = ir_get_docs(ir, doc_nums, cnt, fs, field_cnt);
+        for (i = 0; i < cnt; i++) {
+            Document *expected = ir->get_doc(ir, doc_nums[i]);
+            check_docs_equal(tc, expected, docs[i], fs, field_cnt);
+            doc_destroy(expected);
+            doc_destroy(docs[i]);
+        }
+        free(docs);
+    }
+
+    /* already sorted */
+    docs = ir_get_docs(ir, doc_nums + 1, 1, NULL, 0);
+    Asequal("War And Peace", doc_get_field(docs[0], title)->data[0]);
+    doc_destroy(docs[0]);
+    free(docs);
+
+    doc_nums[2] = IR_TEST_DOC_CNT;
+    TRY
+        docs = ir_get_docs(ir, doc_nums, cnt, NULL, 0);
+        Afail("getting a document past max_doc should fail");
+    case INDEX_ERROR:
+        HANDLED();
+    XENDTRY
+}
+
+#define IR_THREAD_CNT 4
+
+typedef struct IRThreadArg {
+    IndexReader *ir;
+    char **expected;
+    int start;
+    int failures;
+} IRThreadArg;
+
+static void *ir_get_doc_thread(void *p)
+{
+    IRThreadArg *arg = (IRThreadArg *)p;
+    IndexReader *ir = arg->ir;
+    int i;
+    for (i = 0; i < IR_TEST_DOC_CNT; i++) {
+        /* jump about so that consecutive reads are in different blocks */
+        const int doc_num = (arg->start + i * 37) % IR_TEST_DOC_CNT;
+        Document *doc = ir->get_doc(ir, doc_num);
+        DocField *df = doc_get_field(doc, compressed_field);
+        const char *data = df ? df->data[0] : NULL;
+        const char *expected = arg->expected[doc_num];
+        if ((NULL == data) != (NULL == expected)
+            || (data && 0 != strcmp(expected, data))) {
+            arg->failures++;
+        }
+        doc_destroy(doc);
+    }
+    return NULL;
+}
+
+/**
+ * Threads sharing a reader each keep their own last block of compressed
+ * fields so they read the right data however their reads interleave.
+ */
+static void test_ir_get_doc_threads(TestCase *tc, void *data)
+{
+    IndexReader *ir = (IndexReader *)data;
+    char *expected[IR_TEST_DOC_CNT];
+    thread_t threads[IR_THREAD_CNT];
+    IRThreadArg args[IR_THREAD_CNT];
+    int i;
+
+    for (i = 0; i < IR_TEST_DOC_CNT; i++) {
+        Document *doc = ir->get_doc(ir, i);
+        DocField *df = doc_get_field(doc, compressed_field);
+        expected[i] = df ? estrdup(df->data[0]) : NULL;
+        doc_destroy(doc);
+    }
+    for (i = 0; i < IR_THREAD_CNT; i++) {
+        args[i].ir = ir;
+        args[i].expected = expected;
+        args[i].start = i * IR_TEST_DOC_CNT / IR_THREAD_CNT;
+        args[i].failures = 0;
+        thread_create(&threads[i], &ir_get_doc_thread, &args[i]);
+    }
+    for (i = 0; i < IR_THREAD_CNT; i++) {
+        thread_join(threads[i]);
+        Aiequal(0, args[i].failures);
+    }
+    for (i = 0; i < IR_TEST_DOC_CNT; i++) {
+        free(expected[i]);
+    }
+}
+
 static void test_ir_compression(TestCase *tc, void *data)
 { 
     int i;
@@ -2215,6 +3231,17 @@ TestSuite *ts_index(TestSuite *suite)
     tst_run_test(suite, test_iw_add_docs, store);
     tst_run_test(suite, test_iw_add_empty_tv, store);
     tst_run_test(suite, test_iw_del_terms, store);
+    tst_run_test(suite, test_iw_del_terms_buffered, store);
+    tst_run_test(suite, test_iw_update_doc, store);
+    tst_run_test(suite, test_iw_bloom_filter, store);
+    tst_run_test(suite, test_iw_merge_legacy_fields, store);
+    tst_run_test(suite, test_iw_tiered_merge_policy, store);
+    tst_run_test(suite, test_iw_index_sort, store);
+#ifndef UNTHREADED
+    tst_run_test(suite, test_iw_pipeline, store);
+#endif
+    tst_run_test(suite, test_iw_pre_analyzed_docs, store);
+    tst_run_test(suite, test_iw_doc_tokens, store);
     tst_run_test(suite, test_create_with_reader, store);
     tst_run_test(suite, test_simulated_crashed_writer, store);
     tst_run_test(suite, test_simulated_corrupt_index1, store);
@@ -2231,6 +3258,10 @@ TestSuite *ts_index(TestSuite *suite)
                            "test_segment_reader_basic_ops");
     tst_run_test_with_name(suite, test_ir_get_doc, ir,
                            "test_segment_get_doc");
+    tst_run_test_with_name(suite, test_ir_get_docs, ir,
+                           "test_segment_get_docs");
+    tst_run_test_with_name(suite, test_ir_get_doc_threads, ir,
+                           "test_segment_get_doc_threads");
     tst_run_test_with_name(suite, test_ir_compression, ir,
                            "test_segment_compression");
     tst_run_test_with_name(suite, test_ir_term_enum, ir,
@@ -2257,6 +3288,10 @@ TestSuite *ts_index(TestSuite *suite)
                            "test_multi_reader_basic_ops");
     tst_run_test_with_name(suite, test_ir_get_doc, ir,
                            "test_multi_get_doc");
+    tst_run_test_with_name(suite, test_ir_get_docs, ir,
+                           "test_multi_get_docs");
+    tst_run_test_with_name(suite, test_ir_get_doc_threads, ir,
+                           "test_multi_get_doc_threads");
     tst_run_test_with_name(suite, test_ir_compression, ir,
                            "test_multi_compression");
     tst_run_test_with_name(suite, test_ir_term_enum, ir,
@@ -2283,6 +3318,10 @@ TestSuite *ts_index(TestSuite *suite)
                            "test_multi_ext_reader_basic_ops");
     tst_run_test_with_name(suite, test_ir_get_doc, ir,
                            "test_multi_ext_get_doc");
+    tst_run_test_with_name(suite, test_ir_get_docs, ir,
+                           "test_multi_ext_get_docs");
+    tst_run_test_with_name(suite, test_ir_get_doc_threads, ir,
+                           "test_multi_ext_get_doc_threads");
     tst_run_test_with_name(suite, test_ir_compression, ir,
                            "test_multi_ext_compression");
     tst_run_test_with_name(suite, test_ir_term_enum, ir,
@@ -2310,6 +3349,10 @@ TestSuite *ts_index(TestSuite *suite)
                            "test_add_indexes_reader_basic_ops");
     tst_run_test_with_name(suite, test_ir_get_doc, ir,
                            "test_add_indexes_get_doc");
+    tst_run_test_with_name(suite, test_ir_get_docs, ir,
+                           "test_add_indexes_get_docs");
+    tst_run_test_with_name(suite, test_ir_get_doc_threads, ir,
+                           "test_add_indexes_get_doc_threads");
     tst_run_test_with_name(suite, test_ir_compression, ir,
                            "test_add_indexes_compression");
     tst_run_test_with_name(suite, test_ir_term_enum, ir,
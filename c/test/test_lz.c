@@ -0,0 +1,155 @@
+#include "testhelper.h"
+#include "lz.h"
+#include "test.h"
+
+#define LZ_TEST_LEN 100000
+
+static char *lz_test_data(int len, int alphabet)
+{
+    char *data = ALLOC_N(char, len);
+    int i;
+    for (i = 0; i < len; i++) {
+        data[i] = (char)('a' + rand() % alphabet);
+        if (i > 50 && rand() % 4 == 0) {
+            /* repeat some earlier text so there is something to match */
+            const int back = 1 + rand() % 50;
+            data[i] = data[i - back];
+        }
+    }
+    return data;
+}
+
+static void check_round_trip(TestCase *tc, const char *data, int len)
+{
+    char *zip = ALLOC_N(char, LZ_COMPRESS_BOUND(len));
+    char *out = ALLOC_N(char, len + 1);
+    const int zip_len = lz_compress(data, len, zip);
+
+    Assert(zip_len <= LZ_COMPRESS_BOUND(len), "%d is over the bound for %d",
+           zip_len, len);
+    Aiequal(len, lz_decompress(zip, zip_len, out, len));
+    Atrue(0 == memcmp(data, out, len));
+    if (len > 0) {
+        Aiequal(-1, lz_decompress(zip, zip_len, out, len - 1));
+    }
+    free(out);
+    free(zip);
+}
+
+/**
+ * Compress and decompress text with few repeats, lots of repeats and long
+ * runs of the same byte.
+ */
+static void test_lz_round_trip(TestCase *tc, void *data)
+{
+    char *text;
+    int i;
+    (void)data;
+
+    check_round_trip(tc, "", 0);
+    check_round_trip(tc, "a", 1);
+    check_round_trip(tc, "abcdefghijkl", 12);
+    check_round_trip(tc, "abcdabcdabcdabcd", 16);
+
+    text = lz_test_data(LZ_TEST_LEN, 26);
+    check_round_trip(tc, text, LZ_TEST_LEN);
+    free(text);
+
+    text = lz_test_data(LZ_TEST_LEN, 2);
+    check_round_trip(tc, text, LZ_TEST_LEN);
+    free(text);
+
+    text = ALLOC_N(char, LZ_TEST_LEN);
+    memset(text, 'x', LZ_TEST_LEN);
+    for (i = 0; i < 1000; i += 100) {
+        check_round_trip(tc, text, i);
+    }
+    check_round_trip(tc, text, LZ_TEST_LEN);
+    free(text);
+}
+
+/**
+ * Truncated input never decompresses to the whole text.
+ */
+static void test_lz_truncated(TestCase *tc, void *data)
+{
+    const int len = 5000;
+    char *text = lz_test_data(len, 4);
+    char *zip = ALLOC_N(char, LZ_COMPRESS_BOUND(len));
+    char *out = ALLOC_N(char, len);
+    const int zip_len = lz_compress(text, len, zip);
+    int i;
+    (void)data;
+
+    for (i = 0; i < zip_len; i++) {
+        /* copy the prefix so reading past it is caught by memory checkers */
+        char *prefix = ALLOC_N(char, i + 1);
+        memcpy(prefix, zip, i);
+        Assert(lz_decompress(prefix, i, out, len) < len,
+               "%d of %d bytes decompressed to the whole text", i, zip_len);
+        free(prefix);
+    }
+    Aiequal(len, lz_decompress(zip, zip_len, out, len));
+
+    free(out);
+    free(zip);
+    free(text);
+}
+
+/**
+ * Bad offsets and lengths are rejected and random corruption never reads or
+ * writes out of bounds.
+ */
+static void test_lz_corrupt(TestCase *tc, void *data)
+{
+    const int len = 5000;
+    char *text = lz_test_data(len, 8);
+    char *zip = ALLOC_N(char, LZ_COMPRESS_BOUND(len));
+    char *bad = ALLOC_N(char, LZ_COMPRESS_BOUND(len));
+    char *out = ALLOC_N(char, len);
+    const int zip_len = lz_compress(text, len, zip);
+    /* a match before any output, a zero offset and an offset past the start */
+    const char no_output[] = {0x00, 0x01, 0x00};
+    const char zero_offset[] = {0x10, 'a', 0x00, 0x00};
+    const char far_offset[] = {0x10, 'a', 0x02, 0x00};
+    /* a literal length running off the end of the input */
+    const char long_literals[] = {(char)0xF0, (char)0xFF, (char)0xFF};
+    /* a match longer than the output space */
+    const char long_match[] = {0x1F, 'a', 0x01, 0x00, (char)0xFF, 0x10};
+    int i, j;
+    (void)data;
+
+    Aiequal(-1, lz_decompress(no_output, sizeof(no_output), out, len));
+    Aiequal(-1, lz_decompress(zero_offset, sizeof(zero_offset), out, len));
+    Aiequal(-1, lz_decompress(far_offset, sizeof(far_offset), out, len));
+    Aiequal(-1, lz_decompress(long_literals, sizeof(long_literals), out, len));
+    Aiequal(-1, lz_decompress(long_match, sizeof(long_match), out, 100));
+    Aiequal(1 + 4 + 15 + 255 + 16,
+            lz_decompress(long_match, sizeof(long_match), out, len));
+
+    for (i = 0; i < 500; i++) {
+        int out_len;
+        memcpy(bad, zip, zip_len);
+        for (j = 1 + rand() % 4; j > 0; j--) {
+            bad[rand() % zip_len] = (char)rand();
+        }
+        out_len = lz_decompress(bad, zip_len, out, len);
+        Assert(out_len >= -1 && out_len <= len, "%d is out of range", out_len);
+    }
+
+    free(out);
+    free(bad);
+    free(zip);
+    free(text);
+}
+
+TestSuite *ts_lz(TestSuite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    tst_run_test(suite, test_lz_round_trip, NULL);
+    tst_run_test(suite, test_lz_truncated, NULL);
+    tst_run_test(suite, test_lz_corrupt, NULL);
+
+    return suite;
+}
@@ -0,0 +1,90 @@
+#include "index.h"
+#include "test_store.h"
+#include "test.h"
+
+#ifdef POSH_OS_WIN32
+# define MMAP_STORE_PATH ".\\test\\testdir\\store"
+#else
+# define MMAP_STORE_PATH "./test/testdir/store"
+#endif
+
+/**
+ * Test that bytes can be read in place from a memory mapped file, including
+ * from within a compound file, and that the mapping outlives the stream it
+ * was opened with as long as a clone is still open.
+ */
+static void test_is_map(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data, *cmpd_store;
+    CompoundWriter *cw;
+    OutStream *os;
+    InStream *is, *is2;
+    const uchar *bytes;
+
+    os = store->new_output(store, "_mmap.tst");
+    os_write_bytes(os, (const uchar *)"0123456789", 10);
+    os_close(os);
+
+    is = store->open_input(store, "_mmap.tst");
+    Aiequal(10, is_length(is));
+    Aiequal('0', is_read_byte(is));
+    Atrue(NULL != (bytes = is_map(is, 3, 4)));
+    Atrue(0 == memcmp("3456", bytes, 4));
+    /* mapping doesn't move the stream */
+    Aiequal(1, is_pos(is));
+    Aiequal('1', is_read_byte(is));
+    TRY
+        is_map(is, 8, 4);
+        Afail("mapping past the end of the file should fail");
+    case EOF_ERROR:
+        HANDLED();
+    XENDTRY
+
+    is2 = is_clone(is);
+    is_close(is);
+    Atrue(0 == memcmp("3456", is_map(is2, 3, 4), 4));
+    is_close(is2);
+
+    cw = open_cw(store, "_mmap.cfs");
+    cw_add_file(cw, "_mmap.tst");
+    cw_close(cw);
+    cmpd_store = open_cmpd_store(store, "_mmap.cfs");
+    is = cmpd_store->open_input(cmpd_store, "_mmap.tst");
+    Atrue(NULL != (bytes = is_map(is, 5, 5)));
+    Atrue(0 == memcmp("56789", bytes, 5));
+    is_close(is);
+    store_deref(cmpd_store);
+
+    /* RAM files can't be mapped */
+    cmpd_store = open_ram_store();
+    os = cmpd_store->new_output(cmpd_store, "_mmap.tst");
+    os_write_bytes(os, (const uchar *)"0123456789", 10);
+    os_close(os);
+    is = cmpd_store->open_input(cmpd_store, "_mmap.tst");
+    Apnull(is_map(is, 0, 4));
+    is_close(is);
+    store_deref(cmpd_store);
+
+    store->remove(store, "_mmap.tst");
+    store->remove(store, "_mmap.cfs");
+}
+
+/**
+ * Test a memory mapped FileSystem store
+ */
+TestSuite *ts_mmap_store(TestSuite *suite)
+{
+    Store *store = open_mmap_store(MMAP_STORE_PATH);
+    store->clear(store);
+
+    suite = ADD_SUITE(suite);
+
+    create_test_store_suite(suite, store);
+#ifndef POSH_OS_WIN32
+    tst_run_test(suite, test_is_map, store);
+#endif
+
+    store_deref(store);
+
+    return suite;
+}
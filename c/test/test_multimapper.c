@@ -53,12 +53,40 @@ static void test_multimapper_utf8(TestCase *tc, void *data)
     mulmap_destroy(mapper);
 }
 
+static void test_multimapper_scan(TestCase *tc, void *data)
+{
+    char text[] = "a plain ascii string long enough for SIMD \xc3\xa0 z";
+    const int len = (int)strlen(text);
+    MultiMapper *mapper = mulmap_new();
+    (void)data;
+
+    mulmap_add_mapping(mapper, "\xc3\xa0", "a");
+    mulmap_add_mapping(mapper, "\xc3\xa9", "e");
+    Aiequal(len - 4, mulmap_scan(mapper, text, len));
+    Aiequal(len - 4, mulmap_scan(mapper, text, len - 2));
+    Aiequal(len - 5, mulmap_scan(mapper, text, len - 5));
+    Aiequal(0, mulmap_scan(mapper, text + len - 4, 4));
+    Atrue(mapper->ascii_unmapped);
+    Atrue(mapper->never_grows);
+    /* mapped in place */
+    Aiequal(len - 1, mulmap_map_len(mapper, text, text, len + 1));
+    Asequal("a plain ascii string long enough for SIMD a z", text);
+    Aiequal(len - 1, mulmap_scan(mapper, text, len - 1));
+
+    mulmap_add_mapping(mapper, "SIMD", "single instruction");
+    Aiequal(37, mulmap_scan(mapper, text, len - 1));
+    Atrue(!mapper->ascii_unmapped);
+    Atrue(!mapper->never_grows);
+    mulmap_destroy(mapper);
+}
+
 TestSuite *ts_multimapper(TestSuite *suite)
 {
     suite = ADD_SUITE(suite);
 
     tst_run_test(suite, test_multimapper, NULL);
     tst_run_test(suite, test_multimapper_utf8, NULL);
+    tst_run_test(suite, test_multimapper_scan, NULL);
 
     return suite;
 }
@@ -42,6 +42,40 @@ static void test_filtered_query(TestCase *tc, void *data)
     q_deref(q);
 }
 
+/**
+ * Selective filters on broad queries and filtered queries nested in boolean
+ * queries which move them with skip_to.
+ */
+static void test_filtered_query_leapfrog(TestCase *tc, void *data)
+{
+    Searcher *searcher = (Searcher *)data;
+    Query *q, *bq;
+    q = fq_new(tq_new(flipflop, "on"), rfilt_new(num, "3", "5", true, true));
+    check_hits(tc, searcher, q, "4", -1);
+    q_deref(q);
+    q = fq_new(maq_new(), rfilt_new(num, "99", NULL, true, false));
+    check_hits(tc, searcher, q, "", -1);
+    q_deref(q);
+    q = fq_new(maq_new(), rfilt_new(num, "9", NULL, true, false));
+    check_hits(tc, searcher, q, "9", -1);
+    q_deref(q);
+
+    bq = bq_new(false);
+    bq_add_query_nr(bq, fq_new(maq_new(), rfilt_new(num, "2", "6", true, true)),
+                    BC_MUST);
+    bq_add_query_nr(bq, tq_new(flipflop, "off"), BC_MUST);
+    check_hits(tc, searcher, bq, "3,5", -1);
+    q_deref(bq);
+
+    bq = bq_new(false);
+    bq_add_query_nr(bq, fq_new(tq_new(flipflop, "on"),
+                               rfilt_new(num, "1", "8", true, true)), BC_MUST);
+    bq_add_query_nr(bq, fq_new(maq_new(), rfilt_new(num, "4", NULL, true, false)),
+                    BC_MUST);
+    check_hits(tc, searcher, bq, "4,6,8", -1);
+    q_deref(bq);
+}
+
 TestSuite *ts_q_filtered(TestSuite *suite)
 {
     Store *store = open_ram_store();
@@ -58,6 +92,7 @@ TestSuite *ts_q_filtered(TestSuite *suite)
     searcher = isea_new(ir);
 
     tst_run_test(suite, test_filtered_query, (void *)searcher);
+    tst_run_test(suite, test_filtered_query_leapfrog, (void *)searcher);
 
     store_deref(store);
     searcher->close(searcher);
@@ -1,4 +1,5 @@
 #include "search.h"
+#include "ind.h"
 #include "test.h"
 
 typedef struct QPTestPair {
@@ -449,6 +450,216 @@ static void test_qp_keyword_switch(TestCase *tc, void *data)
     qp_destroy(parser);
 }
 
+typedef struct ParseThreadArg {
+    QParser *parser;
+    Query *q;
+} ParseThreadArg;
+
+static void *parse_thread(void *data)
+{
+    ParseThreadArg *arg = (ParseThreadArg *)data;
+    arg->q = qp_parse(arg->parser, "www xxx");
+    q_deref(arg->q);
+    return NULL;
+}
+
+#define Aqpc_stats(hit_cnt, miss_cnt) do {\
+    QParserCache *cache\
+        = (QParserCache *)thread_getspecific(parser->thread_cache);\
+    Aiequal(hit_cnt, cache->hits);\
+    Aiequal(miss_cnt, cache->misses);\
+} while (0)
+
+/**
+ * Parsing the same query string again returns the cached Query as long as
+ * nothing that changes the parse has changed.
+ */
+static void test_qp_cache(TestCase *tc, void *data)
+{
+    QParser *parser;
+    Query *q1, *q2;
+    thread_t thread_id;
+    ParseThreadArg arg;
+    (void)data;
+
+    parser = qp_new(letter_analyzer_new(true));
+    qp_add_field(parser, I("xx"), true,  true);
+    qp_add_field(parser, I("f1"), false, true);
+    qp_set_cache_size(parser, 2);
+
+    q1 = qp_parse(parser, "www xxx");
+    q2 = qp_parse(parser, "www xxx");
+    Apequal(q1, q2);
+    Aqpc_stats(1, 1);
+    q_deref(q2);
+    PARSER_TEST("www xxx", "www xxx");
+    Aqpc_stats(2, 1);
+
+    /* options and default fields are part of the key */
+    parser->or_default = false;
+    PARSER_TEST("www xxx", "+www +xxx");
+    PARSER_TEST("www xxx", "+www +xxx");
+    Aqpc_stats(3, 2);
+    parser->or_default = true;
+    hs_add(parser->def_fields, I("f1"));
+    PARSER_TEST("www", "www f1:www");
+    hs_rem(parser->def_fields, I("f1"));
+
+    /* the least recently used query was evicted */
+    PARSER_TEST("www xxx", "www xxx");
+    Aqpc_stats(3, 4);
+    q2 = qp_parse(parser, "www xxx");
+    Atrue(q1 != q2);
+    q_deref(q2);
+
+    /* each thread has a cache of its own */
+    arg.parser = parser;
+    thread_create(&thread_id, &parse_thread, &arg);
+    thread_join(thread_id);
+    Atrue(arg.q != q1);
+    Aqpc_stats(4, 4);
+    /* the thread's cache was freed when it exited */
+    Aiequal(1, parser->cache_bucket->size);
+
+    /* adding a field clears the cache */
+    qp_add_field(parser, I("f2"), true, true);
+    PARSER_TEST("www xxx", "(www f2:www) (xxx f2:xxx)");
+    Aqpc_stats(4, 5);
+
+    q_deref(q1);
+    qp_destroy(parser);
+}
+
+/**
+ * Index adds the fields it finds in the index to all_fields before parsing,
+ * so "*" covers fields added since the last parse even if it was cached.
+ */
+static void test_qp_cache_index_fields(TestCase *tc, void *data)
+{
+    Store *store = open_ram_store();
+    Analyzer *a = letter_analyzer_new(true);
+    HashSet *def_fields = hs_new_ptr(NULL);
+    Index *index;
+    Document *doc;
+    Query *q;
+    char *qres;
+    (void)data;
+
+    hs_add(def_fields, (void *)I("xx"));
+    index = index_new(store, a, def_fields, true);
+    hs_destroy(def_fields);
+    a_deref(a);
+    store_deref(store);
+    qp_set_cache_size(index->qp, 10);
+
+    doc = doc_new();
+    doc_add_field(doc, df_add_data(df_new(I("f1")), "x"));
+    index_add_doc(index, doc);
+    doc_destroy(doc);
+    q = index_get_query(index, "*:x");
+    qres = q->to_s(q, I("xx"));
+    Asequal("x f1:x", qres);
+    free(qres);
+    q_deref(q);
+
+    doc = doc_new();
+    doc_add_field(doc, df_add_data(df_new(I("f2")), "x"));
+    index_add_doc(index, doc);
+    doc_destroy(doc);
+    q = index_get_query(index, "*:x");
+    qres = q->to_s(q, I("xx"));
+    Asequal("x f1:x f2:x", qres);
+    free(qres);
+    q_deref(q);
+
+    index_destroy(index);
+}
+
+#define QP_THREAD_CNT 8
+#define QP_THREAD_PARSES 200
+
+static const char *QP_THREAD_QUERIES[] = {
+    "word", "f1:word", "\"word1 word2 word3\"", "f1|f2:(aaa bbb) ccc",
+    "+aaa -bbb ccc^2.0", "f1:[aaa bbb}", "*:xxx yyy", "zzz~0.5", "ab?d*",
+    "(aaa", "\"aaa bbb", "f1:(aaa f2:bbb ccc)"
+};
+
+typedef struct QPThreadArg {
+    QParser *parser;
+    char **expected;
+    int failures;
+} QPThreadArg;
+
+static void *qp_parse_thread(void *data)
+{
+    QPThreadArg *arg = (QPThreadArg *)data;
+    int i;
+    for (i = 0; i < QP_THREAD_PARSES; i++) {
+        const int j = i % NELEMS(QP_THREAD_QUERIES);
+        Query *q = qp_parse(arg->parser, (char *)QP_THREAD_QUERIES[j]);
+        char *qres = q->to_s(q, I("xx"));
+        if (0 != strcmp(arg->expected[j], qres)) arg->failures++;
+        free(qres);
+        q_deref(q);
+    }
+    return NULL;
+}
+
+/**
+ * Any number of threads can parse with the same QParser at once.
+ */
+static void test_qp_threads(TestCase *tc, void *data)
+{
+    QParser *parser = qp_new(letter_analyzer_new(true));
+    char *expected[NELEMS(QP_THREAD_QUERIES)];
+    thread_t threads[QP_THREAD_CNT];
+    QPThreadArg args[QP_THREAD_CNT];
+    Query *q;
+    int i, k;
+    (void)data;
+
+    qp_add_field(parser, I("xx"), true,  true);
+    qp_add_field(parser, I("f1"), false, true);
+    qp_add_field(parser, I("f2"), false, true);
+    parser->handle_parse_errors = true;
+
+    for (i = 0; i < NELEMS(QP_THREAD_QUERIES); i++) {
+        Query *q = qp_parse(parser, (char *)QP_THREAD_QUERIES[i]);
+        expected[i] = q->to_s(q, I("xx"));
+        q_deref(q);
+    }
+    for (k = 0; k < 2; k++) {
+        /* the second time round the queries come from each thread's cache */
+        qp_set_cache_size(parser, k * 4);
+        for (i = 0; i < QP_THREAD_CNT; i++) {
+            args[i].parser = parser;
+            args[i].expected = expected;
+            args[i].failures = 0;
+            thread_create(&threads[i], &qp_parse_thread, &args[i]);
+        }
+        for (i = 0; i < QP_THREAD_CNT; i++) {
+            thread_join(threads[i]);
+            Aiequal(0, args[i].failures);
+        }
+    }
+    for (i = 0; i < NELEMS(QP_THREAD_QUERIES); i++) {
+        free(expected[i]);
+    }
+
+    /* a parse error leaves the parser ready for the next parse */
+    parser->handle_parse_errors = false;
+    TRY
+        q = qp_parse(parser, "(aaa");
+        q_deref(q);
+        Assert(false, "parse error should have been raised");
+    XCATCHALL
+        HANDLED();
+        Aiequal(PARSE_ERROR, xcontext.excode);
+    XENDTRY
+    PARSER_TEST("f1|f2:(aaa bbb) ccc", "((f1:aaa f2:aaa) (f1:bbb f2:bbb)) ccc");
+    qp_destroy(parser);
+}
+
 TestSuite *ts_q_parser(TestSuite *suite)
 {
     suite = ADD_SUITE(suite);
@@ -459,6 +670,9 @@ TestSuite *ts_q_parser(TestSuite *suite)
     tst_run_test(suite, test_qp_bad_queries, NULL);
     tst_run_test(suite, test_qp_prefix_query, NULL);
     tst_run_test(suite, test_qp_keyword_switch, NULL);
+    tst_run_test(suite, test_qp_cache, NULL);
+    tst_run_test(suite, test_qp_cache_index_fields, NULL);
+    tst_run_test(suite, test_qp_threads, NULL);
 
     return suite;
 }
@@ -73,6 +73,10 @@ static void span_test_setup(Store *store)
 
 extern void check_hits(TestCase *tc, Searcher *searcher, Query *query,
                        char *expected_hits, int top);
+extern void check_filtered_hits(TestCase *tc, Searcher *searcher,
+                                Query *query, Filter *f,
+                                PostFilter *post_filter,
+                                char *expected_hits, int top);
 
 static void test_span_term(TestCase *tc, void *data)
 {
@@ -556,6 +560,43 @@ static void test_span_not_hash(TestCase *tc, void *data)
     q_deref(q1);
 }
 
+/**
+ * The filter is applied by skipping the span scorer to each doc in the
+ * filter so the scorer must score whichever doc it lands on.
+ */
+static void test_span_filtered(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data;
+    IndexReader *ir;
+    Searcher *sea;
+    Query *q;
+    Filter *all = qfilt_new_nr(maq_new());
+    Filter *eight = qfilt_new_nr(tq_new(field, "eight"));
+
+    ir = ir_open(store);
+    sea = isea_new(ir);
+
+    q = spantq_new(field, "nine");
+    check_filtered_hits(tc, sea, q, all, NULL, "7,23", -1);
+    check_filtered_hits(tc, sea, q, eight, NULL, "7,23", -1);
+    q_deref(q);
+
+    q = spantq_new(field, "flip");
+    check_filtered_hits(tc, sea, q, all, NULL, "2,4,16,19,21,29", -1);
+    check_filtered_hits(tc, sea, q, eight, NULL, "", -1);
+    q_deref(q);
+
+    q = spannq_new(1, false);
+    spannq_add_clause_nr(q, spantq_new(field, "start"));
+    spannq_add_clause_nr(q, spantq_new(field, "finish"));
+    check_filtered_hits(tc, sea, q, all, NULL, "0,1,13,14,16,17,29,30", -1);
+    q_deref(q);
+
+    filt_deref(all);
+    filt_deref(eight);
+    searcher_close(sea);
+}
+
 TestSuite *ts_q_span(TestSuite *suite)
 {
     Store *store = open_ram_store();
@@ -585,6 +626,8 @@ TestSuite *ts_q_span(TestSuite *suite)
     tst_run_test(suite, test_span_not, (void *)store);
     tst_run_test(suite, test_span_not_hash, NULL);
 
+    tst_run_test(suite, test_span_filtered, (void *)store);
+
     store_deref(store);
     return suite;
 }
@@ -254,6 +254,25 @@ static void test_get_doc(TestCase *tc, void *data)
     doc_destroy(doc);
 }
 
+static void test_get_docs(TestCase *tc, void *data)
+{
+    Searcher *searcher = (Searcher *)data;
+    int doc_nums[] = {12, 0, 4, 12};
+    Document **docs = searcher_get_docs(searcher, doc_nums, 4, &date, 1);
+    int i;
+
+    Asequal("20051012", doc_get_field(docs[0], date)->data[0]);
+    Asequal("20050930", doc_get_field(docs[1], date)->data[0]);
+    Asequal("20051012", doc_get_field(docs[3], date)->data[0]);
+    for (i = 0; i < 4; i++) {
+        /* only the date field is loaded */
+        Aiequal(1, docs[i]->size);
+        Apnull(doc_get_field(docs[i], cat));
+        doc_destroy(docs[i]);
+    }
+    free(docs);
+}
+
 void check_to_s(TestCase *tc, Query *query, Symbol field, char *q_str)
 {
     char *q_res = query->to_s(query, field);
@@ -264,6 +283,11 @@ void check_to_s(TestCase *tc, Query *query, Symbol field, char *q_str)
     free(q_res);
 }
 
+extern void check_filtered_hits(TestCase *tc, Searcher *searcher,
+                                Query *query, Filter *f,
+                                PostFilter *post_filter,
+                                char *expected_hits, int top);
+
 void check_hits(TestCase *tc, Searcher *searcher, Query *query,
                 char *expected_hits, int top)
 {
@@ -696,6 +720,30 @@ static void test_phrase_query(TestCase *tc, void *data)
     q_deref(phq);
 }
 
+/**
+ * Phrase scorers are skipped to each doc in the filter so they must score
+ * whichever doc they land on.
+ */
+static void test_phrase_query_filtered(TestCase *tc, void *data)
+{
+    Searcher *searcher = (Searcher *)data;
+    Query *phq = phq_new(field);
+    Filter *all = qfilt_new_nr(maq_new());
+    Filter *fox = qfilt_new_nr(tq_new(field, "fox"));
+
+    phq_add_term(phq, "quick", 1);
+    phq_add_term(phq, "fox", 2);
+    check_filtered_hits(tc, searcher, phq, all, NULL, "1, 11, 14", 14);
+    check_filtered_hits(tc, searcher, phq, fox, NULL, "1, 11, 14", 14);
+
+    phq_set_slop(phq, 4);
+    check_filtered_hits(tc, searcher, phq, all, NULL, "1, 11, 14, 16, 17", 14);
+    q_deref(phq);
+
+    filt_deref(all);
+    filt_deref(fox);
+}
+
 static void test_phrase_query_hash(TestCase *tc, void *data)
 {
     Query *q1, *q2;
@@ -1678,6 +1726,7 @@ TestSuite *ts_search(TestSuite *suite)
     searcher = isea_new(ir);
 
     tst_run_test(suite, test_get_doc, (void *)searcher);
+    tst_run_test(suite, test_get_docs, (void *)searcher);
 
     tst_run_test(suite, test_term_query, (void *)searcher);
     tst_run_test(suite, test_term_query_hash, NULL);
@@ -1686,6 +1735,7 @@ TestSuite *ts_search(TestSuite *suite)
     tst_run_test(suite, test_boolean_query_hash, NULL);
 
     tst_run_test(suite, test_phrase_query, (void *)searcher);
+    tst_run_test(suite, test_phrase_query_filtered, (void *)searcher);
     tst_run_test(suite, test_phrase_query_hash, NULL);
 
     tst_run_test(suite, test_multi_phrase_query, (void *)searcher);
@@ -1872,6 +1922,7 @@ TestSuite *ts_multi_search(TestSuite *suite)
     searcher = msea_new(searchers, 2, true);
 
     tst_run_test(suite, test_get_doc, (void *)searcher);
+    tst_run_test(suite, test_get_docs, (void *)searcher);
 
     tst_run_test(suite, test_term_query, (void *)searcher);
     tst_run_test(suite, test_boolean_query, (void *)searcher);
@@ -82,7 +82,7 @@ static void test_segment_field_index_single_field(TestCase *tc, void *data)
     Store *store = (Store *)data;
     SegmentFieldIndex *sfi;
     SegmentTermIndex *sti;
-    TermInfosWriter *tiw = tiw_open(store, "_0", 32, SKIP_INTERVAL);
+    TermInfosWriter *tiw = tiw_open(store, "_0", NULL, 32, SKIP_INTERVAL);
 
     tiw_start_field(tiw, 0);
 
@@ -109,7 +109,7 @@ static void add_multi_field_terms(Store *store)
 {
     int i;
     int field_num = 0;
-    TermInfosWriter *tiw = tiw_open(store, "_0", 8, 8);
+    TermInfosWriter *tiw = tiw_open(store, "_0", NULL, 8, 8);
 
     for (i = 0; i < DICT_LEN; i++) {
         TermInfo term_info = {(i % 20) + 1, i, i, i};
@@ -280,6 +280,101 @@ void test_segment_term_enum(TestCase *tc, void *data)
     sfi_close(sfi);
 }
 
+#define RESTART_TERM_CNT 1000
+
+/**
+ * Write enough terms to fill several index blocks, some with a partial last
+ * block, and look them up in every order so that lookups go through the
+ * restart points.
+ */
+static void test_restart_points(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data;
+    static const int index_intervals[] = {INDEX_INTERVAL, 100};
+    /* the writer refers to the last term added so each needs its own buffer */
+    static char terms[RESTART_TERM_CNT][10];
+    int i, j, k;
+
+    for (i = 0; i < RESTART_TERM_CNT; i++) {
+        sprintf(terms[i], "term%04d", i);
+    }
+    for (k = 0; k < NELEMS(index_intervals); k++) {
+        SegmentFieldIndex *sfi;
+        SegmentTermIndex *sti;
+        TermInfosReader *tir;
+        TermEnum *te;
+        TermInfosWriter *tiw = tiw_open(store, "_0", NULL, index_intervals[k],
+                                        SKIP_INTERVAL);
+        tiw_start_field(tiw, 0);
+        for (i = 0; i < RESTART_TERM_CNT; i++) {
+            TermInfo term_info = {(i % 20) + 1, i * 3, i * 7, i};
+            tiw_add(tiw, terms[i], 8, &term_info);
+        }
+        tiw_start_field(tiw, 1);
+        for (i = 0; i < RESTART_TERM_CNT / 2; i++) {
+            TermInfo term_info = {1, i, i, 0};
+            tiw_add(tiw, terms[i * 2], 8, &term_info);
+        }
+        tiw_close(tiw);
+
+        sfi = sfi_open(store, "_0");
+        Aiequal(k == 0 ? RESTART_INTERVAL : 10, sfi->restart_interval);
+        te = ste_new(store->open_input(store, "_0.tis"), sfi);
+
+        /* every term from a fresh enum */
+        for (i = 0; i < RESTART_TERM_CNT; i++) {
+            te->set_field(te, 0);
+            Asequal(terms[i], te->skip_to(te, terms[i]));
+            Aiequal(i % 20 + 1, te->curr_ti.doc_freq);
+            Aiequal(i * 3, te->curr_ti.frq_ptr);
+            Aiequal(i * 7, te->curr_ti.prx_ptr);
+            if (i % 20 + 1 >= SKIP_INTERVAL) {
+                Aiequal(i, te->curr_ti.skip_offset);
+            }
+        }
+
+        /* forwards and backwards through the same enum */
+        te->set_field(te, 0);
+        for (i = 0; i < RESTART_TERM_CNT; i += 7) {
+            Asequal(terms[i], te->skip_to(te, terms[i]));
+            Aiequal(i * 3, te->curr_ti.frq_ptr);
+        }
+        for (i = RESTART_TERM_CNT - 1; i >= 0; i -= 13) {
+            Asequal(terms[i], te->skip_to(te, terms[i]));
+            Aiequal(i * 7, te->curr_ti.prx_ptr);
+            /* sequential reads carry on past the restart point */
+            if (i + 1 < RESTART_TERM_CNT) {
+                Asequal(terms[i + 1], te->next(te));
+                Aiequal((i + 1) * 3, te->curr_ti.frq_ptr);
+            }
+        }
+
+        /* terms that aren't there land on the next term */
+        te->set_field(te, 1);
+        for (i = 1; i < RESTART_TERM_CNT - 1; i += 2) {
+            Asequal(terms[i + 1], te->skip_to(te, terms[i]));
+            Aiequal((i + 1) / 2, te->curr_ti.frq_ptr);
+        }
+        Apnull(te->skip_to(te, "term9999"));
+        te->close(te);
+
+        sti = (SegmentTermIndex *)h_get_int(sfi->field_dict, 0);
+        Apnotnull(sti->restart_offsets);
+
+        tir = tir_open(store, sfi, "_0");
+        tir_set_field(tir, 0);
+        for (i = 0, j = 0; i < RESTART_TERM_CNT; i++) {
+            /* jump around the dictionary */
+            j = (j + 389) % RESTART_TERM_CNT;
+            Asequal(terms[j], tir_get_term(tir, j));
+            Apnotnull(tir_get_ti(tir, terms[j]));
+        }
+        Apnull(tir_get_term(tir, RESTART_TERM_CNT));
+        tir_close(tir);
+        sfi_close(sfi);
+    }
+}
+
 static void test_term_infos_reader(TestCase *tc, void *data)
 {
     Store *store = (Store *)data;
@@ -334,6 +429,79 @@ static void test_term_infos_reader(TestCase *tc, void *data)
     sfi_close(sfi);
 }
 
+/**
+ * Repeated lookups should come from the cache and give the same TermInfo as
+ * the first lookup, even once the cache is full and evicting terms.
+ */
+static void test_term_infos_reader_cache(TestCase *tc, void *data)
+{
+    Store *store = (Store *)data;
+    static char terms[TI_CACHE_SIZE * 2][10];
+    SegmentFieldIndex *sfi;
+    TermInfosReader *tir;
+    TermInfosWriter *tiw;
+    TermInfoCacheStats stats;
+    TermInfo *ti;
+    int i;
+
+    tiw = tiw_open(store, "_0", NULL, INDEX_INTERVAL, SKIP_INTERVAL);
+    tiw_start_field(tiw, 0);
+    for (i = 0; i < NELEMS(terms); i++) {
+        TermInfo term_info = {i + 1, i * 3, i * 7, 0};
+        sprintf(terms[i], "term%04d", i);
+        tiw_add(tiw, terms[i], 8, &term_info);
+    }
+    tiw_close(tiw);
+
+    sfi = sfi_open(store, "_0");
+    tir = tir_open(store, sfi, "_0");
+    tir_set_field(tir, 0);
+
+    for (i = 0; i < 3; i++) {
+        ti = tir_get_ti(tir, terms[100]);
+        Aiequal(101, ti->doc_freq);
+        Aiequal(300, ti->frq_ptr);
+        Aiequal(700, ti->prx_ptr);
+    }
+    tir_cache_stats(tir, &stats);
+    Aiequal(2, stats.hits);
+    Aiequal(1, stats.misses);
+    Aiequal(1, stats.size);
+
+    /* the enum still finds terms by position after a cache hit */
+    Asequal(terms[99], tir_get_term(tir, 99));
+    Asequal(terms[101], tir_get_term(tir, 101));
+    ti = tir_get_ti(tir, terms[101]);
+    Aiequal(303, ti->frq_ptr);
+
+    /* missing terms aren't cached */
+    Apnull(tir_get_ti(tir, "term"));
+    Apnull(tir_get_ti(tir, "term"));
+    tir_cache_stats(tir, &stats);
+    Aiequal(2, stats.hits);
+    Aiequal(4, stats.misses);
+
+    for (i = 0; i < NELEMS(terms); i++) {
+        ti = tir_get_ti(tir, terms[i]);
+        Aiequal(i * 3, ti->frq_ptr);
+    }
+    for (i = NELEMS(terms) - 1; i >= 0; i--) {
+        ti = tir_get_ti(tir, terms[i]);
+        Aiequal(i * 7, ti->prx_ptr);
+    }
+    tir_cache_stats(tir, &stats);
+    Atrue(stats.size <= TI_CACHE_SIZE);
+    Atrue(stats.hits > 2);
+    Aiequal(NELEMS(terms) * 2 + 6, stats.hits + stats.misses);
+
+    /* the same term in another field is a different entry */
+    tir_set_field(tir, 1);
+    Apnull(tir_get_ti(tir, terms[100]));
+
+    tir_close(tir);
+    sfi_close(sfi);
+}
+
 TestSuite *ts_term(TestSuite *suite)
 {
     Store *store = open_ram_store();
@@ -344,6 +512,8 @@ TestSuite *ts_term(TestSuite *suite)
     tst_run_test(suite, test_segment_field_index_multi_field, store);
     tst_run_test(suite, test_segment_term_enum, store);
     tst_run_test(suite, test_term_infos_reader, store);
+    tst_run_test(suite, test_restart_points, store);
+    tst_run_test(suite, test_term_infos_reader_cache, store);
 
     store_deref(store);
 
@@ -0,0 +1,97 @@
+#include "term_hash.h"
+#include "global.h"
+#include <string.h>
+#include "test.h"
+#include "testhelper.h"
+
+/**
+ * Basic test for the TermHash. Terms don't have to be null terminated
+ */
+static void test_term_hash(TestCase *tc, void *data)
+{
+    TermHash *th = th_new();
+    TermHashSlot *slot;
+    const char *text = "onetwothree";
+    (void)data; /* suppress unused argument warning */
+
+    Apnull(th_get(th, "one", 3));
+    Aiequal(0, th->size);
+
+    Atrue(th_set_ext(th, text, 3, th_hash(text, 3), &slot));
+    Apequal(text, slot->term);
+    Aiequal(3, slot->len);
+    Apnull(slot->value);
+    slot->value = "1";
+    Atrue(th_set_ext(th, text + 3, 3, th_hash(text + 3, 3), &slot));
+    slot->value = "2";
+    Atrue(th_set_ext(th, text + 6, 5, th_hash(text + 6, 5), &slot));
+    slot->value = "3";
+    Aiequal(3, th->size);
+
+    Asequal("1", th_get(th, "one", 3));
+    Asequal("2", th_get(th, "two", 3));
+    Asequal("3", th_get(th, "three", 5));
+    Apnull(th_get(th, "thre", 4));
+    Apnull(th_get(th, "onetwo", 6));
+
+    Atrue(!th_set_ext(th, "two", 3, th_hash("two", 3), &slot));
+    Asequal("2", slot->value);
+    Aiequal(3, th->size);
+
+    th_clear(th);
+    Aiequal(0, th->size);
+    Apnull(th_get(th, "one", 3));
+    Apnull(th_get(th, "three", 5));
+    th_destroy(th);
+}
+
+/**
+ * Add enough terms to force the TermHash to grow a few times and make sure
+ * they can all still be found, both before and after clearing the table.
+ */
+static void stress_term_hash(TestCase *tc, void *data)
+{
+    int i, j, full;
+    TermHash *th = th_new();
+    TermHashSlot *slot;
+    (void)data; /* suppress unused argument warning */
+
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < TEST_WORD_LIST_SIZE; i++) {
+            const char *word = test_word_list[i];
+            const int len = (int)strlen(word);
+            if (th_set_ext(th, word, len, th_hash(word, len), &slot)) {
+                slot->value = (void *)word;
+            }
+        }
+        for (i = 0; i < TEST_WORD_LIST_SIZE; i++) {
+            const char *word = test_word_list[i];
+            if (th_get(th, word, (int)strlen(word)) != word) {
+                /* the word list contains duplicates so only check the
+                 * content */
+                Asequal(word, th_get(th, word, (int)strlen(word)));
+            }
+        }
+        for (i = 0, full = 0; i <= th->mask; i++) {
+            if (th_slot_is_full(th, i)) {
+                full++;
+            }
+        }
+        Aiequal(th->size, full);
+        Atrue(th->size <= TEST_WORD_LIST_SIZE);
+        Atrue(th->size > TH_MIN_CAPA);
+        th_clear(th);
+        Apnull(th_get(th, test_word_list[0], (int)strlen(test_word_list[0])));
+    }
+    th_destroy(th);
+}
+
+TestSuite *ts_term_hash(TestSuite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+    tst_run_test(suite, test_term_hash, NULL);
+    tst_run_test(suite, stress_term_hash, NULL);
+
+    return suite;
+}
@@ -51,6 +51,7 @@ static VALUE sym_compressed;
 static VALUE sym_untokenized;
 static VALUE sym_omit_norms;
 static VALUE sym_untokenized_omit_norms;
+static VALUE sym_bloom_filter;
 
 static VALUE sym_with_positions;
 static VALUE sym_with_offsets;
@@ -172,13 +173,21 @@ frb_get_field_info(FieldInfo *fi)
     return rfi;
 }
 
+static void
+frb_fi_set_bloom_filter(VALUE roptions, FieldInfo *fi)
+{
+    if (RTEST(rb_hash_aref(roptions, sym_bloom_filter))) {
+        fi->bits |= FI_BLOOM_FILTER_BM;
+    }
+}
+
 /*
  *  call-seq:
  *     FieldInfo.new(name, options = {}) -> field_info
  *
  *  Create a new FieldInfo object with the name +name+ and the properties
  *  specified in +options+. The available options are [:store, :index,
- *  :term_vector, :boost]. See the description of FieldInfo for more
+ *  :term_vector, :boost, :bloom_filter]. See the description of FieldInfo for more
  *  information on these properties. 
  */
 static VALUE
@@ -197,6 +206,9 @@ frb_fi_init(int argc, VALUE *argv, VALUE self)
     }
     fi = fi_new(frb_field(rname), store, index, term_vector);
     fi->boost = boost;
+    if (argc > 1) {
+        frb_fi_set_bloom_filter(roptions, fi);
+    }
     Frt_Wrap_Struct(self, NULL, &frb_fi_free, fi);
     object_add(fi, self);
     return self;
@@ -344,6 +356,19 @@ frb_fi_has_norms(VALUE self)
     return fi_has_norms(fi) ? Qtrue : Qfalse;
 }
 
+/*
+ *  call-seq:
+ *     fi.bloom_filter? -> bool
+ *
+ *  Return true if each segment stores a bloom filter of this field's terms.
+ */
+static VALUE
+frb_fi_has_bloom_filter(VALUE self)
+{
+    FieldInfo *fi = (FieldInfo *)DATA_PTR(self);
+    return fi_has_bloom_filter(fi) ? Qtrue : Qfalse;
+}
+
 /*
  *  call-seq:
  *     fi.boost -> boost
@@ -549,6 +574,9 @@ frb_fis_add_field(int argc, VALUE *argv, VALUE self)
     }
     fi = fi_new(frb_field(rname), store, index, term_vector);
     fi->boost = boost;
+    if (argc > 1) {
+        frb_fi_set_bloom_filter(roptions, fi);
+    }
     fis_add_field(fis, fi);
     return self;
 }
@@ -1628,6 +1656,24 @@ frb_iw_delete(VALUE self, VALUE rfield, VALUE rterm)
     return self;
 }
 
+/*
+ *  call-seq:
+ *     iw.update_document(field, term, document) -> iw
+ *
+ *  Replace all documents in the index with the given +term+ in the field
+ *  +field+ by +document+. The delete is buffered so the reader doesn't need
+ *  to be opened and +document+ itself will never be deleted.
+ */
+static VALUE
+frb_iw_update_doc(VALUE self, VALUE rfield, VALUE rterm, VALUE rdoc)
+{
+    IndexWriter *iw = (IndexWriter *)DATA_PTR(self);
+    Document *doc = frb_get_doc(rdoc);
+    iw_update_doc(iw, frb_field(rfield), StringValuePtr(rterm), doc);
+    doc_destroy(doc);
+    return self;
+}
+
 /*
  *  call-seq:
  *     index_writer.field_infos -> FieldInfos
@@ -1947,14 +1993,16 @@ frb_lazy_df_load(VALUE self, VALUE rkey, LazyDocField *lazy_df)
 {
     VALUE rdata = Qnil;
     if (lazy_df) {
+        /* views point straight into mmapped stores so the data is only
+         * copied once, into the ruby string */
         if (lazy_df->size == 1) {
-            char *data = lazy_df_get_data(lazy_df, 0);
-            rdata = rb_str_new(data, lazy_df->len);
+            const char *data = lazy_df_get_view(lazy_df, 0);
+            rdata = rb_str_new(data, lazy_df->data[0].length);
         } else {
             int i;
             rdata = rb_ary_new2(lazy_df->size);
             for (i = 0; i < lazy_df->size; i++) {
-                char *data = lazy_df_get_data(lazy_df, i);
+                const char *data = lazy_df_get_view(lazy_df, i);
                 rb_ary_store(rdata, i, rb_str_new(data, lazy_df->data[i].length));
             }
         }
@@ -2803,6 +2851,13 @@ frb_ir_version(VALUE self)
  *                  |                         | create the field. All values
  *                  |                         | should be positive.
  *                  |                         | 
+ *     -------------|-------------------------|------------------------------
+ *     :bloom_filter| true                    | Store a bloom filter of the
+ *                  |                         | field's terms with each
+ *                  |                         | segment so that lookups of
+ *                  |                         | unique terms like ids can skip
+ *                  |                         | the segments that don't
+ *                  |                         | contain them.
  *
  *  == Examples
  *
@@ -2816,6 +2871,9 @@ frb_ir_version(VALUE self)
  *
  *    fi = FieldInfo.new(:image, :store => :compressed, :index => :no,
  *                       :term_vector => :no)
+ *
+ *    fi = FieldInfo.new(:id, :index => :untokenized, :term_vector => :no,
+ *                       :bloom_filter => true)
  */
 static void
 Init_FieldInfo(void)
@@ -2830,6 +2888,7 @@ Init_FieldInfo(void)
     sym_untokenized = ID2SYM(rb_intern("untokenized"));
     sym_omit_norms = ID2SYM(rb_intern("omit_norms"));
     sym_untokenized_omit_norms = ID2SYM(rb_intern("untokenized_omit_norms"));
+    sym_bloom_filter = ID2SYM(rb_intern("bloom_filter"));
 
     sym_with_positions = ID2SYM(rb_intern("with_positions"));
     sym_with_offsets = ID2SYM(rb_intern("with_offsets"));
@@ -2852,6 +2911,8 @@ Init_FieldInfo(void)
     rb_define_method(cFieldInfo, "store_offsets?",
                                                 frb_fi_store_offsets, 0);
     rb_define_method(cFieldInfo, "has_norms?",  frb_fi_has_norms, 0);
+    rb_define_method(cFieldInfo, "bloom_filter?",
+                                                frb_fi_has_bloom_filter, 0);
     rb_define_method(cFieldInfo, "boost",       frb_fi_boost, 0);
     rb_define_method(cFieldInfo, "to_s",        frb_fi_to_s, 0);
 }
@@ -3284,6 +3345,7 @@ Init_IndexWriter(void)
     rb_define_method(cIndexWriter, "commit",        frb_iw_commit, 0);
     rb_define_method(cIndexWriter, "add_readers",   frb_iw_add_readers, 1);
     rb_define_method(cIndexWriter, "delete",        frb_iw_delete, 2);
+    rb_define_method(cIndexWriter, "update_document", frb_iw_update_doc, 3);
     rb_define_method(cIndexWriter, "field_infos",   frb_iw_field_infos, 0);
     rb_define_method(cIndexWriter, "analyzer",      frb_iw_get_analyzer, 0);
     rb_define_method(cIndexWriter, "analyzer=",     frb_iw_set_analyzer, 1);
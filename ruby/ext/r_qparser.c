@@ -200,7 +200,6 @@ frb_qp_init(int argc, VALUE *argv, VALUE self)
     qp->all_fields = all_fields;
     qp->def_fields = def_fields ? def_fields : all_fields;
     qp->tokenized_fields = tkz_fields ? tkz_fields : all_fields;
-    qp->fields_top->fields = def_fields;
 
     qp->allow_any_fields = true;
     qp->clean_str = true;
@@ -321,11 +320,9 @@ frb_qp_set_fields(VALUE self, VALUE rfields)
 
     /* add the new fields set and add to def_fields if necessary */
     qp->all_fields = fields;
-    if (qp->def_fields == NULL) {
-        qp->def_fields = fields;
-        qp->fields_top->fields = fields;
-    }
+    if (qp->def_fields == NULL) qp->def_fields = fields;
     if (qp->tokenized_fields == NULL) qp->tokenized_fields = fields;
+    qp_clear_cache(qp);
 
     return self;
 }
@@ -371,6 +368,7 @@ frb_qp_set_tkz_fields(VALUE self, VALUE rfields)
         hs_destroy(qp->tokenized_fields);
     }
     qp->tokenized_fields = frb_get_fields(rfields);
+    qp_clear_cache(qp);
     return self;
 }
 
@@ -184,6 +184,27 @@ frb_get_td(TopDocs *td, VALUE rsearcher)
     return rtop_docs;
 }
 
+/* Returns the id of the first deleted document in +docs+, or -1 if they were
+ * all loaded. If one is missing, the rest are destroyed along with +docs+. */
+static int
+frb_docs_deleted(Document **docs, const int *doc_ids, int cnt)
+{
+    int i, deleted = -1;
+    for (i = 0; i < cnt; i++) {
+        if (NULL == docs[i]) {
+            deleted = doc_ids[i];
+            break;
+        }
+    }
+    if (deleted >= 0) {
+        for (i = 0; i < cnt; i++) {
+            if (docs[i]) doc_destroy(docs[i]);
+        }
+        free(docs);
+    }
+    return deleted;
+}
+
 /*
  *  call-seq:
  *     top_doc.to_s(field = :id) -> string
@@ -202,10 +223,22 @@ frb_td_to_s(int argc, VALUE *argv, VALUE self)
     char *str = ALLOC_N(char, len * 64 + 100);
     Symbol field = fsym_id;
     VALUE rstr;
+    int *doc_ids = ALLOC_N(int, len);
+    Document **docs;
 
     if (argc) {
         field = frb_field(argv[0]);
     }
+    for (i = 0; i < len; i++) {
+        doc_ids[i] = FIX2INT(rb_funcall(RARRAY_PTR(rhits)[i], id_doc, 0));
+    }
+    /* load just the field we need for all the hits at once */
+    docs = sea->get_docs(sea, doc_ids, len, &field, 1);
+    if ((i = frb_docs_deleted(docs, doc_ids, len)) >= 0) {
+        free(doc_ids);
+        free(str);
+        RAISE(STATE_ERROR, "Document %d has already been deleted", i);
+    }
 
     sprintf(str, "TopDocs: total_hits = %ld, max_score = %lf [\n",
             FIX2LONG(rb_funcall(self, id_total_hits, 0)),
@@ -214,13 +247,12 @@ frb_td_to_s(int argc, VALUE *argv, VALUE self)
 
     for (i = 0; i < len; i++) {
         VALUE rhit = RARRAY_PTR(rhits)[i];
-        int doc_id = FIX2INT(rb_funcall(rhit, id_doc, 0));
+        int doc_id = doc_ids[i];
         const char *value = "";
         size_t value_len = 0;
-        LazyDoc *lzd = sea->get_lazy_doc(sea, doc_id);
-        LazyDocField *lzdf = lazy_doc_get(lzd, field);
-        if (NULL != lzdf) {
-            value = lazy_df_get_data(lzdf, 0);
+        DocField *df = doc_get_field(docs[i], field);
+        if (NULL != df) {
+            value = df->data[0];
             value_len = strlen(value);
         }
         if (p + value_len + 64 > capa) {
@@ -231,8 +263,10 @@ frb_td_to_s(int argc, VALUE *argv, VALUE self)
         sprintf(str + p, "\t%d \"%s\": %0.5f\n", doc_id, value,
                 NUM2DBL(rb_funcall(rhit, id_score, 0)));
         p += strlen(str + p);
-        lazy_doc_close(lzd);
+        doc_destroy(docs[i]);
     }
+    free(docs);
+    free(doc_ids);
 
     sprintf(str + p, "]\n");
     rstr = rb_str_new2(str);
@@ -241,20 +275,23 @@ frb_td_to_s(int argc, VALUE *argv, VALUE self)
 }
 
 static INLINE char *
-frb_lzd_load_to_json(LazyDoc *lzd, char **str, char *s, int *slen)
+frb_doc_load_to_json(Document *doc, char **str, char *s, int *slen)
 {
 	int i, j;
 	int diff = s - *str;
 	int len = diff, l;
-	LazyDocField *f;
+	DocField *f;
 	
-	for (i = 0; i < lzd->size; i++) {
-		f = lzd->fields[i];
+	for (i = 0; i < doc->size; i++) {
+		f = doc->fields[i];
         /* 3 times length of field to make space for quoted quotes ('"') and
          * 4 times field elements to make space for '"' around fields and ','
          * between fields. Add 100 for '[', ']' and good safety.
          */
-        len += sym_len(f->name) + f->len * 3 + 100 + 4 * f->size;
+        len += sym_len(f->name) + 100 + 4 * f->size;
+        for (j = 0; j < f->size; j++) {
+            len += f->lengths[j] * 3;
+        }
     }
 
     if (len > *slen) {
@@ -263,9 +300,9 @@ frb_lzd_load_to_json(LazyDoc *lzd, char **str, char *s, int *slen)
         s = *str + diff;
     }
 
-	for (i = 0; i < lzd->size; i++) {
+	for (i = 0; i < doc->size; i++) {
         const char *field_name;
-		f = lzd->fields[i];
+		f = doc->fields[i];
         field_name = S(f->name);
 		if (i)  *(s++) = ',';
         *(s++) = '"';
@@ -277,7 +314,7 @@ frb_lzd_load_to_json(LazyDoc *lzd, char **str, char *s, int *slen)
         if (f->size > 1)  *(s++) = '[';
 		for (j = 0; j < f->size; j++) {
 			if (j) *(s++) = ',';
-			s = json_concat_string(s, lazy_df_get_data(f, j));
+			s = json_concat_string(s, f->data[j]);
 		}
         if (f->size > 1)  *(s++) = ']';
 	}
@@ -295,27 +332,36 @@ frb_td_to_json(VALUE self)
 {
 	int i;
 	VALUE rhits = rb_funcall(self, id_hits, 0);
-	VALUE rhit;
-	LazyDoc *lzd;
 	Searcher *sea = (Searcher *)DATA_PTR(rb_funcall(self, id_searcher, 0));
 	const int num_hits = RARRAY_LEN(rhits);
-	int doc_id;
+	int *doc_ids = ALLOC_N(int, num_hits);
+	Document **docs;
     int len = 32768;
 	char *str = ALLOC_N(char, len);
     char *s = str;
 	VALUE rstr;
 
+	for (i = 0; i < num_hits; i++) {
+		doc_ids[i] = FIX2INT(rb_funcall(RARRAY_PTR(rhits)[i], id_doc, 0));
+	}
+	/* load all the hits' documents in one pass over the index */
+	docs = sea->get_docs(sea, doc_ids, num_hits, NULL, 0);
+	if ((i = frb_docs_deleted(docs, doc_ids, num_hits)) >= 0) {
+		free(doc_ids);
+		free(str);
+		RAISE(STATE_ERROR, "Document %d has already been deleted", i);
+	}
+
     *(s++) = '[';
 	for (i = 0; i < num_hits; i++) {
         if (i) *(s++) = ',';
         *(s++) = '{';
-		rhit = RARRAY_PTR(rhits)[i];
-		doc_id = FIX2INT(rb_funcall(rhit, id_doc, 0));
-		lzd = sea->get_lazy_doc(sea, doc_id);
-		s = frb_lzd_load_to_json(lzd, &str, s, &len);
-        lazy_doc_close(lzd);
+		s = frb_doc_load_to_json(docs[i], &str, s, &len);
+		doc_destroy(docs[i]);
         *(s++) = '}';
 	}
+	free(docs);
+	free(doc_ids);
     *(s++) = ']';
     *(s++) = '\0';
 	rstr = rb_str_new2(str);
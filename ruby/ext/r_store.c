@@ -7,6 +7,7 @@ VALUE cLockError;
 VALUE cDirectory;
 VALUE cRAMDirectory;
 VALUE cFSDirectory;
+VALUE cMMapDirectory;
 
 /****************************************************************************
  *
@@ -366,7 +367,12 @@ frb_fsdir_new(int argc, VALUE *argv, VALUE klass)
         rb_raise(rb_eIOError, "No directory <%s> found. Use :create => true"
                  " to create one.", rs2s(rpath));
     }
-    store = open_fs_store(rs2s(rpath));
+    if (klass == cMMapDirectory) {
+        store = open_mmap_store(rs2s(rpath));
+    }
+    else {
+        store = open_fs_store(rs2s(rpath));
+    }
     if (create) store->clear_all(store);
     if ((self = object_get(store)) == Qnil) {
         self = Data_Wrap_Struct(klass, NULL, &frb_dir_free, store);
@@ -489,6 +495,24 @@ Init_FSDirectory(void)
     rb_define_singleton_method(cFSDirectory, "new", frb_fsdir_new, -1);
 }
 
+/*
+ *  Document-class: Ferret::Store::MMapDirectory
+ *
+ *  File-system resident Directory implementation which memory maps its files
+ *  for reading. Stored fields of LazyDocs loaded from an index in an
+ *  MMapDirectory are read straight from the mapped files rather than being
+ *  copied into an intermediate buffer first, which makes loading documents
+ *  faster. Use it just like an FSDirectory.
+ */
+void
+Init_MMapDirectory(void)
+{
+    cMMapDirectory = rb_define_class_under(mStore, "MMapDirectory",
+                                           cFSDirectory);
+    rb_define_alloc_func(cMMapDirectory, frb_data_alloc);
+    rb_define_singleton_method(cMMapDirectory, "new", frb_fsdir_new, -1);
+}
+
 /* rdoc hack
 extern VALUE mFerret = rb_define_module("Ferret");
 */
@@ -512,4 +536,5 @@ Init_Store(void)
     Init_Lock();
     Init_RAMDirectory();
     Init_FSDirectory();
+    Init_MMapDirectory();
 }
@@ -569,13 +569,13 @@ module Ferret::Index
     def update(id, new_doc)
       @dir.synchronize do
         ensure_writer_open()
-        delete(id)
         if id.is_a?(String) or id.is_a?(Symbol)
-          @writer.commit
+          @writer.update_document(@id_field, id.to_s, new_doc)
         else
+          delete(id)
           ensure_writer_open()
+          @writer << new_doc
         end
-        @writer << new_doc
         flush() if @auto_flush
       end
     end
@@ -0,0 +1,34 @@
+require File.dirname(__FILE__) + "/../../test_helper"
+require File.dirname(__FILE__) + "/tm_store"
+require File.dirname(__FILE__) + "/tm_store_lock"
+
+class MMapStoreTest < Test::Unit::TestCase
+  include Ferret::Store
+  include StoreTest
+  include StoreLockTest
+  def setup
+    @dpath = File.expand_path(File.join(File.dirname(__FILE__),
+                       '../../temp/fsdir'))
+    @dir = MMapDirectory.new(@dpath, true)
+  end
+
+  def teardown
+    @dir.close()
+    Dir[File.join(@dpath, "*")].each {|path| begin File.delete(path) rescue nil end}
+  end
+
+  def test_is_fs_directory
+    assert(@dir.is_a?(FSDirectory))
+  end
+
+  def test_lazy_doc_loading
+    index = Ferret::Index::Index.new(:dir => @dir, :create => true)
+    index << {:id => "1", :title => "the first document", :tags => ["a", "b"]}
+    index << {:id => "2", :title => "the second document"}
+    index.flush
+    doc = index[1]
+    assert_equal("the second document", doc[:title])
+    assert_equal(["a", "b"], index[0][:tags])
+    index.close
+  end
+end